@@ -62,6 +62,7 @@ LOCAL_SRC_FILES := \
 	ResourceMonitorAndroid.cpp \
 	SecurityManager.cpp \
 	SQLDataStore.cpp \
+	MemoryDataStore.cpp \
 	Trace.cpp \
 	Utility.cpp \
 	Metadata.cpp \
@@ -30,6 +30,9 @@ Attribute::Attribute(const string _name, const string _value, unsigned long _wei
 #endif
 	name(_name), value(_value), weight(_weight)
 {
+	// Attribute names come from a small set, and are compared on
+	// every match
+	stringintern(name);
 }
 
 // Copy-constructor
@@ -97,6 +97,7 @@ public:
 	*/
         void setName(const char *_name) {
                 name = _name;
+                stringintern(name);
         }
 	/**
 		Sets the value part of the attribute.
@@ -38,8 +38,10 @@ using namespace haggle;
 
 unsigned int Test_cnt = 0;
 
-BenchmarkManager::BenchmarkManager(HaggleKernel * _kernel, unsigned int _DataObjects_Attr, unsigned int _Nodes_Attr, unsigned int _Attr_Num, unsigned int _DataObjects_Num, unsigned int _Test_Num) : 
-	Manager("BenchmarkManager", _kernel)
+BenchmarkManager::BenchmarkManager(HaggleKernel * _kernel, unsigned int _DataObjects_Attr, unsigned int _Nodes_Attr, unsigned int _Attr_Num, unsigned int _DataObjects_Num, unsigned int _Test_Num, unsigned int _Wildcard_Num) : 
+	Manager("BenchmarkManager", _kernel), Wildcard_Num(_Wildcard_Num), wildcardQueries(0), 
+	wildcardResults(0), wildcardPending(false), wildcardTotal(0), wildcardMax(0), 
+	wildcardInsertedCallback(NULL)
 {
 	DataObjects_Attr = _DataObjects_Attr;
 	Nodes_Attr = _Nodes_Attr;
@@ -50,6 +52,8 @@ BenchmarkManager::BenchmarkManager(HaggleKernel * _kernel, unsigned int _DataObj
 
 BenchmarkManager::~BenchmarkManager()
 {
+	if (wildcardInsertedCallback)
+		delete wildcardInsertedCallback;
 }
 
 bool BenchmarkManager::init_derived()
@@ -92,6 +96,16 @@ bool BenchmarkManager::init_derived()
 
 	kernel->getDataStore()->insertFilter(evaluateFilter);
 
+	// private event: wildcard filter matches
+	wildcardEType = registerEventType("BenchmarkManager Wildcard Event", onWildcardResult);
+
+	if (wildcardEType < 0) {
+		HAGGLE_ERR("Could not register Wildcard Event...");
+		return false;
+	}
+
+	wildcardInsertedCallback = newEventCallback(onWildcardFilterInserted);
+
 	return true;
 }
 
@@ -210,6 +224,11 @@ void BenchmarkManager::insertDataobject(Event* e)
 
 	n++;
 
+	// Every node insert also calls back here, so there are several 
+	// chains of inserts that all stop at the last data object
+	if (n >= DataObjects_Num)
+		return;
+
 	DataObjectRef dObj = createDataObject(DataObjects_Attr);
 	HAGGLE_LOG("Generating and inserting dataobject %d\n", n);
 	
@@ -318,9 +337,76 @@ void BenchmarkManager::onQueryResult(Event *e)
 	if (!node) {
 		HAGGLE_LOG("finished\n");
 		BENCH_TRACE_DUMP(DataObjects_Attr, Nodes_Attr, Attr_Num, DataObjects_Num);
+
+		if (Wildcard_Num > 0) {
+			doWildcardQuery();
+			return;
+		}
 		exit(1);
 	}
 
 	kernel->getDataStore()->doDataObjectQuery(node, 1, queryCallback);
 }
+
+/*
+	Matches filters that combine a wildcard with an exact attribute
+	against the data objects, one filter at a time. All the data
+	objects have attributes with the wildcard's name, so every filter
+	matches all of them. The time until the first page of matches is
+	delivered is measured. Inserting the next filter with the same 
+	event type replaces the previous one, and pages of the previous 
+	filter that were delivered before the insert callback are ignored.
+*/
+void BenchmarkManager::doWildcardQuery()
+{
+	char value[128];
+
+	if (wildcardQueries == Wildcard_Num) {
+		printf("Wildcard filters: %u, data objects matched: %lu, "
+		       "average time to first page: %.3lf ms, max: %.3lf ms\n",
+		       wildcardQueries, wildcardResults, 
+		       wildcardTotal * 1000 / wildcardQueries, wildcardMax * 1000);
+		HAGGLE_LOG("wildcard benchmark finished\n");
+		exit(1);
+	}
+
+	Attributes attrs;
+
+	sprintf(value, "value %u", RANDOM_INT(Attr_Num));
+	attrs.add(Attribute("name", ATTR_WILDCARD));
+	attrs.add(Attribute("name", value));
+
+	Filter wildcardFilter(&attrs, wildcardEType);
+
+	HAGGLE_LOG("Doing wildcard query %u\n", wildcardQueries + 1);
+
+	wildcardPending = false;
+	wildcardStart = Timeval::now();
+	kernel->getDataStore()->insertFilter(wildcardFilter, true, wildcardInsertedCallback);
+}
+
+void BenchmarkManager::onWildcardFilterInserted(Event *e)
+{
+	wildcardPending = true;
+}
+
+void BenchmarkManager::onWildcardResult(Event *e)
+{
+	// Later pages of a filter that has been replaced are ignored
+	if (!e || !wildcardPending)
+		return;
+
+	double t = (Timeval::now() - wildcardStart).getTimeAsSecondsDouble();
+	
+	wildcardTotal += t;
+	
+	if (t > wildcardMax)
+		wildcardMax = t;
+
+	wildcardResults += e->getDataObjectList().size();
+	wildcardQueries++;
+	wildcardPending = false;
+
+	doWildcardQuery();
+}
 #endif
@@ -39,12 +39,22 @@ class BenchmarkManager : public Manager
         unsigned int Attr_Num;
         unsigned int DataObjects_Num;
         unsigned int Test_Num;
+        // The number of wildcard filters matched after the node queries
+        unsigned int Wildcard_Num;
+        unsigned int wildcardQueries;
+        unsigned long wildcardResults;
+        bool wildcardPending;
+        Timeval wildcardStart;
+        double wildcardTotal;
+        double wildcardMax;
         EventCallback<EventHandler> *queryCallback;
+        EventCallback<EventHandler> *wildcardInsertedCallback;
         NodeRefList queryNodes;
         EventType evaluateEType;
+        EventType wildcardEType;
 	bool init_derived();
 public:
-        BenchmarkManager(HaggleKernel *_haggle = haggleKernel, unsigned int _DataObjects_Attr = 0, unsigned int _Nodess_Attr = 0, unsigned int _Attr_Num = 0, unsigned int _DataObjects_Num = 0, unsigned int _Test_Num = 0);
+        BenchmarkManager(HaggleKernel *_haggle = haggleKernel, unsigned int _DataObjects_Attr = 0, unsigned int _Nodess_Attr = 0, unsigned int _Attr_Num = 0, unsigned int _DataObjects_Num = 0, unsigned int _Test_Num = 0, unsigned int _Wildcard_Num = 0);
 	~BenchmarkManager();
 
 	int handleAttributes(Event* e);
@@ -56,6 +66,9 @@ public:
 	void onEvaluate(Event *e);
 	void onQueryResult(Event* e);
 	void onRetreiveNodes(Event *e);
+	void doWildcardQuery();
+	void onWildcardFilterInserted(Event *e);
+	void onWildcardResult(Event *e);
 };
 
 #endif
@@ -125,7 +125,10 @@ void DataHelper::cleanup()
 DataManager::DataManager(HaggleKernel * _kernel, const bool _setCreateTimeOnBloomfilterUpdate) : 
 	Manager("DataManager", _kernel), localBF(NULL), 
 	setCreateTimeOnBloomfilterUpdate(_setCreateTimeOnBloomfilterUpdate), 
-	keepInBloomfilterOnAging(true)
+	keepInBloomfilterOnAging(true), evictionPeriod(DEFAULT_EVICTION_PERIOD), 
+	keepInBloomfilterOnEviction(true), evictionInProgress(false), 
+	evictionTimerPending(false), bytesInsertedSinceEviction(0), 
+	numInsertedSinceEviction(0)
 {	
 	if (setCreateTimeOnBloomfilterUpdate) {
 		HAGGLE_DBG("Will set create time in node description when updating bloomfilter\n");
@@ -173,6 +176,7 @@ bool DataManager::init_derived()
 #endif
 	onInsertedDataObjectCallback = newEventCallback(onInsertedDataObject);
 	onAgedDataObjectsCallback = newEventCallback(onAgedDataObjects);
+	onEvictedDataObjectsCallback = newEventCallback(onEvictedDataObjects);
 
 	// Insert time stamp for when haggle starts up into the data store:
 	RepositoryEntryRef timestamp = RepositoryEntryRef(new RepositoryEntry("DataManager", "Startup timestamp", Timeval::now().getAsString().c_str()));
@@ -185,6 +189,8 @@ bool DataManager::init_derived()
 
 	// Start aging:
 	onAgedDataObjects(NULL);
+
+	evictionEvent = registerEventType("Eviction Event", onEviction);
 	
 	dataTaskEvent = registerEventType("DataTaskEvent", onDataTaskComplete);
 
@@ -218,6 +224,7 @@ DataManager::~DataManager()
 	
 	Event::unregisterType(dataTaskEvent);
 	Event::unregisterType(agingEvent);
+	Event::unregisterType(evictionEvent);
 	
 	if (onInsertedDataObjectCallback)
 		delete onInsertedDataObjectCallback;
@@ -225,6 +232,9 @@ DataManager::~DataManager()
 	if (onAgedDataObjectsCallback)
 		delete onAgedDataObjectsCallback;
 
+	if (onEvictedDataObjectsCallback)
+		delete onEvictedDataObjectsCallback;
+
 	if (onGetLocalBFCallback)
 		delete onGetLocalBFCallback;
 	
@@ -409,6 +419,11 @@ void DataManager::onSendResult(Event *e)
 		HAGGLE_DBG("Adding data object [%s] to node %s's bloomfilter\n", dObj->getIdStr(), node->getName().c_str());
 		node->getBloomfilter()->add(dObj);
 
+		// Node descriptions are never evicted, and are superseded
+		// without being reported as deleted
+		if (evictionPolicy.isEnabled() && !dObj->isNodeDescription())
+			popularity[dObj->getIdStr()]++;
+
 #ifdef DEBUG
 	if (dataObjectsSent.size() >= MAX_DATAOBJECTS_LISTED) {
 		dataObjectsSent.pop_front();
@@ -516,6 +531,7 @@ void DataManager::onDeletedDataObject(Event * e)
 	unsigned int n_removed = 0;
 
 	for (DataObjectRefList::iterator it = dObjs.begin(); it != dObjs.end(); it++) {
+		popularity.erase((*it)->getIdStr());
 		/* 
 		  Do not remove Node descriptions from the bloomfilter. We do not
 		  want to receive old node descriptions again.
@@ -558,6 +574,19 @@ void DataManager::onInsertedDataObject(Event * e)
 		HAGGLE_DBG("Data object %s is a duplicate! Not generating DATAOBJECT_NEW event\n", dObj->getIdStr());
 	} else {
 		kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_NEW, dObj));
+
+		if (evictionPolicy.isEnabled()) {
+			bytesInsertedSinceEviction += dObj->getDataLen();
+			numInsertedSinceEviction++;
+
+			// Do not wait for the eviction period if much data 
+			// has been inserted
+			if ((evictionPolicy.maxBytes > 0 && 
+			     bytesInsertedSinceEviction * 10 >= evictionPolicy.maxBytes) ||
+			    (evictionPolicy.maxDataObjects > 0 && 
+			     numInsertedSinceEviction * 10 >= evictionPolicy.maxDataObjects))
+				startEviction(false);
+		}
 	}
 }
 
@@ -597,6 +626,56 @@ void DataManager::onAging(Event *e)
 	kernel->getDataStore()->ageDataObjects(Timeval(agingMaxAge, 0), onAgedDataObjectsCallback, keepInBloomfilterOnAging);
 }
 
+void DataManager::startEviction(bool continuing)
+{
+	if (!continuing && evictionInProgress)
+		return;
+
+	evictionInProgress = true;
+	bytesInsertedSinceEviction = 0;
+	numInsertedSinceEviction = 0;
+
+	kernel->getDataStore()->evictDataObjects(evictionPolicy, popularity, onEvictedDataObjectsCallback, 
+						 continuing, keepInBloomfilterOnEviction);
+}
+
+void DataManager::onEvictedDataObjects(Event *e)
+{
+	if (!e || kernel->isShuttingDown())
+		return;
+
+	DataObjectRefList dObjs = e->getDataObjectList();
+
+	if (dObjs.size() > 0) {
+		HAGGLE_DBG("Evicted %lu data objects\n", dObjs.size());
+	}
+
+	if (evictionPolicy.isEnabled() && dObjs.size() >= evictionPolicy.batchSize) {
+		// Continue immediately in case there are more data objects 
+		// to evict.
+		startEviction(true);
+		return;
+	}
+	
+	evictionInProgress = false;
+
+	if (evictionPolicy.isEnabled() && !evictionTimerPending) {
+		evictionTimerPending = true;
+		kernel->addEvent(new Event(evictionEvent, NULL, (double)evictionPeriod));
+	}
+}
+
+void DataManager::onEviction(Event *e)
+{
+	if (e)
+		evictionTimerPending = false;
+
+	if (kernel->isShuttingDown() || !evictionPolicy.isEnabled())
+		return;
+
+	startEviction(false);
+}
+
 void DataManager::onConfig(Metadata *m)
 {
 	bool agingHasChanged = false;
@@ -658,6 +737,13 @@ void DataManager::onConfig(Metadata *m)
 		}
 	}
 
+	dm = m->getMetadata("DataStore");
+
+	if (dm) {
+		// The data store applies its configuration in its own thread
+		kernel->getDataStore()->onConfig(*dm);
+	}
+
 	dm = m->getMetadata("Aging");
 
 	if (dm) {
@@ -704,6 +790,98 @@ void DataManager::onConfig(Metadata *m)
 		}
 	}
 	
+	dm = m->getMetadata("Eviction");
+
+	if (dm) {
+		const char *param = dm->getParameter("max_bytes");
+		
+		if (param) {
+			char *endptr = NULL;
+			unsigned long long max_bytes = strtoull(param, &endptr, 10);
+			
+			if (endptr && endptr != param) {
+				evictionPolicy.maxBytes = max_bytes;
+				HAGGLE_DBG("config eviction maxBytes=%llu\n", evictionPolicy.maxBytes);
+				LOG_ADD("# %s: eviction maxBytes=%llu\n", getName(), evictionPolicy.maxBytes);
+			}
+		}
+		
+		param = dm->getParameter("max_dataobjects");
+		
+		if (param) {
+			char *endptr = NULL;
+			unsigned long max_dataobjects = strtoul(param, &endptr, 10);
+			
+			if (endptr && endptr != param) {
+				evictionPolicy.maxDataObjects = max_dataobjects;
+				HAGGLE_DBG("config eviction maxDataObjects=%lu\n", evictionPolicy.maxDataObjects);
+				LOG_ADD("# %s: eviction maxDataObjects=%lu\n", getName(), evictionPolicy.maxDataObjects);
+			}
+		}
+		
+		param = dm->getParameter("batch_size");
+		
+		if (param) {
+			char *endptr = NULL;
+			unsigned long batch_size = strtoul(param, &endptr, 10);
+			
+			if (endptr && endptr != param && batch_size > 0) {
+				evictionPolicy.batchSize = batch_size;
+				HAGGLE_DBG("config eviction batchSize=%lu\n", evictionPolicy.batchSize);
+				LOG_ADD("# %s: eviction batchSize=%lu\n", getName(), evictionPolicy.batchSize);
+			}
+		}
+		
+		param = dm->getParameter("period");
+		
+		if (param) {
+			char *endptr = NULL;
+			unsigned long period = strtoul(param, &endptr, 10);
+			
+			if (endptr && endptr != param && period > 0) {
+				evictionPeriod = period;
+				HAGGLE_DBG("config evictionPeriod=%lu\n", evictionPeriod);
+				LOG_ADD("# %s: evictionPeriod=%lu\n", getName(), evictionPeriod);
+			}
+		}
+
+		const char *weights[] = { "interest_weight", "popularity_weight", "age_weight", "size_weight" };
+		double *values[] = { &evictionPolicy.interestWeight, &evictionPolicy.popularityWeight, 
+				     &evictionPolicy.ageWeight, &evictionPolicy.sizeWeight };
+
+		for (unsigned int i = 0; i < sizeof(weights) / sizeof(weights[0]); i++) {
+			param = dm->getParameter(weights[i]);
+
+			if (param) {
+				char *endptr = NULL;
+				double weight = strtod(param, &endptr);
+
+				if (endptr && endptr != param) {
+					*values[i] = weight;
+					HAGGLE_DBG("config eviction %s=%.3lf\n", weights[i], weight);
+					LOG_ADD("# %s: eviction %s=%.3lf\n", getName(), weights[i], weight);
+				}
+			}
+		}
+		
+		param = dm->getParameter("keep_in_bloomfilter");
+		
+		if (param) {
+			if (strcmp(param, "true") == 0) {
+				HAGGLE_DBG("config eviction: keep_in_bloomfilter=true\n");
+				LOG_ADD("# %s: eviction: keep_in_bloomfilter=true\n", getName());
+				keepInBloomfilterOnEviction = true;
+			} else if (strcmp(param, "false") == 0) {
+				HAGGLE_DBG("config eviction: keep_in_bloomfilter=false\n");
+				LOG_ADD("# %s: eviction: keep_in_bloomfilter=false\n", getName());
+				keepInBloomfilterOnEviction = false;
+			}
+		}
+
+		if (evictionPolicy.isEnabled())
+			startEviction(false);
+	}
+
 	if (agingHasChanged)
 		onAging(NULL);
 }
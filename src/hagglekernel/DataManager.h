@@ -19,6 +19,7 @@
 // default values for simple aging
 #define DEFAULT_AGING_MAX_AGE 24*3600	// max age of data objects [s]
 #define DEFAULT_AGING_PERIOD  3600	// period between aging processes [s]
+#define DEFAULT_EVICTION_PERIOD 60	// period between eviction checks [s]
 
 /*
 	Forward declarations of all data types declared in this file. This is to
@@ -30,6 +31,7 @@ class DataManager;
 #include "Manager.h"
 #include "Event.h"
 #include "Bloomfilter.h"
+#include "DataStore.h"
 
 typedef enum {
 	DATA_TASK_VERIFY_DATA,
@@ -78,6 +80,24 @@ class DataManager : public Manager
 	bool keepInBloomfilterOnAging;
 	unsigned long agingMaxAge;
 	unsigned long agingPeriod;
+	/*
+		Eviction of data objects when the data store exceeds its 
+		storage budget. It is disabled unless a budget is configured.
+		Rounds run every eviction period, when the data inserted since 
+		the last round amounts to a tenth of the budget, and directly 
+		after a round that evicted a full batch.
+	*/
+	EventCallback <EventHandler> *onEvictedDataObjectsCallback;
+	EventType evictionEvent;
+	DataStoreEvictionPolicy evictionPolicy;
+	unsigned long evictionPeriod;
+	bool keepInBloomfilterOnEviction;
+	bool evictionInProgress;
+	bool evictionTimerPending;
+	unsigned long long bytesInsertedSinceEviction;
+	unsigned long numInsertedSinceEviction;
+	// The number of times a data object has been sent, by id
+	Map<string, unsigned long> popularity;
 #if defined(DEBUG)
 #define MAX_DATAOBJECTS_LISTED 10
 	List<string> dataObjectsSent; // List of data objects sent.
@@ -99,6 +119,9 @@ private:
 	void onDataTaskComplete(Event *e);
 	void onAgedDataObjects(Event *e);
 	void onAging(Event *e);
+	void startEviction(bool continuing);
+	void onEvictedDataObjects(Event *e);
+	void onEviction(Event *e);
 	void onShutdown();
 	void onConfig(Metadata *m);
 #if defined(ENABLE_METADAPARSER)
@@ -102,7 +102,8 @@ DataObject::DataObject(InterfaceRef _localIface, InterfaceRef _remoteIface, cons
 #endif
                 signatureStatus(DataObject::SIGNATURE_MISSING),
                 signee(""), signature(NULL), signature_len(0), num(totNum++), 
-                metadata(NULL), filename(""), filepath(""), isForLocalApp(false), 
+                metadata(NULL), rawMetadata(NULL), rawMetadataLen(0), filename(""), 
+		filepath(""), isForLocalApp(false), 
 		storagepath(_storagepath), dataLen(0), createTime(-1), receiveTime(-1), 
                 localIface(_localIface), remoteIface(_remoteIface), rxTime(0), 
                 persistent(true), duplicate(false), stored(false), isNodeDesc(false), 
@@ -120,6 +121,7 @@ DataObject::DataObject(const DataObject& dObj) :
                 signatureStatus(dObj.signatureStatus),
                 signee(dObj.signee), signature(NULL), signature_len(dObj.signature_len), 
 		num(totNum++), metadata(dObj.metadata ? dObj.metadata->copy() : NULL), 
+		rawMetadata(NULL), rawMetadataLen(0),
                 attrs(dObj.attrs), filename(dObj.filename), filepath(dObj.filepath), 
                 isForLocalApp(dObj.isForLocalApp), storagepath(dObj.storagepath),
                 dataLen(dObj.dataLen), createTime(dObj.createTime), 
@@ -128,7 +130,7 @@ DataObject::DataObject(const DataObject& dObj) :
 		persistent(dObj.persistent), duplicate(false), 
 		stored(dObj.stored), isNodeDesc(dObj.isNodeDesc), 
 		isThisNodeDesc(dObj.isThisNodeDesc),
-		controlMessage(false), putData_data(NULL), dataState(dObj.dataState)
+		controlMessage(dObj.controlMessage), putData_data(NULL), dataState(dObj.dataState)
 {
 	memcpy(id, dObj.id, DATAOBJECT_ID_LEN);
 	memcpy(idStr, dObj.idStr, MAX_DATAOBJECT_ID_STR_LEN);
@@ -140,6 +142,15 @@ DataObject::DataObject(const DataObject& dObj) :
 		if (signature) 
 			memcpy(signature, dObj.signature, signature_len);
 	}
+
+	if (dObj.rawMetadata) {
+		rawMetadata = (unsigned char *)malloc(dObj.rawMetadataLen);
+		
+		if (rawMetadata) {
+			memcpy(rawMetadata, dObj.rawMetadata, dObj.rawMetadataLen);
+			rawMetadataLen = dObj.rawMetadataLen;
+		}
+	}
 }
 
 DataObject *DataObject::create_for_putting(InterfaceRef sourceIface, InterfaceRef remoteIface, const string storagepath)
@@ -260,42 +271,12 @@ DataObject *DataObject::create(const unsigned char *raw, size_t len, InterfaceRe
 	  Note, that many of these values set here will probably be overwritten in 
 	  case the metadata is valid. The values will be parsed from the metadata
 	  and set according to the values there, which in most cases will anyhow
-	  be the same.
-
-	  In the future, we might want to figure out a way to either create a 
-	  data object entirely from the raw metadata, or only from the values
-	  we pass into the function here.
+	  be the same. Use create_from_fields() to create a data object only from 
+	  the values passed into the function.
 	*/
-	dObj->filepath = filepath;
-	dObj->filename = filename;
-	dObj->stored = stored;
-
-	if (filepath.length()) {
-		if (!dObj->setFilePath(filepath, datalen)) {
-			goto out_failure;
-		}
-	}
-
-	dObj->signatureStatus = sig_status;
-
-	if (signature && siglen) {
-		unsigned char *signature_copy = (unsigned char *)malloc(siglen);
-		if (!signature_copy) {
-			HAGGLE_ERR("Could not set signature\n");
-			goto out_failure;
-		}
-		memcpy(signature_copy, signature, siglen);
-		dObj->setSignature(signee, signature_copy, siglen);
-	}
-	dObj->createTime = create_time;
-	dObj->receiveTime = receive_time;
-	dObj->rxTime = rxtime;
-	dObj->dataLen = datalen;
-	dObj->dataState = datastate;
-
-	if (datahash && datastate > DATA_STATE_NO_DATA) {
-		memcpy(dObj->dataHash, datahash, sizeof(DataHash_t));
-	}
+	if (!dObj->initFields(stored, filepath, filename, sig_status, signee, signature, siglen, 
+			      create_time, receive_time, rxtime, datalen, datastate, datahash))
+		goto out_failure;
 
 	if (!raw) {
                 if (!dObj->initMetadata()) {
@@ -342,6 +323,97 @@ out_failure:
 	return NULL;
 }
 
+DataObject *DataObject::create_from_fields(const DataObjectId_t id, const Attributes& attrs, const unsigned char *raw, size_t len, 
+					   bool stored, const string filepath, const string filename, SignatureStatus_t sig_status, 
+					   const string signee, const unsigned char *signature, unsigned long siglen, const Timeval create_time, 
+					   const Timeval receive_time, unsigned long rxtime, size_t datalen, DataState_t datastate, 
+					   const unsigned char *datahash, const string storagepath)
+{
+	if (!raw || len == 0) {
+		HAGGLE_ERR("No metadata\n");
+		return NULL;
+	}
+
+	DataObject *dObj = new DataObject(NULL, NULL, storagepath);
+
+	if (!dObj)
+		return NULL;
+
+	if (!dObj->initFields(stored, filepath, filename, sig_status, signee, signature, siglen, 
+			      create_time, receive_time, rxtime, datalen, datastate, datahash))
+		goto out_failure;
+
+	dObj->rawMetadata = (unsigned char *)malloc(len);
+
+	if (!dObj->rawMetadata) {
+		HAGGLE_ERR("Could not allocate raw metadata\n");
+		goto out_failure;
+	}
+	memcpy(dObj->rawMetadata, raw, len);
+	dObj->rawMetadataLen = len;
+
+	for (Attributes::const_iterator it = attrs.begin(); it != attrs.end(); it++) {
+		if ((*it).second.getName() == NODE_DESC_ATTR)
+			dObj->isNodeDesc = true;
+
+		dObj->attrs.add((*it).second);
+	}
+
+	/*
+	  The create time passed in may have lost precision compared to the one
+	  in the metadata, so we use the given identifier rather than calculating
+	  it from the create time.
+	*/
+	memcpy(dObj->id, id, DATAOBJECT_ID_LEN);
+	dObj->calcIdStr();
+
+	return dObj;
+
+out_failure:
+	delete dObj;
+
+	return NULL;
+}
+
+bool DataObject::initFields(bool stored, const string filepath, const string filename, SignatureStatus_t sig_status, 
+			    const string signee, const unsigned char *signature, unsigned long siglen, const Timeval create_time, 
+			    const Timeval receive_time, unsigned long rxtime, size_t datalen, DataState_t datastate, 
+			    const unsigned char *datahash)
+{
+	this->filepath = filepath;
+	this->filename = filename;
+	this->stored = stored;
+
+	if (filepath.length()) {
+		if (!setFilePath(filepath, datalen)) {
+			return false;
+		}
+	}
+
+	signatureStatus = sig_status;
+
+	if (signature && siglen) {
+		unsigned char *signature_copy = (unsigned char *)malloc(siglen);
+		if (!signature_copy) {
+			HAGGLE_ERR("Could not set signature\n");
+			return false;
+		}
+		memcpy(signature_copy, signature, siglen);
+		setSignature(signee, signature_copy, siglen);
+	}
+	createTime = create_time;
+	receiveTime = receive_time;
+	rxTime = rxtime;
+	dataLen = datalen;
+	dataState = datastate;
+
+	if (datahash && datastate > DATA_STATE_NO_DATA) {
+		memcpy(dataHash, datahash, sizeof(DataHash_t));
+	}
+
+	return true;
+}
+
 DataObject::~DataObject()
 {
 	if (putData_data) {
@@ -350,6 +422,8 @@ DataObject::~DataObject()
 	if (metadata) {
                 delete metadata;
 	}
+	if (rawMetadata)
+		free(rawMetadata);
 	if (signature)
 		free(signature);
 
@@ -516,9 +590,9 @@ bool DataObject::createFilePath()
 	return duplicate;
 }
 
-Metadata *DataObject::getOrCreateDataMetadata()
+Metadata *DataObject::getOrCreateDataMetadata() const
 {
-        if (!metadata)
+        if (!loadMetadata())
                 return NULL;
 
         Metadata *md = metadata->getMetadata(DATAOBJECT_METADATA_DATA);
@@ -950,7 +1024,7 @@ ssize_t DataObjectDataRetrieverImplementation::retrieve(void *data, size_t len,
 }
 void DataObject::setCreateTime(Timeval t)
 {
-        if (!metadata)
+        if (!loadMetadata())
                 return;
         
         createTime = t;
@@ -1102,15 +1176,10 @@ DataObject::DataState_t DataObject::verifyData()
         return dataState;
 }
 
-int DataObject::parseMetadata(bool from_network)
+void DataObject::parseMetadataHeader() const
 {
-        const char *pval;
-
-        if (!metadata)
-                return -1;
-
         // Check persistency
-        pval = metadata->getParameter(DATAOBJECT_PERSISTENT_PARAM);
+        const char *pval = metadata->getParameter(DATAOBJECT_PERSISTENT_PARAM);
         
         if (pval) {
 		if (strcmp(pval, "no") == 0 || strcmp(pval, "false") == 0)
@@ -1141,6 +1210,55 @@ int DataObject::parseMetadata(bool from_network)
 			controlMessage = true;
 		}
 	}
+}
+
+/*
+  Parse raw metadata kept by create_from_fields(). All fields except
+  those in parseMetadataHeader() are already set, so the rest of the
+  metadata is left as it is until it is synced in toMetadata().
+ */
+bool DataObject::loadMetadata() const
+{
+	if (metadata)
+		return true;
+
+	if (!rawMetadata)
+		return false;
+
+	metadata = new XMLMetadata();
+
+	if (!metadata) {
+		HAGGLE_ERR("Could not allocate new metadata\n");
+		return false;
+	}
+
+	bool ret = metadata->initFromRaw(rawMetadata, rawMetadataLen) && metadata->getName() == "Haggle";
+
+	// The raw metadata is only parsed once, whether it succeeds or not
+	free(rawMetadata);
+	rawMetadata = NULL;
+	rawMetadataLen = 0;
+
+	if (!ret) {
+		HAGGLE_ERR("Could not create metadata\n");
+		delete metadata;
+		metadata = NULL;
+		return false;
+	}
+
+	parseMetadataHeader();
+
+	return true;
+}
+
+int DataObject::parseMetadata(bool from_network)
+{
+        const char *pval;
+
+        if (!metadata)
+                return -1;
+
+	parseMetadataHeader();
 
 	if (signatureStatus == DataObject::SIGNATURE_MISSING) {
 		Metadata *sm = metadata->getMetadata(DATAOBJECT_METADATA_SIGNATURE);
@@ -1279,6 +1397,10 @@ int DataObject::parseMetadata(bool from_network)
 int DataObject::calcId()
 {
         SHA_CTX ctxt;  
+
+	// Make sure the create time is the one in the metadata
+	if (rawMetadata)
+		loadMetadata();
         
         SHA1_Init(&ctxt);
 		
@@ -1373,12 +1495,17 @@ const Metadata *DataObject::getMetadata() const
 
 const Metadata *DataObject::toMetadata() const
 {
-	return const_cast<DataObject *>(this)->toMetadata();
+	return syncMetadata();
 }
 
 Metadata *DataObject::toMetadata()
 {
-	if (!metadata)
+	return syncMetadata();
+}
+
+Metadata *DataObject::syncMetadata() const
+{
+	if (!loadMetadata())
 		return NULL;
 	
 	metadata->setParameter(DATAOBJECT_PERSISTENT_PARAM, persistent ? "yes" : "no");
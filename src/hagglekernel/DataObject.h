@@ -153,13 +153,13 @@ typedef ReferenceList<DataObject> DataObjectRefList;
 /** */
 #if OMNETPP
 #include <omnetpp.h>
-class DataObject : public cObject
+class DataObject : public cObject, public RefCounted
 {
 #else
 #ifdef DEBUG_LEAKS
-class DataObject : public LeakMonitor
+class DataObject : public LeakMonitor, public RefCounted
 #else
-class DataObject
+class DataObject : public RefCounted
 #endif
 {
 #endif /* OMNETPP */
@@ -185,7 +185,16 @@ class DataObject
 	size_t signature_len;
         static unsigned int totNum;
         unsigned int num;
-        Metadata* metadata; // The metadata part of the data object
+        mutable Metadata* metadata; // The metadata part of the data object
+	/*
+	  Raw metadata that has not yet been parsed. Data objects rebuilt
+	  from the fields in a data store keep their header in raw form
+	  until the metadata is needed, e.g., when the data object is sent.
+	  The metadata, and the fields parsed from its header, are loaded
+	  on first use also through const accessors, hence mutable.
+	*/
+	mutable unsigned char *rawMetadata;
+	mutable size_t rawMetadataLen;
         Attributes attrs; // The attributes of this data object
         string filename;
         string filepath;
@@ -202,7 +211,7 @@ class DataObject
 
 	/* A timestamp indicating when this was data object was created
            at the source (in the source's local time) */
-	Timeval createTime;
+	mutable Timeval createTime;
 	
 	/* A timestamp indicating when this data object was first received. */
 	Timeval receiveTime; 
@@ -210,12 +219,12 @@ class DataObject
 	InterfaceRef localIface;  // The local interface that received this data object
         InterfaceRef remoteIface; // The remote interface from which this data object was sent
         unsigned long rxTime;  // Time taken to transfer/receive the object in milliseconds
-        bool persistent; // Determines whether data object should be stored persistently
+        mutable bool persistent; // Determines whether data object should be stored persistently
         bool duplicate; // Set if the data object was received, but already existed in the data store
 	bool stored; // Set if the data object is stored in the data store
-	bool isNodeDesc; // True if this is a node description
+	mutable bool isNodeDesc; // True if this is a node description
 	bool isThisNodeDesc; // True iff this is the node description for the local node.
-	bool controlMessage; // True if this is a control message from an application
+	mutable bool controlMessage; // True if this is a control message from an application
         /*
           this is for putData().
         */
@@ -226,10 +235,20 @@ class DataObject
 	void free_pDd(void);
 
         int parseMetadata(bool from_network = false);
+	// Parses the header parameters and tags that are not stored as fields
+	void parseMetadataHeader() const;
+	// Parses any raw metadata that has not yet been parsed
+	bool loadMetadata() const;
+	// Brings the metadata up to date with the fields
+	Metadata *syncMetadata() const;
+	bool initFields(bool stored, const string filepath, const string filename, SignatureStatus_t sig_status, 
+			const string signee, const unsigned char *signature, unsigned long siglen, const Timeval create_time, 
+			const Timeval receive_time, unsigned long rxtime, size_t datalen, DataState_t datastate, 
+			const unsigned char *datahash);
 
         // Retrieves the 'Data' section of the metadata, or creates it
         // if it doesn't exist.
-        Metadata *getOrCreateDataMetadata();
+        Metadata *getOrCreateDataMetadata() const;
         /*
           Suggestion for improvement:
         	
@@ -270,6 +289,16 @@ public:
 		const string signee = "", const unsigned char *signature = NULL, unsigned long siglen = 0, const Timeval create_time = -1, const Timeval receive_time = -1,				unsigned long rxtime = 0, size_t datalen = 0, DataState_t datastate = DATA_STATE_UNKNOWN, 
 		const unsigned char *datahash = NULL, const string storagepath  = HAGGLE_DEFAULT_STORAGE_PATH);
 
+	/*
+	  Create from decoded fields, e.g., those kept in a data store. The
+	  identifier and attributes are set directly, and the raw metadata 
+	  is only parsed once the metadata is accessed.
+	*/
+	static DataObject *create_from_fields(const DataObjectId_t id, const Attributes& attrs, const unsigned char *raw, size_t len, 
+		bool stored = false, const string filepath = "", const string filename = "", SignatureStatus_t sig_status = DataObject::SIGNATURE_MISSING, 
+		const string signee = "", const unsigned char *signature = NULL, unsigned long siglen = 0, const Timeval create_time = -1, const Timeval receive_time = -1,
+		unsigned long rxtime = 0, size_t datalen = 0, DataState_t datastate = DATA_STATE_UNKNOWN, 
+		const unsigned char *datahash = NULL, const string storagepath  = HAGGLE_DEFAULT_STORAGE_PATH);
 	// Create from file
 	static DataObject *create(const string filepath, const string filename = "");
 	// Create from network
@@ -331,7 +360,7 @@ public:
 	bool isNodeDescription() const { return isNodeDesc; }
 	void setIsThisNodeDescription(bool yes) { isThisNodeDesc = yes; }
 	bool isThisNodeDescription() const { return isThisNodeDesc; }
-	bool isControlMessage() const { return controlMessage; }
+	bool isControlMessage() const { loadMetadata(); return controlMessage; }
 	void setStored(bool _stored = true) { stored = _stored; }
 	bool isStored() const { return stored; }
 
@@ -379,10 +408,13 @@ public:
                 return rxTime;
         }
         bool isPersistent() const {
+		loadMetadata();
                 return persistent;
         };
 	void setPersistent(bool _persistent = true)
 	{
+		// Loading the metadata later must not override the setting
+		loadMetadata();
 		persistent = _persistent;
 	}
 	/**
@@ -13,6 +13,7 @@
  * limitations under the License.
  */
 #include "DataStore.h"
+#include "HaggleKernel.h"
 #include <libcpphaggle/String.h>
 #include <haggleutils.h>
 
@@ -138,6 +139,10 @@ const char *DataStoreTask::taskName[_TASK_MAX] = {
 	"TASK_DELETE_REPOSITORY",
 	"TASK_DUMP_DATASTORE",
 	"TASK_DUMP_DATASTORE_TO_FILE",
+	"TASK_CONFIGURE",
+	"TASK_FILTER_MATCH_PAGE",
+	"TASK_EVICT_DATAOBJECTS",
+	"TASK_CHECKPOINT",
 #ifdef DEBUG_DATASTORE
 	"TASK_DEBUG_PRINT",
 #endif
@@ -262,6 +267,33 @@ DataStoreTask::DataStoreTask(DataStoreRepositoryQuery *q, TaskType _type) :
 	}
 }
 
+DataStoreTask::DataStoreTask(DataStoreFilterCursor *c, TaskType _type) :
+	type(_type), priority(TASK_PRIORITY_LOW), num(totNum++), 
+	timestamp(Timeval::now()), cursor(c), callback(NULL), boolParameter(false) 
+{
+	if (type != TASK_FILTER_MATCH_PAGE) {
+		HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
+	}
+}
+
+DataStoreTask::DataStoreTask(DataStoreDumpCursor *c, TaskType _type) :
+	type(_type), priority(TASK_PRIORITY_LOW), num(totNum++), 
+	timestamp(Timeval::now()), dumpCursor(c), callback(NULL), boolParameter(false) 
+{
+	if (type != TASK_DUMP_DATASTORE) {
+		HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
+	}
+}
+
+DataStoreTask::DataStoreTask(DataStoreEvictionQuery *q, TaskType _type) :
+	type(_type), priority(TASK_PRIORITY_LOW), num(totNum++), 
+	timestamp(Timeval::now()), EvictionQuery(q), callback(NULL), boolParameter(false) 
+{
+	if (type != TASK_EVICT_DATAOBJECTS) {
+		HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
+	}
+}
+
 DataStoreTask::DataStoreTask(const Filter& _f, TaskType _type, 
 			     const EventCallback<EventHandler> *_callback, 
 			     bool _boolParameter) :
@@ -281,20 +313,18 @@ DataStoreTask::DataStoreTask(TaskType _type, void *_data,
 	timestamp(Timeval::now()), data(_data), callback(_callback), 
 	boolParameter(false) 
 {
-	if (type == TASK_EXIT) {
+	if (type == TASK_EXIT || type == TASK_CHECKPOINT) {
 		priority = TASK_PRIORITY_LOW;
-	} else if (
 #ifdef DEBUG_DATASTORE
-		type == TASK_DEBUG_PRINT ||
-#endif
-		type == TASK_DUMP_DATASTORE) {
-			if (data != NULL) {
-				HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
-			}
-		
+	} else if (type == TASK_DEBUG_PRINT) {
+		if (data != NULL) {
+			HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
+		}
 		priority = TASK_PRIORITY_HIGH;
+#endif
 	} else if (type == TASK_DUMP_DATASTORE_TO_FILE ||
-		type == TASK_DELETE_FILTER) {
+		type == TASK_DELETE_FILTER || 
+		type == TASK_CONFIGURE) {
 		priority = TASK_PRIORITY_HIGH;
 	} else {
 		HAGGLE_ERR("Tried to create a data store task with the wrong task for the data. (task type = %s)\n", taskName[type]);
@@ -382,27 +412,345 @@ DataStoreTask::~DataStoreTask()
 		break;
 #endif
 	case TASK_DUMP_DATASTORE:
+		if (dumpCursor)
+			delete dumpCursor;
 		break;
 	case TASK_DUMP_DATASTORE_TO_FILE:
 		delete static_cast<string *>(data);
 		break;
+	case TASK_CONFIGURE:
+		delete static_cast<Metadata *>(data);
+		break;
+	case TASK_FILTER_MATCH_PAGE:
+		if (cursor)
+			delete cursor;
+		break;
+	case TASK_EVICT_DATAOBJECTS:
+		delete EvictionQuery;
+		break;
 	default:
 		// HAGGLE_DBG("Unknown task type (%d) in Task Queue!\n", type);
 		break;
 	}
 }
 
+DataStoreReader::DataStoreReader(DataStore *_ds, DataStore *_backend, const string name) :
+	Runnable(name), ds(_ds), backend(_backend), load(0)
+{
+}
+
+DataStoreReader::~DataStoreReader()
+{
+	while (!taskQ.empty()) {
+		DataStoreTask *task = taskQ.front();
+
+		taskQ.pop_front();
+		
+		delete task;
+	}
+	
+	if (backend)
+		delete backend;
+}
+
+void DataStoreReader::addTask(DataStoreTask *task)
+{
+	Mutex::AutoLocker l(mutex);
+
+	taskQ.push_back(task);
+	load++;
+
+	cond.signal();
+}
+
+unsigned long DataStoreReader::getLoad()
+{
+	Mutex::AutoLocker l(mutex);
+
+	return load;
+}
+
+int DataStoreReader::cancelDataObjectQueries(const NodeRef& node)
+{
+	int count = 0;
+	Mutex::AutoLocker l(mutex);
+	List<DataStoreTask *>::iterator it = taskQ.begin();
+
+	while (it != taskQ.end()) {
+		if (((*it)->getType() == TASK_DATAOBJECT_QUERY && 
+		     (*it)->DOQuery->getNode() == node) ||
+		    ((*it)->getType() == TASK_DATAOBJECT_FOR_NODES_QUERY && 
+		     (*it)->DOForNodesQuery->getNode() == node)) {
+			delete *it;
+			it = taskQ.erase(it);
+			load--;
+			count++;
+			continue;
+		}
+		it++;
+	}
+
+	return count;
+}
+
+void DataStoreReader::hookCancel()
+{
+	Mutex::AutoLocker l(mutex);
+
+	cond.signal();
+}
+
+bool DataStoreReader::run()
+{
+	while (true) {
+		mutex.lock();
+
+		while (taskQ.empty() && !shouldExit()) {
+			cond.wait(&mutex);
+		}
+
+		// Queries are not executed when exiting
+		if (shouldExit() || ds->shouldExit()) {
+			mutex.unlock();
+			return false;
+		}
+
+		DataStoreTask *task = taskQ.front();
+
+		taskQ.pop_front();
+
+		mutex.unlock();
+		
+		backend->doTask(task);
+
+		mutex.lock();
+		load--;
+		mutex.unlock();
+	}
+	return false;
+}
+
+void DataStoreReader::cleanup()
+{
+	HAGGLE_DBG("%s thread cleanup\n", getName());
+}
+
 DataStore::~DataStore()
 {
+	stopReaders();
+
+	const DataStoreTaskQueueStats& stats = taskQ.getStats();
+
+	HAGGLE_DBG("Task queue stats: queued=%lu executed=%lu coalesced=%lu cancelled=%lu max length=%lu avg wait=%.3lf ms max wait=%.3lf ms\n", 
+		   stats.numQueued, stats.numExecuted, stats.numCoalesced, 
+		   stats.numCancelled, stats.maxLength, stats.getAverageWait(), 
+		   stats.maxWait.getTimeAsMilliSecondsDouble());
+
 	HAGGLE_DBG("Destroying task queue containing %lu tasks\n", taskQ.size());
 
 	while (!taskQ.empty()) {
-		DataStoreTask *task = static_cast<DataStoreTask *>(taskQ.front());
+		DataStoreTask *task = taskQ.front();
 
 		taskQ.pop_front();
 		
 		delete task;
 	}
+
+	clearEvictionPlan();
+}
+
+void DataStore::clearEvictionPlan()
+{
+	while (!evictionPlan.empty()) {
+		delete evictionPlan.front();
+		evictionPlan.pop_front();
+	}
+}
+
+DataStoreEvictionPolicy::DataStoreEvictionPolicy() :
+	maxBytes(0), maxDataObjects(0), batchSize(DATASTORE_EVICTION_BATCH_SIZE), 
+	interestWeight(10.0), popularityWeight(10.0), ageWeight(1.0), sizeWeight(0.01)
+{
+}
+
+bool DataStoreEvictionPolicy::isOverBudget(unsigned long numDataObjects, 
+					   unsigned long long bytes, bool continuing) const
+{
+	unsigned long long percent = continuing ? DATASTORE_EVICTION_LOW_WATERMARK : 100;
+
+	if (maxBytes > 0 && bytes * 100 > maxBytes * percent)
+		return true;
+
+	if (maxDataObjects > 0 && 
+	    (unsigned long long)numDataObjects * 100 > (unsigned long long)maxDataObjects * percent)
+		return true;
+
+	return false;
+}
+
+double DataStoreEvictionPolicy::getUtility(unsigned long interest, unsigned long popularity, 
+					   double ageSeconds, unsigned long long size) const
+{
+	return interestWeight * interest + popularityWeight * popularity - 
+		ageWeight * ageSeconds / 3600.0 - sizeWeight * size / 1024.0;
+}
+
+DataStoreEvictionQuery::~DataStoreEvictionQuery()
+{
+	while (!candidates.empty())
+		delete static_cast<DataStoreEvictionCandidate *>(candidates.extractFirst());
+}
+
+void DataStoreEvictionQuery::addCandidate(int64_t num, const string& id, unsigned long interest, 
+					  double ageSeconds, unsigned long long size)
+{
+	unsigned long pop = 0;
+	Map<string, unsigned long>::const_iterator it = popularity.find(id);
+
+	if (it != popularity.end())
+		pop = (*it).second;
+
+	candidates.insert(new DataStoreEvictionCandidate(num, size, 
+							 policy.getUtility(interest, pop, ageSeconds, size)));
+}
+
+void DataStoreEvictionQuery::getCandidates(List<DataStoreEvictionCandidate *>& l, 
+					   unsigned long numDataObjects, unsigned long long bytes)
+{
+	List<DataStoreEvictionCandidate *> sorted;
+
+	// The heap has the highest utility first
+	while (!candidates.empty())
+		sorted.push_front(static_cast<DataStoreEvictionCandidate *>(candidates.extractFirst()));
+
+	while (!sorted.empty()) {
+		DataStoreEvictionCandidate *c = sorted.front();
+
+		sorted.pop_front();
+
+		if (policy.isOverBudget(numDataObjects, bytes, true)) {
+			l.push_back(c);
+			numDataObjects--;
+			bytes -= c->size < bytes ? c->size : bytes;
+		} else {
+			delete c;
+		}
+	}
+}
+
+DataStoreTaskQueueStats::DataStoreTaskQueueStats() :
+	length(0), maxLength(0), numQueued(0), numExecuted(0), 
+	numCoalesced(0), numCancelled(0)
+{
+	for (int i = 0; i < DataStoreTask::_TASK_PRIORITY_MAX; i++)
+		lengthByPriority[i] = 0;
+}
+
+double DataStoreTaskQueueStats::getAverageWait() const
+{
+	if (numExecuted == 0)
+		return 0.0;
+
+	return totalWait.getTimeAsMilliSecondsDouble() / numExecuted;
+}
+
+DataStore::TaskQueue::TaskQueue()
+{
+}
+
+DataStore::TaskQueue::~TaskQueue()
+{
+}
+
+static string nodeInsertKey(const NodeRef& node)
+{
+	return string("insert_node:") + node->getIdStr();
+}
+
+string DataStore::TaskQueue::coalesceKey(const DataStoreTask *task)
+{
+	char buf[64];
+
+	switch (task->type) {
+	case TASK_DATAOBJECT_QUERY:
+		if (!task->DOQuery->getNode())
+			break;
+
+		// Queries are identical if they are for the same node and 
+		// have the same result handler and match parameter
+		snprintf(buf, sizeof(buf), ":%p:%u", 
+			 (void *)task->DOQuery->getCallback(), 
+			 task->DOQuery->getAttrMatch());
+		
+		return string("dataobject_query:") + 
+			task->DOQuery->getNode()->getIdStr() + buf;
+	case TASK_INSERT_NODE:
+		// An insert that merges bloomfilters depends on the node 
+		// already in the data store, and an insert that is ignored 
+		// must not replace a pending one
+		if (task->boolParameter || !(*task->node) || 
+		    (*task->node)->getType() == Node::TYPE_UNDEFINED ||
+		    !(*task->node)->getDataObject())
+			break;
+
+		return nodeInsertKey(*task->node);
+	default:
+		break;
+	}
+	return "";
+}
+
+bool DataStore::TaskQueue::coalesce(DataStoreTask *task, const string& key)
+{
+	Map<string, DataStoreTask *>::iterator it = pending.find(key);
+
+	if (it == pending.end())
+		return false;
+
+	DataStoreTask *p_task = (*it).second;
+
+	if (task->type == TASK_DATAOBJECT_QUERY) {
+		// The pending task keeps its place in the queue, but 
+		// executes the newest query
+		DataStoreDataObjectQuery *q = p_task->DOQuery;
+		p_task->DOQuery = task->DOQuery;
+		task->DOQuery = q;
+	} else if (task->type == TASK_INSERT_NODE) {
+		// The pending insert is overwritten by the new one, 
+		// unless there is a callback that expects its result
+		if (p_task->callback)
+			return false;
+
+		NodeRef *node = p_task->node;
+		p_task->node = task->node;
+		task->node = node;
+		p_task->callback = task->callback;
+	} else {
+		return false;
+	}
+
+	HAGGLE_DBG("Coalesced task %s with pending task\n", DataStoreTask::taskName[task->type]);
+
+	stats.numCoalesced++;
+	delete task;
+
+	return true;
+}
+
+void DataStore::TaskQueue::unindex(DataStoreTask *task)
+{
+	if (task->type != TASK_DATAOBJECT_QUERY && task->type != TASK_INSERT_NODE)
+		return;
+
+	string key = coalesceKey(task);
+
+	if (key.length() == 0)
+		return;
+
+	Map<string, DataStoreTask *>::iterator it = pending.find(key);
+
+	if (it != pending.end() && (*it).second == task)
+		pending.erase(it);
 }
 
 void DataStore::TaskQueue::insert(DataStoreTask *task)
@@ -410,36 +758,113 @@ void DataStore::TaskQueue::insert(DataStoreTask *task)
 	if (!task)
 		return;
 
-	//HAGGLE_DBG("New task %u %s\n", task->getPriority(), task->getTimestamp().getAsString());
+	string key = coalesceKey(task);
+
+	if (key.length() > 0) {
+		if (coalesce(task, key))
+			return;
+		
+		// The task replaces any pending task with the same key as 
+		// the one that later tasks are coalesced with
+		pending.erase(key);
+		pending.insert(make_pair(key, task));
+	} else if ((task->type == TASK_INSERT_NODE || task->type == TASK_DELETE_NODE) && 
+		   *task->node) {
+		// A later insert of the node must not be moved ahead of this task
+		pending.erase(nodeInsertKey(*task->node));
+	}
 	
-	TaskQueue::iterator it = begin();
+	queues[task->priority].push_back(task);
+	
+	stats.numQueued++;
+	stats.lengthByPriority[task->priority]++;
 
-	while (it != end()) {
-		DataStoreTask *q_task = *it;
-		//HAGGLE_DBG("Task %u %s\n", q_task->getPriority(), q_task->getTimestamp().getAsString());
-		if (task->getPriority() < q_task->getPriority()) {
-			break;
-		} else if (task->getPriority() == q_task->getPriority() && 
-			   task->getTimestamp() < q_task->getTimestamp()) {
-			break;
+	if (++stats.length > stats.maxLength)
+		stats.maxLength = stats.length;
+}
+
+DataStoreTask *DataStore::TaskQueue::front()
+{
+	for (int i = 0; i < DataStoreTask::_TASK_PRIORITY_MAX; i++) {
+		if (!queues[i].empty())
+			return queues[i].front();
+	}
+	return NULL;
+}
+
+void DataStore::TaskQueue::pop_front()
+{
+	for (int i = 0; i < DataStoreTask::_TASK_PRIORITY_MAX; i++) {
+		if (!queues[i].empty()) {
+			DataStoreTask *task = queues[i].front();
+			Timeval wait = Timeval::now() - task->getTimestamp();
+
+			queues[i].pop_front();
+			unindex(task);
+
+			stats.length--;
+			stats.lengthByPriority[i]--;
+			stats.numExecuted++;
+			stats.totalWait += wait;
+
+			if (wait > stats.maxWait)
+				stats.maxWait = wait;
+			return;
 		}
-		it++;
 	}
+}
 
-	if (it != end()) {
-		it = List<DataStoreTask *>::insert(it, task);
+int DataStore::TaskQueue::cancelDataObjectQueries(const NodeRef& node)
+{
+	int count = 0;
 
-		/*
-		HAGGLE_DBG("inserted task %u %s\n", (*it)->getPriority(), (*it)->getTimestamp().getAsString());
-		it++;
-		if (it != end()) {
-			HAGGLE_DBG("next task %u %s\n", (*it)->getPriority(), (*it)->getTimestamp().getAsString());
+	for (int i = 0; i < DataStoreTask::_TASK_PRIORITY_MAX; i++) {
+		List<DataStoreTask *>::iterator it = queues[i].begin();
+
+		while (it != queues[i].end()) {
+			DataStoreTask *task = *it;
+
+			if ((task->type == TASK_DATAOBJECT_QUERY && 
+			     task->DOQuery->getNode() == node) ||
+			    (task->type == TASK_DATAOBJECT_FOR_NODES_QUERY && 
+			     task->DOForNodesQuery->getNode() == node)) {
+				unindex(task);
+				delete task;
+				it = queues[i].erase(it);
+				stats.length--;
+				stats.lengthByPriority[i]--;
+				stats.numCancelled++;
+				count++;
+				continue;
+			}
+			it++;
 		}
-		*/
+	}
+	return count;
+}
 
-	} else {
-		push_back(task);
+int DataStore::TaskQueue::cancelFilterMatch(long eventType)
+{
+	int count = 0;
+	List<DataStoreTask *>& q = queues[DataStoreTask::TASK_PRIORITY_LOW];
+	List<DataStoreTask *>::iterator it = q.begin();
+
+	while (it != q.end()) {
+		DataStoreTask *task = *it;
+
+		if (task->type == TASK_FILTER_MATCH_PAGE && 
+		    task->cursor->eventType == eventType) {
+			delete task;
+			it = q.erase(it);
+			stats.length--;
+			stats.lengthByPriority[DataStoreTask::TASK_PRIORITY_LOW]--;
+			stats.numCancelled++;
+			count++;
+			continue;
+		}
+		it++;
 	}
+	return count;
 }
 
 void DataStore::insertNode(NodeRef& node, const EventCallback<EventHandler> *callback, 
@@ -539,6 +964,21 @@ void DataStore::ageDataObjects(const Timeval& minimumAge,
 	cond.signal();
 }
 
+void DataStore::evictDataObjects(const DataStoreEvictionPolicy& policy, 
+				 const Map<string, unsigned long>& popularity, 
+				 const EventCallback<EventHandler> *callback, 
+				 bool continuing, bool keepInBloomfilter)
+{
+	Mutex::AutoLocker l(mutex);
+	const Map<string, unsigned long> noPopularity;
+	
+	// A continuing round evicts from the plan, and does not score the data objects
+	taskQ.insert(new DataStoreTask(new DataStoreEvictionQuery(policy, continuing ? noPopularity : popularity, 
+								  callback, continuing, keepInBloomfilter)));
+	
+	cond.signal();
+}
+
 void DataStore::insertFilter(const Filter& f, bool matchFilter, 
 			     const EventCallback<EventHandler> *callback)
 {
@@ -698,34 +1138,33 @@ int DataStore::cancelDataObjectQueries(const NodeRef& node)
 	if (!node)
 		return -1;
 	
-	TaskQueue::iterator it = taskQ.begin();
-
-	while (it != taskQ.end()) {
-		if ((*it)->getType() == TASK_DATAOBJECT_QUERY) {
-			if ((*it)->DOQuery->getNode() == node) {
-				it = taskQ.erase(it);	
-				count++;
-				continue;
-			}
-		} else if ((*it)->getType() == TASK_DATAOBJECT_FOR_NODES_QUERY) {
-			if ((*it)->DOForNodesQuery->getNode() == node) {
-				it = taskQ.erase(it);	
-				count++;
-				continue;
-			}
-		}
-		it++;
+	for (List<DataStoreReader *>::iterator rit = readers.begin(); rit != readers.end(); rit++) {
+		count += (*rit)->cancelDataObjectQueries(node);
 	}
 
+	count += taskQ.cancelDataObjectQueries(node);
+
 	return count;
 }
 
+DataStoreTaskQueueStats DataStore::getTaskQueueStats()
+{
+	Mutex::AutoLocker l(mutex);
+
+	return taskQ.getStats();
+}
+
 
 void DataStore::dump(const EventCallback<EventHandler> *callback)
+{
+	continueDump(new DataStoreDumpCursor(callback));
+}
+
+void DataStore::continueDump(DataStoreDumpCursor *c)
 {
         Mutex::AutoLocker l(mutex);
                 
-	taskQ.insert(new DataStoreTask(TASK_DUMP_DATASTORE, NULL, callback));
+	taskQ.insert(new DataStoreTask(c));
 	
 	cond.signal();
 }
@@ -740,6 +1179,173 @@ void DataStore::dumpToFile(const char *filename)
 	cond.signal();
 }
 
+void DataStore::onConfig(const Metadata& m)
+{
+	Metadata *mcopy = m.copy();
+
+	if (!mcopy)
+		return;
+
+        Mutex::AutoLocker l(mutex);
+                
+	taskQ.insert(new DataStoreTask(TASK_CONFIGURE, mcopy));
+	
+	cond.signal();
+}
+
+int DataStore::_configure(const Metadata& m)
+{
+	const char *param = m.getParameter("max_transaction_batch_size");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long size = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param && size > 0) {
+			maxTransactionBatchSize = size;
+			HAGGLE_DBG("config maxTransactionBatchSize=%lu\n", maxTransactionBatchSize);
+			LOG_ADD("# %s: maxTransactionBatchSize=%lu\n", getName(), maxTransactionBatchSize);
+		}
+	}
+
+	param = m.getParameter("max_transaction_latency");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long latency = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param) {
+			maxTransactionLatency = latency;
+			HAGGLE_DBG("config maxTransactionLatency=%lu ms\n", maxTransactionLatency);
+			LOG_ADD("# %s: maxTransactionLatency=%lu\n", getName(), maxTransactionLatency);
+		}
+	}
+
+	param = m.getParameter("filter_page_size");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long size = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param) {
+			filterPageSize = size;
+			HAGGLE_DBG("config filterPageSize=%lu\n", filterPageSize);
+			LOG_ADD("# %s: filterPageSize=%lu\n", getName(), filterPageSize);
+		}
+	}
+
+	param = m.getParameter("checkpoint_interval");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long interval = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param) {
+			checkpointInterval = interval;
+			nextCheckpoint = Timeval::now() + Timeval(checkpointInterval, 0);
+			HAGGLE_DBG("config checkpointInterval=%lu s\n", checkpointInterval);
+			LOG_ADD("# %s: checkpointInterval=%lu\n", getName(), checkpointInterval);
+		}
+	}
+
+	param = m.getParameter("reader_threads");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long num = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param && num <= DATASTORE_MAX_READER_THREADS) {
+			numReaderThreads = num;
+			HAGGLE_DBG("config numReaderThreads=%lu\n", numReaderThreads);
+			LOG_ADD("# %s: numReaderThreads=%lu\n", getName(), numReaderThreads);
+		} else {
+			HAGGLE_ERR("Bad number of reader threads '%s' (max %u)\n", 
+				   param, DATASTORE_MAX_READER_THREADS);
+		}
+	}
+
+	return 0;
+}
+
+bool DataStore::isReaderTask(const DataStoreTask *task) const
+{
+	return (task->getType() == TASK_FILTER_QUERY || 
+		task->getType() == TASK_DATAOBJECT_QUERY || 
+		task->getType() == TASK_DATAOBJECT_FOR_NODES_QUERY || 
+		task->getType() == TASK_NODE_QUERY);
+}
+
+/*
+	Starts reader threads until the configured number is running. The 
+	readers are only started, never stopped, on reconfiguration, since 
+	a reader may be in the middle of a query.
+*/
+void DataStore::startReaders()
+{
+	while (readers.size() < numReaderThreads) {
+		DataStore *backend = _createReader();
+
+		if (!backend) {
+			HAGGLE_ERR("Could not create data store reader, %lu reader threads running\n", 
+				   readers.size());
+			numReaderThreads = readers.size();
+			break;
+		}
+
+		DataStoreReader *reader = new DataStoreReader(this, backend);
+
+		if (!reader->start()) {
+			HAGGLE_ERR("Could not start data store reader thread\n");
+			delete reader;
+			numReaderThreads = readers.size();
+			break;
+		}
+
+		mutex.lock();
+		readers.push_back(reader);
+		mutex.unlock();
+
+		HAGGLE_DBG("Started data store reader %lu\n", readers.size());
+	}
+}
+
+void DataStore::stopReaders()
+{
+	while (!readers.empty()) {
+		DataStoreReader *reader = readers.front();
+
+		reader->stop();
+
+		mutex.lock();
+		readers.pop_front();
+		mutex.unlock();
+
+		delete reader;
+	}
+}
+
+/*
+	The data store thread executes all tasks preceding a query before it 
+	hands the query to a reader, so that the query sees their results, 
+	just as if the data store thread had executed the query itself.
+*/
+void DataStore::dispatchToReader(DataStoreTask *task)
+{
+	DataStoreReader *reader = NULL;
+	unsigned long min_load = 0;
+
+	for (List<DataStoreReader *>::iterator it = readers.begin(); it != readers.end(); it++) {
+		unsigned long load = (*it)->getLoad();
+
+		if (!reader || load < min_load) {
+			reader = *it;
+			min_load = load;
+		}
+	}
+
+	reader->addTask(task);
+}
+
 void DataStore::hookCancel()
 {
 	Mutex::AutoLocker l(mutex);
@@ -769,10 +1375,27 @@ bool DataStore::run()
 				return false;
 			}
 			HAGGLE_DBG("Waiting for task\n");
-			cond.wait(&mutex);
+
+			if (checkpointInterval > 0 && !checkpointInProgress) {
+				// Wake up in time for the next checkpoint
+				Timeval timeout = nextCheckpoint - Timeval::now();
+
+				if (timeout > Timeval(0, 0))
+					cond.timedWait(&mutex, timeout.getTimevalStruct());
+			} else {
+				cond.wait(&mutex);
+			}
+		}
+		
+		if (!shouldExit())
+			scheduleCheckpoint();
+
+		if (taskQ.empty()) {
+			mutex.unlock();
+			continue;
 		}
                 
-		DataStoreTask *task = static_cast<DataStoreTask *>(taskQ.front());
+		DataStoreTask *task = taskQ.front();
 
 		taskQ.pop_front();
 #if defined(DEBUG)
@@ -780,110 +1403,356 @@ bool DataStore::run()
 		// execute a task
 		if (++count > 10) {
 			count = 0;
-			LOG_ADD("%s: DataStore task queue length=%lu\n", 
-				Timeval::now().getAsString().c_str(), taskQ.size());
+			LOG_ADD("%s: DataStore task queue length=%lu max=%lu coalesced=%lu avg wait=%.3lf ms\n", 
+				Timeval::now().getAsString().c_str(), taskQ.size(), 
+				taskQ.getStats().maxLength, taskQ.getStats().numCoalesced, 
+				taskQ.getStats().getAverageWait());
 		}
 #endif
 		mutex.unlock();
 
+		if (isReaderTask(task)) {
+			// Queries are not executed when exiting
+			if (shouldExit()) {
+				delete task;
+			} else if (!readers.empty()) {
+				dispatchToReader(task);
+			} else {
+				doTask(task);
+			}
+		} else if (maxTransactionBatchSize > 1 && isTransactionBatchTask(task)) {
+			doTransactionBatch(task);
+		} else {
+			doTask(task);
+		}
+	}
+	HAGGLE_DBG("DataStore exits...\n");
+	LOG_ADD("%s DATA STORE EXIT\n", Timeval::now().getAsString().c_str());
+	return false;
+}
+
+void DataStore::cancelFilterMatch(long eventType)
+{
+	Mutex::AutoLocker l(mutex);
 
-		//HAGGLE_DBG("Executing task with priority=%u timestamp=%s\n", 
-		//	   task->getPriority(), task->getTimestamp().getAsString().c_str());
+	if (taskQ.cancelFilterMatch(eventType) > 0) {
+		HAGGLE_DBG("Cancelled remaining pages of filter match for event type %ld\n", eventType);
+	}
+}
+
+void DataStore::evaluateFilterPage(DataStoreFilterCursor *c)
+{
+	int n = _evaluateFilterPage(c, filterPageSize);
+
+	if (n > 0)
+		c->numPages++;
+
+	// A full page means that there may be more matching data objects
+	if (n > 0 && filterPageSize > 0 && (unsigned long)n >= filterPageSize) {
+		Mutex::AutoLocker l(mutex);
 		
-		switch (task->getType()) {
-		case TASK_INSERT_DATAOBJECT:
-			_insertDataObject(*task->dObj, task->callback);
-			break;
-		case TASK_DELETE_DATAOBJECT:
-			_deleteDataObject(*task->dObj, true, task->boolParameter);
-			break;
-		case TASK_DELETE_DATAOBJECT_BY_ID:
-			_deleteDataObject(task->id, true, task->boolParameter);
-			break;
-		case TASK_AGE_DATAOBJECTS:
-			_ageDataObjects(*task->age, task->callback, task->boolParameter);
-			break;
-		case TASK_INSERT_NODE:
-			_insertNode(*task->node, task->callback, task->boolParameter);
-			break;
-		case TASK_DELETE_NODE:
-			_deleteNode(*task->node);
-			break;
-		case TASK_RETRIEVE_NODE:
-			_retrieveNode(*task->node, task->callback, task->boolParameter);
-			break;
-		case TASK_RETRIEVE_NODE_BY_TYPE:
-			_retrieveNode(task->nodeType, task->callback);
-			break;
-		case TASK_RETRIEVE_NODE_BY_INTERFACE:
-			_retrieveNode(*task->iface, task->callback, task->boolParameter);
-			break;
-		case TASK_ADD_FILTER:
-			_insertFilter(task->f, task->boolParameter, task->callback);
-			break;
-		case TASK_DELETE_FILTER:
-			_deleteFilter(*static_cast<long *>(task->data));
-			break;
-		case TASK_FILTER_QUERY:
-			if (!shouldExit())
-				_doFilterQuery(task->query);
-			break;
-		case TASK_DATAOBJECT_QUERY:
-			if (!shouldExit())
-				_doDataObjectQuery(task->DOQuery);
-			break;
-		case TASK_DATAOBJECT_FOR_NODES_QUERY:
-			if (!shouldExit())
-				_doDataObjectForNodesQuery(task->DOForNodesQuery);
-			break;
-		case TASK_NODE_QUERY:
-			if (!shouldExit())
-				_doNodeQuery(task->NodeQuery);
-			break;
-		case TASK_INSERT_REPOSITORY:
-			_insertRepository(task->RepositoryQuery);
-			break;
-		case TASK_READ_REPOSITORY:
-			_readRepository(task->RepositoryQuery);
-			break;
-		case TASK_DELETE_REPOSITORY:
-			_deleteRepository(task->RepositoryQuery);
-			break;
-                case TASK_DUMP_DATASTORE:
-			_dump(task->callback);
-			break;
-                case TASK_DUMP_DATASTORE_TO_FILE:
-			_dumpToFile(static_cast<string *>(task->data)->c_str());
-			break;
+		HAGGLE_DBG("Delivered page %lu of filter match for event type %ld, next page queued\n", 
+			   c->numPages, c->eventType);
+		
+		taskQ.insert(new DataStoreTask(c));
+		cond.signal();
+	} else {
+		HAGGLE_DBG("Filter match for event type %ld done, %lu data objects in %lu pages\n", 
+			   c->eventType, c->numDataObjects, c->numPages);
+		delete c;
+	}
+}
+
+void DataStore::scheduleCheckpoint()
+{
+	if (checkpointInterval == 0 || checkpointInProgress || Timeval::now() < nextCheckpoint)
+		return;
+
+	checkpointInProgress = true;
+	taskQ.insert(new DataStoreTask(TASK_CHECKPOINT));
+}
+
+/*
+	A checkpoint is copied one slice per task. The continuation task is 
+	queued behind the tasks that arrived meanwhile, so a large data store 
+	does not keep the data store thread busy. The next checkpoint is 
+	scheduled an interval after the previous one completed.
+*/
+void DataStore::checkpoint()
+{
+	int ret = _checkpoint();
+
+	if (ret > 0 && !shouldExit()) {
+		Mutex::AutoLocker l(mutex);
+		
+		taskQ.insert(new DataStoreTask(TASK_CHECKPOINT));
+		cond.signal();
+		return;
+	}
+	
+	if (ret < 0) {
+		HAGGLE_ERR("Checkpoint failed\n");
+	}
+
+	checkpointInProgress = false;
+	nextCheckpoint = Timeval::now() + Timeval(checkpointInterval, 0);
+}
+
+/*
+	The cursor goes with the chunk to the receiver, which decides whether 
+	to continue the dump. The data store thread thus only spends the time 
+	of one chunk per task on a dump, and never has more than one chunk of 
+	a dump in memory.
+*/
+void DataStore::dumpChunk(DataStoreDumpCursor *c)
+{
+	char *data = NULL;
+	size_t len = 0;
+	int ret;
+
+	if (!c->callback) {
+		HAGGLE_ERR("Invalid callback\n");
+		delete c;
+		return;
+	}
+
+	ret = _dump(c, DATASTORE_DUMP_CHUNK_SIZE, &data, &len);
+	
+	c->started = true;
+	c->numChunks++;
+
+	if (ret < 0) {
+		// An empty last chunk lets the receiver end the dump
+		HAGGLE_ERR("Dump failed after %lu chunks\n", c->numChunks);
+		if (data)
+			free(data);
+		data = NULL;
+		len = 0;
+	}
+	
+	if (ret > 0) {
+		kernel->addEvent(new Event(c->callback, new DataStoreDump(data, len, c)));
+	} else {
+		HAGGLE_DBG("Dump done, %lu rows in %lu chunks\n", c->numRows, c->numChunks);
+		kernel->addEvent(new Event(c->callback, new DataStoreDump(data, len)));
+		delete c;
+	}
+}
+
+bool DataStore::isTransactionBatchTask(const DataStoreTask *task) const
+{
+	return (task->getType() == TASK_INSERT_DATAOBJECT || 
+		task->getType() == TASK_INSERT_NODE);
+}
+
+void DataStore::doTask(DataStoreTask *task)
+{
+	executeTask(task);
+	delete task;
+}
+
+void DataStore::executeTask(DataStoreTask *task)
+{
+	//HAGGLE_DBG("Executing task with priority=%u timestamp=%s\n", 
+	//	   task->getPriority(), task->getTimestamp().getAsString().c_str());
+	
+	switch (task->getType()) {
+	case TASK_INSERT_DATAOBJECT:
+		_insertDataObject(*task->dObj, task->callback);
+		break;
+	case TASK_DELETE_DATAOBJECT:
+		_deleteDataObject(*task->dObj, true, task->boolParameter);
+		break;
+	case TASK_DELETE_DATAOBJECT_BY_ID:
+		_deleteDataObject(task->id, true, task->boolParameter);
+		break;
+	case TASK_AGE_DATAOBJECTS:
+		_ageDataObjects(*task->age, task->callback, task->boolParameter);
+		break;
+	case TASK_INSERT_NODE:
+		_insertNode(*task->node, task->callback, task->boolParameter);
+		break;
+	case TASK_DELETE_NODE:
+		_deleteNode(*task->node);
+		break;
+	case TASK_RETRIEVE_NODE:
+		_retrieveNode(*task->node, task->callback, task->boolParameter);
+		break;
+	case TASK_RETRIEVE_NODE_BY_TYPE:
+		_retrieveNode(task->nodeType, task->callback);
+		break;
+	case TASK_RETRIEVE_NODE_BY_INTERFACE:
+		_retrieveNode(*task->iface, task->callback, task->boolParameter);
+		break;
+	case TASK_ADD_FILTER:
+		cancelFilterMatch(task->f->getEventType());
+		_insertFilter(task->f, task->boolParameter, task->callback);
+		break;
+	case TASK_DELETE_FILTER:
+		cancelFilterMatch(*static_cast<long *>(task->data));
+		_deleteFilter(*static_cast<long *>(task->data));
+		break;
+	case TASK_FILTER_QUERY:
+		_doFilterQuery(task->query);
+		break;
+	case TASK_DATAOBJECT_QUERY:
+		_doDataObjectQuery(task->DOQuery);
+		break;
+	case TASK_DATAOBJECT_FOR_NODES_QUERY:
+		_doDataObjectForNodesQuery(task->DOForNodesQuery);
+		break;
+	case TASK_NODE_QUERY:
+		_doNodeQuery(task->NodeQuery);
+		break;
+	case TASK_INSERT_REPOSITORY:
+		_insertRepository(task->RepositoryQuery);
+		break;
+	case TASK_READ_REPOSITORY:
+		_readRepository(task->RepositoryQuery);
+		break;
+	case TASK_DELETE_REPOSITORY:
+		_deleteRepository(task->RepositoryQuery);
+		break;
+	case TASK_DUMP_DATASTORE:
+		dumpChunk(task->dumpCursor);
+		task->dumpCursor = NULL;
+		break;
+	case TASK_DUMP_DATASTORE_TO_FILE:
+		_dumpToFile(static_cast<string *>(task->data)->c_str());
+		break;
+	case TASK_CONFIGURE:
+		_configure(*static_cast<Metadata *>(task->data));
+		startReaders();
+		break;
+	case TASK_EVICT_DATAOBJECTS:
+		_evictDataObjects(task->EvictionQuery);
+		break;
+	case TASK_CHECKPOINT:
+		checkpoint();
+		break;
+	case TASK_FILTER_MATCH_PAGE:
+		// The remaining pages are not delivered when exiting
+		if (!shouldExit()) {
+			evaluateFilterPage(task->cursor);
+			task->cursor = NULL;
+		}
+		break;
 #ifdef DEBUG_DATASTORE
-		case TASK_DEBUG_PRINT:
-			HAGGLE_DBG("Printing data store\n");
-			_print();
-			HAGGLE_DBG("Done printing data store\n");
-			break;
+	case TASK_DEBUG_PRINT:
+		HAGGLE_DBG("Printing data store\n");
+		_print();
+		HAGGLE_DBG("Done printing data store\n");
+		break;
 #endif
-		case TASK_EXIT:
-			// Do not execute anymore tasks after this one.
-			HAGGLE_DBG("DataStore exit task\n");
-			/* 
-			 delete task;
-			 return false;
-			 */
-			LOG_ADD("%s DATA STORE EXIT TASK - number of tasks left=%lu\n", 
-				Timeval::now().getAsString().c_str(), taskQ.size());
-			break;
-		default:
-			HAGGLE_DBG("Undefined data store task\n");
+	case TASK_EXIT:
+		// Do not execute anymore tasks after this one.
+		HAGGLE_DBG("DataStore exit task\n");
+		/* 
+		 delete task;
+		 return false;
+		 */
+		LOG_ADD("%s DATA STORE EXIT TASK - number of tasks left=%lu\n", 
+			Timeval::now().getAsString().c_str(), taskQ.size());
+		break;
+	default:
+		HAGGLE_DBG("Undefined data store task\n");
+		break;
+	}
+}
+
+/*
+	Group commit: executes the given insert task and then keeps draining 
+	consecutive insert tasks from the task queue, so that a burst of 
+	inserts is committed with one transaction (and one sync to disk) 
+	instead of one per statement. The batch ends when the next task in 
+	the queue is not an insert, when the batch is full, or when the queue 
+	has been empty until the batch latency has passed.
+*/
+void DataStore::doTransactionBatch(DataStoreTask *task)
+{
+	List<DataStoreTask *> batch;
+	Timeval deadline = Timeval::now() + 
+		Timeval(maxTransactionLatency / 1000, (maxTransactionLatency % 1000) * 1000);
+
+	if (_beginTransaction() < 0) {
+		doTask(task);
+		return;
+	}
+	
+	holdEvents = true;
+	executeTask(task);
+	batch.push_back(task);
+
+	while (batch.size() < maxTransactionBatchSize) {
+		mutex.lock();
+
+		if (taskQ.empty() && !shouldExit()) {
+			Timeval now = Timeval::now();
+
+			if (now < deadline) {
+				Timeval left = deadline - now;
+				cond.timedWait(&mutex, left.getTimevalStruct());
+			}
+		}
+
+		if (taskQ.empty() || !isTransactionBatchTask(taskQ.front())) {
+			mutex.unlock();
 			break;
 		}
-		delete task;
+
+		task = taskQ.front();
+		taskQ.pop_front();
+
+		mutex.unlock();
+
+		executeTask(task);
+		batch.push_back(task);
+	}
+	
+	holdEvents = false;
+
+	if (_endTransaction() < 0) {
+		/*
+		  Nothing of the batch was stored, so its events are dropped
+		  and the tasks are executed again, each in a transaction of 
+		  its own.
+		 */
+		HAGGLE_ERR("Could not commit transaction with %lu tasks, executing them one by one\n", 
+			   batch.size());
+
+		while (!heldEvents.empty()) {
+			delete heldEvents.front();
+			heldEvents.pop_front();
+		}
+
+		for (List<DataStoreTask *>::iterator it = batch.begin(); it != batch.end(); it++)
+			executeTask(*it);
+	} else {
+		HAGGLE_DBG("Committed %lu tasks in one transaction\n", batch.size());
+
+		while (!heldEvents.empty()) {
+			kernel->addEvent(heldEvents.front());
+			heldEvents.pop_front();
+		}
+	}
+
+	while (!batch.empty()) {
+		delete batch.front();
+		batch.pop_front();
 	}
-	HAGGLE_DBG("DataStore exits...\n");
-	LOG_ADD("%s DATA STORE EXIT\n", Timeval::now().getAsString().c_str());
-	return false;
+}
+
+void DataStore::postEvent(Event *e)
+{
+	if (holdEvents)
+		heldEvents.push_back(e);
+	else
+		kernel->addEvent(e);
 }
 
 void DataStore::cleanup()
 {
 	HAGGLE_DBG("DataStore thread cleanup\n");
+
+	stopReaders();
 }
@@ -27,11 +27,19 @@ class DataStoreFilterQuery;
 class DataStoreDataObjectQuery;
 class DataStoreDataObjectForNodesQuery;
 class DataStoreRepositoryQuery;
+class DataStoreFilterCursor;
+class DataStoreDumpCursor;
+class DataStoreEvictionPolicy;
+class DataStoreEvictionCandidate;
+class DataStoreEvictionQuery;
 class DataStoreTask;
+class DataStoreReader;
 class DataStore;
 
 #include <libcpphaggle/Timeval.h>
 #include <libcpphaggle/List.h>
+#include <libcpphaggle/Map.h>
+#include <libcpphaggle/Heap.h>
 #include <libcpphaggle/Thread.h>
 
 #include "Metadata.h"
@@ -48,6 +56,65 @@ class DataStore;
 
 #define DATASTORE_MAX_DATAOBJECTS_AGED_AT_ONCE 3
 
+/*
+	Consecutive insert tasks in the task queue are committed as one 
+	transaction (group commit). The batch is closed when it holds 
+	this many tasks, or when no further insert task has arrived 
+	within the latency (in milliseconds) counted from the first task 
+	of the batch. A batch size of 1 disables group commit.
+*/
+#define DATASTORE_MAX_TRANSACTION_BATCH_SIZE 100
+#define DATASTORE_MAX_TRANSACTION_LATENCY 50
+
+/*
+	Query tasks can be served by a pool of reader threads, each with its 
+	own connection to the data store, while the data store thread itself 
+	handles inserts, deletes and aging. Zero reader threads means that 
+	all tasks are executed by the data store thread.
+*/
+#define DATASTORE_NUM_READER_THREADS 0
+#define DATASTORE_MAX_READER_THREADS 16
+
+/*
+	The data objects that match a newly registered filter are delivered 
+	in pages of this many data objects, ranked by match ratio and weight. 
+	The first page is delivered when the filter is inserted, and the 
+	following pages by low priority continuation tasks, so that a broad 
+	filter does not keep the data store thread busy. A page size of 0 
+	delivers all matching data objects at once.
+*/
+#define DATASTORE_FILTER_PAGE_SIZE 10
+
+/*
+	Eviction of data objects when the data store exceeds its storage 
+	budget. An eviction round removes at most the batch size number of 
+	data objects. Once the budget has been exceeded, the following rounds 
+	continue to evict until the usage is below the low watermark (in 
+	percent of the budget), so that eviction does not run for every 
+	inserted data object. The data objects are scored once, when the 
+	budget is found exceeded, and the following rounds evict the next 
+	batch of the candidates planned then.
+*/
+#define DATASTORE_EVICTION_BATCH_SIZE 10
+#define DATASTORE_EVICTION_LOW_WATERMARK 90
+
+/*
+	A data store that is not written to persistent storage as it goes 
+	(e.g., an in-memory database) is checkpointed at this interval, in 
+	seconds. A checkpoint is copied in slices by low priority tasks, so 
+	that other tasks are executed in between. An interval of 0 disables 
+	checkpointing.
+*/
+#define DATASTORE_CHECKPOINT_INTERVAL 0
+
+/*
+	A dump of the data store is delivered in chunks of at most this many 
+	rows (or data objects), and the next chunk is only produced when the 
+	receiver of the previous one asks for it. The dump thus never holds 
+	more than a chunk in memory, and a slow receiver paces the dump.
+*/
+#define DATASTORE_DUMP_CHUNK_SIZE 100
+
 class HaggleKernel;
 
 // Result returned from a query
@@ -218,15 +285,171 @@ public:
 	~DataStoreRepositoryQuery() {}
 };
 
+/**
+	The position of a filter match that is delivered in pages. The 
+	position is the rank of the last delivered data object, so that the 
+	next page starts after it even if data objects have been inserted or 
+	deleted in between.
+*/
+class DataStoreFilterCursor
+{
+public:
+	const long eventType;
+	// Backend specific identifier of the filter, e.g., its rowid. A 
+	// re-registered filter gets a new identifier, which ends the match
+	const int64_t filterId;
+	// True when at least one page has been delivered
+	bool started;
+	// Rank of the last delivered data object
+	long lastRatio;
+	long lastWeight;
+	int64_t lastNum;
+	unsigned long numPages;
+	unsigned long numDataObjects;
+	DataStoreFilterCursor(long _eventType, int64_t _filterId) : 
+		eventType(_eventType), filterId(_filterId), started(false), 
+		lastRatio(0), lastWeight(0), lastNum(0), numPages(0), numDataObjects(0) {}
+	// Moves the cursor past a delivered data object
+	void advance(long ratio, long weight, int64_t num) {
+		started = true;
+		lastRatio = ratio;
+		lastWeight = weight;
+		lastNum = num;
+		numDataObjects++;
+	}
+};
+
+/**
+	The storage budget of the data store, and the weights of the utility 
+	score that decides which data objects to evict first. Data objects 
+	with the lowest utility are evicted first, where
+
+	utility = interestWeight * interest + popularityWeight * popularity
+		  - ageWeight * age - sizeWeight * size
+
+	The interest is the number of node (and application) interests that 
+	the data object matches, the popularity is the number of times it 
+	has been sent, the age is the number of hours since it was inserted, 
+	and the size is the data and metadata size in kilobytes. Node 
+	descriptions are never evicted.
+*/
+class DataStoreEvictionPolicy
+{
+public:
+	unsigned long long maxBytes; // 0 means no byte budget
+	unsigned long maxDataObjects; // 0 means no data object budget
+	unsigned long batchSize;
+	double interestWeight;
+	double popularityWeight;
+	double ageWeight;
+	double sizeWeight;
+	DataStoreEvictionPolicy();
+	bool isEnabled() const { return maxBytes > 0 || maxDataObjects > 0; }
+	/*
+		Returns true if the usage exceeds the budget, or, when 
+		continuing an eviction, the low watermark of the budget.
+	*/
+	bool isOverBudget(unsigned long numDataObjects, unsigned long long bytes, bool continuing) const;
+	double getUtility(unsigned long interest, unsigned long popularity, double ageSeconds, unsigned long long size) const;
+};
+
+/**
+	A data object that may be evicted. The identifier is specific to 
+	the data store backend, e.g., the rowid.
+*/
+class DataStoreEvictionCandidate : public HeapItem
+{
+public:
+	const int64_t num;
+	const unsigned long long size;
+	const double utility;
+	DataStoreEvictionCandidate(int64_t _num, unsigned long long _size, double _utility) : 
+		num(_num), size(_size), utility(_utility) {}
+	// The candidate with the highest utility is first in the heap, so 
+	// that it is the one dropped when the heap is full
+	bool compare_less(const HeapItem& i) const { 
+		return utility > static_cast<const DataStoreEvictionCandidate&>(i).utility; 
+	}
+	bool compare_greater(const HeapItem& i) const { 
+		return utility < static_cast<const DataStoreEvictionCandidate&>(i).utility; 
+	}
+};
+
+/**
+	An eviction round. When the round does not continue an eviction, the 
+	backend scores every data object that may be evicted through 
+	addCandidate(), and plans the evictions with getCandidates(). A 
+	continuing round has no popularity counts, as it only evicts from 
+	the plan.
+*/
+class DataStoreEvictionQuery
+{
+	const DataStoreEvictionPolicy policy;
+	// The number of times data objects have been sent, by id
+	const Map<string, unsigned long> popularity;
+	const EventCallback<EventHandler> *callback;
+	const bool continuing;
+	const bool keepInBloomfilter;
+	Heap candidates;
+public:
+	DataStoreEvictionQuery(const DataStoreEvictionPolicy& _policy, const Map<string, unsigned long>& _popularity, 
+			       const EventCallback<EventHandler> *_callback, bool _continuing, bool _keepInBloomfilter) :
+		policy(_policy), popularity(_popularity), callback(_callback), 
+		continuing(_continuing), keepInBloomfilter(_keepInBloomfilter) {}
+	~DataStoreEvictionQuery();
+	const DataStoreEvictionPolicy& getPolicy() const { return policy; }
+	const EventCallback<EventHandler> *getCallback() const { return callback; }
+	bool isContinuing() const { return continuing; }
+	bool getKeepInBloomfilter() const { return keepInBloomfilter; }
+	void addCandidate(int64_t num, const string& id, unsigned long interest, double ageSeconds, unsigned long long size);
+	/*
+		Moves the candidates that must be evicted to bring the given 
+		usage below the low watermark to the list, lowest utility 
+		first. The caller deletes them.
+	*/
+	void getCandidates(List<DataStoreEvictionCandidate *>& l, unsigned long numDataObjects, unsigned long long bytes);
+};
+
+/**
+	The position of a data store dump that is delivered in chunks. The 
+	position is backend specific, e.g., the table being dumped and the 
+	rowid of the last dumped row in it.
+*/
+class DataStoreDumpCursor
+{
+public:
+	const EventCallback<EventHandler> *callback;
+	// True when the first chunk has been produced
+	bool started;
+	unsigned int part;
+	int64_t lastRow;
+	unsigned long numChunks;
+	unsigned long numRows;
+	DataStoreDumpCursor(const EventCallback<EventHandler> *_callback) : 
+		callback(_callback), started(false), part(0), lastRow(0), 
+		numChunks(0), numRows(0) {}
+};
+
+/**
+	A chunk of a data store dump. The chunks of a dump concatenated form 
+	one XML document, without an XML declaration. All chunks but the last 
+	one carry the cursor of the dump, which the receiver passes back to 
+	DataStore::continueDump() to get the next chunk. A cursor that is not 
+	taken is deleted with the chunk, which ends the dump.
+*/
 class DataStoreDump
 {
         char *data;
         size_t len;
+	DataStoreDumpCursor *cursor;
     public:
 	size_t getLen() { return len; }
         const char *getData() { return data; }
-        DataStoreDump(char *_data, const size_t _len) : data(_data), len(_len) {}
-        ~DataStoreDump() { if (data) free(data); }
+	bool isLast() const { return cursor == NULL; }
+	DataStoreDumpCursor *takeCursor() { DataStoreDumpCursor *c = cursor; cursor = NULL; return c; }
+        DataStoreDump(char *_data, const size_t _len, DataStoreDumpCursor *_cursor = NULL) : 
+		data(_data), len(_len), cursor(_cursor) {}
+        ~DataStoreDump() { if (data) free(data); if (cursor) delete cursor; }
 };
 
 /*
@@ -255,6 +478,10 @@ typedef enum {
 	TASK_DELETE_REPOSITORY,
 	TASK_DUMP_DATASTORE,
 	TASK_DUMP_DATASTORE_TO_FILE,
+	TASK_CONFIGURE,
+	TASK_FILTER_MATCH_PAGE,
+	TASK_EVICT_DATAOBJECTS,
+	TASK_CHECKPOINT,
 #ifdef DEBUG_DATASTORE
 	TASK_DEBUG_PRINT,
 #endif
@@ -265,19 +492,23 @@ typedef enum {
 /** */
 class DataStoreTask
 {
+public:
 	/*
-	 The priority decides how a task is sorted in the data store's task queue.
-	 Higher priorities should be lower to be sorted first as our heap implementation
-	 is a min-heap.
+	 The priority decides in which of the data store's task queues a task
+	 is put. The queue of a higher priority is always drained first, so
+	 higher priorities should be lower.
 	 */
 	typedef enum {
 		TASK_PRIORITY_HIGH,
 		TASK_PRIORITY_MEDIUM,
-		TASK_PRIORITY_LOW
+		TASK_PRIORITY_LOW,
+		_TASK_PRIORITY_MAX
 	} Priority_t;
+private:
 	static unsigned long totNum;
 	static const char *taskName[_TASK_MAX];
 	friend class DataStore;
+	friend class DataStoreReader;
 	TaskType type;
 	Priority_t priority;
 	unsigned long num;
@@ -290,6 +521,9 @@ class DataStoreTask
 		DataStoreDataObjectForNodesQuery *DOForNodesQuery;
 		DataStoreNodeQuery *NodeQuery;
 		DataStoreRepositoryQuery *RepositoryQuery;
+		DataStoreFilterCursor *cursor;
+		DataStoreEvictionQuery *EvictionQuery;
+		DataStoreDumpCursor *dumpCursor;
 		NodeRef *node;
 		DataObjectRef *dObj;
 		InterfaceRef *iface;
@@ -311,6 +545,9 @@ public:
         DataStoreTask(DataStoreDataObjectForNodesQuery *q, TaskType _type = TASK_DATAOBJECT_FOR_NODES_QUERY);
 	DataStoreTask(DataStoreNodeQuery *q, TaskType _type = TASK_NODE_QUERY);
 	DataStoreTask(DataStoreRepositoryQuery *q, TaskType _type);
+	DataStoreTask(DataStoreFilterCursor *c, TaskType _type = TASK_FILTER_MATCH_PAGE);
+	DataStoreTask(DataStoreEvictionQuery *q, TaskType _type = TASK_EVICT_DATAOBJECTS);
+	DataStoreTask(DataStoreDumpCursor *c, TaskType _type = TASK_DUMP_DATASTORE);
 	DataStoreTask(const Filter& _f, TaskType _type, const EventCallback<EventHandler> *_callback = NULL, bool _boolParameter = false);
 	DataStoreTask(TaskType _type, void *_data = NULL, const EventCallback<EventHandler> *_callback = NULL);
 	DataStoreTask(const Timeval &_age, TaskType _type = TASK_AGE_DATAOBJECTS, const EventCallback<EventHandler> *_callback = NULL, bool keepInBloomfilter = false);
@@ -320,12 +557,57 @@ public:
 
 	const TaskType& getType() const { return type; }
 	const Priority_t& getPriority() const { return priority; }
-	// getKey() is overridden from the HeapItem class and decides how the task
-	// is sorted in the task queue.
+	// The time the task was created, which is also the time it was queued
 	const Timeval& getTimestamp() const { return timestamp; }
 };
 
 
+/**
+	Task queue metrics. The wait time of a task is the time from when 
+	it was queued until it was taken from the queue for execution.
+*/
+class DataStoreTaskQueueStats
+{
+public:
+	unsigned long length; // Current number of queued tasks
+	unsigned long lengthByPriority[DataStoreTask::_TASK_PRIORITY_MAX];
+	unsigned long maxLength; // Highest number of queued tasks
+	unsigned long numQueued; // Number of tasks inserted into the queue
+	unsigned long numExecuted; // Number of tasks taken from the queue
+	unsigned long numCoalesced; // Number of tasks merged into a pending task
+	unsigned long numCancelled; // Number of tasks removed before execution
+	Timeval totalWait; // Sum of the wait times of the tasks taken
+	Timeval maxWait; // Longest wait time of a task
+	DataStoreTaskQueueStats();
+	// Average wait time in milliseconds
+	double getAverageWait() const;
+};
+
+/**
+	A reader thread that executes query tasks on behalf of a data store.
+	The reader owns a backend instance (created by the data store's 
+	_createReader()) with its own connection, and has its own task queue 
+	to which the data store thread hands the query tasks.
+*/
+class DataStoreReader : public Runnable
+{
+	friend class DataStore;
+	DataStore *ds;
+	DataStore *backend;
+	List<DataStoreTask *> taskQ;
+	// Number of tasks queued or being executed, protected by the mutex
+	unsigned long load;
+	bool run();
+	void cleanup();
+	void hookCancel();
+public:
+	DataStoreReader(DataStore *_ds, DataStore *_backend, const string name = "DataStoreReader");
+	~DataStoreReader();
+	void addTask(DataStoreTask *task);
+	unsigned long getLoad();
+	int cancelDataObjectQueries(const NodeRef& node);
+};
+
 // This is an abstract DataStore class. From this it should be
 // possible to implement several backends, e.g., based on XML or SQL
 /** */
@@ -335,13 +617,92 @@ class DataStore :
 #endif
 	public Runnable
 {
-        // The runnable class's mutex protects the task Queue
-	class TaskQueue : public List<DataStoreTask *> {
+	/*
+		The task queue keeps one FIFO queue per priority. Tasks of equal 
+		priority are executed in the order they were inserted, which is 
+		also their timestamp order, so insert and pop are O(1).
+		
+		Redundant pending tasks are coalesced on insert: a data object 
+		query for a node that already has an identical query pending, 
+		and a node insert for a node that already has an insert 
+		pending, update the pending task in place instead of being 
+		queued. Coalescible tasks are indexed by a key that identifies 
+		the work they do.
+
+		The runnable class's mutex protects the task queue.
+	*/
+	class TaskQueue {
+		List<DataStoreTask *> queues[DataStoreTask::_TASK_PRIORITY_MAX];
+		Map<string, DataStoreTask *> pending;
+		DataStoreTaskQueueStats stats;
+		// Returns the coalescing key of a task, or an empty string
+		// if the task cannot be coalesced
+		static string coalesceKey(const DataStoreTask *task);
+		// Merges the task into an equivalent pending task. Returns 
+		// true if it did, in which case the task has been deleted
+		bool coalesce(DataStoreTask *task, const string& key);
+		void unindex(DataStoreTask *task);
 	public:
-		TaskQueue() {}
-		~TaskQueue() {}
+		TaskQueue();
+		~TaskQueue();
 		void insert(DataStoreTask *task);
+		bool empty() const { return stats.length == 0; }
+		unsigned long size() const { return stats.length; }
+		DataStoreTask *front();
+		void pop_front();
+		// Removes and deletes the pending data object queries for a node
+		int cancelDataObjectQueries(const NodeRef& node);
+		// Removes and deletes the pending pages of a filter match
+		int cancelFilterMatch(long eventType);
+		const DataStoreTaskQueueStats& getStats() const { return stats; }
 	} taskQ;
+	friend class DataStoreReader;
+	// Group commit parameters, only accessed by the data store thread
+	unsigned long maxTransactionBatchSize;
+	unsigned long maxTransactionLatency;
+	// True while the tasks of a transaction batch are executed, in 
+	// which case posted events are held back until the batch commits
+	bool holdEvents;
+	List<Event *> heldEvents;
+	// Number of data objects per page of a filter match, only accessed 
+	// by the data store thread
+	unsigned long filterPageSize;
+	// Checkpoint parameters and state, only accessed by the data store 
+	// thread
+	unsigned long checkpointInterval;
+	Timeval nextCheckpoint;
+	bool checkpointInProgress;
+	// Queues a checkpoint task if a checkpoint is due. Called with the 
+	// mutex held
+	void scheduleCheckpoint();
+	// Copies one slice of a checkpoint, and queues a continuation task 
+	// if the checkpoint is not complete
+	void checkpoint();
+	// Produces the next chunk of a dump and delivers it in the callback
+	void dumpChunk(DataStoreDumpCursor *c);
+	// The reader threads. The list is only modified by the data store 
+	// thread while holding the mutex, so that other threads may access 
+	// it with the mutex held
+	unsigned long numReaderThreads;
+	List<DataStoreReader *> readers;
+	// Returns true if the task may be handed to a reader thread
+	bool isReaderTask(const DataStoreTask *task) const;
+	// Starts reader threads up to the configured number
+	void startReaders();
+	// Stops and deletes the reader threads
+	void stopReaders();
+	// Hands the task to the reader thread with the lowest load
+	void dispatchToReader(DataStoreTask *task);
+	// Returns true if the task may be part of a group commit
+	bool isTransactionBatchTask(const DataStoreTask *task) const;
+	// Executes a task
+	void executeTask(DataStoreTask *task);
+	// Executes a task and deletes it
+	void doTask(DataStoreTask *task);
+	// Cancels the pending pages of the match of a replaced or deleted filter
+	void cancelFilterMatch(long eventType);
+	// Executes the task and any consecutive insert tasks within one transaction
+	void doTransactionBatch(DataStoreTask *task);
         // run() is the function executed by the thread
         bool run();
         // cleanup() is called when the thread is stopped or cancelled
@@ -350,6 +711,13 @@ class DataStore :
 protected:
 	friend class HaggleKernel;
 	HaggleKernel *kernel;
+	/*
+		Posts an event to the kernel. Within a transaction batch, the
+		event is only posted once the batch has committed, so that 
+		no one is told about data objects or nodes that were rolled 
+		back.
+	*/
+	void postEvent(Event *e);
 
 	// Functions acting on the DataStore through the task queue
 	virtual int _insertNode(NodeRef& node, const EventCallback<EventHandler> *callback = NULL, bool mergeBloomfilter = false) = 0;
@@ -361,6 +729,22 @@ protected:
 	virtual int _deleteDataObject(const DataObjectId_t &id, bool shouldReportRemoval = true, bool keepInBloomfilter = false) = 0;
 	virtual int _deleteDataObject(DataObjectRef& dObj, bool shouldReportRemoval = true, bool keepInBloomfilter = false) = 0;
 	virtual int _ageDataObjects(const Timeval& minimumAge, const EventCallback<EventHandler> *callback = NULL, bool keepInBloomfilter = false) = 0;
+	/*
+		Evicts the data objects with the lowest utility if the data 
+		store is over its budget. Like aging, the evicted data objects 
+		are reported in a EVENT_TYPE_DATAOBJECT_DELETED event, and in 
+		the callback (with an empty list if nothing was evicted).
+		Returns: the number of evicted data objects, or -1 on error.
+	*/
+	virtual int _evictDataObjects(DataStoreEvictionQuery *q) = 0;
+	/*
+		The planned evictions of the eviction in progress, lowest 
+		utility first. A round that does not continue an eviction 
+		replaces the plan, and the continuing rounds evict the next 
+		batch of it. Only accessed by the data store thread.
+	*/
+	List<DataStoreEvictionCandidate *> evictionPlan;
+	void clearEvictionPlan();
 	virtual int _insertFilter(Filter *f, bool matchFilter = false, const EventCallback<EventHandler> *callback = NULL) = 0;
 	virtual int _deleteFilter(long eventtype) = 0;
 	virtual int _doFilterQuery(DataStoreFilterQuery *q) = 0;
@@ -370,8 +754,63 @@ protected:
 	virtual int _insertRepository(DataStoreRepositoryQuery* q) = 0;
 	virtual int _readRepository(DataStoreRepositoryQuery* q, const EventCallback<EventHandler> *callback = NULL) = 0;
 	virtual int _deleteRepository(DataStoreRepositoryQuery* q) = 0;
-	virtual int _dump(const EventCallback<EventHandler> *callback = NULL) = 0;
+	/*
+		Serializes the next at most max rows of a dump, starting after 
+		the cursor, into a buffer allocated with malloc(), and advances 
+		the cursor. The first chunk opens the root element of the dump 
+		and the last one closes it.
+		Returns: 1 if there are rows left to dump, 0 when the dump is 
+		complete, or -1 on failure.
+	*/
+	virtual int _dump(DataStoreDumpCursor *c, unsigned long max, char **data, size_t *len) = 0;
 	virtual int _dumpToFile(const char *filename) = 0;
+	/*
+		Delivers the next page of the data objects that match a filter, 
+		at most max data objects (0 means no limit) ranked after the 
+		cursor by descending match ratio, filter attribute weight and 
+		insertion order (newest first). The cursor is advanced past the 
+		delivered data objects.
+		Returns: the number of data objects delivered, or -1 on error.
+	*/
+	virtual int _evaluateFilterPage(DataStoreFilterCursor *c, unsigned long max) = 0;
+	/*
+		Delivers the first page of a filter match, and queues a 
+		continuation task for the next page if the page was full. 
+		Takes ownership of the cursor.
+	*/
+	void evaluateFilterPage(DataStoreFilterCursor *c);
+	/*
+		Transaction hooks for group commit. A backend that does not 
+		support transactions can rely on the default implementations, 
+		in which case every task is committed on its own.
+		Returns: 0 on success, or -1 on failure.
+	*/
+	virtual int _beginTransaction() { return -1; }
+	virtual int _endTransaction() { return -1; }
+	/*
+		Applies the <DataStore> section of the configuration. Derived 
+		classes that override this function should also call the base 
+		class version, which handles the group commit parameters.
+	*/
+	virtual int _configure(const Metadata& m);
+	/*
+		Creates a backend instance, with its own connection to the 
+		data store, that a reader thread uses to execute queries. 
+		The instance must be safe to use concurrently with this one. 
+		A backend that does not support reader threads can rely on 
+		the default implementation.
+		Returns: the reader instance, or NULL on failure.
+	*/
+	virtual DataStore *_createReader() { return NULL; }
+	/*
+		Copies the next slice of a checkpoint of the data store to 
+		persistent storage, starting a new checkpoint if none is in 
+		progress. A backend that always writes to persistent storage 
+		can rely on the default implementation.
+		Returns: 1 if there are slices left to copy, 0 when the 
+		checkpoint is complete, or -1 on failure.
+	*/
+	virtual int _checkpoint() { return 0; }
 
 #ifdef DEBUG_DATASTORE
 	virtual void _print() {};
@@ -382,7 +821,14 @@ public:
 #ifdef DEBUG_LEAKS
 			LeakMonitor(LEAK_TYPE_DATASTORE),
 #endif
-			Runnable(name)
+			Runnable(name),
+			maxTransactionBatchSize(DATASTORE_MAX_TRANSACTION_BATCH_SIZE),
+			maxTransactionLatency(DATASTORE_MAX_TRANSACTION_LATENCY),
+			holdEvents(false),
+			filterPageSize(DATASTORE_FILTER_PAGE_SIZE),
+			checkpointInterval(DATASTORE_CHECKPOINT_INTERVAL),
+			checkpointInProgress(false),
+			numReaderThreads(DATASTORE_NUM_READER_THREADS)
 		{}
         virtual ~DataStore();
 
@@ -401,15 +847,22 @@ public:
 	// throught the task queue
 
         /**
-           Dump the data store to memory which is returned in a
-           callback as a DataStoreDump object. The dump object must be
-           deleted in the callback to avoid memory leaks.
+           Dump the data store to memory, which is returned in chunks
+           in the callback as DataStoreDump objects. Only the first
+           chunk is produced by this call, the following ones are
+           produced one at a time by continueDump(). The dump object
+           must be deleted in the callback to avoid memory leaks.
 
            @param callback the callback context to return the dump to
-           @returns 0 on success, or negative on failure.
            
          */
         void dump(const EventCallback<EventHandler> *callback = NULL);
+        /**
+           Produce the next chunk of a dump, given the cursor taken
+           from the previous chunk. The data store takes ownership of
+           the cursor.
+         */
+        void continueDump(DataStoreDumpCursor *c);
         /**
            Dump the data store to a file. The function works asynchronously.
 
@@ -428,6 +881,13 @@ public:
 	void deleteDataObject(const DataObjectId_t id, bool keepInBloomfilter = false);
 	void deleteDataObject(DataObjectRef& dObj, bool keepInBloomfilter = false);
 	void ageDataObjects(const Timeval& minimumAge, const EventCallback<EventHandler> *callback = NULL, bool keepInBloomfilter = false);
+	/**
+	   Runs an eviction round with the given policy and popularity counts 
+	   (by data object id). Continuing is true if the round follows a 
+	   round that evicted a full batch.
+	 */
+	void evictDataObjects(const DataStoreEvictionPolicy& policy, const Map<string, unsigned long>& popularity, 
+			      const EventCallback<EventHandler> *callback = NULL, bool continuing = false, bool keepInBloomfilter = false);
 	void insertFilter(const Filter& f, bool matchFilter = false, const EventCallback<EventHandler> *callback = NULL);
 	void deleteFilter(long eventtype);
 	void doFilterQuery(const Filter *f, EventCallback<EventHandler> *callback);
@@ -446,7 +906,15 @@ public:
 	// Query cancel functions. Returns the number of queries removed, or -1 on error.
 	int cancelDataObjectQueries(const NodeRef& node);
 
-	void onConfig();
+	// Returns a copy of the task queue metrics
+	DataStoreTaskQueueStats getTaskQueueStats();
+
+	/**
+	   Configure the data store from the <DataStore> section of the 
+	   configuration. The metadata is copied and applied asynchronously 
+	   by the data store thread.
+	 */
+	void onConfig(const Metadata& m);
 
 };
 
@@ -48,7 +48,8 @@ SOCKET openSocket(int port);
 
 DebugManager::DebugManager(HaggleKernel * _kernel, bool _interactive) : 
 	Manager("DebugManager", _kernel), onFindRepositoryKeyCallback(NULL), 
-	onDumpDataStoreCallback(NULL), server_sock(-1), interactive(_interactive), console(INVALID_STDIN)
+	onDumpDataStoreCallback(NULL), server_sock(-1), dumpInProgress(false), 
+	interactive(_interactive), console(INVALID_STDIN)
 {
 }
 
@@ -198,17 +199,10 @@ static bool sendBuffer(SOCKET sock, const void *data, size_t toSend)
 		ssize_t ret = send(sock, (char *)data + i, toSend, 0);
         
 		if (ret == -1) {
-#if defined(OS_WINDOWS)
-			if (WSAGetLastError() != WSAEWOULDBLOCK) {
-				HAGGLE_ERR("Could not write HTTP to socket err=%d\n", ERRNO);
-				goto out;
-			}
-#else
-			if (errno != EAGAIN) {
-				HAGGLE_ERR("Could not write HTTP to socket err=%d\n", errno);
-				goto out;
-			}
-#endif
+			// The client sockets have a send timeout, so this 
+			// also happens when a client does not keep up
+			HAGGLE_ERR("Could not write HTTP to socket err=%d\n", ERRNO);
+			goto out;
 		} else {
 			toSend -= ret;
 			i += ret;
@@ -234,23 +228,18 @@ static size_t skipXMLTag(const char *data, size_t len)
 	return i;
 }
 
-void DebugManager::dumpTo(SOCKET client_sock, DataStoreDump *dump)
+bool DebugManager::sendDumpHeader(SOCKET client_sock)
 {
-	size_t toSend = dump->getLen();
-	const char *data = dump->getData();
-	size_t i = 0;
-	
-	i = skipXMLTag(data, toSend);
-	toSend -= i;
 	// Send the <?xml version="1.0"?> tag:
 	if (!sendString(client_sock, "<?xml version=\"1.0\"?>\n"))
-		return;
+		return false;
 	// Send the root tag:
-	if (!sendString(client_sock, "<HaggleInfo>"))
-		return;
-	// Send the data:
-	if (!sendBuffer(client_sock, &(data[i]), toSend))
-		return;
+	return sendString(client_sock, "<HaggleInfo>");
+}
+
+bool DebugManager::sendDumpTrailer(SOCKET client_sock)
+{
+	size_t i = 0;
 	
         DataObjectRef dObj = kernel->getThisNode()->getDataObject(false);
         unsigned char *buf;
@@ -260,15 +249,15 @@ void DebugManager::dumpTo(SOCKET client_sock, DataStoreDump *dump)
                 len -= i;
                 if (!sendString(client_sock, "<ThisNode>\n")) {
 			free(buf);
-			return;
+			return false;
 		}
                 if (!sendBuffer(client_sock, &(buf[i]), len)) {
 			free(buf);
-			return;
+			return false;
 		}
                 if (!sendString(client_sock, "</ThisNode>\n")) {
 			free(buf);
-			return;
+			return false;
 		}
                 free(buf);
         }
@@ -291,15 +280,15 @@ void DebugManager::dumpTo(SOCKET client_sock, DataStoreDump *dump)
                                 len -= i;
                                 if (!sendString(client_sock, "<RoutingData>\n")) {
 					free(buf);
-					return;
+					return false;
 				}
                                 if (!sendBuffer(client_sock, &(buf[i]), len)) {
 					free(buf);
-					return;
+					return false;
 				}
                                 if (!sendString(client_sock, "</RoutingData>\n")) {
 					free(buf);
-					return;
+					return false;
 				}
                                 free(buf);
                         }
@@ -311,21 +300,53 @@ void DebugManager::dumpTo(SOCKET client_sock, DataStoreDump *dump)
         kernel->getNodeStore()->retrieveNeighbors(nl);
         if (!nl.empty()) {
                 if (!sendString(client_sock, "<NeighborInfo>\n"))
-                        return;
+                        return false;
                 for (NodeRefList::iterator it = nl.begin(); it != nl.end(); it++) {
                         if (!sendString(client_sock, "<Neighbor>"))
-                                return;
+                                return false;
                         if (!sendString(client_sock, (*it)->getIdStr()))
-                                return;
+                                return false;
                         if (!sendString(client_sock, "</Neighbor>\n"))
-                                return;
+                                return false;
                 }
                 if (!sendString(client_sock, "</NeighborInfo>\n"))
-                        return;
+                        return false;
         }
 	
 	// Send the end of the root tag:
-	sendString(client_sock, "</HaggleInfo>");
+	return sendString(client_sock, "</HaggleInfo>");
+}
+
+void DebugManager::closeClient(SOCKET client_sock)
+{
+	kernel->unregisterWatchable(client_sock);
+	CLOSE_SOCKET(client_sock);
+}
+
+/*
+	Starts a dump for the waiting clients. The data store produces the 
+	dump one chunk at a time, and the next chunk is only asked for once 
+	the previous one has been written to the clients. A client that does 
+	not keep up thus paces the dump, until it is dropped by the send 
+	timeout.
+*/
+void DebugManager::startDump()
+{
+	while (!waiting_sockets.empty()) {
+		SOCKET client_sock = waiting_sockets.front();
+
+		waiting_sockets.pop_front();
+
+		if (sendDumpHeader(client_sock))
+			client_sockets.push_back(client_sock);
+		else
+			closeClient(client_sock);
+	}
+
+	if (!client_sockets.empty()) {
+		dumpInProgress = true;
+		kernel->getDataStore()->dump(onDumpDataStoreCallback);
+	}
 }
 
 void DebugManager::onDumpDataStore(Event *e)
@@ -334,13 +355,31 @@ void DebugManager::onDumpDataStore(Event *e)
 		return;
 	
 	DataStoreDump *dump = static_cast <DataStoreDump *>(e->getData());
+	List<SOCKET>::iterator it = client_sockets.begin();
+
+	while (it != client_sockets.end()) {
+		if (!sendBuffer(*it, dump->getData(), dump->getLen()) || 
+		    (dump->isLast() && !sendDumpTrailer(*it))) {
+			closeClient(*it);
+			it = client_sockets.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	if (dump->isLast()) {
+		for (it = client_sockets.begin(); it != client_sockets.end(); it++)
+			closeClient(*it);
+		client_sockets.clear();
+	}
 	
-	for (List<SOCKET>::iterator it = client_sockets.begin(); it != client_sockets.end(); it++) {
-		dumpTo(*it, dump);
-		kernel->unregisterWatchable(*it);
-		CLOSE_SOCKET(*it);
+	if (!client_sockets.empty()) {
+		kernel->getDataStore()->continueDump(dump->takeCursor());
+	} else {
+		// The dump ends when the cursor is deleted with the chunk
+		dumpInProgress = false;
+		startDump();
 	}
-	client_sockets.clear();
 	
 	delete dump;
 }
@@ -351,12 +390,13 @@ void DebugManager::onShutdown()
 		kernel->unregisterWatchable(server_sock);
 		CLOSE_SOCKET(server_sock);
 	}
-	if (!client_sockets.empty()) {
-		for (List<SOCKET>::iterator it = client_sockets.begin(); it != client_sockets.end(); it++) {
-			kernel->unregisterWatchable(*it);
-			CLOSE_SOCKET(*it);
-		}
-	}
+	for (List<SOCKET>::iterator it = client_sockets.begin(); it != client_sockets.end(); it++)
+		closeClient(*it);
+	client_sockets.clear();
+
+	for (List<SOCKET>::iterator it = waiting_sockets.begin(); it != waiting_sockets.end(); it++)
+		closeClient(*it);
+	waiting_sockets.clear();
 	
 #if defined(OS_LINUX) || defined(OS_MACOSX)
 	if (console != -1) {
@@ -376,6 +416,11 @@ void DebugManager::onDebugReport(Event *e)
 {
 	LOG_ADD("%s: kernel event queue size=%lu\n", 
 		Timeval::now().getAsString().c_str(), kernel->size()); 
+	DataStoreTaskQueueStats stats = kernel->getDataStore()->getTaskQueueStats();
+	LOG_ADD("%s: data store task queue size=%lu max=%lu coalesced=%lu avg wait=%.3lf ms max wait=%.3lf ms\n", 
+		Timeval::now().getAsString().c_str(), stats.length, stats.maxLength, 
+		stats.numCoalesced, stats.getAverageWait(), 
+		stats.maxWait.getTimeAsMilliSecondsDouble());
 	kernel->getNodeStore()->print();
 	kernel->getInterfaceStore()->print();
 
@@ -402,15 +447,25 @@ void DebugManager::onWatchableEvent(const Watchable& wbl)
 		client_sock = accept(server_sock, &cliaddr, &len);
 	
 		if (client_sock != INVALID_SOCKET) {
+#if defined(OS_WINDOWS)
+			DWORD timeout = DEBUG_CLIENT_SEND_TIMEOUT * 1000;
+#else
+			struct timeval timeout = { DEBUG_CLIENT_SEND_TIMEOUT, 0 };
+#endif
 			HAGGLE_DBG("Registering client socket: %ld\n", client_sock);
+
+			if (setsockopt(client_sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout)) == -1) {
+				HAGGLE_ERR("Could not set send timeout on client socket err=%d\n", ERRNO);
+			}
 			if (!kernel->registerWatchable(client_sock, this)) {
 				CLOSE_SOCKET(client_sock);
 				return;
 			}
-			if (client_sockets.empty())
-				kernel->getDataStore()->dump(onDumpDataStoreCallback);
 
-			client_sockets.push_back(client_sock);
+			waiting_sockets.push_back(client_sock);
+
+			if (!dumpInProgress)
+				startDump();
 		} else {
 			HAGGLE_DBG("accept failed: %ld\n", client_sock);
 		}
@@ -50,6 +50,9 @@ using namespace haggle;
 
 #define DATABUF_LEN 2048
 
+// Seconds a dump client may stall a send before it is dropped
+#define DEBUG_CLIENT_SEND_TIMEOUT 5
+
 /** */
 class DebugManager : public Manager
 {
@@ -57,7 +60,11 @@ private:
 	EventCallback<EventHandler> *onFindRepositoryKeyCallback;
 	EventCallback<EventHandler> *onDumpDataStoreCallback;
         SOCKET server_sock;
+	// The clients receiving the dump in progress
 	List<SOCKET> client_sockets;
+	// The clients that connected during a dump, and get the next one
+	List<SOCKET> waiting_sockets;
+	bool dumpInProgress;
 	bool interactive;
 #if defined(OS_LINUX) || defined(OS_MACOSX)
 #define INVALID_STDIN -1
@@ -71,7 +78,10 @@ private:
 #ifdef DEBUG
         EventType debugEType;
 #endif
-	void dumpTo(SOCKET client_sock, DataStoreDump *dump);
+	void startDump();
+	void closeClient(SOCKET client_sock);
+	bool sendDumpHeader(SOCKET client_sock);
+	bool sendDumpTrailer(SOCKET client_sock);
 	bool init_derived();
 public:
         DebugManager(HaggleKernel *_kernel = haggleKernel, bool interactive = true);
@@ -793,11 +793,19 @@ int Event::unregisterType(EventType _type)
 }
 
 
+/*
+	Events with the same timeout are ordered by the sequence number the
+	event queue gave them, i.e., in the order they were added.
+*/
 bool Event::compare_less(const HeapItem& i) const
 {
-	return (timeout < static_cast<const Event&>(i).timeout);
+	const Event& e = static_cast<const Event&>(i);
+
+	return (timeout < e.timeout || (timeout == e.timeout && sequence < e.sequence));
 }
 bool Event::compare_greater(const HeapItem& i) const
 {
-	return (timeout > static_cast<const Event&>(i).timeout);
+	const Event& e = static_cast<const Event&>(i);
+
+	return (timeout > e.timeout || (timeout == e.timeout && sequence > e.sequence));
 }
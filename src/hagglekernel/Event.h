@@ -29,6 +29,7 @@ typedef int EventType;
 #include <haggleutils.h>
 
 #include <libcpphaggle/Heap.h>
+#include <libcpphaggle/TimerWheel.h>
 #include <libcpphaggle/Timeval.h>
 
 #include "DataObject.h"
@@ -269,6 +270,11 @@ protected:
                 
 		return NULL;
         }
+	/*
+		Called after an event interest has been added or removed, so
+		that the interests can be tracked outside the handler.
+	*/
+	virtual void onEventInterestChange(EventType type) {}
 	int addEventInterest(EventType type, EventCallback<EventHandler> *callback) {
 		if (EVENT_TYPE_PUBLIC(type)) {
 			if (callbacks[type]) {
@@ -276,6 +282,7 @@ protected:
 				delete callback;
 			} else {
 				callbacks[type] = callback;
+				onEventInterestChange(type);
 				return 0;
 			}
 		}
@@ -285,6 +292,7 @@ protected:
 		if (EVENT_TYPE_PUBLIC(type)) {
 			delete callbacks[type];
 			callbacks[type] = NULL;
+			onEventInterestChange(type);
 			return 0;
 		}
 		return -1;
@@ -322,9 +330,9 @@ protected:
 	} while(0)
 /** */
 #ifdef DEBUG_LEAKS
-class Event : public LeakMonitor, public HeapItem
+class Event : public LeakMonitor, public HeapItem, public TimerWheelItem
 #else
-class Event : public HeapItem
+class Event : public HeapItem, public TimerWheelItem
 #endif
 {
 private:
@@ -335,6 +343,10 @@ private:
 	Timeval timeout;
 	bool scheduled;
 	bool autoDelete;
+	// Set by the event queue when the event is added to it
+	friend class EventQueue;
+	Event *next;
+	unsigned long sequence;
         const EventCallback<EventHandler> *callback;
         /*
         	Data type contained in events:
@@ -29,7 +29,9 @@ class EventQueue;
 #include <time.h>
 
 #include <libcpphaggle/Platform.h>
+#include <libcpphaggle/Atomic.h>
 #include <libcpphaggle/Heap.h>
+#include <libcpphaggle/TimerWheel.h>
 #include <libcpphaggle/Thread.h>
 #include <libcpphaggle/Timeval.h>
 #include <libcpphaggle/Watch.h>
@@ -45,46 +47,177 @@ typedef enum {
 	EQ_EVENT_SHUTDOWN
 } EQEvent_t;
 
-// Locking is provided by a mutex, so the queue should be thread safe
+/*
+	Atomically replace *ptr with newval if it is oldval. Returns true if
+	the pointer was replaced. This is a full memory barrier.
+*/
+static inline bool event_compare_and_swap(Event * volatile *ptr, Event *oldval, Event *newval)
+{
+	return atomic_cas_ptr((void * volatile *)ptr, oldval, newval);
+}
+
+/*
+	The event queue is added to by many threads, but only the kernel
+	thread takes events from it.
+
+	Added events are pushed onto a lock-free stack, so that adding an
+	event never takes a lock that the kernel thread holds. The kernel
+	thread moves them off the stack when it looks for the next event.
+	Events that are already due, which are most of them, go on a ready
+	list in the order they were added. Events with a timeout in the
+	future go into a timer wheel, and when they expire into a heap
+	together with any due events that arrived out of order. Events are
+	handled in the order of their timeouts, and events with the same
+	timeout in the order they were added.
+*/
 /** */
-class EventQueue : public Heap
+class EventQueue
 {
 private:
-        Mutex mutex;
+	Event * volatile incoming; // The lock-free stack of added events
+	Event *readyHead, *readyTail; // Due events in timeout order
+	unsigned long numReady;
+	Heap due; // Due events that are not on the ready list
+	TimerWheel timers; // Events that were not due when added
+	unsigned long sequence; // Orders events with the same timeout
         Mutex shutdown_mutex;
         bool shutdownEvent;
+	/*
+		Move the added events off the stack and onto the ready list
+		or into the timer wheel, and move the expired timers into the
+		heap of due events.
+	*/
+	void collect() {
+		Event *e = incoming, *list = NULL;
+		TimerWheelItem *item;
+		Timeval now = Timeval::now();
+
+		if (e) {
+			while (!event_compare_and_swap(&incoming, e, NULL))
+				e = incoming;
+		}
+
+		// Reverse the stack, so that the events are in the order they were added
+		while (e) {
+			Event *tmp = e->next;
+			e->next = list;
+			list = e;
+			e = tmp;
+		}
+
+		while (list) {
+			e = list;
+			list = list->next;
+			e->next = NULL;
+			e->sequence = sequence++;
+
+			if (e->getTimeout() > now) {
+				timers.insert(e, e->getTimeout());
+			} else if (!readyTail || readyTail->getTimeout() <= e->getTimeout()) {
+				/*
+				  A due event goes on the ready list, unless
+				  another thread gave it an earlier timeout than
+				  the last event on the list.
+				*/
+				if (readyTail)
+					readyTail->next = e;
+				else
+					readyHead = e;
+				readyTail = e;
+				numReady++;
+			} else {
+				due.insert(e);
+			}
+		}
+
+		while ((item = timers.expire(now)))
+			due.insert(static_cast<Event *>(item));
+	}
+	// Returns the event to handle next, or NULL if there is none that is due
+	Event *first() {
+		Event *e = due.empty() ? NULL : static_cast<Event *>(due.front());
+
+		if (readyHead && (!e || *readyHead < *e))
+			return readyHead;
+
+		return e;
+	}
 protected:
 	Signal signal;
 public:
-        EventQueue() : Heap(),
-                       shutdownEvent(false) {}
+        EventQueue() : incoming(NULL), readyHead(NULL), readyTail(NULL), numReady(0), 
+		       sequence(0), shutdownEvent(false) {}
         ~EventQueue() {
                 Event *e;
 
-                while ((e = static_cast<Event *>(extractFirst())))
+		collect();
+
+		while (readyHead) {
+			e = readyHead;
+			readyHead = e->next;
+			delete e;
+		}
+                while ((e = static_cast<Event *>(due.extractFirst())))
                         delete e;
+		
+		while ((e = static_cast<Event *>(timers.extract())))
+			delete e;
         }
+	/*
+		The number of events in the queue. Events that are added
+		by other threads are counted once the kernel thread has seen
+		them.
+	*/
+	unsigned long size() const { return numReady + due.size() + timers.size(); }
 	EQEvent_t hasNextEvent() { 
-                Mutex::AutoLocker l(mutex);		
-                return shutdownEvent ? EQ_EVENT_SHUTDOWN : (empty() ? EQ_EMPTY : EQ_EVENT); 
+		collect();
+
+                Mutex::AutoLocker l(shutdown_mutex);
+
+                return shutdownEvent ? EQ_EVENT_SHUTDOWN : ((first() || !timers.empty()) ? EQ_EVENT : EQ_EMPTY); 
 	}
+	/*
+		Sets the time of the next event. When the next event is
+		far off in the timer wheel, this may be a time at which
+		getNextEvent() has no event yet.
+	*/
         EQEvent_t getNextEventTime(Timeval *tv) {
-                Mutex::AutoLocker l(mutex);
+		Event *e;
 
 		if (!tv)
 			return EQ_ERROR;
 
+		// Lower the signal before looking at the added events, so
+		// that an event added after we have looked raises it again.
+		// The barrier pairs with the one in addEvent(), so that
+		// either we see the event, or the adder sees the signal
+		// lowered.
 		signal.lower();
+		memory_barrier();
+
+		collect();
 		
-                if (shutdownEvent) {
-			tv->zero();
-			return EQ_EVENT_SHUTDOWN;
-		} else if (!empty()) {
-                        *tv = static_cast<Event *>(front())->getTimeout();
+		synchronized(shutdown_mutex) {
+			if (shutdownEvent) {
+				tv->zero();
+				return EQ_EVENT_SHUTDOWN;
+			}
+		}
+
+		e = first();
+
+		if (e) {
+                        *tv = e->getTimeout();
                         return EQ_EVENT;
                 }
+		if (timers.getNextExpiry(*tv))
+			return EQ_EVENT;
+
                 return EQ_EMPTY;
         }
+	/*
+		Returns the next due event, or NULL if there is none.
+	*/
         Event *getNextEvent() {
                 Event *e = NULL;
 	
@@ -96,27 +229,114 @@ public:
                         }
                 }
 
-                mutex.lock();
-                e = static_cast<Event *>(extractFirst());
+		collect();
+
+		e = first();
+
+		if (!e)
+			return NULL;
+
+		if (e == readyHead) {
+			readyHead = e->next;
+
+			if (!readyHead)
+				readyTail = NULL;
+
+			e->next = NULL;
+			numReady--;
+		} else {
+			due.extractFirst();
+		}
 		e->setScheduled(false);
-                mutex.unlock();
 
                 return e;
         }
+	/*
+		Make every timer due, so that the events are handled
+		without waiting for their timeouts. The kernel does this
+		during shutdown.
+	*/
+	void expireAllTimers() {
+		TimerWheelItem *item;
+
+		collect();
+
+		while ((item = timers.extract()))
+			due.insert(static_cast<Event *>(item));
+	}
         void enableShutdownEvent() {
                 Mutex::AutoLocker l(shutdown_mutex);
                 shutdownEvent = true;
 		HAGGLE_DBG("Setting shutdown event\n");
 		signal.raise();
         }
+	/*
+		Add an event to the queue. This may be called by any thread.
+	*/
         void addEvent(Event *e) {
-                Mutex::AutoLocker l(mutex);
-		
-                if (e && insert(e)) {
-			e->setScheduled(true);
-			signal.raise();
+		if (!e)
+			return;
+
+		// The event can only be linked into the queue once
+		if (e->isScheduled()) {
+			HAGGLE_ERR("Event %s is already in the queue\n", e->getName());
+			return;
 		}
+		e->setScheduled(true);
+
+		do {
+			e->next = incoming;
+		} while (!event_compare_and_swap(&incoming, e->next, e));
+
+		/*
+		  The signal only needs to be raised if the kernel thread has
+		  lowered it. If it is lowered after we check, the kernel
+		  thread collects our event after lowering it. The barrier
+		  keeps the check from being done before the event is added,
+		  on processors that reorder a load before a store.
+		*/
+		memory_barrier();
+
+		if (!signal.isRaised())
+			signal.raise();
         }
+	/*
+		Remove an event from the queue without handling it, so
+		that it can be deleted or added again. This may only be
+		called by the kernel thread. Removing a timer takes constant
+		time. Returns false if the event was not in the queue.
+	*/
+	bool removeEvent(Event *e) {
+		if (!e || !e->isScheduled())
+			return false;
+
+		collect();
+
+		if (!timers.remove(e) && !due.remove(e)) {
+			Event *prev = NULL, *tmp = readyHead;
+
+			while (tmp && tmp != e) {
+				prev = tmp;
+				tmp = tmp->next;
+			}
+			if (!tmp)
+				return false;
+
+			if (prev)
+				prev->next = e->next;
+			else
+				readyHead = e->next;
+
+			if (readyTail == e)
+				readyTail = prev;
+
+			e->next = NULL;
+			numReady--;
+		}
+		e->setScheduled(false);
+
+		return true;
+	}
 };
 
 #endif /* _EVENTQUEUE_H */
@@ -170,10 +170,8 @@ ForwardingManager::~ForwardingManager()
 	Event::unregisterType(moduleEventType);
 
 	if (periodicDataObjectQueryEvent) {
-		if (periodicDataObjectQueryEvent->isScheduled())
-			periodicDataObjectQueryEvent->setAutoDelete(true);
-		else
-			delete periodicDataObjectQueryEvent;
+		kernel->removeEvent(periodicDataObjectQueryEvent);
+		delete periodicDataObjectQueryEvent;
 	}
 
 	Event::unregisterType(periodicDataObjectQueryEventType);
@@ -413,20 +411,14 @@ bool ForwardingManager::isNeighbor(const NodeRef& node)
 	if (node->isNeighbor())
 		return true;
 
-	if (node && node->getType() == Node::TYPE_PEER) {
+	if (node && node.unlocked()->getType() == Node::TYPE_PEER) {
 		/*
-		 WARNING! Previously, kernel->getNodeStore()->retrieve(node,...) was
-		 called on the same line as node->getType(), i.e.,
-		 
-		 if (node && node->getType() == Node::TYPE_PEER && kernel->getNodeStore()->retrieve(node, true))
-			...
-		 
-		 but this could cause a potential deadlock in the NodeStore(). The first
-		 call to getType() will lock the node (through the use of the reference auto
-		 locking) and that lock will remain until the next line is executed. If
-		 getNodeStore()->retrieve() is called on the same line, the node will hence
-		 be in a locked state when accessing the node store, which is forbidden
-		 due to the risk of deadlock (see separate note in NodeStore.{h,cpp}).
+		 WARNING! The node must not be locked while accessing the node
+		 store, due to the risk of deadlock (see separate note in
+		 NodeStore.{h,cpp}). Reading the type does not lock the node,
+		 but dereferencing it with operator-> would, until the end of
+		 the line. Therefore, do not call other member functions of
+		 the node on the same line as getNodeStore()->retrieve().
 		 */
 		if (kernel->getNodeStore()->retrieve(node, true))
 			return true;
@@ -484,7 +476,7 @@ bool ForwardingManager::shouldForward(const DataObjectRef& dObj, const NodeRef&
 	
 	HAGGLE_DBG("%s Checking if data object %s should be forwarded to node %s (%s num=%lu)\n", 
 		getName(), dObj->getIdStr(), node->getName().c_str(), 
-		node->isStored() ? "stored" : "not stored", node->getNum());
+		node->isStored() ? "stored" : "not stored", node.unlocked()->getNum());
 	
         // Make sure we use the node in the node store
         peer = kernel->getNodeStore()->retrieve(node, false);
@@ -495,7 +487,7 @@ bool ForwardingManager::shouldForward(const DataObjectRef& dObj, const NodeRef&
 
 	if (peer->getBloomfilter()->has(dObj)) {
 		HAGGLE_DBG("%s node %s [%s] already has data object [%s]\n", 
-			getName(), peer->getName().c_str(), peer->getIdStr(), dObj->getIdStr());
+			getName(), peer->getName().c_str(), peer.unlocked()->getIdStr(), dObj->getIdStr());
 	} else {
 		return true;
 	}
@@ -613,7 +605,7 @@ void ForwardingManager::onDataObjectQueryResult(Event *e)
 		return;
 	}
 	
-	HAGGLE_DBG("Got dataobject query result for target node %s\n", target->getIdStr());
+	HAGGLE_DBG("Got dataobject query result for target node %s\n", target.unlocked()->getIdStr());
 	
 	DataObjectRef dObj;
 
@@ -641,7 +633,7 @@ void ForwardingManager::onDataObjectQueryResult(Event *e)
 		snprintf(countstr, 29, "%lu", ++count);
 		m->setParameter("hop_count", countstr);
 		
-		m = m->addMetadata("Hop", kernel->getThisNode()->getIdStr());
+		m = m->addMetadata("Hop", kernel->getThisNode().unlocked()->getIdStr());
 		
 		if (m) {
 			m->setParameter("time", Timeval::now().getAsString().c_str());
@@ -709,8 +701,8 @@ void ForwardingManager::onNodeQueryResult(Event *e)
 						dObj->getIdStr(), target->getName().c_str());
                                         target_neighbors.push_front(target);
                                 }
-                        } else if (target->getType() == Node::TYPE_PEER || 
-				   target->getType() == Node::TYPE_GATEWAY) { 
+                        } else if (target.unlocked()->getType() == Node::TYPE_PEER || 
+				   target.unlocked()->getType() == Node::TYPE_GATEWAY) { 
                                 HAGGLE_DBG("Trying to find delegates for data object %s bound for target %s\n", 
 					dObj->getIdStr(), target->getName().c_str());
                                 forwardByDelegate(dObj, target, targets);
@@ -784,7 +776,7 @@ void ForwardingManager::onNewNeighbor(Event *e)
 	
 	NodeRef node = e->getNode();
 	
-	if (node->getType() == Node::TYPE_UNDEFINED)
+	if (node.unlocked()->getType() == Node::TYPE_UNDEFINED)
 		return;
 	
 	// Tell the forwarding module that we've got a new neighbor:
@@ -802,7 +794,7 @@ void ForwardingManager::onNewNeighbor(Event *e)
 	HAGGLE_DBG("%s - new node contact with %s [id=%s]."
 		   " Delaying data object query in case there is"
 		   " an incoming node description for the node\n", 
-		   getName(), node->getName().c_str(), node->getIdStr());
+		   getName(), node->getName().c_str(), node.unlocked()->getIdStr());
 
 
 	/* Start periodic data object query if configuration allows. */
@@ -816,7 +808,7 @@ void ForwardingManager::onNewNeighbor(Event *e)
 
 void ForwardingManager::onEndNeighbor(Event *e)
 {	
-	if (e->getNode()->getType() == Node::TYPE_UNDEFINED)
+	if (e->getNode().unlocked()->getType() == Node::TYPE_UNDEFINED)
 		return;
 	
 	NodeRef node = e->getNode();
@@ -856,14 +848,14 @@ void ForwardingManager::onNodeUpdated(Event *e)
 	NodeRef node = e->getNode();
 	NodeRefList &replaced = e->getNodeList();
 	
-	if (node->getType() == Node::TYPE_UNDEFINED) {
+	if (node.unlocked()->getType() == Node::TYPE_UNDEFINED) {
 		HAGGLE_DBG("%s Node is undefined, deferring dataObjectQuery\n", 
 			   getName());
 		return;
 	} 
 	
 	HAGGLE_DBG("%s - got node update for %s [id=%s]\n", 
-		   getName(), node->getName().c_str(), node->getIdStr());
+		   getName(), node->getName().c_str(), node.unlocked()->getIdStr());
 
 	// Did this updated node replace an undefined node?
 	// Go through the replaced nodes to find out...
@@ -871,7 +863,7 @@ void ForwardingManager::onNodeUpdated(Event *e)
 	
 	while (it != replaced.end()) {
 		// Was this undefined?
-		if ((*it)->getType() == Node::TYPE_UNDEFINED && node->isNeighbor()) {
+		if ((*it).unlocked()->getType() == Node::TYPE_UNDEFINED && node->isNeighbor()) {
 			// Yep. Tell the forwarding module that we've got a new neighbor:
 			if (forwardingModule) {
 				forwardingModule->newNeighbor(node);
@@ -900,7 +892,7 @@ void ForwardingManager::onNodeUpdated(Event *e)
 
 void ForwardingManager::findMatchingDataObjectsAndTargets(NodeRef& node)
 {
-	if (!node || node->getType() == Node::TYPE_UNDEFINED)
+	if (!node || node.unlocked()->getType() == Node::TYPE_UNDEFINED)
 		return;
 	
 	// Check that this is an active neighbor node we can send to:
@@ -910,13 +902,13 @@ void ForwardingManager::findMatchingDataObjectsAndTargets(NodeRef& node)
 		
 		if (forwardingModule) {
 			HAGGLE_DBG("%s trying to find targets for which neighbor %s [id=%s] is a good delegate\n", 
-				 getName(), node->getName().c_str(), node->getIdStr());
+				 getName(), node->getName().c_str(), node.unlocked()->getIdStr());
 			forwardingModule->generateTargetsFor(node);
 		}
 	}
 	
 	HAGGLE_DBG("%s doing data object query for node %s [id=%s]\n", 
-		   getName(), node->getName().c_str(), node->getIdStr());
+		   getName(), node->getName().c_str(), node.unlocked()->getIdStr());
 	
 	// Ask the data store for data objects bound for the node.
 	// The node can be a valid target, even if it is not a current
@@ -980,7 +972,7 @@ Metadata *ForwardingManager::recurseListToMetadata(Metadata *m,
 		Metadata *nm = tm->addMetadata("Node");
 		
 		if (nm) {
-			nm->setParameter("node_id", (*it)->getIdStr());
+			nm->setParameter("node_id", (*it).unlocked()->getIdStr());
 		}
 	}
 	
@@ -1025,7 +1017,7 @@ void ForwardingManager::recursiveRoutingUpdate(NodeRef peer, Metadata *m)
 			if (neighbor == *jt) {
 				/*
 				 HAGGLE_DBG("Neighbor %s [%s] has already received the update\n", 
-					   neighbor->getName().c_str(), neighbor->getIdStr());
+					   neighbor->getName().c_str(), neighbor.unlocked()->getIdStr());
 				 */
 				should_notify = false;
 				break;
@@ -1178,7 +1170,7 @@ void ForwardingManager::onDelegateNodes(Event * e)
 			Metadata *hop = m->getMetadata("Hop");
 
 			while (hop) {
-				if (hop->getContent() == kernel->getThisNode()->getIdStr()) {
+				if (hop->getContent() == kernel->getThisNode().unlocked()->getIdStr()) {
 					hop->setParameter("delegated", "true");
 				}
 				hop = m->getNextMetadata();
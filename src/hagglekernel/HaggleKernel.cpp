@@ -36,8 +36,16 @@ void HaggleKernel::setThisNode(NodeRef &_thisNode)
 
 HaggleKernel::HaggleKernel(DataStore *ds , const string _storagepath) :
 	dataStore(ds), starttime(Timeval::now()), shutdownCalled(false),
-	running(false), storagepath(_storagepath)
+	running(false), numRemovedWatchables(0), dispatchType(-1), 
+	dispatchUnsubscribed(false), 
+	executor("Executor", KERNEL_EXECUTOR_WORKERS), storagepath(_storagepath)
 {
+	for (int i = 0; i < MAX_NUM_PUBLIC_EVENT_TYPES; i++) {
+		dispatchStats[i].events = 0;
+		dispatchStats[i].callbacks = 0;
+	}
+	// The signal that is raised whenever something is added to the event queue
+	signalIndex = watch.add(signal);
 }
 
 bool HaggleKernel::init()
@@ -108,6 +116,11 @@ bool HaggleKernel::init()
 		return false;
 	}
 
+	if (!executor.start()) {
+		HAGGLE_ERR("Could not start the executor\n");
+		return false;
+	}
+
 	// The interfaces on this node will be discovered when the
 	// ConnectivityManager is started. Hence, they will not be
 	// part of thisNode when we insert it in the datastore. This
@@ -146,6 +159,11 @@ HaggleKernel::~HaggleKernel()
 #endif
 	LogTrace::fini();
 
+	while (!watchables.empty()) {
+		delete watchables.front();
+		watchables.pop_front();
+	}
+
 	// Now that it has finished processing, delete the data store:
 	if (dataStore)
 		delete dataStore;
@@ -171,6 +189,10 @@ int HaggleKernel::registerManager(Manager *m)
 		return -1;
 	}
 
+	// Subscribe to the events the manager already has handlers for
+	for (EventType type = EVENT_TYPE_PUBLIC_MIN; type <= EVENT_TYPE_PUBLIC_MAX; type++)
+		subscribe(m, type);
+
 	HAGGLE_DBG("Manager \'%s\' registered\n", m->getName());
 
 	return registry.size();
@@ -181,13 +203,23 @@ int HaggleKernel::unregisterManager(Manager *m)
 	if (!m)
 		return -1;
 	
-	if (registry.erase(m) != 1) {
+	registry_t::iterator it = registry.find(m);
+
+	if (it == registry.end()) {
 		HAGGLE_ERR("Manager \'%s\' not registered\n", m->getName());
 		return 0;
 	}
 
+	// Remove any watchables that the manager did not unregister itself
+	for (wregistry_t::iterator itt = (*it).second.begin(); itt != (*it).second.end(); itt++) {
+		removeWatchable((*itt).second);
+	}
+	registry.erase(it);
+
+	for (EventType type = EVENT_TYPE_PUBLIC_MIN; type <= EVENT_TYPE_PUBLIC_MAX; type++)
+		unsubscribe(m, type);
+
 #ifdef DEBUG
-        registry_t::iterator it;
         string registeredManagers;
 	
 	for (it = registry.begin(); it != registry.end(); it++) {
@@ -224,11 +256,23 @@ int HaggleKernel::registerWatchable(Watchable wbl, Manager *m)
 	
 	wregistry_t& wr = (*it).second;
 	
-        if (!wr.insert(make_pair(wbl, 0)).second) {
+        if (wr.find(wbl) != wr.end()) {
 		HAGGLE_ERR("Manager \'%s\' has already registered %s\n", m->getName(), wbl.getStr());
                 return -1;
         }
 	
+	int index = watch.add(wbl);
+
+	if (index < 0) {
+		HAGGLE_ERR("Could not add %s to the kernel's watch\n", wbl.getStr());
+		return -1;
+	}
+
+	RegisteredWatchable *rw = new RegisteredWatchable(wbl, m, index);
+
+	wr.insert(make_pair(wbl, rw));
+	watchables.push_back(rw);
+
 	HAGGLE_DBG("Manager \'%s\' registered %s\n", m->getName(), wbl.getStr());
 
 	return wr.size();
@@ -240,8 +284,11 @@ int HaggleKernel::unregisterWatchable(Watchable wbl)
 	
 	for (it = registry.begin(); it != registry.end(); it++) {
 		wregistry_t& wr = (*it).second;
+		wregistry_t::iterator itt = wr.find(wbl);
 		
-		if (wr.erase(wbl) == 1) {			
+		if (itt != wr.end()) {
+			removeWatchable((*itt).second);
+			wr.erase(itt);
 			HAGGLE_DBG("Manager \'%s\' unregistered %s\n", (*it).first->getName(), wbl.getStr());
 			return wr.size();
 		}
@@ -252,6 +299,138 @@ int HaggleKernel::unregisterWatchable(Watchable wbl)
 	return 0;
 }
 
+void HaggleKernel::subscribe(Manager *m, EventType type)
+{
+	EventCallback<EventHandler> *callback = m->getEventInterest(type);
+
+	if (callback)
+		subscribers[type].push_back(EventSubscriber(m, callback));
+}
+
+void HaggleKernel::unsubscribe(Manager *m, EventType type)
+{
+	subscriberlist_t::iterator it = subscribers[type].begin();
+
+	while (it != subscribers[type].end()) {
+		if ((*it).m != m) {
+			it++;
+		} else if (type == dispatchType) {
+			// The list is being iterated, so only clear the entry
+			(*it).callback = NULL;
+			dispatchUnsubscribed = true;
+			it++;
+		} else {
+			it = subscribers[type].erase(it);
+		}
+	}
+}
+
+void HaggleKernel::updateEventInterest(Manager *m, EventType type)
+{
+	if (!EVENT_TYPE_PUBLIC(type) || registry.find(m) == registry.end())
+		return;
+
+	unsubscribe(m, type);
+	subscribe(m, type);
+}
+
+void HaggleKernel::dispatchPublicEvent(Event *e)
+{
+	EventType type = e->getType();
+
+	if (!EVENT_TYPE_PUBLIC(type))
+		return;
+
+	subscriberlist_t& subs = subscribers[type];
+	/*
+	 Subscribers added by a callback are appended to the list, and do
+	 not get the event that is being dispatched.
+	 */
+	size_t n = subs.size();
+	Timeval start = Timeval::now();
+	
+	dispatchType = type;
+
+	for (subscriberlist_t::iterator it = subs.begin(); n > 0; it++, n--) {
+		if ((*it).callback) {
+			(*(*it).callback) (e);
+			dispatchStats[type].callbacks++;
+		}
+	}
+	dispatchType = -1;
+	dispatchStats[type].events++;
+	dispatchStats[type].time += Timeval::now() - start;
+
+	if (dispatchUnsubscribed) {
+		subscriberlist_t::iterator it = subs.begin();
+
+		while (it != subs.end()) {
+			if ((*it).callback)
+				it++;
+			else
+				it = subs.erase(it);
+		}
+		dispatchUnsubscribed = false;
+	}
+}
+
+void HaggleKernel::printDispatchStatistics()
+{
+	for (EventType type = EVENT_TYPE_PUBLIC_MIN; type <= EVENT_TYPE_PUBLIC_MAX; type++) {
+		if (dispatchStats[type].events == 0)
+			continue;
+
+		HAGGLE_DBG("%s: %lu events, %lu callbacks, %.3lf ms\n", 
+			   Event::getPublicName(type), dispatchStats[type].events, 
+			   dispatchStats[type].callbacks, 
+			   dispatchStats[type].time.getTimeAsMilliSecondsDouble());
+	}
+}
+
+void HaggleKernel::printExecutorStatistics()
+{
+	for (unsigned int i = 0; i < executor.getNumWorkers(); i++) {
+		Executor::WorkerStats stats;
+
+		if (!executor.getWorkerStats(i, stats))
+			continue;
+
+		HAGGLE_DBG("Executor worker %u: %lu tasks (%lu stolen), %.3lf ms busy, %.1lf%% utilization\n", 
+			   i, stats.tasksRun, stats.tasksStolen, 
+			   stats.busyTime.getTimeAsMilliSecondsDouble(), 
+			   stats.utilization * 100);
+	}
+}
+
+void HaggleKernel::removeWatchable(RegisteredWatchable *rw)
+{
+	/*
+	 The watchable stays in the watch until it is purged, so that
+	 its index is not reused by a watchable registered while the run
+	 loop is still checking the results of the last wait.
+	 */
+	rw->removed = true;
+	numRemovedWatchables++;
+}
+
+void HaggleKernel::purgeWatchables()
+{
+	List<RegisteredWatchable *>::iterator it = watchables.begin();
+
+	while (numRemovedWatchables && it != watchables.end()) {
+		RegisteredWatchable *rw = *it;
+
+		if (rw->removed) {
+			watch.remove(rw->index);
+			delete rw;
+			it = watchables.erase(it);
+			numRemovedWatchables--;
+		} else {
+			it++;
+		}
+	}
+}
+
 void HaggleKernel::signalIsReadyForStartup(Manager *m)
 {
 	for (registry_t::iterator it = registry.begin(); it != registry.end(); it++) {
@@ -466,20 +645,17 @@ void HaggleKernel::run()
 	readStartupDataObjectFile();
 	
 	while (registry.size()) {
-		Watch w;
 		Timeval now = Timeval::now();
-		int signalIndex, res;
+		int res;
 		EQEvent_t ee;
 		Timeval timeout, *t = NULL;
 		Event *e = NULL;
 		
 		/*
-		 We make a copy of the registry each time we loop. This is because a manager
-		 can unregister sockets, or itself, in the event (or socket) it processes.
-		 Therefore, if we'd use the original registry, it might become inconsistent as 
-		 we iterate it in the event loop.
+		 Remove the watchables that were unregistered in the last
+		 iteration from the watch.
 		 */
-		registry_t reg = registry;
+		purgeWatchables();
 
 		/* 
 		   Get the time until the next event and check the status of
@@ -493,8 +669,16 @@ void HaggleKernel::run()
 				HAGGLE_DBG("\n****************** SHUTDOWN EVENT *********************\n\n");
 				shutdownmode = true;
 			case EQ_EVENT:
-				if (shutdownmode)
+				/*
+				 During shutdown, the events are handled without
+				 waiting for their timeouts. Timers are made due,
+				 or the loop would wake up without an event to
+				 handle until they expire.
+				 */
+				if (shutdownmode) {
+					expireAllTimers();
 					timeout = 0;
+				}
 						
 				/* Convert the timeout from absolute time to relative time.
 				 We need to make sure we do not have a negative time, which sometimes can 
@@ -521,37 +705,27 @@ void HaggleKernel::run()
 		}
 		
 		/*
-			Iterate through the registered sockets and add them to our Watch. The registry
+			The registered watchables are already in the watch. The registry
 			does not require locking, as only managers and manager modules running 
 			in the same thread as the kernel may register sockets. Modules running
 			in separate threads do not need to register sockets, as they can easily 
 			implement their own run-loop.
-		 
-		 */
-		registry_t::iterator it = reg.begin();
-		
-		for (; it != reg.end(); it++) {
-			wregistry_t& wr = (*it).second;
-			wregistry_t::iterator itt = wr.begin();
-			for (; itt != wr.end(); itt++) {
-				(*itt).second = w.add((*itt).first);
-				//HAGGLE_DBG("watchable %s added to watch with index %d\n", (*itt).first.getStr(), (*itt).second);
-			}
-		}
-		
-		/*
-		 Add the Signal that is raised whenever something is added to the event queue.
 		 */
-		signalIndex = w.add(signal);
-				
 		//HAGGLE_DBG("Waiting on kernel watch with timeout %s\n", t ? t->getAsString().c_str() : "INFINATE");
 		
-		res = w.wait(t);
+		res = watch.wait(t);
 		
 		if (res == Watch::TIMEOUT) {
 			// Timeout occurred -> Process event from EventQueue
 			e = getNextEvent();
 
+			/*
+			 The timeout may have been for a timer that was only
+			 moved closer in the timer wheel.
+			 */
+			if (!e)
+				continue;
+
                         LOG_ADD("%s: %s\n", Timeval::now().getAsString().c_str(), e->getDescription().c_str());
 			
 			if (e->isPrivate()) {
@@ -561,21 +735,8 @@ void HaggleKernel::run()
 				//HAGGLE_DBG("Doing callback\n");
 				e->doCallback();
 			} else {
-				/* 
-				 Loop through all registered managers and check whether they are 
-				 interested in this event.
-				 */
-				registry_t::iterator it = reg.begin();
-				
 				//HAGGLE_DBG("Doing public event %s\n", e->getName());
-				
-				for (; it != reg.end(); it++) {
-					Manager *m = (*it).first;
-					EventCallback < EventHandler > *callback = m->getEventInterest(e->getType());
-					if (callback) {
-						(*callback) (e);
-					}
-				}
+				dispatchPublicEvent(e);
 			}
 			
 			/*
@@ -595,7 +756,7 @@ void HaggleKernel::run()
 		
 		//HAGGLE_DBG("%d objects are set\n", res);
 		
-		if (w.isSet(signalIndex)) {
+		if (watch.isSet(signalIndex)) {
 			/* Something was added to the queue. We do not
 			   need to do anyting here as this signal is
 			   only a trigger for us to check the queue
@@ -603,26 +764,32 @@ void HaggleKernel::run()
 
 			//HAGGLE_DBG("Queue signal was set\n");
 		}
-		// Check and handle readable watchables. 
-		it = reg.begin();
+		/*
+		 Check and handle readable watchables. Watchables registered
+		 in a callback are appended to the list, but are never set
+		 until the next wait. Unregistered ones are skipped.
+		 */
+		List<RegisteredWatchable *>::iterator it = watchables.begin();
 		
-		for (; it != reg.end(); it++) {
-			Manager *m = (*it).first;
-			wregistry_t& wr = (*it).second;
-			wregistry_t::iterator itt = wr.begin();
-			
-			for (; itt != wr.end(); itt++) {				
-				//HAGGLE_DBG("Checking if watchable %s with watch index %d is set\n", (*itt).first.getStr(), (*itt).second);
+		for (; it != watchables.end(); it++) {
+			RegisteredWatchable *rw = *it;
 
-				if (w.isSet((*itt).second)) {
-					//HAGGLE_DBG("Watchable %s with watch index %d is set\n", (*itt).first.getStr(), (*itt).second);
-					m->onWatchableEvent((*itt).first);
-				}
+			//HAGGLE_DBG("Checking if watchable %s with watch index %d is set\n", rw->wbl.getStr(), rw->index);
+			
+			if (!rw->removed && watch.isSet(rw->index)) {
+				//HAGGLE_DBG("Watchable %s with watch index %d is set\n", rw->wbl.getStr(), rw->index);
+				rw->m->onWatchableEvent(rw->wbl);
 			}
 		}
 	}
 	HAGGLE_DBG("Kernel exits from main loop\n");
 
+	printDispatchStatistics();
+
+	// The managers have exited, so there are no more tasks
+	executor.stop();
+	printExecutorStatistics();
+
 	// stop the dataStore thread and try to join with its thread
 	HAGGLE_DBG("Joining with DataStore thread\n");
 	dataStore->stop();
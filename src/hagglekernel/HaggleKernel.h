@@ -31,6 +31,8 @@ class HaggleKernel;
 #include <libcpphaggle/Pair.h>
 #include <libcpphaggle/Map.h>
 #include <libcpphaggle/List.h>
+#include <libcpphaggle/Watch.h>
+#include <libcpphaggle/Executor.h>
 
 using namespace haggle;
 
@@ -61,13 +63,77 @@ class HaggleKernel : public EventQueue
 	bool shutdownCalled;
 	bool running; // true if running (after startup)
 	
+	/*
+	 A watchable registered by a manager. Registered watchables stay
+	 in the kernel's watch across iterations of the run loop, and are
+	 only added to and removed from it when they are registered and
+	 unregistered.
+	 */
+	class RegisteredWatchable {
+	public:
+		Watchable wbl;
+		Manager *m;
+		int index; // The index in the kernel's watch
+		bool removed; // Unregistered, but not yet removed from the watch
+		RegisteredWatchable(Watchable _wbl, Manager *_m, int _index) : 
+			wbl(_wbl), m(_m), index(_index), removed(false) {}
+	};
 	/*
 	 We have a registry of registered managers, where each 
-	 manager has a set of <watchable, watch indices> pairs.
+	 manager has a set of <watchable, registration> pairs.
 	 */
-	typedef Map<Watchable, int> wregistry_t;
+	typedef Map<Watchable, RegisteredWatchable *> wregistry_t;
 	typedef Map<Manager *, wregistry_t> registry_t;
 	registry_t registry;
+	/*
+	 The registered watchables in registration order. Unregistered
+	 watchables are only marked as removed, since the run loop may be
+	 dispatching events to them, and are purged at the start of the
+	 next iteration.
+	 */
+	List<RegisteredWatchable *> watchables;
+	unsigned long numRemovedWatchables;
+	Watch watch;
+	int signalIndex; // The index of the event queue signal in the watch
+	void removeWatchable(RegisteredWatchable *rw);
+	void purgeWatchables();
+	/*
+	 The managers that subscribe to each public event type, in the
+	 order they subscribed. The table is updated whenever a manager
+	 adds or removes an event interest, so that a public event is
+	 only dispatched to the managers interested in it.
+	 */
+	class EventSubscriber {
+	public:
+		Manager *m;
+		// NULL if the subscription was removed while dispatching
+		EventCallback<EventHandler> *callback;
+		EventSubscriber(Manager *_m = NULL, EventCallback<EventHandler> *_callback = NULL) : 
+			m(_m), callback(_callback) {}
+	};
+	typedef List<EventSubscriber> subscriberlist_t;
+	subscriberlist_t subscribers[MAX_NUM_PUBLIC_EVENT_TYPES];
+	EventType dispatchType; // The type being dispatched, or -1
+	bool dispatchUnsubscribed; // True if a subscriber was removed while dispatching
+	/*
+	 Dispatch statistics for each public event type.
+	 */
+	struct {
+		unsigned long events; // The number of events dispatched
+		unsigned long callbacks; // The number of callbacks made
+		Timeval time; // The total time spent in callbacks
+	} dispatchStats[MAX_NUM_PUBLIC_EVENT_TYPES];
+	void subscribe(Manager *m, EventType type);
+	void unsubscribe(Manager *m, EventType type);
+	void dispatchPublicEvent(Event *e);
+	void printDispatchStatistics();
+	/*
+	 The executor runs short tasks for the managers and their
+	 modules, so that they do not need a thread each.
+	 */
+#define KERNEL_EXECUTOR_WORKERS 2
+	Executor executor;
+	void printExecutorStatistics();
 	const string storagepath; // Path to where we can write files, etc.
 	void closeAllSockets();
 	
@@ -95,6 +161,11 @@ public:
         PolicyRef& getCurrentPolicy() { return currentPolicy; }
         void setCurrentPolicy(PolicyRef &_currentPolicy) { currentPolicy = _currentPolicy; }
         DataStore *getDataStore() { return dataStore; }
+	/**
+		Returns the kernel's executor. It runs from the time the kernel
+		is initialized until the kernel exits its run loop.
+	 */
+	Executor *getExecutor() { return &executor; }
 	
 	/**
 		Register a manager with the kernel. The manager will be
@@ -140,6 +211,14 @@ public:
 		the manager's watchable was already registered, or there was a failure.
 	 */
         int unregisterWatchable(Watchable wbl);
+	/**
+		Called by a manager when it has added or removed the event
+		handler for a public event type, so that the kernel can
+		update its subscribers for that type. Changes made by a
+		manager that is not registered are picked up when it
+		registers.
+	 */
+	void updateEventInterest(Manager *m, EventType type);
 	/**
 		Since managers should not communicate directly with each other, this
 		function should be used only in exceptional cases. It was needed by the 
@@ -60,9 +60,9 @@ using namespace haggle;
 	This is the class that keeps interface information. 
  */
 #ifdef DEBUG_LEAKS
-class Interface : public LeakMonitor
+class Interface : public LeakMonitor, public RefCounted
 #else
-class Interface
+class Interface : public RefCounted
 #endif
 {
 public:
@@ -131,6 +131,11 @@ public:
 	static Interface::Type_t strToType(const char *str);
 	static const char *typeToStr(Type_t type);
 
+	/*
+		The name, type and identifier of an interface are set when
+		the interface is created, and can be read through
+		InterfaceRef::unlocked() without locking the interface.
+	*/
 	/**
 		Gets the currently set name for this interface.
 	*/
@@ -83,6 +83,12 @@ bool Manager::init()
 	return init_derived();
 }
 
+void Manager::onEventInterestChange(EventType type)
+{
+	// Let the kernel update its subscriber table
+	kernel->updateEventInterest(this, type);
+}
+
 void Manager::signalIsReadyForStartup()
 {
 	readyForStartup = true;
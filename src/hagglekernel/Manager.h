@@ -64,6 +64,7 @@ private:
 protected:
         HaggleKernel *kernel;
 	virtual void onWatchableEvent(const Watchable& wbl) {}
+	void onEventInterestChange(EventType type);
 	
 	bool isStartupComplete() { return state >= MANAGER_STATE_RUNNING; }
 	void signalIsReadyForStartup();
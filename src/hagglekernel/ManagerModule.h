@@ -23,6 +23,7 @@
 template <class ManagerClass> class ManagerModule;
 
 #include <libcpphaggle/Thread.h>
+#include <libcpphaggle/Executor.h>
 #include "Manager.h"
 
 #include "HaggleKernel.h"
@@ -114,6 +115,19 @@ public:
 		if (getKernel())
 			getKernel()->addEvent(e);
 	}
+	/**
+	  Runs a task on the kernel's executor. Short pieces of work, that
+	  do not wait on sockets or other external events, should run as
+	  tasks rather than in a thread of their own.
+
+	  Returns: true if the task was queued, or false otherwise.
+	*/
+	bool submitTask(const TaskRef& task)
+	{
+		if (getKernel())
+			return getKernel()->getExecutor()->submit(task);
+		return false;
+	}
 	/**
 	  The init() function is used to initialize a manager module before it
 	  is started. The function should be overridden in those modules that
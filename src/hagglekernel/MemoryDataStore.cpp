@@ -0,0 +1,2265 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "MemoryDataStore.h"
+#include "XMLMetadata.h"
+#include "HaggleKernel.h"
+
+#include <haggleutils.h>
+
+// Snapshot and dump names
+#define MEMORY_DATASTORE_METADATA "HaggleDump"
+#define MEMORY_DATASTORE_DATAOBJECT "DataObject"
+#define MEMORY_DATASTORE_NODE "Node"
+#define MEMORY_DATASTORE_FILTER "Filter"
+#define MEMORY_DATASTORE_REPOSITORY "Repository"
+
+/*
+	The metadata is not kept in serialized form, so its size is 
+	estimated from the attributes.
+*/
+static unsigned long long dataObjectSize(const DataObjectRef& dObj)
+{
+	unsigned long long size = dObj->getDataLen();
+	const Attributes *attrs = dObj->getAttributes();
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		size += (*it).second.getName().length() + (*it).second.getValue().length();
+	}
+	return size;
+}
+
+MemoryDataObjectEntry::MemoryDataObjectEntry(unsigned long _num, const DataObjectRef& _dObj, 
+					     const Timeval& _timestamp, const string& _nodeId) :
+	num(_num), dObj(_dObj), timestamp(_timestamp), nodeId(_nodeId), size(dataObjectSize(_dObj))
+{
+}
+
+MemoryNodeEntry::~MemoryNodeEntry()
+{
+	if (bloomfilter)
+		delete bloomfilter;
+}
+
+/*
+	Ranks the match before the given one. The heap is a min-heap,
+	so the "smallest" match is the best one.
+*/
+bool MemoryMatch::compare_less(const HeapItem& i) const
+{
+	const MemoryMatch& m = static_cast<const MemoryMatch&>(i);
+
+	if (ratio != m.ratio)
+		return ratioAscending ? ratio < m.ratio : ratio > m.ratio;
+	if (mcount != m.mcount)
+		return mcount > m.mcount;
+	if (rank != m.rank)
+		return rank > m.rank;
+
+	return newestFirst ? num > m.num : num < m.num;
+}
+
+bool MemoryMatch::compare_greater(const HeapItem& i) const
+{
+	return static_cast<const MemoryMatch&>(i).compare_less(*this);
+}
+
+MemoryDataStore::MemoryDataStore(const bool _recreate, const string _filepath, const string name) :
+	DataStore(name), recreate(_recreate), filepath(_filepath), snapshot(true), num(1), repositoryId(1), bytes(0)
+{
+}
+
+MemoryDataStore::~MemoryDataStore()
+{
+	if (snapshot)
+		writeSnapshot();
+
+	HAGGLE_DBG("%lu data objects, %lu nodes and %lu filters in memory data store\n",
+		   (unsigned long)dataObjects.size(), (unsigned long)nodes.size(),
+		   (unsigned long)filters.size());
+
+	while (!dataObjectsByNum.empty()) {
+		MemoryDataObjectEntry *e = (*dataObjectsByNum.begin()).second;
+		unindexDataObject(e);
+		delete e;
+	}
+
+	while (!nodes.empty()) {
+		removeNode((*nodes.begin()).second);
+	}
+
+	while (!filters.empty()) {
+		removeFilter((*filters.begin()).second);
+	}
+}
+
+bool MemoryDataStore::init()
+{
+	string file = getFilepath();
+
+	if (file.empty()) {
+		HAGGLE_ERR("No snapshot file, snapshots disabled\n");
+		snapshot = false;
+		return true;
+	}
+
+	if (recreate) {
+		if (unlink(file.c_str()) == 0) {
+			printf("Deleted existing snapshot file: %s\n", file.c_str());
+		}
+		return true;
+	}
+
+	if (!readSnapshot()) {
+		HAGGLE_ERR("Could not read snapshot %s\n", file.c_str());
+	}
+
+	return true;
+}
+
+string MemoryDataStore::getFilepath()
+{
+	string noResult;
+
+	if (filepath.empty())
+		return noResult;
+
+	string file = filepath + PLATFORM_PATH_DELIMITER + DEFAULT_MEMORY_DATASTORE_SNAPSHOT_FILENAME;
+
+	if (!create_path(filepath.c_str())) {
+		HAGGLE_ERR("Could not create directory path \'%s\'\n", filepath.c_str());
+		return noResult;
+	}
+
+	return file;
+}
+
+/* ========================================================= */
+/* The inverted index                                        */
+/* ========================================================= */
+
+string MemoryDataStore::attributeKey(const string& name, const string& value)
+{
+	// Control characters are not allowed in the XML metadata, so the
+	// separator cannot be part of an attribute name
+	string key = name;
+	key.append(1, '\x1f');
+	key.append(value);
+	return key;
+}
+
+string MemoryDataStore::interfaceKey(const InterfaceRef& iface)
+{
+	string key = iface->getTypeStr();
+	key.append(1, '\x1f');
+	key.append(iface->getIdentifierStr());
+	return key;
+}
+
+void MemoryDataStore::indexDataObject(MemoryDataObjectEntry *e)
+{
+	const Attributes *attrs = e->dObj->getAttributes();
+
+	dataObjects.insert(make_pair(string(e->dObj->getIdStr()), e));
+	dataObjectsByNum.insert(make_pair(e->num, e));
+	bytes += e->size;
+
+	if (!e->nodeId.empty())
+		nodeDescriptions.insert(make_pair(e->nodeId, e));
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+		string key = attributeKey(a.getName(), a.getValue());
+
+		Map<string, MemoryDataObjectPostings *>::iterator pit = dataObjectIndex.find(key);
+
+		if (pit == dataObjectIndex.end())
+			pit = dataObjectIndex.insert(make_pair(key, new MemoryDataObjectPostings())).first;
+
+		(*pit).second->insert(make_pair(e->num, e));
+
+		Map<string, MemoryNameCounts *>::iterator nit = dataObjectNameIndex.find(a.getName());
+
+		if (nit == dataObjectNameIndex.end())
+			nit = dataObjectNameIndex.insert(make_pair(a.getName(), new MemoryNameCounts())).first;
+
+		(*(*nit).second)[e->num]++;
+	}
+}
+
+void MemoryDataStore::unindexDataObject(MemoryDataObjectEntry *e)
+{
+	const Attributes *attrs = e->dObj->getAttributes();
+
+	dataObjects.erase(string(e->dObj->getIdStr()));
+	dataObjectsByNum.erase(e->num);
+	bytes -= e->size;
+
+	if (!e->nodeId.empty()) {
+		Map<string, MemoryDataObjectEntry *>::iterator it = nodeDescriptions.find(e->nodeId);
+
+		if (it != nodeDescriptions.end() && (*it).second == e)
+			nodeDescriptions.erase(it);
+	}
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+
+		Map<string, MemoryDataObjectPostings *>::iterator pit = dataObjectIndex.find(attributeKey(a.getName(), a.getValue()));
+
+		if (pit != dataObjectIndex.end()) {
+			(*pit).second->erase(e->num);
+
+			if ((*pit).second->empty()) {
+				delete (*pit).second;
+				dataObjectIndex.erase(pit);
+			}
+		}
+
+		Map<string, MemoryNameCounts *>::iterator nit = dataObjectNameIndex.find(a.getName());
+
+		if (nit != dataObjectNameIndex.end()) {
+			(*nit).second->erase(e->num);
+
+			if ((*nit).second->empty()) {
+				delete (*nit).second;
+				dataObjectNameIndex.erase(nit);
+			}
+		}
+	}
+}
+
+void MemoryDataStore::removeNode(MemoryNodeEntry *ne)
+{
+	for (Map<string, long>::iterator it = ne->interests.begin(); it != ne->interests.end(); it++) {
+		Map<string, MemoryNodePostings *>::iterator pit = nodeIndex.find((*it).first);
+
+		if (pit != nodeIndex.end()) {
+			(*pit).second->erase(ne->num);
+
+			if ((*pit).second->empty()) {
+				delete (*pit).second;
+				nodeIndex.erase(pit);
+			}
+		}
+	}
+
+	for (InterfaceRefList::iterator it = ne->ifaces.begin(); it != ne->ifaces.end(); it++) {
+		nodesByInterface.erase(interfaceKey(*it));
+	}
+
+	nodes.erase(ne->idStr);
+	delete ne;
+}
+
+void MemoryDataStore::removeFilter(MemoryFilterEntry *fe)
+{
+	for (Attributes::const_iterator it = fe->attrs.begin(); it != fe->attrs.end(); it++) {
+		const Attribute& a = (*it).second;
+		Map<string, MemoryFilterPostings *>::iterator pit = filterIndex.find(attributeKey(a.getName(), a.getValue()));
+
+		if (pit != filterIndex.end()) {
+			(*pit).second->erase(fe->num);
+
+			if ((*pit).second->empty()) {
+				delete (*pit).second;
+				filterIndex.erase(pit);
+			}
+		}
+	}
+
+	filters.erase(fe->eventType);
+	delete fe;
+}
+
+MemoryNodeEntry *MemoryDataStore::findNode(const NodeRef& node)
+{
+	if (node->getType() != Node::TYPE_UNDEFINED) {
+		Map<string, MemoryNodeEntry *>::iterator it = nodes.find(string(node->getIdStr()));
+
+		if (it != nodes.end())
+			return (*it).second;
+
+		return NULL;
+	}
+
+	// Lookup by common interfaces, the first interface that maps to a
+	// node decides
+	const InterfaceRefList *ifaces = node->getInterfaces();
+
+	for (InterfaceRefList::const_iterator it = ifaces->begin(); it != ifaces->end(); it++) {
+		Map<string, MemoryNodeEntry *>::iterator nit = nodesByInterface.find(interfaceKey(*it));
+
+		if (nit != nodesByInterface.end())
+			return (*nit).second;
+	}
+	return NULL;
+}
+
+NodeRef MemoryDataStore::createNode(const MemoryNodeEntry *ne)
+{
+	// First try to retrieve the node from the node store
+	NodeRef node = kernel->getNodeStore()->retrieve(ne->id);
+
+	if (!node) {
+		node = Node::create_with_id(ne->type, ne->id, ne->name, ne->nodeDescriptionCreateTime);
+
+		if (!node) {
+			HAGGLE_ERR("Could not create node from data store information\n");
+			return NULL;
+		}
+		node->setMaxDataObjectsInMatch(ne->maxDataObjectsInMatch);
+		node->setMatchingThreshold(ne->matchingThreshold);
+
+		if (!node->getBloomfilter()->setRaw(ne->bloomfilter->getRaw(), ne->bloomfilter->getRawLen())) {
+			HAGGLE_ERR("Could not set bloomfilter from information in data store.\n");
+			return NULL;
+		}
+	}
+
+	for (Attributes::const_iterator it = ne->attrs.begin(); it != ne->attrs.end(); it++) {
+		node->addAttribute((*it).second);
+	}
+
+	for (InterfaceRefList::const_iterator it = ne->ifaces.begin(); it != ne->ifaces.end(); it++) {
+		// Try to find the interface from the interface store:
+		InterfaceRef iface = kernel->getInterfaceStore()->retrieve((*it)->getType(), (*it)->getIdentifier());
+
+		if (!iface) {
+			iface = Interface::create((*it)->getType(), (*it)->getIdentifier());
+
+			if (!iface) {
+				HAGGLE_DBG("Get iface failed\n");
+				return NULL;
+			}
+		}
+		node->addInterface(iface);
+	}
+
+	return node;
+}
+
+void MemoryDataStore::clearMatches(MemoryMatchMap& scores)
+{
+	for (MemoryMatchMap::iterator it = scores.begin(); it != scores.end(); it++) {
+		delete (*it).second;
+	}
+	scores.clear();
+}
+
+/*
+	Accumulates the same scores as the SQL data store's node to data
+	object matching: the number of shared attributes, the sum of the
+	node's weights of those attributes and whether any of them has a
+	"no match" weight. Only the posting lists of the node's interests
+	are visited.
+*/
+unsigned long MemoryDataStore::matchNode(const MemoryNodeEntry *ne, unsigned int threshold, unsigned int attrMatch,
+					 Heap& heap, MemoryMatchMap& scores)
+{
+	unsigned long num_match = 0;
+
+	// The ratio is undefined when the weights sum to zero
+	if (ne->sumWeights == 0)
+		return 0;
+
+	for (Map<string, long>::const_iterator it = ne->interests.begin(); it != ne->interests.end(); it++) {
+		Map<string, MemoryDataObjectPostings *>::iterator pit = dataObjectIndex.find((*it).first);
+
+		if (pit == dataObjectIndex.end())
+			continue;
+
+		for (MemoryDataObjectPostings::iterator dit = (*pit).second->begin(); dit != (*pit).second->end(); dit++) {
+			MemoryMatch *&m = scores[(*dit).first];
+
+			if (!m)
+				m = new MemoryMatch((*dit).second, (*dit).first, true);
+
+			m->mcount++;
+			m->weight += (*it).second;
+
+			if ((*it).second == ATTR_WEIGHT_NO_MATCH)
+				m->notMatch = true;
+		}
+	}
+
+	for (MemoryMatchMap::iterator it = scores.begin(); it != scores.end(); it++) {
+		MemoryMatch *m = (*it).second;
+
+		m->ratio = 100 * m->weight / ne->sumWeights;
+
+		if (!m->notMatch && m->ratio >= (long)threshold && m->mcount >= attrMatch) {
+			heap.insert(m);
+			num_match++;
+		}
+	}
+
+	return num_match;
+}
+
+/*
+	A filter attribute matches a data object attribute with the same
+	name if it has the same value or the wildcard value. The ratio is
+	the share of the filter's attributes that match.
+*/
+unsigned long MemoryDataStore::matchFilters(const DataObjectRef& dObj, Heap& heap, MemoryMatchMap& scores)
+{
+	unsigned long num_match = 0;
+	const Attributes *attrs = dObj->getAttributes();
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+
+		for (int i = 0; i < 2; i++) {
+			if (i == 1 && a.getValue() == ATTR_WILDCARD)
+				break;
+
+			Map<string, MemoryFilterPostings *>::iterator pit =
+				filterIndex.find(attributeKey(a.getName(), i == 0 ? a.getValue() : string(ATTR_WILDCARD)));
+
+			if (pit == filterIndex.end())
+				continue;
+
+			for (MemoryFilterPostings::iterator fit = (*pit).second->begin(); fit != (*pit).second->end(); fit++) {
+				MemoryMatch *&m = scores[(*fit).first];
+
+				if (!m) {
+					m = new MemoryMatch((*fit).second, (*fit).first);
+					m->rank = (*fit).second->attrs.size();
+				}
+				m->weight++;
+			}
+		}
+	}
+
+	for (MemoryMatchMap::iterator it = scores.begin(); it != scores.end(); it++) {
+		MemoryMatch *m = (*it).second;
+
+		m->ratio = 100 * m->weight / (long)m->rank;
+
+		if (m->ratio > 0) {
+			heap.insert(m);
+			num_match++;
+		}
+	}
+
+	return num_match;
+}
+
+unsigned long MemoryDataStore::matchFilter(const Attributes *attrs, bool ratioAscending, Heap& heap, MemoryMatchMap& scores, const DataStoreFilterCursor *cursor)
+{
+	unsigned long num_match = 0;
+
+	if (attrs->empty())
+		return 0;
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+
+		if (a.getValue() == ATTR_WILDCARD) {
+			Map<string, MemoryNameCounts *>::iterator nit = dataObjectNameIndex.find(a.getName());
+
+			if (nit == dataObjectNameIndex.end())
+				continue;
+
+			for (MemoryNameCounts::iterator cit = (*nit).second->begin(); cit != (*nit).second->end(); cit++) {
+				MemoryMatch *&m = scores[(*cit).first];
+
+				if (!m) {
+					m = new MemoryMatch(dataObjectsByNum[(*cit).first], (*cit).first, cursor != NULL);
+					m->ratioAscending = ratioAscending;
+				}
+				m->weight += (*cit).second;
+
+				if (cursor)
+					m->rank += a.getWeight() * (*cit).second;
+			}
+		} else {
+			Map<string, MemoryDataObjectPostings *>::iterator pit = dataObjectIndex.find(attributeKey(a.getName(), a.getValue()));
+
+			if (pit == dataObjectIndex.end())
+				continue;
+
+			for (MemoryDataObjectPostings::iterator dit = (*pit).second->begin(); dit != (*pit).second->end(); dit++) {
+				MemoryMatch *&m = scores[(*dit).first];
+
+				if (!m) {
+					m = new MemoryMatch((*dit).second, (*dit).first, cursor != NULL);
+					m->ratioAscending = ratioAscending;
+				}
+				m->weight++;
+
+				if (cursor)
+					m->rank += a.getWeight();
+			}
+		}
+	}
+
+	for (MemoryMatchMap::iterator it = scores.begin(); it != scores.end(); it++) {
+		MemoryMatch *m = (*it).second;
+
+		m->ratio = 100 * m->weight / (long)attrs->size();
+
+		// Skip the data objects ranked before the cursor position
+		if (cursor && cursor->started && 
+		    !(m->ratio < cursor->lastRatio || 
+		      (m->ratio == cursor->lastRatio && 
+		       ((long)m->rank < cursor->lastWeight || 
+			((long)m->rank == cursor->lastWeight && (int64_t)m->num < cursor->lastNum)))))
+			continue;
+
+		if (m->ratio > 0) {
+			heap.insert(m);
+			num_match++;
+		}
+	}
+
+	return num_match;
+}
+
+/* ========================================================= */
+/* Filter matching                                           */
+/* ========================================================= */
+
+// ----- Dataobject > Filters
+
+int MemoryDataStore::evaluateFilters(const DataObjectRef& dObj)
+{
+	int n = 0;
+	Heap heap;
+	MemoryMatchMap scores;
+	DataObjectRefList dObjs;
+
+	if (!dObj)
+		return -1;
+
+	HAGGLE_DBG("Evaluating filters\n");
+
+	// Add the data object to the result list
+	dObjs.add(dObj);
+
+	matchFilters(dObj, heap, scores);
+
+	while (!heap.empty()) {
+		MemoryMatch *m = static_cast<MemoryMatch *>(heap.extractFirst());
+		MemoryFilterEntry *fe = static_cast<MemoryFilterEntry *>(m->entry);
+
+		HAGGLE_DBG("Filter %lu with event type %ld matches!\n", fe->num, fe->eventType);
+		n++;
+
+		kernel->addEvent(new Event((EventType)fe->eventType, dObjs));
+	}
+
+	clearMatches(scores);
+
+	return n;
+}
+
+// ----- Filter > Dataobjects
+
+int MemoryDataStore::_evaluateFilterPage(DataStoreFilterCursor *c, unsigned long max)
+{
+	int n = 0;
+	Heap heap;
+	MemoryMatchMap scores;
+	DataObjectRefList dObjs;
+
+	HAGGLE_DBG("Evaluating filter, page %lu\n", c->numPages + 1);
+
+	Map<long, MemoryFilterEntry *>::iterator it = filters.find(c->eventType);
+
+	// The filter has been removed or replaced
+	if (it == filters.end() || (int64_t)(*it).second->num != c->filterId)
+		return 0;
+
+	matchFilter(&(*it).second->attrs, false, heap, scores, c);
+
+	// Report the highest ranking data objects
+	while (!heap.empty() && (max == 0 || (unsigned long)n < max)) {
+		MemoryMatch *m = static_cast<MemoryMatch *>(heap.extractFirst());
+		MemoryDataObjectEntry *e = static_cast<MemoryDataObjectEntry *>(m->entry);
+
+		HAGGLE_DBG("Data object %lu matches!\n", e->num);
+
+		c->advance(m->ratio, (long)m->rank, m->num);
+		dObjs.push_back(e->dObj);
+		n++;
+	}
+
+	clearMatches(scores);
+
+	if (dObjs.size())
+		kernel->addEvent(new Event((EventType)c->eventType, dObjs));
+
+	return n;
+}
+
+/* ========================================================= */
+/* inserting and deleting of different objects               */
+/* ========================================================= */
+
+// remove old node descriptions
+int MemoryDataStore::deleteDataObjectNodeDescriptions(DataObjectRef dObj, string& node_id)
+{
+	// get node_id
+	NodeRef node = Node::create(dObj);
+
+	if (!node)
+		return -1;
+
+	node_id = node->getIdStr();
+
+	Map<string, MemoryDataObjectEntry *>::iterator it = nodeDescriptions.find(node_id);
+
+	if (it == nodeDescriptions.end())
+		return 1;
+
+	HAGGLE_DBG("Node description from same node [%s] already in datastore\n", node_id.c_str());
+
+	DataObjectRef dObj_stored = (*it).second->dObj;
+
+	if (dObj_stored->getCreateTime() < dObj->getCreateTime()) {
+		// delete and report as event
+		_deleteDataObject(dObj_stored, true);
+		return 1;
+	}
+
+	return 0;
+}
+
+int MemoryDataStore::_deleteFilter(long eventtype)
+{
+	Map<long, MemoryFilterEntry *>::iterator it = filters.find(eventtype);
+
+	if (it != filters.end())
+		removeFilter((*it).second);
+
+	return 0;
+}
+
+int MemoryDataStore::_insertFilter(Filter *f, bool matchFilter,
+				   const EventCallback<EventHandler> *callback)
+{
+	const Attributes *attrs;
+
+	if (!f)
+		return -1;
+
+	HAGGLE_DBG("Insert filter: %s\n", f->getFilterDescription().c_str());
+
+	if (filters.find(f->getEventType()) != filters.end()) {
+		HAGGLE_DBG("Filter exists, updating...\n");
+		_deleteFilter(f->getEventType());
+	}
+
+	MemoryFilterEntry *fe = new MemoryFilterEntry(num++, f->getEventType());
+
+	filters.insert(make_pair(fe->eventType, fe));
+
+	// Insert Attributes
+	attrs = f->getAttributes();
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+		string key = attributeKey(a.getName(), a.getValue());
+
+		Map<string, MemoryFilterPostings *>::iterator pit = filterIndex.find(key);
+
+		if (pit == filterIndex.end())
+			pit = filterIndex.insert(make_pair(key, new MemoryFilterPostings())).first;
+
+		if ((*pit).second->insert(make_pair(fe->num, fe)).second)
+			fe->attrs.add(a);
+	}
+
+	if (callback)
+		kernel->addEvent(new Event(callback, f));
+
+	// Find all data objects that match this filter, and report them back:
+	if (matchFilter)
+		evaluateFilterPage(new DataStoreFilterCursor(f->getEventType(), fe->num));
+
+	return (int)fe->num;
+}
+
+int MemoryDataStore::_deleteNode(NodeRef& node)
+{
+	Map<string, MemoryNodeEntry *>::iterator it = nodes.find(string(node->getIdStr()));
+
+	if (it != nodes.end())
+		removeNode((*it).second);
+
+	return 0;
+}
+
+int MemoryDataStore::_insertNode(NodeRef& node,
+				 const EventCallback<EventHandler> *callback,
+				 bool mergeBloomfilter)
+{
+	const Attributes *attrs;
+	const InterfaceRefList *ifaces;
+
+	if (!node->getDataObject())
+		return -1;
+
+	node.lock();
+
+	// Do not insert nodes with undefined state/type
+	if (node->getType() == Node::TYPE_UNDEFINED) {
+		HAGGLE_DBG("Node type undefined. Ignoring INSERT of node %s\n",
+			   node->getName().c_str());
+		node.unlock();
+		return -1;
+	}
+
+	HAGGLE_DBG("Inserting node %s, num attributes=%lu num interfaces=%lu\n",
+		   node->getName().c_str(), node->getAttributes()->size(),
+		   node->getInterfaces()->size());
+
+	Map<string, MemoryNodeEntry *>::iterator it = nodes.find(string(node->getIdStr()));
+
+	if (it != nodes.end()) {
+		HAGGLE_DBG("Node %s already in datastore -> replacing...\n",
+			   node->getName().c_str());
+
+		if (mergeBloomfilter) {
+			HAGGLE_DBG("Merging BF of node %s\n", node->getName().c_str());
+			node->getBloomfilter()->merge(*(*it).second->bloomfilter);
+		}
+		removeNode((*it).second);
+	}
+
+	MemoryNodeEntry *ne = new MemoryNodeEntry(num++);
+
+	ne->type = node->getType();
+	memcpy(ne->id, node->getId(), NODE_ID_LEN);
+	ne->idStr = node->getIdStr();
+	ne->name = node->getName();
+	ne->nodeDescriptionCreateTime = node->getNodeDescriptionCreateTime();
+	ne->maxDataObjectsInMatch = node->getMaxDataObjectsInMatch();
+	ne->matchingThreshold = node->getMatchingThreshold();
+	ne->bloomfilter = Bloomfilter::create(*node->getBloomfilter());
+
+	if (!ne->bloomfilter) {
+		HAGGLE_ERR("Could not copy bloomfilter of node %s\n", node->getName().c_str());
+		delete ne;
+		node.unlock();
+		return -1;
+	}
+
+	nodes.insert(make_pair(ne->idStr, ne));
+
+	// Insert the attributes as the node's interests. Must use the node
+	// pointer here since the nodeRef is now locked.
+	attrs = node->getAttributes();
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+		const Attribute& a = (*it).second;
+		string key = attributeKey(a.getName(), a.getValue());
+		long weight = (long)a.getWeight();
+
+		HAGGLE_DBG("Inserting attribute %s=%s\n",
+			   a.getName().c_str(), a.getValue().c_str());
+
+		if (!ne->interests.insert(make_pair(key, weight)).second)
+			continue;
+
+		ne->attrs.add(a);
+		ne->sumWeights += weight;
+
+		Map<string, MemoryNodePostings *>::iterator pit = nodeIndex.find(key);
+
+		if (pit == nodeIndex.end())
+			pit = nodeIndex.insert(make_pair(key, new MemoryNodePostings())).first;
+
+		(*pit).second->insert(make_pair(ne->num, ne));
+	}
+
+	// Insert node interfaces
+	ifaces = node->getInterfaces();
+
+	for (InterfaceRefList::const_iterator it = ifaces->begin(); it != ifaces->end(); it++) {
+		InterfaceRef iface = (*it);
+
+		iface.lock();
+
+		HAGGLE_DBG("Insert interface %s\n", iface->getIdentifierStr());
+
+		if (!nodesByInterface.insert(make_pair(interfaceKey(iface), ne)).second) {
+			HAGGLE_DBG("Interface %s already in datastore\n",
+				   iface->getIdentifierStr());
+		} else {
+			ne->ifaces.push_back(iface);
+		}
+		iface.unlock();
+	}
+
+	node.unlock();
+
+	if (callback) {
+		HAGGLE_DBG("Scheduling callback for inserted node\n");
+		kernel->addEvent(new Event(callback, node));
+	}
+	HAGGLE_DBG("Node %s inserted successfully\n",
+		   node->getName().c_str());
+
+	return 1;
+}
+
+int MemoryDataStore::_deleteDataObject(const DataObjectId_t &id,
+				       bool shouldReportRemoval,
+				       bool keepInBloomfilter)
+{
+	char idStr[MAX_DATAOBJECT_ID_STR_LEN];
+	int len = 0;
+
+	// Generate a readable string of the Id
+	for (int i = 0; i < DATAOBJECT_ID_LEN; i++) {
+		len += sprintf(idStr + len, "%02x", id[i] & 0xff);
+	}
+
+	Map<string, MemoryDataObjectEntry *>::iterator it = dataObjects.find(string(idStr));
+
+	if (shouldReportRemoval) {
+		if (it != dataObjects.end()) {
+			DataObjectRef dObj = (*it).second->dObj;
+			dObj->setStored(false);
+			kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED,
+						   dObj, keepInBloomfilter));
+		} else {
+			HAGGLE_ERR("Tried to report removal of a data object that "
+				"isn't in the data store. (id=%s)\n", idStr);
+			// there should not be a data object to delete, so done.
+			return -1;
+		}
+	}
+
+	if (it == dataObjects.end()) {
+		HAGGLE_DBG("Delete data object %s - NO MATCH?\n", idStr);
+		return 0;
+	}
+
+	MemoryDataObjectEntry *e = (*it).second;
+
+	unindexDataObject(e);
+	delete e;
+
+	HAGGLE_DBG("Deleted data object %s\n", idStr);
+
+	return 0;
+}
+
+int MemoryDataStore::_deleteDataObject(DataObjectRef& dObj,
+				       bool shouldReportRemoval,
+				       bool keepInBloomfilter)
+{
+	if (_deleteDataObject(dObj->getId(), false, keepInBloomfilter) == 0 && shouldReportRemoval)
+		kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObj, keepInBloomfilter));
+
+	return 0;
+}
+
+int MemoryDataStore::_ageDataObjects(const Timeval& minimumAge,
+				     const EventCallback<EventHandler> *callback,
+				     bool keepInBloomfilter)
+{
+	DataObjectRefList dObjs;
+	Timeval maxTimestamp = Timeval::now() - minimumAge;
+
+	// -- delete dataobjects not related to any filter (no interest) and
+	// being inserted more than minimumAge seconds ago. The entries are in
+	// insertion order, so we can stop at the first one that is too young.
+	for (MemoryDataObjectPostings::iterator it = dataObjectsByNum.begin();
+	     it != dataObjectsByNum.end() && dObjs.size() < DATASTORE_MAX_DATAOBJECTS_AGED_AT_ONCE; it++) {
+		MemoryDataObjectEntry *e = (*it).second;
+		Heap heap;
+		MemoryMatchMap scores;
+
+		if (!(e->timestamp < maxTimestamp))
+			break;
+
+		unsigned long num_match = matchFilters(e->dObj, heap, scores);
+
+		clearMatches(scores);
+
+		if (num_match == 0) {
+			e->dObj->setStored(false);
+			dObjs.push_back(e->dObj);
+		}
+	}
+
+	for (DataObjectRefList::iterator it = dObjs.begin(); it != dObjs.end(); it++) {
+		_deleteDataObject(*it, false);	// delete and report as event
+	}
+
+	kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObjs, keepInBloomfilter));
+
+	if (callback)
+		kernel->addEvent(new Event(callback, dObjs));
+
+	return dObjs.size();
+}
+
+int MemoryDataStore::_evictDataObjects(DataStoreEvictionQuery *q)
+{
+	DataObjectRefList dObjs;
+	const DataStoreEvictionPolicy& policy = q->getPolicy();
+	unsigned long num_dataobjects = dataObjects.size();
+	Timeval now = Timeval::now();
+
+	HAGGLE_DBG("Data store usage: %lu data objects, %llu bytes\n", num_dataobjects, bytes);
+
+	if (!q->isContinuing()) {
+		clearEvictionPlan();
+
+		if (policy.isOverBudget(num_dataobjects, bytes, false)) {
+			for (MemoryDataObjectPostings::iterator it = dataObjectsByNum.begin(); it != dataObjectsByNum.end(); it++) {
+				MemoryDataObjectEntry *e = (*it).second;
+				const Attributes *attrs = e->dObj->getAttributes();
+				unsigned long interest = 0;
+
+				// Node descriptions are not evicted
+				if (!e->nodeId.empty())
+					continue;
+
+				// The number of node attributes that the data object matches
+				for (Attributes::const_iterator ait = attrs->begin(); ait != attrs->end(); ait++) {
+					Map<string, MemoryNodePostings *>::iterator pit = 
+						nodeIndex.find(attributeKey((*ait).second.getName(), (*ait).second.getValue()));
+
+					if (pit != nodeIndex.end())
+						interest += (*pit).second->size();
+				}
+
+				q->addCandidate(e->num, e->dObj->getIdStr(), interest, 
+						(now - e->timestamp).getTimeAsSecondsDouble(), e->size);
+			}
+			q->getCandidates(evictionPlan, num_dataobjects, bytes);
+		}
+	}
+
+	// Evict the next batch of the plan, until the usage is within budget
+	while (!evictionPlan.empty() && dObjs.size() < policy.batchSize && 
+	       policy.isOverBudget(num_dataobjects, bytes, true)) {
+		DataStoreEvictionCandidate *c = evictionPlan.front();
+
+		evictionPlan.pop_front();
+
+		// The data object may have been deleted since the plan was made
+		MemoryDataObjectPostings::iterator it = dataObjectsByNum.find((unsigned long)c->num);
+
+		if (it != dataObjectsByNum.end()) {
+			DataObjectRef dObj = (*it).second->dObj;
+
+			HAGGLE_DBG("Evicting data object [%s] with utility %.2lf\n", 
+				   dObj->getIdStr(), c->utility);
+			dObj->setStored(false);
+			_deleteDataObject(dObj, false);
+			dObjs.push_back(dObj);
+			num_dataobjects--;
+		}
+		delete c;
+	}
+
+	if (!policy.isOverBudget(num_dataobjects, bytes, true))
+		clearEvictionPlan();
+
+	if (dObjs.size()) {
+		LOG_ADD("%s: Evicted %lu data objects, data store usage %lu data objects, %llu bytes\n", 
+			Timeval::now().getAsString().c_str(), (unsigned long)dObjs.size(), 
+			num_dataobjects, bytes);
+		kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObjs, q->getKeepInBloomfilter()));
+	}
+
+	if (q->getCallback())
+		kernel->addEvent(new Event(q->getCallback(), dObjs));
+
+	return dObjs.size();
+}
+
+int MemoryDataStore::_insertDataObject(DataObjectRef& dObj,
+				       const EventCallback<EventHandler> *callback)
+{
+	int ret;
+	string node_id;
+
+	if (!dObj) {
+		return -1;
+	}
+
+	dObj.lock();
+
+	HAGGLE_DBG("DataStore insert data object [%s] with num_attributes=%d\n",
+		dObj->getIdStr(), dObj->getAttributes()->size());
+
+	// adding node_id for node descriptions to refer to the corresponding node
+	// and simplifying to delete old node descriptions
+	if (dObj->isNodeDescription()) {
+		ret = deleteDataObjectNodeDescriptions(dObj, node_id);
+		/*
+		   return value of 1 means the node description is a new one,
+		   and we will continue with the insert. Otherwise ignore.
+		*/
+		if (ret == 0) {
+			// this is an old node description, ignore it.
+			HAGGLE_DBG("There are already newer node descriptions for"
+				   " the same node [%s] in the data store.\n",
+				   node_id.c_str());
+			dObj.unlock();
+			return -1;
+		} else if (ret == -1) {
+			HAGGLE_ERR("Bad node description, ignoring insert.\n");
+			dObj.unlock();
+			return -1;
+		}
+	}
+
+	if (dataObjects.find(string(dObj->getIdStr())) != dataObjects.end()) {
+		if (!dObj->isPersistent()) {
+			/*
+			   There was already a copy of a non-persistent
+			   data object in the data store. Delete the data
+			   object, and then try to insert it again.
+			*/
+			dObj.unlock();
+			_deleteDataObject(dObj, false);
+			return _insertDataObject(dObj, callback);
+		}
+		HAGGLE_ERR("DataObject [%s] already in datastore\n", dObj->getIdStr());
+		// Mark as a duplicate
+		dObj->setDuplicate();
+		// Also mark object as stored so that the data is not deleted
+		dObj->setStored();
+		dObj.unlock();
+
+		// Notify the data manager of this duplicate data object
+		if (callback)
+			kernel->addEvent(new Event(callback, dObj));
+
+		return 0;
+	}
+
+	// Mark object as stored so that the data is not deleted
+	dObj->setStored();
+
+	indexDataObject(new MemoryDataObjectEntry(num++, dObj, Timeval::now(), node_id));
+
+	dObj.unlock();
+
+	HAGGLE_DBG("Data object [%s] successfully inserted\n", dObj->getIdStr());
+
+	// Evaluate Filters
+	evaluateFilters(dObj);
+
+	// Remove non-persistent data object from the data store
+	if (!dObj->isPersistent()) {
+		_deleteDataObject(dObj, false);
+	}
+
+	if (callback)
+		kernel->addEvent(new Event(callback, dObj));
+
+	return 0;
+}
+
+/* ========================================================= */
+/* Asynchronous calls to retrieve objects                    */
+/* ========================================================= */
+
+int MemoryDataStore::_retrieveNode(NodeRef& refNode, const EventCallback<EventHandler> *callback, bool forceCallback)
+{
+	NodeRef node = NULL;
+
+	if (!callback) {
+		HAGGLE_ERR("No callback specified\n");
+		return -1;
+	}
+
+	HAGGLE_DBG("Retrieve Node %s\n", refNode->getName().c_str());
+
+	MemoryNodeEntry *ne = findNode(refNode);
+
+	if (ne)
+		node = createNode(ne);
+
+	if (!node) {
+		HAGGLE_DBG("No node %s in data store\n", refNode->getName().c_str());
+		if (forceCallback) {
+			HAGGLE_DBG("Forcing callback\n");
+			kernel->addEvent(new Event(callback, refNode));
+			return 0;
+		} else {
+			return -1;
+		}
+	}
+
+	// See SQLDataStore::_retrieveNode(): allows an application's new UDP
+	// port number to be moved to it's old node.
+	if (forceCallback) {
+		refNode.lock();
+		const InterfaceRefList *lst = refNode->getInterfaces();
+
+		for (InterfaceRefList::const_iterator it = lst->begin();
+		     it != lst->end(); it++) {
+			node->addInterface(*it);
+		}
+		refNode.unlock();
+	}
+
+	HAGGLE_DBG("Node %s retrieved successfully\n", refNode->getName().c_str());
+
+	kernel->addEvent(new Event(callback, node));
+
+	return 1;
+}
+
+int MemoryDataStore::_retrieveNode(Node::Type_t type, const EventCallback<EventHandler> *callback)
+{
+	NodeRefList *nodes_of_type = NULL;
+
+	if (!callback) {
+		HAGGLE_ERR("No callback specified\n");
+		return -1;
+	}
+
+	for (Map<string, MemoryNodeEntry *>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+		if ((*it).second->type != type)
+			continue;
+
+		NodeRef node = createNode((*it).second);
+
+		if (node) {
+			if (nodes_of_type == NULL) {
+				nodes_of_type = new NodeRefList();
+			}
+			nodes_of_type->push_front(node);
+		}
+	}
+
+	kernel->addEvent(new Event(callback, nodes_of_type));
+
+	return 1;
+}
+
+int MemoryDataStore::_retrieveNode(const InterfaceRef& iface, const EventCallback<EventHandler> *callback, bool forceCallback)
+{
+	NodeRef node = NULL;
+
+	if (!callback) {
+		HAGGLE_ERR("No callback specified\n");
+		return -1;
+	}
+
+	HAGGLE_DBG("Retrieving node based on interface [%s]\n", iface->getIdentifierStr());
+
+	Map<string, MemoryNodeEntry *>::iterator it = nodesByInterface.find(interfaceKey(iface));
+
+	if (it != nodesByInterface.end())
+		node = createNode((*it).second);
+
+	if (!node) {
+		HAGGLE_DBG("No node with interface [%s] in data store\n", iface->getIdentifierStr());
+		if (forceCallback) {
+			HAGGLE_DBG("Forcing callback\n");
+			kernel->addEvent(new Event(callback, iface));
+			return 0;
+		} else {
+			return -1;
+		}
+	}
+
+	if (iface->isUp()) {
+		node->setInterfaceUp(iface);
+	}
+
+	HAGGLE_DBG("Node %s retrieved successfully based on interface [%s]\n", node->getName().c_str(), iface->getIdentifierStr());
+
+	kernel->addEvent(new Event(callback, node));
+
+	return 1;
+}
+
+/* ========================================================= */
+/* Asynchronous queries                                      */
+/* ========================================================= */
+
+// ----- Filter > Dataobjects
+
+int MemoryDataStore::_doFilterQuery(DataStoreFilterQuery *q)
+{
+	DataStoreQueryResult *qr;
+	unsigned int num_match = 0;
+	Heap heap;
+	MemoryMatchMap scores;
+
+	HAGGLE_DBG("Filter Query\n");
+
+	if (!q) {
+		return -1;
+	}
+
+	qr = new DataStoreQueryResult();
+
+	if (!qr) {
+		HAGGLE_DBG("Could not allocate query result object\n");
+		return -1;
+	}
+
+	// The filter is matched directly, without being inserted. Results
+	// are ordered by ascending ratio, like in the SQL data store.
+	matchFilter(q->getFilter()->getAttributes(), true, heap, scores);
+
+	qr->setQuerySqlEndTime();
+
+	while (!heap.empty()) {
+		MemoryMatch *m = static_cast<MemoryMatch *>(heap.extractFirst());
+		MemoryDataObjectEntry *e = static_cast<MemoryDataObjectEntry *>(m->entry);
+
+		HAGGLE_DBG("Dataobject %lu matches!\n", e->num);
+
+		qr->addDataObject(e->dObj);
+		num_match++;
+	}
+
+	clearMatches(scores);
+
+	if (num_match) {
+		kernel->addEvent(new Event(q->getCallback(), qr));
+	} else {
+		delete qr;
+	}
+
+	return num_match;
+}
+
+// ----- Node > Dataobjects
+
+int MemoryDataStore::_doDataObjectQueryStep2(NodeRef &node,
+					     NodeRef delegate_node,
+					     DataStoreQueryResult *qr,
+					     int max_matches,
+					     unsigned int threshold,
+					     unsigned int attrMatch)
+{
+	int num_match = 0;
+	Heap heap;
+	MemoryMatchMap scores;
+
+	MemoryNodeEntry *ne = findNode(node);
+
+	if (!ne) {
+		HAGGLE_DBG("Node %s not in data store\n", node->getName().c_str());
+		return 0;
+	}
+
+	matchNode(ne, threshold, attrMatch, heap, scores);
+
+	// Only the data objects that are returned are ranked
+	while (!heap.empty()) {
+		MemoryMatch *m = static_cast<MemoryMatch *>(heap.extractFirst());
+		MemoryDataObjectEntry *e = static_cast<MemoryDataObjectEntry *>(m->entry);
+		DataObjectRef dObj = e->dObj;
+
+		bool delegate_has_dataobject = delegate_node ? delegate_node->getBloomfilter()->has(dObj) : false;
+		// Ignore this data object if the target or the potential delegate
+		// already has it
+		if (node->getBloomfilter()->has(dObj) || delegate_has_dataobject)
+			continue;
+
+		if (!e->nodeId.empty()) {
+			// Ignore this data object if it is the node description of the target
+			// or a potential delegate
+			if (e->nodeId == node->getIdStr() || 
+			    (delegate_node && e->nodeId == delegate_node->getIdStr())) {
+				continue;
+			}
+			// Nodes without a node description are only known by their 
+			// interfaces, which requires the node in the description
+			if (node->getType() == Node::TYPE_UNDEFINED || 
+			    (delegate_node && delegate_node->getType() == Node::TYPE_UNDEFINED)) {
+				NodeRef desc_node = Node::create(Node::TYPE_PEER, dObj);
+
+				if (desc_node == node || (delegate_node && delegate_node == desc_node)) {
+					continue;
+				}
+			}
+		}
+		qr->addDataObject(dObj);
+		num_match++;
+
+		if (max_matches != 0 && (num_match >= max_matches)) {
+			break;
+		}
+	}
+
+	clearMatches(scores);
+
+	return num_match;
+}
+
+int MemoryDataStore::_doDataObjectQuery(DataStoreDataObjectQuery *q)
+{
+	unsigned int num_match = 0;
+	DataStoreQueryResult *qr;
+	NodeRef node = q->getNode();
+
+	HAGGLE_DBG("DataStore DataObject Query for node=%s\n", node->getIdStr());
+
+	qr = new DataStoreQueryResult();
+
+	if (!qr) {
+		HAGGLE_DBG("Could not allocate query result object\n");
+		return -1;
+	}
+
+	qr->addNode(node);
+	qr->setQuerySqlStartTime();
+	qr->setQueryInitTime(q->getQueryInitTime());
+
+	num_match = _doDataObjectQueryStep2(node, NULL,
+					    qr, node->getMaxDataObjectsInMatch(),
+					    node->getMatchingThreshold(),
+					    q->getAttrMatch());
+
+	qr->setQuerySqlEndTime();
+	qr->setQueryResultTime();
+
+#if defined(BENCHMARK)
+	kernel->addEvent(new Event(q->getCallback(), qr));
+#else
+	if (num_match) {
+		kernel->addEvent(new Event(q->getCallback(), qr));
+	} else {
+		delete qr;
+	}
+#endif
+
+	HAGGLE_DBG("%u data objects matched query\n", num_match);
+
+	return num_match;
+}
+
+/*
+	This function is basically the same as _doDataObjectQuery, except that it
+	also goes through a list of secondary nodes.
+*/
+int MemoryDataStore::_doDataObjectForNodesQuery(DataStoreDataObjectForNodesQuery *q)
+{
+	unsigned int num_match = 0;
+	unsigned int total_match = 0;
+	long num_left;
+	bool has_maximum = false;
+	DataStoreQueryResult *qr;
+	NodeRef node = q->getNode();
+	NodeRef delegateNode = node;
+	unsigned int threshold = 0;
+
+	HAGGLE_DBG("DataStore DataObject (for multiple nodes) Query for node=%s\n",
+		node->getIdStr());
+
+	qr = new DataStoreQueryResult();
+
+	if (!qr) {
+		HAGGLE_DBG("Could not allocate query result object\n");
+		return -1;
+	}
+
+	qr->addNode(node);
+	qr->setQuerySqlStartTime();
+	qr->setQueryInitTime(q->getQueryInitTime());
+
+	num_left = node->getMaxDataObjectsInMatch();
+
+	if (num_left > 0)
+		has_maximum = true;
+
+	threshold = node->getMatchingThreshold();
+	node = q->getNextNode();
+
+	while (node && !(has_maximum && (num_left <= 0))) {
+
+		num_match = _doDataObjectQueryStep2(node, delegateNode, qr, num_left, threshold, q->getAttrMatch());
+
+		if (has_maximum) {
+			num_left -= num_match;
+		}
+		total_match += num_match;
+		node = q->getNextNode();
+	}
+
+	qr->setQuerySqlEndTime();
+	qr->setQueryResultTime();
+
+	// Like the SQL data store, the result is only reported if the last
+	// node had matches
+#if defined(BENCHMARK)
+	kernel->addEvent(new Event(q->getCallback(), qr));
+#else
+	if (num_match) {
+		kernel->addEvent(new Event(q->getCallback(), qr));
+	} else {
+		delete qr;
+	}
+#endif
+
+	HAGGLE_DBG("%u data objects matched query\n", total_match);
+
+	return num_match;
+}
+
+// ----- Dataobject > Nodes
+
+int MemoryDataStore::_doNodeQuery(DataStoreNodeQuery *q)
+{
+	unsigned int num_match = 0;
+	DataStoreQueryResult *qr;
+	DataObjectRef dObj = q->getDataObject();
+	Heap heap;
+	MemoryMatchMap scores;
+
+	if (!dObj) {
+		HAGGLE_ERR("No data object in query\n");
+		return -1;
+	}
+
+	HAGGLE_DBG("Node query for data object [%s]\n", dObj->getIdStr());
+
+	qr = new DataStoreQueryResult();
+
+	if (!qr) {
+		HAGGLE_DBG("Could not allocate query result object\n");
+		return -1;
+	}
+
+	qr->addDataObject(dObj);
+	qr->setQuerySqlStartTime();
+	qr->setQueryInitTime(q->getQueryInitTime());
+
+	// Only data objects in the data store are matched
+	Map<string, MemoryDataObjectEntry *>::iterator dit = dataObjects.find(string(dObj->getIdStr()));
+
+	if (dit != dataObjects.end()) {
+		const Attributes *attrs = (*dit).second->dObj->getAttributes();
+
+		for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
+			const Attribute& a = (*it).second;
+			string key = attributeKey(a.getName(), a.getValue());
+			Map<string, MemoryNodePostings *>::iterator pit = nodeIndex.find(key);
+
+			if (pit == nodeIndex.end())
+				continue;
+
+			for (MemoryNodePostings::iterator nit = (*pit).second->begin(); nit != (*pit).second->end(); nit++) {
+				MemoryMatch *&m = scores[(*nit).first];
+				long weight = (*(*nit).second->interests.find(key)).second;
+
+				if (!m)
+					m = new MemoryMatch((*nit).second, (*nit).first);
+
+				m->mcount++;
+				m->weight += weight;
+
+				if (weight == ATTR_WEIGHT_NO_MATCH)
+					m->notMatch = true;
+			}
+		}
+
+		for (MemoryMatchMap::iterator it = scores.begin(); it != scores.end(); it++) {
+			MemoryMatch *m = (*it).second;
+			MemoryNodeEntry *ne = static_cast<MemoryNodeEntry *>(m->entry);
+
+			if (ne->sumWeights == 0)
+				continue;
+
+			m->ratio = 100 * m->weight / ne->sumWeights;
+
+			if (!m->notMatch && m->ratio >= (long)ne->matchingThreshold && m->mcount >= q->getAttrMatch())
+				heap.insert(m);
+		}
+	}
+
+	qr->setQuerySqlEndTime();
+
+	// Like the limit of the SQL query, at most getMaxResp() nodes are returned
+	while (!heap.empty() && (q->getMaxResp() == 0 || num_match < q->getMaxResp())) {
+		MemoryMatch *m = static_cast<MemoryMatch *>(heap.extractFirst());
+		MemoryNodeEntry *ne = static_cast<MemoryNodeEntry *>(m->entry);
+
+		/*
+		 Only consider peers and gateways as targets.
+		 Application nodes receive data objects via their
+		 filters....
+		*/
+		if (ne->type == Node::TYPE_PEER || ne->type == Node::TYPE_GATEWAY) {
+			NodeRef node = createNode(ne);
+
+			if (node) {
+				qr->addNode(node);
+				num_match++;
+			}
+		}
+	}
+
+	clearMatches(scores);
+
+	qr->setQueryResultTime();
+
+#if !defined(BENCHMARK)
+	if (num_match) {
+		kernel->addEvent(new Event(q->getCallback(), qr));
+	} else {
+		delete qr;
+	}
+#else
+	kernel->addEvent(new Event(q->getCallback(), qr));
+#endif
+
+	HAGGLE_DBG("%u nodes matched data object [%s]\n", num_match, dObj->getIdStr());
+
+	return num_match;
+}
+
+/* ========================================================= */
+/* Repository Methods                                        */
+/* ========================================================= */
+
+/*
+	Matches a string against a pattern in the same way as the SQL LIKE
+	operator: '%' matches any sequence, '_' any single character, and
+	the comparison is case insensitive.
+*/
+static bool like(const char *pattern, const char *str)
+{
+	for (; *pattern; pattern++, str++) {
+		if (*pattern == '%') {
+			while (*pattern == '%')
+				pattern++;
+
+			if (!*pattern)
+				return true;
+
+			for (; *str; str++) {
+				if (like(pattern, str))
+					return true;
+			}
+			return false;
+		}
+		if (!*str)
+			return false;
+
+		if (*pattern != '_' && tolower(*pattern) != tolower(*str))
+			return false;
+	}
+	return *str == '\0';
+}
+
+static inline const char *nonull(const char *str)
+{
+	return str ? str : "";
+}
+
+int MemoryDataStore::_insertRepository(DataStoreRepositoryQuery *q)
+{
+	const RepositoryEntryRef query = q->getQuery();
+	bool found = false;
+
+	HAGGLE_DBG("Inserting repository \'%s\' : \'%s\'\n", query->getAuthority(), query->getKey() ? query->getKey() : "-");
+
+	// Update the matching entries, or insert a new one
+	for (RepositoryEntryList::iterator it = repository.begin(); it != repository.end(); it++) {
+		RepositoryEntryRef& re = *it;
+
+		if (strcmp(nonull(re->getAuthority()), nonull(query->getAuthority())) != 0 ||
+		    strcmp(nonull(re->getKey()), nonull(query->getKey())) != 0)
+			continue;
+
+		found = true;
+
+		if (re->getType() != query->getType() ||
+		    (query->getId() > 0 && re->getId() != query->getId()))
+			continue;
+
+		if (query->getType() == RepositoryEntry::VALUE_TYPE_BLOB) {
+			re = new RepositoryEntry(nonull(query->getAuthority()), nonull(query->getKey()),
+						 query->getValueBlob(), query->getValueLen(), re->getId());
+		} else {
+			re = new RepositoryEntry(nonull(query->getAuthority()), nonull(query->getKey()),
+						 nonull(query->getValueStr()), re->getId());
+		}
+	}
+
+	if (found)
+		return 1;
+
+	if (query->getType() == RepositoryEntry::VALUE_TYPE_BLOB) {
+		repository.push_back(new RepositoryEntry(nonull(query->getAuthority()), nonull(query->getKey()),
+							 query->getValueBlob(), query->getValueLen(), repositoryId++));
+	} else {
+		repository.push_back(new RepositoryEntry(nonull(query->getAuthority()), nonull(query->getKey()),
+							 nonull(query->getValueStr()), repositoryId++));
+	}
+
+	return 1;
+}
+
+int MemoryDataStore::_readRepository(DataStoreRepositoryQuery *q, const EventCallback<EventHandler> *callback)
+{
+	const RepositoryEntryRef query = q->getQuery();
+
+	HAGGLE_DBG("Reading repository \'%s\' : \'%s\'\n", query->getAuthority(), query->getKey() ? query->getKey() : "-");
+
+	if (!query->getAuthority()) {
+		HAGGLE_ERR("Error: No authority in repository entry\n");
+		return -1;
+	}
+
+	DataStoreQueryResult *qr = new DataStoreQueryResult();
+
+	if (!qr) {
+		HAGGLE_ERR("Could not allocate query result object\n");
+		return -1;
+	}
+
+	for (RepositoryEntryList::iterator it = repository.begin(); it != repository.end(); it++) {
+		const RepositoryEntryRef& re = *it;
+
+		if (strcmp(nonull(re->getAuthority()), query->getAuthority()) != 0)
+			continue;
+
+		if (query->getKey() && !like(query->getKey(), nonull(re->getKey())))
+			continue;
+
+		if (query->getId() > 0 && re->getId() != query->getId())
+			continue;
+
+		// Return a copy, like the SQL data store
+		RepositoryEntryRef copy;
+
+		if (re->getType() == RepositoryEntry::VALUE_TYPE_BLOB) {
+			copy = new RepositoryEntry(re->getAuthority(), nonull(re->getKey()),
+						   re->getValueBlob(), re->getValueLen(), re->getId());
+		} else {
+			copy = new RepositoryEntry(re->getAuthority(), nonull(re->getKey()),
+						   nonull(re->getValueStr()), re->getId());
+		}
+		qr->addRepositoryEntry(copy);
+	}
+
+	kernel->addEvent(new Event(q->getCallback(), qr));
+
+	return 1;
+}
+
+int MemoryDataStore::_deleteRepository(DataStoreRepositoryQuery *q)
+{
+	const RepositoryEntryRef query = q->getQuery();
+	RepositoryEntryList::iterator it = repository.begin();
+
+	while (it != repository.end()) {
+		const RepositoryEntryRef& re = *it;
+
+		if (strcmp(nonull(re->getAuthority()), nonull(query->getAuthority())) == 0 &&
+		    strcmp(nonull(re->getKey()), nonull(query->getKey())) == 0 &&
+		    (query->getId() == 0 || re->getId() == query->getId())) {
+			it = repository.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	return 1;
+}
+
+/* ========================================================= */
+/* Dumping and snapshots                                     */
+/* ========================================================= */
+
+/*
+	Creates metadata describing the data store. With fields, the data
+	objects carry the fields needed to recreate them from a snapshot.
+*/
+bool MemoryDataStore::fillDataObjectMetadata(Metadata *dm, MemoryDataObjectEntry *e, bool withFields)
+{
+	char buf[32];
+	DataObjectRef& dObj = e->dObj;
+
+	dObj.lock();
+
+	dm->setParameter("id", dObj->getIdStr());
+	dm->setParameter("timestamp", e->timestamp.getAsString());
+
+	if (!e->nodeId.empty())
+		dm->setParameter("node_id", e->nodeId);
+
+	if (withFields) {
+		dm->setParameter("filepath", dObj->getFilePath());
+		dm->setParameter("filename", dObj->getFileName());
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)dObj->getDataLen());
+		dm->setParameter("datalen", buf);
+		dm->setParameter("datastate", (unsigned int)dObj->getDataState());
+		dm->setParameter("signature_status", (unsigned int)dObj->getSignatureStatus());
+		dm->setParameter("signee", dObj->getSignee());
+		snprintf(buf, sizeof(buf), "%lu", dObj->getRxTime());
+		dm->setParameter("rxtime", buf);
+
+		if (dObj->getReceiveTime().isValid())
+			dm->setParameter("receive_time", dObj->getReceiveTime().getAsString());
+
+		if (dObj->getSignatureLength() &&
+		    dObj->getSignatureStatus() != DataObject::SIGNATURE_MISSING) {
+			char *b64 = NULL;
+
+			if (base64_encode_alloc((const char *)dObj->getSignature(), dObj->getSignatureLength(), &b64) > 0) {
+				dm->setParameter("signature", b64);
+			}
+			if (b64)
+				free(b64);
+		}
+	}
+
+	const Metadata *hm = dObj->toMetadata();
+
+	if (hm)
+		dm->addMetadata(hm->copy());
+
+	dObj.unlock();
+
+	return true;
+}
+
+bool MemoryDataStore::fillNodeMetadata(Metadata *nm, MemoryNodeEntry *ne)
+{
+	char buf[32];
+
+	nm->setParameter("id", ne->idStr);
+	nm->setParameter("name", ne->name);
+	nm->setParameter("type", Node::typeToStr(ne->type));
+	nm->setParameter("threshold", (unsigned int)ne->matchingThreshold);
+	nm->setParameter("max_dataobjects_in_match", (unsigned int)ne->maxDataObjectsInMatch);
+	snprintf(buf, sizeof(buf), "%ld", ne->sumWeights);
+	nm->setParameter("sum_weights", buf);
+
+	for (Attributes::const_iterator ait = ne->attrs.begin(); ait != ne->attrs.end(); ait++) {
+		Metadata *am = nm->addMetadata(DATAOBJECT_ATTRIBUTE_NAME, (*ait).second.getValue());
+
+		if (am) {
+			am->setParameter(DATAOBJECT_ATTRIBUTE_NAME_PARAM, (*ait).second.getName());
+			am->setParameter(DATAOBJECT_ATTRIBUTE_WEIGHT_PARAM, (*ait).second.getWeightAsString());
+		}
+	}
+
+	for (InterfaceRefList::const_iterator iit = ne->ifaces.begin(); iit != ne->ifaces.end(); iit++) {
+		Metadata *im = nm->addMetadata("Interface", (*iit)->getIdentifierStr());
+
+		if (im)
+			im->setParameter("type", (*iit)->getTypeStr());
+	}
+
+	return true;
+}
+
+bool MemoryDataStore::fillFilterMetadata(Metadata *fm, MemoryFilterEntry *fe)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%ld", fe->eventType);
+	fm->setParameter("event", buf);
+
+	for (Attributes::const_iterator ait = fe->attrs.begin(); ait != fe->attrs.end(); ait++) {
+		Metadata *am = fm->addMetadata(DATAOBJECT_ATTRIBUTE_NAME, (*ait).second.getValue());
+
+		if (am) {
+			am->setParameter(DATAOBJECT_ATTRIBUTE_NAME_PARAM, (*ait).second.getName());
+			am->setParameter(DATAOBJECT_ATTRIBUTE_WEIGHT_PARAM, (*ait).second.getWeightAsString());
+		}
+	}
+
+	return true;
+}
+
+Metadata *MemoryDataStore::toMetadata(bool withFields)
+{
+	Metadata *m = new XMLMetadata(MEMORY_DATASTORE_METADATA);
+
+	if (!m)
+		return NULL;
+
+	for (MemoryDataObjectPostings::iterator it = dataObjectsByNum.begin(); it != dataObjectsByNum.end(); it++) {
+		Metadata *dm = m->addMetadata(MEMORY_DATASTORE_DATAOBJECT);
+
+		if (!dm || !fillDataObjectMetadata(dm, (*it).second, withFields))
+			goto out_err;
+	}
+
+	if (withFields) {
+		for (RepositoryEntryList::iterator it = repository.begin(); it != repository.end(); it++) {
+			const RepositoryEntryRef& re = *it;
+			Metadata *rm;
+
+			if (re->getType() == RepositoryEntry::VALUE_TYPE_BLOB) {
+				char *b64 = NULL;
+
+				if (base64_encode_alloc((const char *)re->getValueBlob(), re->getValueLen(), &b64) == 0 && re->getValueLen()) {
+					HAGGLE_ERR("Could not encode repository value\n");
+					continue;
+				}
+				rm = m->addMetadata(MEMORY_DATASTORE_REPOSITORY, b64 ? b64 : "");
+
+				if (b64)
+					free(b64);
+			} else {
+				rm = m->addMetadata(MEMORY_DATASTORE_REPOSITORY, nonull(re->getValueStr()));
+			}
+
+			if (!rm)
+				goto out_err;
+
+			rm->setParameter("type", (unsigned int)re->getType());
+			rm->setParameter("authority", nonull(re->getAuthority()));
+			rm->setParameter("key", nonull(re->getKey()));
+			rm->setParameter("id", re->getId());
+		}
+		return m;
+	}
+
+	for (Map<string, MemoryNodeEntry *>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+		Metadata *nm = m->addMetadata(MEMORY_DATASTORE_NODE);
+
+		if (!nm || !fillNodeMetadata(nm, (*it).second))
+			goto out_err;
+	}
+
+	for (Map<long, MemoryFilterEntry *>::iterator it = filters.begin(); it != filters.end(); it++) {
+		Metadata *fm = m->addMetadata(MEMORY_DATASTORE_FILTER);
+
+		if (!fm || !fillFilterMetadata(fm, (*it).second))
+			goto out_err;
+	}
+
+	return m;
+
+out_err:
+	HAGGLE_ERR("Could not allocate metadata when dumping data store\n");
+	delete m;
+	return NULL;
+}
+
+bool MemoryDataStore::writeSnapshot()
+{
+	unsigned char *raw;
+	size_t len;
+	string file = getFilepath();
+
+	if (file.empty())
+		return false;
+
+	Metadata *m = toMetadata(true);
+
+	if (!m)
+		return false;
+
+	if (!m->getRawAlloc(&raw, &len)) {
+		HAGGLE_ERR("Could not create snapshot\n");
+		delete m;
+		return false;
+	}
+
+	delete m;
+
+	/*
+	  The snapshot is written to a temporary file, which then
+	  replaces the old snapshot, so that a crash while writing does
+	  not leave a truncated snapshot behind.
+	 */
+	string tmpfile = file + ".tmp";
+	FILE *fp = fopen(tmpfile.c_str(), "wb");
+
+	if (!fp) {
+		HAGGLE_ERR("Could not open snapshot file %s\n", tmpfile.c_str());
+		free(raw);
+		return false;
+	}
+
+	size_t nitems = fwrite(raw, len, 1, fp);
+
+	free(raw);
+
+	if (nitems != 1 || fflush(fp) != 0) {
+		HAGGLE_ERR("Could not write snapshot file %s\n", tmpfile.c_str());
+		fclose(fp);
+		remove(tmpfile.c_str());
+		return false;
+	}
+#if !defined(OS_WINDOWS)
+	if (fsync(fileno(fp)) != 0) {
+		HAGGLE_ERR("Could not sync snapshot file %s\n", tmpfile.c_str());
+		fclose(fp);
+		remove(tmpfile.c_str());
+		return false;
+	}
+#endif
+	fclose(fp);
+
+#if defined(OS_WINDOWS)
+	// Windows does not rename over an existing file
+	remove(file.c_str());
+#endif
+	if (rename(tmpfile.c_str(), file.c_str()) != 0) {
+		HAGGLE_ERR("Could not replace snapshot file %s\n", file.c_str());
+		remove(tmpfile.c_str());
+		return false;
+	}
+
+	HAGGLE_DBG("Wrote snapshot of %lu data objects to %s\n",
+		   (unsigned long)dataObjects.size(), file.c_str());
+
+	return true;
+}
+
+bool MemoryDataStore::readSnapshot()
+{
+	unsigned char *raw;
+	size_t len;
+	XMLMetadata m;
+	Metadata *dm;
+	string file = getFilepath();
+
+	if (file.empty())
+		return false;
+
+	FILE *fp = fopen(file.c_str(), "rb");
+
+	if (!fp) {
+		HAGGLE_DBG("No snapshot file %s\n", file.c_str());
+		return true;
+	}
+
+	fseek(fp, 0L, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	raw = (unsigned char *)malloc(len);
+
+	if (!raw) {
+		fclose(fp);
+		return false;
+	}
+
+	if (len == 0 || fread(raw, len, 1, fp) != 1) {
+		HAGGLE_ERR("Could not read snapshot file %s\n", file.c_str());
+		fclose(fp);
+		free(raw);
+		return false;
+	}
+
+	fclose(fp);
+
+	if (!m.initFromRaw(raw, len) || m.getName() != MEMORY_DATASTORE_METADATA) {
+		HAGGLE_ERR("Bad snapshot file %s\n", file.c_str());
+		free(raw);
+		return false;
+	}
+
+	free(raw);
+
+	dm = m.getMetadata(MEMORY_DATASTORE_DATAOBJECT);
+
+	while (dm) {
+		const char *param;
+		unsigned char *signature = NULL;
+		size_t siglen = 0;
+		Timeval receive_time = -1;
+		Metadata *hm = dm->getMetadata("Haggle");
+
+		if (!hm || !hm->getRawAlloc(&raw, &len)) {
+			HAGGLE_ERR("Bad data object in snapshot\n");
+			dm = m.getNextMetadata();
+			continue;
+		}
+
+		param = dm->getParameter("signature");
+
+		if (param) {
+			struct base64_decode_context ctx;
+			base64_decode_ctx_init(&ctx);
+
+			if (!base64_decode_alloc(&ctx, param, strlen(param), (char **)&signature, &siglen)) {
+				signature = NULL;
+				siglen = 0;
+			}
+		}
+
+		param = dm->getParameter("receive_time");
+
+		if (param)
+			receive_time = Timeval(param);
+
+		DataObject::SignatureStatus_t sig_status = DataObject::SIGNATURE_MISSING;
+		DataObject::DataState_t datastate = DataObject::DATA_STATE_UNKNOWN;
+		size_t datalen = 0;
+		unsigned long rxtime = 0;
+
+		if ((param = dm->getParameter("signature_status")))
+			sig_status = (DataObject::SignatureStatus_t)strtoul(param, NULL, 10);
+		if ((param = dm->getParameter("datastate")))
+			datastate = (DataObject::DataState_t)strtoul(param, NULL, 10);
+		if ((param = dm->getParameter("datalen")))
+			datalen = (size_t)strtoul(param, NULL, 10);
+		if ((param = dm->getParameter("rxtime")))
+			rxtime = strtoul(param, NULL, 10);
+
+		const char *filepath_param = dm->getParameter("filepath");
+		const char *filename_param = dm->getParameter("filename");
+		const char *signee_param = dm->getParameter("signee");
+
+		DataObjectRef dObj = DataObject::create(raw, len, NULL, NULL, true,
+							nonull(filepath_param), nonull(filename_param),
+							sig_status, nonull(signee_param), signature,
+							(unsigned long)siglen, -1, receive_time, rxtime,
+							datalen, datastate);
+		free(raw);
+
+		if (signature)
+			free(signature);
+
+		if (dObj && dataObjects.find(string(dObj->getIdStr())) == dataObjects.end()) {
+			param = dm->getParameter("timestamp");
+
+			Timeval timestamp = param ? Timeval(param) : Timeval::now();
+
+			param = dm->getParameter("node_id");
+
+			indexDataObject(new MemoryDataObjectEntry(num++, dObj, timestamp, nonull(param)));
+		} else {
+			HAGGLE_ERR("Could not recreate data object from snapshot\n");
+		}
+
+		dm = m.getNextMetadata();
+	}
+
+	dm = m.getMetadata(MEMORY_DATASTORE_REPOSITORY);
+
+	while (dm) {
+		const char *type = dm->getParameter("type");
+		const char *id = dm->getParameter("id");
+		const char *authority = dm->getParameter("authority");
+		const char *key = dm->getParameter("key");
+		unsigned int entryId = id ? (unsigned int)strtoul(id, NULL, 10) : 0;
+
+		if (!authority || entryId == 0) {
+			dm = m.getNextMetadata();
+			continue;
+		}
+
+		if (type && strtoul(type, NULL, 10) == RepositoryEntry::VALUE_TYPE_BLOB) {
+			struct base64_decode_context ctx;
+			char *value = NULL;
+			size_t value_len = 0;
+
+			base64_decode_ctx_init(&ctx);
+			base64_decode_alloc(&ctx, dm->getContent().c_str(), dm->getContent().length(), &value, &value_len);
+
+			repository.push_back(new RepositoryEntry(authority, nonull(key), (unsigned char *)value, value_len, entryId));
+
+			if (value)
+				free(value);
+		} else {
+			repository.push_back(new RepositoryEntry(authority, nonull(key), dm->getContent(), entryId));
+		}
+
+		if (entryId >= repositoryId)
+			repositoryId = entryId + 1;
+
+		dm = m.getNextMetadata();
+	}
+
+	HAGGLE_DBG("Read snapshot of %lu data objects and %lu repository entries from %s\n",
+		   (unsigned long)dataObjects.size(), (unsigned long)repository.size(), file.c_str());
+
+	return true;
+}
+
+/*
+	Appends the XML of a metadata element to a dump chunk, without the 
+	XML declaration.
+*/
+static bool appendToChunk(string& chunk, Metadata& m)
+{
+	unsigned char *raw;
+	size_t len;
+
+	if (!m.getRawAlloc(&raw, &len))
+		return false;
+
+	const char *xml = strstr((char *)raw, "?>");
+
+	chunk += xml ? xml + 2 : (char *)raw;
+
+	free(raw);
+
+	return true;
+}
+
+/*
+	The data objects are dumped in insertion order, and the cursor 
+	position is the number of the last dumped data object. The nodes and 
+	filters are comparatively few, and are dumped with the last chunk.
+*/
+int MemoryDataStore::_dump(DataStoreDumpCursor *c, unsigned long max, char **data, size_t *len)
+{
+	string chunk;
+	unsigned long n = 0;
+
+	if (!c->started)
+		chunk += "<" MEMORY_DATASTORE_METADATA ">";
+
+	if (c->part == 0) {
+		MemoryDataObjectPostings::iterator it = dataObjectsByNum.upper_bound((unsigned long)c->lastRow);
+
+		for (; it != dataObjectsByNum.end() && n < max; it++, n++) {
+			XMLMetadata dm(MEMORY_DATASTORE_DATAOBJECT);
+
+			if (!fillDataObjectMetadata(&dm, (*it).second, false) || !appendToChunk(chunk, dm)) {
+				HAGGLE_ERR("ERROR: Dump to XML failed\n");
+				return -1;
+			}
+			c->lastRow = (*it).first;
+		}
+
+		c->numRows += n;
+
+		if (it != dataObjectsByNum.end())
+			goto out;
+
+		c->part++;
+	}
+
+	for (Map<string, MemoryNodeEntry *>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+		XMLMetadata nm(MEMORY_DATASTORE_NODE);
+
+		if (!fillNodeMetadata(&nm, (*it).second) || !appendToChunk(chunk, nm)) {
+			HAGGLE_ERR("ERROR: Dump to XML failed\n");
+			return -1;
+		}
+	}
+
+	for (Map<long, MemoryFilterEntry *>::iterator it = filters.begin(); it != filters.end(); it++) {
+		XMLMetadata fm(MEMORY_DATASTORE_FILTER);
+
+		if (!fillFilterMetadata(&fm, (*it).second) || !appendToChunk(chunk, fm)) {
+			HAGGLE_ERR("ERROR: Dump to XML failed\n");
+			return -1;
+		}
+	}
+
+	c->numRows += nodes.size() + filters.size();
+	c->part++;
+	chunk += "</" MEMORY_DATASTORE_METADATA ">\n";
+out:
+	*len = chunk.length();
+	*data = (char *)malloc(*len);
+
+	if (!*data) {
+		HAGGLE_ERR("Could not allocate dump chunk\n");
+		return -1;
+	}
+
+	memcpy(*data, chunk.c_str(), *len);
+
+	return c->part == 0 ? 1 : 0;
+}
+
+int MemoryDataStore::_dumpToFile(const char *filename)
+{
+	unsigned char *dump;
+	size_t len;
+	Metadata *m = toMetadata(false);
+
+	if (!m)
+		return -1;
+
+	if (!m->getRawAlloc(&dump, &len)) {
+		delete m;
+		return -1;
+	}
+
+	delete m;
+
+	FILE *fp = fopen(filename, "wb");
+
+	if (!fp) {
+		HAGGLE_ERR("Could not open %s\n", filename);
+		free(dump);
+		return -1;
+	}
+
+	fwrite(dump, len, 1, fp);
+	fclose(fp);
+	free(dump);
+
+	return 0;
+}
+
+int MemoryDataStore::_configure(const Metadata& m)
+{
+	DataStore::_configure(m);
+
+	const char *param = m.getParameter("snapshot");
+
+	if (param) {
+		if (strcmp(param, "true") == 0 || strcmp(param, "yes") == 0) {
+			snapshot = !getFilepath().empty();
+		} else if (strcmp(param, "false") == 0 || strcmp(param, "no") == 0) {
+			snapshot = false;
+		} else {
+			HAGGLE_ERR("Bad value \'%s\' for snapshot\n", param);
+		}
+		HAGGLE_DBG("config snapshot=%s\n", snapshot ? "true" : "false");
+		LOG_ADD("# %s: snapshot=%s\n", getName(), snapshot ? "true" : "false");
+	}
+
+	return 0;
+}
+
+#ifdef DEBUG_DATASTORE
+void MemoryDataStore::_print()
+{
+	printf("============== Data objects ==============\n");
+
+	for (MemoryDataObjectPostings::iterator it = dataObjectsByNum.begin(); it != dataObjectsByNum.end(); it++) {
+		printf("%lu: %s %s\n", (*it).first, (*it).second->dObj->getIdStr(),
+		       (*it).second->timestamp.getAsString().c_str());
+	}
+
+	printf("================= Nodes ==================\n");
+
+	for (Map<string, MemoryNodeEntry *>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+		printf("%lu: %s %s interests=%lu sum_weights=%ld\n", (*it).second->num,
+		       (*it).second->idStr.c_str(), (*it).second->name.c_str(),
+		       (unsigned long)(*it).second->interests.size(), (*it).second->sumWeights);
+	}
+
+	printf("================ Filters =================\n");
+
+	for (Map<long, MemoryFilterEntry *>::iterator it = filters.begin(); it != filters.end(); it++) {
+		printf("%lu: event=%ld num_attributes=%lu\n", (*it).second->num,
+		       (*it).second->eventType, (unsigned long)(*it).second->attrs.size());
+	}
+}
+#endif
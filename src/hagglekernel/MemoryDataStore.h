@@ -0,0 +1,246 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MEMORYDATASTORE_H
+#define _MEMORYDATASTORE_H
+
+/*
+	Forward declarations of all data types declared in this file. This is to
+	avoid circular dependencies. If/when a data type is added to this file,
+	remember to add it here.
+*/
+class MemoryDataObjectEntry;
+class MemoryNodeEntry;
+class MemoryFilterEntry;
+class MemoryMatch;
+class MemoryDataStore;
+
+#include <libcpphaggle/Platform.h>
+#include <libcpphaggle/Map.h>
+#include <libcpphaggle/List.h>
+#include <libcpphaggle/Heap.h>
+#include "DataStore.h"
+#include "DataObject.h"
+#include "Node.h"
+#include "Filter.h"
+#include "Metadata.h"
+#include "RepositoryEntry.h"
+
+#define DEFAULT_MEMORY_DATASTORE_SNAPSHOT_FILENAME "haggle.snapshot"
+
+/*
+	Posting lists of the inverted index. Entries are keyed by their
+	insertion number, which plays the role of the rowid in the SQL data
+	store, so that iteration follows insertion order.
+*/
+typedef Map<unsigned long, MemoryDataObjectEntry *> MemoryDataObjectPostings;
+typedef Map<unsigned long, MemoryNodeEntry *> MemoryNodePostings;
+typedef Map<unsigned long, MemoryFilterEntry *> MemoryFilterPostings;
+// The number of attributes with a given name, per data object number
+typedef Map<unsigned long, unsigned long> MemoryNameCounts;
+
+/**
+	A data object in the memory data store.
+*/
+class MemoryDataObjectEntry {
+public:
+	const unsigned long num;
+	DataObjectRef dObj;
+	const Timeval timestamp; // The time the data object was inserted
+	const string nodeId; // The node id if this is a node description
+	const unsigned long long size; // The size of the data and metadata
+	MemoryDataObjectEntry(unsigned long _num, const DataObjectRef& _dObj, const Timeval& _timestamp, const string& _nodeId);
+};
+
+/**
+	A node in the memory data store. The attributes form the node's
+	interest vector, i.e., the attribute keys of the inverted index
+	mapped to their weights.
+*/
+class MemoryNodeEntry {
+public:
+	const unsigned long num;
+	Node::Type_t type;
+	Node::Id_t id;
+	string idStr;
+	string name;
+	Timeval nodeDescriptionCreateTime;
+	unsigned long maxDataObjectsInMatch;
+	unsigned long matchingThreshold;
+	Bloomfilter *bloomfilter;
+	Attributes attrs;
+	Map<string, long> interests;
+	long sumWeights;
+	InterfaceRefList ifaces;
+	MemoryNodeEntry(unsigned long _num) : num(_num), bloomfilter(NULL), sumWeights(0) {}
+	~MemoryNodeEntry();
+};
+
+/**
+	An application filter in the memory data store.
+*/
+class MemoryFilterEntry {
+public:
+	const unsigned long num;
+	const long eventType;
+	Attributes attrs;
+	MemoryFilterEntry(unsigned long _num, long _eventType) : num(_num), eventType(_eventType) {}
+};
+
+/**
+	The score of a data object, node or filter in a match. The match
+	results are ranked through a heap, so that only the results that
+	are actually used need to be ordered.
+*/
+class MemoryMatch : public HeapItem {
+public:
+	long ratio;
+	bool ratioAscending;
+	unsigned long mcount;
+	long weight;
+	bool notMatch;
+	// The secondary sort key, compared in descending order
+	unsigned long rank;
+	// The entry number, compared in ascending or descending order
+	unsigned long num;
+	bool newestFirst;
+	void *entry;
+	MemoryMatch(void *_entry, unsigned long _num, bool _newestFirst = false) :
+		ratio(0), ratioAscending(false), mcount(0), weight(0), notMatch(false), rank(0),
+		num(_num), newestFirst(_newestFirst), entry(_entry) {}
+	bool compare_less(const HeapItem& i) const;
+	bool compare_greater(const HeapItem& i) const;
+};
+
+typedef Map<unsigned long, MemoryMatch *> MemoryMatchMap;
+
+/**
+	A data store that keeps all data objects, nodes and filters in memory.
+
+	Data objects, nodes and filters are indexed by their attributes in an
+	inverted index that maps an attribute (name and value) to a posting
+	list. A match only visits the posting lists of the attributes of the
+	node, data object or filter in question, and accumulates the same
+	scores that the SQL data store computes through its views (ratio,
+	number of matching attributes and non-matching weights).
+
+	Optionally, the data objects and the repository are written to a
+	snapshot file at shutdown and read back at startup.
+*/
+class MemoryDataStore : public DataStore
+{
+private:
+	bool recreate;
+	string filepath;
+	bool snapshot;
+	unsigned long num; // Incremented for every inserted entry
+	unsigned int repositoryId; // Incremented for every repository entry
+	unsigned long long bytes; // Total size of the data objects
+
+	Map<string, MemoryDataObjectEntry *> dataObjects; // by data object id
+	MemoryDataObjectPostings dataObjectsByNum;
+	Map<string, MemoryDataObjectEntry *> nodeDescriptions; // by node id
+	Map<string, MemoryNodeEntry *> nodes; // by node id
+	Map<string, MemoryNodeEntry *> nodesByInterface;
+	Map<long, MemoryFilterEntry *> filters; // by event type
+	RepositoryEntryList repository;
+
+	// The inverted index
+	Map<string, MemoryDataObjectPostings *> dataObjectIndex;
+	Map<string, MemoryNameCounts *> dataObjectNameIndex;
+	Map<string, MemoryNodePostings *> nodeIndex;
+	Map<string, MemoryFilterPostings *> filterIndex;
+
+	static string attributeKey(const string& name, const string& value);
+	static string interfaceKey(const InterfaceRef& iface);
+
+	void indexDataObject(MemoryDataObjectEntry *e);
+	void unindexDataObject(MemoryDataObjectEntry *e);
+	void removeNode(MemoryNodeEntry *ne);
+	void removeFilter(MemoryFilterEntry *fe);
+
+	MemoryNodeEntry *findNode(const NodeRef& node);
+	NodeRef createNode(const MemoryNodeEntry *ne);
+
+	/**
+		Score the data objects that share attributes with a node,
+		and insert the ones that match into the heap. Returns the
+		number of matching data objects.
+	*/
+	unsigned long matchNode(const MemoryNodeEntry *ne, unsigned int threshold, unsigned int attrMatch, Heap& heap, MemoryMatchMap& scores);
+	/**
+		Score the filters that match a data object, and insert them
+		into the heap. Returns the number of matching filters.
+	*/
+	unsigned long matchFilters(const DataObjectRef& dObj, Heap& heap, MemoryMatchMap& scores);
+	/**
+		Score the data objects that match a filter, and insert them
+		into the heap, ranked by ascending or descending ratio. With
+		a cursor, the data objects are also ranked by filter attribute
+		weight, newest first, and only those ranked after the cursor
+		are inserted.
+		Returns the number of matching data objects.
+	*/
+	unsigned long matchFilter(const Attributes *attrs, bool ratioAscending, Heap& heap, MemoryMatchMap& scores, const DataStoreFilterCursor *cursor = NULL);
+	static void clearMatches(MemoryMatchMap& scores);
+
+	int evaluateFilters(const DataObjectRef& dObj);
+	int deleteDataObjectNodeDescriptions(DataObjectRef dObj, string& node_id);
+
+	string getFilepath();
+	bool fillDataObjectMetadata(Metadata *dm, MemoryDataObjectEntry *e, bool withFields);
+	bool fillNodeMetadata(Metadata *nm, MemoryNodeEntry *ne);
+	bool fillFilterMetadata(Metadata *fm, MemoryFilterEntry *fe);
+	Metadata *toMetadata(bool withFields);
+	bool writeSnapshot();
+	bool readSnapshot();
+protected:
+	int _insertNode(NodeRef& node, const EventCallback<EventHandler> *callback = NULL, bool mergeBloomfilter = false);
+	int _deleteNode(NodeRef& node);
+	int _retrieveNode(NodeRef& node, const EventCallback<EventHandler> *callback, bool forceCallback);
+	int _retrieveNode(Node::Type_t type, const EventCallback<EventHandler> *callback);
+	int _retrieveNode(const InterfaceRef& iface, const EventCallback<EventHandler> *callback, bool forceCallback);
+	int _insertDataObject(DataObjectRef& dObj, const EventCallback<EventHandler> *callback = NULL);
+	int _deleteDataObject(const DataObjectId_t &id, bool shouldReportRemoval = true, bool keepInBloomfilter = false);
+	int _deleteDataObject(DataObjectRef& dObj, bool shouldReportRemoval = true, bool keepInBloomfilter = false);
+	int _ageDataObjects(const Timeval& minimumAge, const EventCallback<EventHandler> *callback = NULL, bool keepInBloomfilter = false);
+	int _evictDataObjects(DataStoreEvictionQuery *q);
+	int _insertFilter(Filter *f, bool matchFilter = false, const EventCallback<EventHandler> *callback = NULL);
+	int _deleteFilter(long eventtype);
+	int _doFilterQuery(DataStoreFilterQuery *q);
+	/**
+		Returns: The number of data objects filled in.
+	*/
+	int _doDataObjectQueryStep2(NodeRef &node, NodeRef alsoThisBF, DataStoreQueryResult *qr, int max_matches, unsigned int ratio, unsigned int attrMatch);
+	int _doDataObjectQuery(DataStoreDataObjectQuery *q);
+	int _doDataObjectForNodesQuery(DataStoreDataObjectForNodesQuery *q);
+	int _doNodeQuery(DataStoreNodeQuery *q);
+	int _insertRepository(DataStoreRepositoryQuery *q);
+	int _readRepository(DataStoreRepositoryQuery *q, const EventCallback<EventHandler> *callback = NULL);
+	int _deleteRepository(DataStoreRepositoryQuery *q);
+	int _dump(DataStoreDumpCursor *c, unsigned long max, char **data, size_t *len);
+	int _dumpToFile(const char *filename);
+	int _evaluateFilterPage(DataStoreFilterCursor *c, unsigned long max);
+	int _configure(const Metadata& m);
+#ifdef DEBUG_DATASTORE
+	void _print();
+#endif
+public:
+	MemoryDataStore(const bool recreate = false, const string = DEFAULT_DATASTORE_PATH, const string name = "MemoryDataStore");
+	~MemoryDataStore();
+
+	bool init();
+};
+
+#endif /* _MEMORYDATASTORE_H */
@@ -4,6 +4,9 @@
 Metadata::Metadata(const string _name, const string _content, Metadata *_parent) :
                 parent(_parent), name(_name), content(_content)
 {
+        // Element names come from a small set, and every element of
+        // a parsed document has one
+        stringintern(name);
 }
 
 Metadata::Metadata(const Metadata& m) : 
@@ -48,18 +51,17 @@ bool Metadata::_addMetadata(Metadata *m)
 bool Metadata::removeMetadata(const string name)
 {
         bool ret = false;
-        
-        r = registry.equal_range(name);
+        registry_t::iterator it;
 
-         while (r.first != r.second) {
-                 registry_t::iterator it = r.first;
-                 Metadata *m = (*it).second;
-                 r.first++;
-                 registry.erase(it);
-                 delete m;
-                 ret = true;
-         }
-         return ret;
+        // Erasing may move the other items in the registry, so look
+        // the name up again each time
+        while ((it = registry.find(name)) != registry.end()) {
+                Metadata *m = (*it).second;
+                registry.erase(it);
+                delete m;
+                ret = true;
+        }
+        return ret;
 }
 
 Metadata *Metadata::getMetadata(const string name, unsigned int n)
@@ -125,8 +127,9 @@ const Metadata *Metadata::getNextMetadata() const
 string& Metadata::setParameter(const string name, const string value)
 {
         Pair<parameter_registry_t::iterator, bool> p;
+        string key = name;
 
-        p = param_registry.insert(make_pair(name, value));
+        p = param_registry.insert(make_pair(stringintern(key), value));
 
         if (!p.second) {
                 // Update value
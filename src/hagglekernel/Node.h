@@ -51,9 +51,9 @@ using namespace haggle;
 
 /** */
 #ifdef DEBUG_LEAKS
-class Node: public LeakMonitor
+class Node: public LeakMonitor, public RefCounted
 #else
-class Node
+class Node : public RefCounted
 #endif
 {
 public:
@@ -187,6 +187,11 @@ public:
 	static const unsigned char *strIdToRaw(const char *strId);
 	static const char *typeToStr(Type_t type);
 	static Type_t strToType(const char *type);
+	/*
+		The type, id and number of a node are set when the node
+		is created, and can be read through NodeRef::unlocked()
+		without locking the node.
+	*/
         Type_t getType() const;
 	const char *getTypeStr() const { return typestr[type]; }
         const unsigned char *getId() const;
@@ -70,12 +70,11 @@ bool NodeStore::_stored(const Node::Id_t id, bool mustBeNeighbor)
 	for (NodeStore::iterator it = begin(); it != end(); it++) {
 		NodeRecord *nr = *it;
 
-		if (mustBeNeighbor && !nr->node->isNeighbor())
+		if (memcmp(id, nr->node.unlocked()->getId(), NODE_ID_LEN) != 0)
 			continue;
 
-		if (memcmp(id, nr->node->getId(), NODE_ID_LEN) == 0) {
+		if (!mustBeNeighbor || nr->node->isNeighbor())
 			return true;
-		}
 	}
 	return false;
 }
@@ -85,12 +84,11 @@ bool NodeStore::_stored(const string idStr, bool mustBeNeighbor)
 	for (NodeStore::iterator it = begin(); it != end(); it++) {
 		NodeRecord *nr = *it;
 
-		if (mustBeNeighbor && !nr->node->isNeighbor())
+		if (strcmp(idStr.c_str(), nr->node.unlocked()->getIdStr()) != 0)
 			continue;
 
-		if (strcmp(idStr.c_str(), nr->node->getIdStr()) == 0) {
+		if (!mustBeNeighbor || nr->node->isNeighbor())
 			return true;
-		}
 	}
 	return false;
 }
@@ -140,11 +138,11 @@ bool NodeStore::add(NodeRef &node)
 		return false;;
 
 	if (_stored(node)) {
-		HAGGLE_DBG("Node %s is already in node store\n", node->getIdStr());
+		HAGGLE_DBG("Node %s is already in node store\n", node.unlocked()->getIdStr());
 		return false;
 	}
 
-	HAGGLE_DBG("Adding new node to node store %s\n", node->getIdStr());
+	HAGGLE_DBG("Adding new node to node store %s\n", node.unlocked()->getIdStr());
 	node->setStored();
 	push_back(new NodeRecord(node));
 
@@ -215,13 +213,13 @@ NodeRef NodeStore::retrieve(const Node::Id_t id, bool mustBeNeighbor)
 
 	for (NodeStore::iterator it = begin(); it != end(); it++) {
 		NodeRecord *nr = *it;
-		NodeRef node = nr->node;
 
-		if (mustBeNeighbor && !node->isNeighbor())
+		// Compare the id first, as it can be read without locking the node
+		if (memcmp(id, nr->node.unlocked()->getId(), NODE_ID_LEN) != 0)
 			continue;
 
-		if (memcmp(id, node->getId(), NODE_ID_LEN) == 0) 
-			return node;
+		if (!mustBeNeighbor || nr->node->isNeighbor())
+			return nr->node;
 	}
 
 	return NULL;
@@ -233,13 +231,12 @@ NodeRef NodeStore::retrieve(const string &id, bool mustBeNeighbor)
 
 	for (NodeStore::iterator it = begin(); it != end(); it++) {
 		NodeRecord *nr = *it;
-		NodeRef node = nr->node;
 
-		if (mustBeNeighbor && !node->isNeighbor())
+		if (memcmp(id.c_str(), nr->node.unlocked()->getIdStr(), MAX_NODE_ID_STR_LEN) != 0)
 			continue;
 
-		if (memcmp(id.c_str(), node->getIdStr(), MAX_NODE_ID_STR_LEN) == 0) 
-			return node;
+		if (!mustBeNeighbor || nr->node->isNeighbor())
+			return nr->node;
 	}
 
 	return NULL;
@@ -274,7 +271,7 @@ NodeStore::size_type NodeStore::retrieve(Node::Type_t type, NodeRefList& nl)
 	for (NodeStore::iterator it = begin(); it != end(); it++) {
 		const NodeRecord *nr = *it;
 
-		if (nr->node->getType() == type) {
+		if (nr->node.unlocked()->getType() == type) {
                         n++;
 			nl.add(nr->node);
 		}
@@ -427,7 +424,7 @@ int NodeStore::remove(const Node::Type_t type)
 	while (it != end()) {
 		NodeRecord *nr = *it;
 
-		if (nr->node->getType() == type) {
+		if (nr->node.unlocked()->getType() == type) {
 			it = erase(it);
 			n++;
 			nr->node->setStored(false);
@@ -478,12 +475,12 @@ void NodeStore::print()
 		const NodeRecord *nr = *it;
 
                 printf("Node: %d type=\'%s\' name=\'%s\' - %s stored=%s\n", 
-                       n++, nr->node->getTypeStr(),
+                       n++, nr->node.unlocked()->getTypeStr(),
                        nr->node->getName().c_str(),
-                       (nr->node->isAvailable() && (nr->node->getType() == Node::TYPE_PEER || nr->node->getType() == Node::TYPE_UNDEFINED)) ? "Neighbor" : "Unconfirmed neighbor",
+                       (nr->node->isAvailable() && (nr->node.unlocked()->getType() == Node::TYPE_PEER || nr->node.unlocked()->getType() == Node::TYPE_UNDEFINED)) ? "Neighbor" : "Unconfirmed neighbor",
                        nr->node->isStored() ? "Yes" : "No");
 		printf("Num objects in bloomfilter=%lu\n", nr->node->getBloomfilter()->numObjects());
-                printf("id=%s\n", nr->node->getIdStr());
+                printf("id=%s\n", nr->node.unlocked()->getIdStr());
                 printf("");
 		nr->node->printInterfaces();
 
@@ -88,6 +88,11 @@ public:
  A Good RULE is therefore to never dereference an object in the argument to 
  NodeStore::retreive(), or any other node store function.
 
+ Reading the members of an object that do not change once it is shared,
+ like the id of a node or an interface, through Reference::unlocked() does
+ not lock the object, and is safe also in the argument to a node store
+ function.
+
  */
 
 class NodeStore : protected List<NodeRecord *>
@@ -284,7 +284,7 @@ bool Protocol::isReceiver()
 
 bool Protocol::isApplication() const
 {
-	if (localIface && localIface->isApplication())
+	if (localIface && localIface.unlocked()->isApplication())
 		return true;
 	return false;
 }
@@ -303,10 +303,10 @@ string Protocol::peerDescription()
 	string peerstr = "Unknown peer";
 
 	if (peerNode) {
-		if (peerNode->getType() != Node::TYPE_UNDEFINED) {
+		if (peerNode.unlocked()->getType() != Node::TYPE_UNDEFINED) {
 			peerstr = peerNode->getName();
 		} else if (peerIface) {
-			peerstr = peerIface->getIdentifierStr();
+			peerstr = peerIface.unlocked()->getIdentifierStr();
 		}
 	}
 
@@ -439,8 +439,8 @@ bool Protocol::sendDataObject(const DataObjectRef& dObj,
 		return false;
 	}
 	
-	if (!peerNode || (peerNode->getType() == Node::TYPE_UNDEFINED && 
-			  peer->getType() != Node::TYPE_UNDEFINED)) {
+	if (!peerNode || (peerNode.unlocked()->getType() == Node::TYPE_UNDEFINED && 
+			  peer.unlocked()->getType() != Node::TYPE_UNDEFINED)) {
 		HAGGLE_DBG("Setting peer node to %s, which was previously undefined\n", 
 			   peer->getName().c_str());
 		peerNode = peer;
@@ -460,7 +460,7 @@ bool Protocol::sendDataObject(const DataObjectRef& dObj,
 	if (!q->insert(qe, true)) {
 		delete qe;
 		HAGGLE_DBG("Data object [%s] already in protocol send queue for node %s [%s]\n", 
-			dObj->getIdStr(), peer->getName().c_str(), peer->getIdStr());
+			dObj->getIdStr(), peer->getName().c_str(), peer.unlocked()->getIdStr());
 		return false;
 	}
 	
@@ -830,7 +830,7 @@ ProtocolEvent Protocol::receiveDataObject()
 						if (pEvent == PROT_EVENT_SUCCESS) {
 							LOG_ADD("%s: %s\t%s\t%s\n", 
 								Timeval::now().getAsString().c_str(), ctrlmsgToStr(&m).c_str(), 
-								dObj->getIdStr(), peerNode ? peerNode->getIdStr() : "unknown");
+								dObj->getIdStr(), peerNode ? peerNode.unlocked()->getIdStr() : "unknown");
 						}
 						
                                                 return pEvent;
@@ -859,7 +859,7 @@ ProtocolEvent Protocol::receiveDataObject()
 
 							LOG_ADD("%s: %s\t%s\t%s\n", 
 								Timeval::now().getAsString().c_str(), ctrlmsgToStr(&m).c_str(), 
-								dObj->getIdStr(), peerNode ? peerNode->getIdStr() : "unknown");
+								dObj->getIdStr(), peerNode ? peerNode.unlocked()->getIdStr() : "unknown");
 						}
 					}
 					
@@ -894,7 +894,7 @@ ProtocolEvent Protocol::receiveDataObject()
 
 	HAGGLE_DBG("Received data object [%s] from node %s interface \n", 
 		   dObj->getIdStr(), peerDescription().c_str(), 
-		   peerIface ? peerIface->getIdentifierStr() : "unknown");
+		   peerIface ? peerIface.unlocked()->getIdentifierStr() : "unknown");
 
 	getKernel()->addEvent(new Event(EVENT_TYPE_DATAOBJECT_RECEIVED, dObj, peerNode));
        
@@ -55,6 +55,17 @@ using namespace haggle;
 #define TABLE_NODES "table_nodes"
 #define TABLE_ATTRIBUTES "table_attributes"
 #define TABLE_FILTERS "table_filters"
+/*
+	A single row with the number of data objects and their total 
+	size, kept up to date by triggers on the data object table.
+*/
+#define TABLE_DATAOBJECT_USAGE "table_dataobject_usage"
+/*
+	The ranked matches of the filters whose matches are being 
+	delivered in pages. It is a temporary table, i.e., it belongs to
+	the connection and is never written to the database file.
+*/
+#define TABLE_FILTER_MATCHES "table_filter_matches"
 
 /*
   Tables that map nodes attributes to nodes (or vice versa really).
@@ -67,6 +78,13 @@ using namespace haggle;
 	"table_map_nodes_to_attributes_via_rowid"
 #define TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID	\
 	"table_map_filters_to_attributes_via_rowid"
+/*
+  The names of the attributes of dataobjects, one row per row in
+  the dataobject map, so that wildcard attributes are matched
+  without visiting every value of the name.
+ */
+#define TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES	\
+	"table_map_dataobjects_to_attribute_names"
 
 /*
 	The following views map between dataobject and attributes,
@@ -361,14 +379,70 @@ enum {
 	" dataobject_rowid INTEGER,"					\
 	" attr_rowid INTEGER,"						\
 	" timestamp DATE,"						\
+	" weight INTEGER,"						\
 	" UNIQUE (dataobject_rowid,attr_rowid) ON CONFLICT ROLLBACK);"
 enum {
 	table_map_dataobjects_to_attributes_via_rowid_rowid = 0,
 	table_map_dataobjects_to_attributes_via_rowid_dataobject_rowid,
 	table_map_dataobjects_to_attributes_via_rowid_attr_rowid,
-	table_map_dataobjects_to_attributes_via_rowid_timestamp
+	table_map_dataobjects_to_attributes_via_rowid_timestamp,
+	table_map_dataobjects_to_attributes_via_rowid_weight
+};
+
+/*
+	Databases created before the weight column was added get it
+	added at startup. Attributes stored before then have a NULL weight.
+*/
+#define SQL_CHECK_DATAOBJECT_ATTRIBUTES_WEIGHT_CMD			\
+	"SELECT weight FROM "						\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" LIMIT 0;"
+#define SQL_ADD_DATAOBJECT_ATTRIBUTES_WEIGHT_CMD			\
+	"ALTER TABLE "							\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" ADD COLUMN weight INTEGER;"
+
+//------------------------------------------
+/*
+	Maintained by the insert and delete triggers of the dataobject 
+	map. The ROWID is that of the row in the dataobject map.
+*/
+#define SQL_CREATE_DATAOBJECT_TABLE_ATTRIBUTE_NAMES_CMD			\
+	"CREATE TABLE "							\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" (ROWID INTEGER PRIMARY KEY,"					\
+	" dataobject_rowid INTEGER,"					\
+	" name TEXT);"
+enum {
+	table_map_dataobjects_to_attribute_names_rowid = 0,
+	table_map_dataobjects_to_attribute_names_dataobject_rowid,
+	table_map_dataobjects_to_attribute_names_name
 };
 
+/*
+	Databases created before the attribute name table was added get
+	it at startup, filled from the dataobject map. The triggers of
+	the map are then replaced.
+*/
+#define SQL_CHECK_DATAOBJECT_ATTRIBUTE_NAMES_CMD			\
+	"SELECT name FROM "						\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" LIMIT 0;"
+#define SQL_FILL_DATAOBJECT_ATTRIBUTE_NAMES_CMD				\
+	"INSERT INTO "							\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" SELECT da.rowid, da.dataobject_rowid, a.name FROM "		\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da INNER JOIN "						\
+	TABLE_ATTRIBUTES						\
+	" as a ON a.rowid=da.attr_rowid;"
+#define SQL_DROP_TRIGGER_INSERT_DATAOBJECT_ATTRIBUTES_CMD		\
+	"DROP TRIGGER IF EXISTS insert_"				\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID ";"
+#define SQL_DROP_TRIGGER_DEL_DATAOBJECT_ATTRIBUTES_CMD			\
+	"DROP TRIGGER IF EXISTS delete_"				\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID ";"
+
 //------------------------------------------
 #define SQL_CREATE_TRIGGER_DEL_DATAOBJECT_CMD		\
 	"CREATE TRIGGER delete_"			\
@@ -379,6 +453,39 @@ enum {
 	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID	\
 	" WHERE dataobject_rowid=old.rowid; END;"
 //------------------------------------------
+#define SQL_CREATE_TABLE_DATAOBJECT_USAGE_CMD				\
+	"CREATE TABLE "							\
+	TABLE_DATAOBJECT_USAGE						\
+	" (num INTEGER, bytes INTEGER);"
+// Also used to add the table to databases created before it existed
+#define SQL_FILL_DATAOBJECT_USAGE_CMD					\
+	"INSERT INTO "							\
+	TABLE_DATAOBJECT_USAGE						\
+	" SELECT count(*), ifnull(sum(ifnull(datalen,0)+"		\
+	"ifnull(length(xmlhdr),0)),0) FROM " TABLE_DATAOBJECTS ";"
+#define SQL_CHECK_DATAOBJECT_USAGE_CMD					\
+	"SELECT num FROM "						\
+	TABLE_DATAOBJECT_USAGE						\
+	" LIMIT 0;"
+#define SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_USAGE_CMD			\
+	"CREATE TRIGGER usage_insert_"					\
+	TABLE_DATAOBJECTS						\
+	" AFTER INSERT ON "						\
+	TABLE_DATAOBJECTS						\
+	" BEGIN UPDATE "						\
+	TABLE_DATAOBJECT_USAGE						\
+	" SET num=num+1,"						\
+	" bytes=bytes+ifnull(NEW.datalen,0)+ifnull(length(NEW.xmlhdr),0); END;"
+#define SQL_CREATE_TRIGGER_DEL_DATAOBJECT_USAGE_CMD			\
+	"CREATE TRIGGER usage_delete_"					\
+	TABLE_DATAOBJECTS						\
+	" AFTER DELETE ON "						\
+	TABLE_DATAOBJECTS						\
+	" BEGIN UPDATE "						\
+	TABLE_DATAOBJECT_USAGE						\
+	" SET num=num-1,"						\
+	" bytes=bytes-ifnull(OLD.datalen,0)-ifnull(length(OLD.xmlhdr),0); END;"
+//------------------------------------------
 #define SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_ATTRIBUTES_CMD		\
 	"CREATE TRIGGER insert_"					\
 	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
@@ -388,7 +495,12 @@ enum {
 	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
 	" SET timestamp = STRFTIME('%s', 'NOW') WHERE ROWID = NEW.ROWID; UPDATE " \
 	TABLE_DATAOBJECTS						\
-	" SET num_attributes=num_attributes+1 WHERE rowid = NEW.dataobject_rowid; END;"
+	" SET num_attributes=num_attributes+1 WHERE rowid = NEW.dataobject_rowid;" \
+	" INSERT INTO "							\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" SELECT NEW.ROWID, NEW.dataobject_rowid, name FROM "		\
+	TABLE_ATTRIBUTES						\
+	" WHERE rowid = NEW.attr_rowid; END;"
 //------------------------------------------
 #define SQL_CREATE_TRIGGER_DEL_DATAOBJECT_ATTRIBUTES_CMD		\
 	"CREATE TRIGGER delete_"					\
@@ -397,7 +509,10 @@ enum {
 	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
 	" BEGIN UPDATE "						\
 	TABLE_DATAOBJECTS						\
-	" SET num_attributes=num_attributes-1 WHERE rowid = OLD.dataobject_rowid; END;"
+	" SET num_attributes=num_attributes-1 WHERE rowid = OLD.dataobject_rowid;" \
+	" DELETE FROM "							\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" WHERE ROWID = OLD.ROWID; END;"
 
 // Node related:
 //------------------------------------------
@@ -513,9 +628,11 @@ enum {
 	Matching element x from type X to elemetes y of type Y is done
 	the following way:
 
-	- limit the link table of X to the attributes of x
-	  (VIEW_LIMITED_X_ATTRIBUTES) to keep the matching limited to
-	  relevant rows.
+	- limit the link table of X to the attributes of x to keep the
+	  matching limited to relevant rows. The views below match all
+	  elements of type X. Matching of a single dataobject or node
+	  is done with the SQL_MATCH_* statements, which limit the link
+	  table through a bound rowid instead.
 
 	- join the limited link table with the link table of type Y to
 	  get a list of all matching attributes linked to type Y
@@ -563,8 +680,8 @@ enum {
 	VIEW_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC	\
 	";"
 
-// Note: VIEW_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC gets
-// dynamically replaced during matching
+// Note: VIEW_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC is no longer
+// replaced during matching, it always covers all dataobjects
 
 // limit the node attributes link table 
 //------------------------------------------
@@ -586,8 +703,8 @@ enum {
 	VIEW_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC \
 	";"
 
-// Note: VIEW_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC gets
-// dynamically replaced during matching
+// Note: VIEW_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC is no longer
+// replaced during matching, it always covers all nodes
 
 // Matching Filter > Dataobjects 
 //------------------------------------------
@@ -894,6 +1011,12 @@ enum {
 	TABLE_DATAOBJECTS		     \
 	" (id);"
 //------------------------------------------
+// Node descriptions are looked up by node id, newest first
+#define SQL_INDEX_DATAOBJECTS_NODE_ID_CMD				\
+	"CREATE INDEX IF NOT EXISTS index_dataobjects_node_id ON "	\
+	TABLE_DATAOBJECTS						\
+	" (node_id, createtime);"
+//------------------------------------------
 #define SQL_INDEX_ATTRIBUTES_CMD					\
 	"CREATE INDEX index_attributes_name ON "			\
 	TABLE_ATTRIBUTES						\
@@ -914,6 +1037,18 @@ enum {
 	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
 	" (dataobject_rowid);"
 //------------------------------------------
+// Wildcard attributes are matched through the name and prefix of the index
+#define SQL_INDEX_DATAOBJECT_ATTR_NAMES_CMD				\
+	"CREATE INDEX IF NOT EXISTS index_dataobjectAttributeNames_name ON " \
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" (name, dataobject_rowid);"
+//------------------------------------------
+// Data objects are matched with filters through their attributes
+#define SQL_INDEX_FILTER_ATTRS_CMD					\
+	"CREATE INDEX IF NOT EXISTS index_filterAttributes_attr ON "	\
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID			\
+	" (attr_rowid);"
+//------------------------------------------
 #define SQL_INDEX_NODE_ATTRS_CMD				    \
 	"CREATE INDEX index_nodeAttributes_attr ON "		    \
 	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID			    \
@@ -934,7 +1069,12 @@ static const char *tbl_cmds[] = {
 	SQL_CREATE_DATAOBJECT_TABLE_ATTRIBUTES_CMD,
 	SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_ATTRIBUTES_CMD,
 	SQL_CREATE_TRIGGER_DEL_DATAOBJECT_ATTRIBUTES_CMD,
+	SQL_CREATE_DATAOBJECT_TABLE_ATTRIBUTE_NAMES_CMD,
 	SQL_CREATE_TRIGGER_DEL_DATAOBJECT_CMD,
+	SQL_CREATE_TABLE_DATAOBJECT_USAGE_CMD,
+	SQL_FILL_DATAOBJECT_USAGE_CMD,
+	SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_USAGE_CMD,
+	SQL_CREATE_TRIGGER_DEL_DATAOBJECT_USAGE_CMD,
 	SQL_CREATE_NODE_TABLE_ATTRIBUTES_CMD,
 	SQL_CREATE_TRIGGER_INSERT_NODE_ATTRIBUTES_CMD,
 	SQL_CREATE_TRIGGER_DEL_NODE_ATTRIBUTES_CMD,
@@ -958,9 +1098,12 @@ static const char *tbl_cmds[] = {
 	SQL_CREATE_VIEW_DATAOBJECT_NODE_MATCH_CMD_RATED_CMD,
 	SQL_CREATE_VIEW_NODE_DATAOBJECT_MATCH_CMD_RATED_CMD,
 	SQL_INDEX_DATAOBJECTS_CMD,
+	SQL_INDEX_DATAOBJECTS_NODE_ID_CMD,
 	SQL_INDEX_ATTRIBUTES_CMD,
 	SQL_INDEX_NODES_CMD,
 	SQL_INDEX_DATAOBJECT_ATTRS_CMD,
+	SQL_INDEX_DATAOBJECT_ATTR_NAMES_CMD,
+	SQL_INDEX_FILTER_ATTRS_CMD,
 	SQL_INDEX_NODE_ATTRS_CMD,
 	SQL_CREATE_TABLE_REPOSITORY_CMD,
 	NULL
@@ -972,172 +1115,148 @@ static const char *tbl_cmds[] = {
 
 static char sqlcmd[SQL_MAX_CMD_SIZE];
 
-static inline char *sql_insert_dataobject_cmd_alloc(const char *metadata, 
-						    const sqlite_int64 ifaceRowId, 
-						    const DataObjectRef dObj, 
-						    const string node_id)
-{
-	size_t cmd_size = strlen(metadata) + node_id.length() + 1024;
-	char *cmd = (char *)malloc(cmd_size);
+// How long (in milliseconds) a reader waits for a lock held by the writer
+#define SQL_READER_BUSY_TIMEOUT 1000
 
-	if (!cmd) {
-		HAGGLE_ERR("could not allocate insert command\n");
-		return NULL;
-	}
-	memset(cmd, 0, cmd_size);
-	/*
-		WARNING:
-		
-		This code, by inserting the xml header verbatim into the actual SQL 
-		query suffers from a risk of SQL injection. See the haggle trac page,
-		ticket #139.
-	*/
-	int ret = snprintf(cmd, cmd_size, 
-			   "INSERT INTO "
-			   "%s ("
-			   "id,"
-			   "xmlhdr,"
-			   "filepath,"
-			   "filename,"
-			   "datalen,"
-			   "datastate,"
-			   "datahash,"
-			   "signaturestatus,"
-			   "signee,"
-			   "signature,"
-			   "siglen,"
-			   "createtime,"
-			   "receivetime,"
-			   "rxtime,"
-			   "source_iface_rowid,"
-			   "node_id"
-			   ") VALUES(?,\'%s\',\'%s\',\'%s\',"
-			   SIZE_T_FMT ",%d,?,%d,\'%s\',?,"
-			   SIZE_T_FMT "," 
-			   SQLITE_INT64_FMT "," 
-			   SQLITE_INT64_FMT ",%lu," 
-			   SQLITE_INT64_FMT ",'%s');", 
-			   TABLE_DATAOBJECTS, 
-			   metadata, 
-			   dObj->getFilePath().c_str(), 
-			   dObj->getFileName().c_str(), 
-			   dObj->getDataLen(),
-			   dObj->getDataState(),
-			   dObj->getSignatureStatus(), 
-			   dObj->getSignee().c_str(),
-			   dObj->getSignatureLength(),
-			   (unsigned long long)
-			   dObj->getCreateTime().getTimeAsMilliSeconds(),
-			   (unsigned long long)
-			   dObj->getReceiveTime().getTimeAsMilliSeconds(), 
-			   dObj->getRxTime(), 
-			   ifaceRowId, 
-			   node_id.c_str());
-	
-        if (ret < 0) {
-                HAGGLE_ERR("insert error: %s\n", STRERROR(ERRNO));
-		free(cmd);
-		cmd = NULL;
-        } else if ((unsigned int)ret == cmd_size) {
-                HAGGLE_ERR("insert command too large\n");
-		free(cmd);
-		cmd = NULL;
-        }
-	return cmd;
-}
-static inline char *SQL_DELETE_DATAOBJECT_CMD()
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "DELETE FROM %s WHERE id = ?;", 
-		 TABLE_DATAOBJECTS);
-	
-	return sqlcmd;
-}
+/*
+	Commands that are compiled once and cached as prepared statements. 
+	Values are bound to the '?' parameters on each use.
 
-static inline char *SQL_AGE_DATAOBJECT_CMD(const Timeval& minimumAge)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM " 
-		 TABLE_DATAOBJECTS 
-		 " WHERE rowid NOT IN (SELECT dataobject_rowid FROM " 
-		 VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO 
-		 " ) AND timestamp < strftime('%s', 'now','-%ld seconds');", 
-		 "%s", minimumAge.getSeconds());
-	
-	return sqlcmd;
-}
+	The inserts use 'OR ABORT' to override the 'ON CONFLICT ROLLBACK' 
+	clauses in the table definitions. Outside a transaction the two are 
+	equivalent, but inside a group commit transaction a rollback would 
+	discard the whole batch when, e.g., an attribute already exists.
+*/
+
+// -- DATAOBJECT
+#define SQL_INSERT_DATAOBJECT_CMD					\
+	"INSERT OR ABORT INTO "						\
+	TABLE_DATAOBJECTS						\
+	" (id,xmlhdr,filepath,filename,datalen,datastate,datahash,"	\
+	"signaturestatus,signee,signature,siglen,createtime,"		\
+	"receivetime,rxtime,source_iface_rowid,node_id)"		\
+	" VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);"
+enum {
+	sql_insert_dataobject_cmd_id = 1,
+	sql_insert_dataobject_cmd_xmlhdr,
+	sql_insert_dataobject_cmd_filepath,
+	sql_insert_dataobject_cmd_filename,
+	sql_insert_dataobject_cmd_datalen,
+	sql_insert_dataobject_cmd_datastate,
+	sql_insert_dataobject_cmd_datahash,
+	sql_insert_dataobject_cmd_signaturestatus,
+	sql_insert_dataobject_cmd_signee,
+	sql_insert_dataobject_cmd_signature,
+	sql_insert_dataobject_cmd_siglen,
+	sql_insert_dataobject_cmd_createtime,
+	sql_insert_dataobject_cmd_receivetime,
+	sql_insert_dataobject_cmd_rxtime,
+	sql_insert_dataobject_cmd_source_iface_rowid,
+	sql_insert_dataobject_cmd_node_id
+};
+
+#define SQL_DELETE_DATAOBJECT_CMD					\
+	"DELETE FROM " TABLE_DATAOBJECTS " WHERE id = ?;"
+
+/*
+	Node descriptions of a node, newest first. Only the rowid and the 
+	create time are read, so the query is answered from the node id
+	index alone.
+*/
+#define SQL_NODE_DESCRIPTIONS_FROM_NODE_ID_CMD				\
+	"SELECT rowid,createtime FROM " TABLE_DATAOBJECTS		\
+	" WHERE node_id=? ORDER BY createtime desc;"
+
+enum {
+	sql_node_descriptions_from_node_id_cmd_rowid = 0,
+	sql_node_descriptions_from_node_id_cmd_createtime
+};
+
+// The parameters are the node id and the create time of the new node description
+#define SQL_DELETE_NODE_DESCRIPTIONS_CMD				\
+	"DELETE FROM " TABLE_DATAOBJECTS				\
+	" WHERE node_id=?1 AND createtime<?2;"
+
+// The parameter is an SQLite date modifier, e.g., '-3600 seconds'
+#define SQL_AGE_DATAOBJECT_CMD						\
+	"SELECT * FROM "						\
+	TABLE_DATAOBJECTS						\
+	" WHERE rowid NOT IN (SELECT dataobject_rowid FROM "		\
+	VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO			\
+	" ) AND timestamp < strftime('%s', 'now', ?);"
+
+// The number of data objects and their total size (data and metadata)
+#define SQL_DATAOBJECT_USAGE_CMD					\
+	"SELECT num, bytes FROM " TABLE_DATAOBJECT_USAGE ";"
+
+/*
+	The data objects that may be evicted, i.e., all but node 
+	descriptions, with the number of node attributes that they match 
+	(through the link table indexes), their age in seconds and size.
+*/
+#define SQL_EVICTION_CANDIDATES_CMD					\
+	"SELECT d.rowid, lower(hex(d.id)),"				\
+	" (SELECT count(*) FROM "					\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da INNER JOIN "						\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" as na ON na.attr_rowid=da.attr_rowid"				\
+	" WHERE da.dataobject_rowid=d.rowid),"				\
+	" strftime('%s','now')-d.timestamp,"				\
+	" ifnull(d.datalen,0)+ifnull(length(d.xmlhdr),0) FROM "	\
+	TABLE_DATAOBJECTS						\
+	" as d WHERE d.node_id='-';"
+enum {
+	sql_eviction_candidates_cmd_rowid = 0,
+	sql_eviction_candidates_cmd_id,
+	sql_eviction_candidates_cmd_interest,
+	sql_eviction_candidates_cmd_age,
+	sql_eviction_candidates_cmd_size
+};
 
 #define SQL_FIND_DATAOBJECT_CMD			\
 	"SELECT * FROM "			\
 	TABLE_DATAOBJECTS			\
 	" WHERE id=?;"
 
-static inline 
-char *SQL_INSERT_DATAOBJECT_ATTR_CMD(const sqlite_int64 dataobject_rowid, 
-				     const sqlite_int64 attr_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "INSERT INTO " 
-		 TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID 
-		 " (dataobject_rowid,attr_rowid) VALUES (" 
-		 SQLITE_INT64_FMT "," SQLITE_INT64_FMT ");", 
-		 dataobject_rowid, attr_rowid);
+#define SQL_INSERT_DATAOBJECT_ATTR_CMD					\
+	"INSERT OR ABORT INTO "						\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" (dataobject_rowid,attr_rowid,weight) VALUES (?,?,?);"
 
-	return sqlcmd;
-}
+#define SQL_DATAOBJECT_FROM_ROWID_CMD					\
+	"SELECT * FROM " TABLE_DATAOBJECTS " WHERE rowid=?;"
 
 // -- ATTRIBUTE
-static inline char *SQL_INSERT_ATTR_CMD(const Attribute * attr)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "INSERT INTO " 
-		 TABLE_ATTRIBUTES " (name,value) VALUES(\'%s\',\'%s\');", 
-		 attr->getName().c_str(), attr->getValue().c_str());
-
-	return sqlcmd;
-}
-
-static inline char *SQL_FIND_ATTR_CMD(const Attribute * attr)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT ROWID FROM " 
-		 TABLE_ATTRIBUTES " WHERE (name=\'%s\' AND value=\'%s\');", 
-		 attr->getName().c_str(), attr->getValue().c_str());
+#define SQL_INSERT_ATTR_CMD						\
+	"INSERT OR ABORT INTO " TABLE_ATTRIBUTES " (name,value) VALUES (?,?);"
 
-	return sqlcmd;
-}
-
-static inline 
-char *SQL_ATTRS_FROM_NODE_ROWID_CMD(const sqlite_int64 node_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM " 
-		 TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID 
-		 " WHERE node_rowid=" SQLITE_INT64_FMT ";", 
-		 node_rowid);
-
-	return sqlcmd;
-}
+#define SQL_FIND_ATTR_CMD						\
+	"SELECT ROWID FROM " TABLE_ATTRIBUTES				\
+	" WHERE (name=? AND value=?);"
 
-static inline 
-char *SQL_ATTRS_FROM_DATAOBJECT_ROWID_CMD(const sqlite_int64 dataobject_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM " 
-		 TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID 
-		 " WHERE dataobject_rowid=" SQLITE_INT64_FMT ";", 
-		 dataobject_rowid);
+#define SQL_ATTRS_FROM_NODE_ROWID_CMD					\
+	"SELECT * FROM "						\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" WHERE node_rowid=?;"
 
-	return sqlcmd;
-}
-static inline 
-char *SQL_ATTR_FROM_ROWID_CMD(const sqlite_int64 attr_rowid, 
-			      const sqlite_int64 node_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT a.rowid, a.name, a.value, w.weight FROM " 
-		 TABLE_ATTRIBUTES 
-		 " as a LEFT JOIN " 
-		 TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID 
-		 " as w ON a.rowid=w.attr_rowid WHERE a.rowid=" 
-		 SQLITE_INT64_FMT " AND w.node_rowid=" SQLITE_INT64_FMT ";", 
-		 attr_rowid, node_rowid);
+#define SQL_ATTRS_FROM_DATAOBJECT_ROWID_CMD				\
+	"SELECT a.name, a.value, m.weight FROM "			\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as m JOIN " TABLE_ATTRIBUTES					\
+	" as a ON a.rowid=m.attr_rowid WHERE m.dataobject_rowid=?;"
+enum {
+	sql_attrs_from_dataobject_rowid_cmd_name = 0,
+	sql_attrs_from_dataobject_rowid_cmd_value,
+	sql_attrs_from_dataobject_rowid_cmd_weight
+};
 
-	return sqlcmd;
-}
+#define SQL_ATTR_FROM_ROWID_CMD						\
+	"SELECT a.rowid, a.name, a.value, w.weight FROM "		\
+	TABLE_ATTRIBUTES						\
+	" as a LEFT JOIN "						\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" as w ON a.rowid=w.attr_rowid WHERE a.rowid=? AND w.node_rowid=?;"
 enum {
 	sql_attr_from_rowid_cmd_rowid	=	0,
 	sql_attr_from_rowid_cmd_name,
@@ -1145,43 +1264,13 @@ enum {
 	sql_attr_from_rowid_cmd_weight
 };
 
-static inline char *SQL_DATAOBJECT_FROM_ROWID_CMD(const sqlite_int64 do_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT * FROM %s WHERE rowid=" 
-		 SQLITE_INT64_FMT ";", 
-		 TABLE_DATAOBJECTS, do_rowid);
-
-	return sqlcmd;
-}
-
 // -- INTERFACE
-static inline char *SQL_INSERT_IFACE_CMD(const int type, 
-					 const char *mac_str, 
-					 const sqlite_int64 node_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "INSERT INTO %s (type,mac,mac_str,node_rowid) "
-		 "VALUES(%d,?,\'%s\',"
-		 SQLITE_INT64_FMT ");", 
-		 TABLE_INTERFACES,  
-		 type, 
-		 mac_str, 
-		 node_rowid);
-
-	return sqlcmd;
-}
-
-static inline 
-char *SQL_IFACES_FROM_NODE_ROWID_CMD(const sqlite_int64 node_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT * FROM %s WHERE "
-		 "node_rowid=" SQLITE_INT64_FMT ";", 
-		 TABLE_INTERFACES, node_rowid);
+#define SQL_INSERT_IFACE_CMD						\
+	"INSERT OR ABORT INTO " TABLE_INTERFACES				\
+	" (type,mac,mac_str,node_rowid) VALUES (?,?,?,?);"
 
-	return sqlcmd;
-}
+#define SQL_IFACES_FROM_NODE_ROWID_CMD					\
+	"SELECT * FROM " TABLE_INTERFACES " WHERE node_rowid=?;"
 
 static inline 
 char *SQL_IFACE_FROM_ROWID_CMD(const sqlite_int64 iface_rowid)
@@ -1199,68 +1288,38 @@ char *SQL_IFACE_FROM_ROWID_CMD(const sqlite_int64 iface_rowid)
 	TABLE_INTERFACES			\
 	" WHERE (mac=?);"
 
-// -- NODE
-
-static inline char *SQL_INSERT_NODE_CMD(const NodeRef& node)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "INSERT INTO " 
-		 TABLE_NODES 
-		 " ("
-		 "type,"
-		 "id,"
-		 "id_str,"
-		 "name,"
-		 "bloomfilter,"
-		 "nodedescription_createtime,"
-		 "resolution_max_matching_dataobjects,"
-		 "resolution_threshold"
-		 ") VALUES (%d,?,\'%s\',\'%s\',?,%lld,%lu,%lu);", 
-		 node->getType(), 
-		 node->getIdStr(), 
-		 node->getName().c_str(), 
-		 (long long int)node->getNodeDescriptionCreateTime().getTimeAsMilliSeconds(), 
-		 node->getMaxDataObjectsInMatch(), 
-		 node->getMatchingThreshold());
+#define SQL_NODE_ROWID_FROM_IFACE_CMD					\
+	"SELECT node_rowid FROM " TABLE_INTERFACES			\
+	" WHERE (type=? AND mac_str=?);"
 
-	return sqlcmd;
-}
-static inline char *SQL_DELETE_NODE_CMD()
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "DELETE FROM %s WHERE id = ?;", 
-		 TABLE_NODES);
-	
-	return sqlcmd;
-}
-static inline char *SQL_INSERT_NODE_ATTR_CMD(const sqlite_int64 node_rowid, const sqlite_int64 attr_rowid, const sqlite_int64 weight)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "INSERT INTO " 
-		 TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID 
-		 " (node_rowid,attr_rowid,weight) VALUES (" 
-		 SQLITE_INT64_FMT "," SQLITE_INT64_FMT "," SQLITE_INT64_FMT ");", 
-		 node_rowid, attr_rowid, weight);
+// -- NODE
+#define SQL_INSERT_NODE_CMD						\
+	"INSERT OR ABORT INTO "						\
+	TABLE_NODES							\
+	" (type,id,id_str,name,bloomfilter,nodedescription_createtime,"	\
+	"resolution_max_matching_dataobjects,resolution_threshold)"	\
+	" VALUES (?,?,?,?,?,?,?,?);"
+enum {
+	sql_insert_node_cmd_type = 1,
+	sql_insert_node_cmd_id,
+	sql_insert_node_cmd_id_str,
+	sql_insert_node_cmd_name,
+	sql_insert_node_cmd_bloomfilter,
+	sql_insert_node_cmd_nodedescription_createtime,
+	sql_insert_node_cmd_resolution_max_matching_dataobjects,
+	sql_insert_node_cmd_resolution_threshold
+};
 
-	return sqlcmd;
-}
-static inline char *SQL_NODE_FROM_ROWID_CMD(const sqlite_int64 node_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT * from %s WHERE rowid=" 
-		 SQLITE_INT64_FMT ";", 
-		 TABLE_NODES, node_rowid);
+#define SQL_DELETE_NODE_CMD "DELETE FROM " TABLE_NODES " WHERE id = ?;"
 
-	return sqlcmd;
-}
+#define SQL_INSERT_NODE_ATTR_CMD					\
+	"INSERT OR ABORT INTO "						\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" (node_rowid,attr_rowid,weight) VALUES (?,?,?);"
 
-static inline char *SQL_NODE_BY_TYPE_CMD(Node::Type_t type)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT rowid from %s WHERE type=%d;", 
-		 TABLE_NODES, type);
+#define SQL_NODE_FROM_ROWID_CMD "SELECT * FROM " TABLE_NODES " WHERE rowid=?;"
 
-	return sqlcmd;
-}
+#define SQL_NODE_BY_TYPE_CMD "SELECT rowid FROM " TABLE_NODES " WHERE type=?;"
 enum {
 	sql_node_by_type_cmd_rowid	=	0
 };
@@ -1269,69 +1328,138 @@ enum {
 
 
 // -- FILTER
-static inline char *SQL_INSERT_FILTER_CMD(const long eventType)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "INSERT INTO " TABLE_FILTERS " (event) VALUES (%ld);", 
-		 eventType);
-
-	return sqlcmd;
-}
-static inline char *SQL_DELETE_FILTER_CMD(const long eventType)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "DELETE FROM " TABLE_FILTERS " WHERE event = %ld;", 
-		 eventType);
+#define SQL_INSERT_FILTER_CMD "INSERT OR ABORT INTO " TABLE_FILTERS " (event) VALUES (?);"
 
-	return sqlcmd;
-}
-static inline 
-char *SQL_INSERT_FILTER_ATTR_CMD(const sqlite_int64 filter_rowid, 
-				 const sqlite_int64 attr_rowid, 
-				 const sqlite_int64 attr_weight)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "INSERT INTO " 
-		 TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID 
-		 " (filter_rowid,attr_rowid,weight) VALUES (" 
-		 SQLITE_INT64_FMT "," SQLITE_INT64_FMT "," SQLITE_INT64_FMT ");", 
-		 filter_rowid, attr_rowid, attr_weight);
+#define SQL_DELETE_FILTER_CMD "DELETE FROM " TABLE_FILTERS " WHERE event = ?;"
 
-	return sqlcmd;
-}
+#define SQL_INSERT_FILTER_ATTR_CMD					\
+	"INSERT OR ABORT INTO "						\
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID			\
+	" (filter_rowid,attr_rowid,weight) VALUES (?,?,?);"
 
-#define SQL_FILTER_MATCH_DATAOBJECT_ALL_CMD				\
-	"SELECT * FROM "						\
-	VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO			\
-	" WHERE ratio>0;"
 #define SQL_FILTER_MATCH_NODE_ALL_CMD					\
 	"SELECT * FROM "						\
 	VIEW_MATCH_FILTERS_AND_NODES_AS_RATIO				\
 	" WHERE filter_id=? and ratio>0;"
 
-static inline char *SQL_FILTER_MATCH_ALL_CMD(long filter_event)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT * FROM " 
-		 VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO 
-		 " WHERE filter_event=%ld and ratio>0;", filter_event);
+#define SQL_CREATE_TEMP_TABLE_FILTER_MATCHES_CMD			\
+	"CREATE TEMP TABLE IF NOT EXISTS "				\
+	TABLE_FILTER_MATCHES						\
+	" (filter_rowid INTEGER, dataobject_rowid INTEGER,"		\
+	" ratio INTEGER, match_weight INTEGER);"
 
-	return sqlcmd;
-}
+#define SQL_INDEX_TEMP_FILTER_MATCHES_CMD				\
+	"CREATE INDEX IF NOT EXISTS temp.index_filter_matches ON "	\
+	TABLE_FILTER_MATCHES						\
+	" (filter_rowid, ratio, match_weight, dataobject_rowid);"
 
-static inline 
-char *SQL_FILTER_MATCH_DATAOBJECT_CMD(const sqlite_int64 filter_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "SELECT * FROM " 
-		 VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO 
-		 " WHERE filter_rowid=" 
-		 SQLITE_INT64_FMT 
-		 " AND ratio>0 ORDER BY ratio, dataobject_rowid;", 
-		 filter_rowid);
+/*
+	Removes the matches of a filter (parameter 1), and those of 
+	filters that no longer exist, e.g., because their match was 
+	cancelled when they were removed.
+*/
+#define SQL_CLEAR_FILTER_MATCHES_CMD					\
+	"DELETE FROM "							\
+	TABLE_FILTER_MATCHES						\
+	" WHERE filter_rowid=?1 OR filter_rowid NOT IN"			\
+	" (SELECT rowid FROM " TABLE_FILTERS ");"
 
-	return sqlcmd;
-}
+/*
+	Filter > Dataobjects, computed once when the match of a filter 
+	starts. The match starts from the attributes of the filter 
+	(parameter 1 is its rowid) and goes through the attribute and link
+	table indexes to the data objects, so that only the data objects 
+	that share attributes with the filter are visited. Wildcard 
+	attributes go through the attribute name table instead, since they
+	match every value of the name. The ratio and filter attribute 
+	weight of every matching data object are stored in the filter match
+	table, from which the pages are read.
+*/
+#define SQL_FILL_FILTER_MATCHES_CMD					\
+	"INSERT INTO "							\
+	TABLE_FILTER_MATCHES						\
+	" SELECT ?1, dataobject_rowid, 100*count(*)/num_attributes as ratio,"	\
+	" sum(weight) FROM"						\
+	" (SELECT da.dataobject_rowid as dataobject_rowid,"		\
+	" fa.weight as weight, f.num_attributes as num_attributes FROM " \
+	TABLE_FILTERS							\
+	" as f INNER JOIN "						\
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as fa ON fa.filter_rowid=f.rowid INNER JOIN "			\
+	TABLE_ATTRIBUTES						\
+	" as fattr ON fa.attr_rowid=fattr.rowid INNER JOIN "		\
+	TABLE_ATTRIBUTES						\
+	" as a ON a.name=fattr.name AND a.value=fattr.value INNER JOIN " \
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da ON da.attr_rowid=a.rowid WHERE f.rowid=?1"		\
+	" AND fattr.value!='" ATTR_WILDCARD "'"				\
+	" UNION ALL SELECT dn.dataobject_rowid, fa.weight,"		\
+	" f.num_attributes FROM "					\
+	TABLE_FILTERS							\
+	" as f INNER JOIN "						\
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as fa ON fa.filter_rowid=f.rowid INNER JOIN "			\
+	TABLE_ATTRIBUTES						\
+	" as fattr ON fa.attr_rowid=fattr.rowid INNER JOIN "		\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTE_NAMES			\
+	" as dn ON dn.name=fattr.name WHERE f.rowid=?1"			\
+	" AND fattr.value='" ATTR_WILDCARD "')"				\
+	" GROUP BY dataobject_rowid HAVING ratio>0;"
+
+/*
+	Filter > Dataobjects, one page at a time from the filter match 
+	table. The data objects are ranked by ratio and filter attribute
+	weight, newest first, and the page starts after the rank given by
+	parameters 2-4, which the index on the table turns into a range 
+	scan. Parameter 5 is the page size, where a negative size means no 
+	limit. Data objects deleted since the match started are skipped.
+*/
+#define SQL_FILTER_MATCH_PAGE_CMD					\
+	"SELECT m.dataobject_rowid, m.ratio, m.match_weight FROM "	\
+	TABLE_FILTER_MATCHES						\
+	" as m INNER JOIN "						\
+	TABLE_DATAOBJECTS						\
+	" as d ON d.rowid=m.dataobject_rowid WHERE m.filter_rowid=?1"	\
+	" AND m.ratio<=?2 AND (m.ratio<?2 OR m.match_weight<?3 OR"	\
+	" (m.match_weight=?3 AND m.dataobject_rowid<?4))"		\
+	" ORDER BY m.ratio desc, m.match_weight desc,"			\
+	" m.dataobject_rowid desc"					\
+	" LIMIT ?5;"
+// Above every ratio, so that the first page starts at the top rank
+#define SQL_FILTER_MATCH_TOP_RATIO ((sqlite_int64)0x7fffffffffffffffLL)
+enum {
+	sql_filter_match_page_cmd_dataobject_rowid = 0,
+	sql_filter_match_page_cmd_ratio,
+	sql_filter_match_page_cmd_match_weight
+};
+
+/*
+	Filter > Dataobjects for a filter that is not in the data store. The
+	statement is put together from one term per filter attribute, which
+	is 1 for every data object attribute that matches the filter 
+	attribute, so that fmcount is the same as in 
+	VIEW_MATCH_FILTERS_AND_DATAOBJECTS. Parameter 1 is the number of 
+	filter attributes, and the name and value of filter attribute i are
+	bound to parameters 2+2i and 3+2i. As the filter is not inserted, the
+	query is read-only.
+*/
+#define SQL_FILTER_QUERY_BEGIN_CMD					\
+	"SELECT dataobject_rowid, 100*sum(fmcount)/?1 as ratio FROM"	\
+	" (SELECT da.dataobject_rowid as dataobject_rowid, (0"
+#define SQL_FILTER_QUERY_TERM_CMD					\
+	"+(a.name=?%u AND (a.value=?%u OR ?%u='" ATTR_WILDCARD "'))"
+#define SQL_FILTER_QUERY_FROM_CMD					\
+	") as fmcount FROM "						\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da INNER JOIN " TABLE_ATTRIBUTES				\
+	" as a ON da.attr_rowid=a.rowid WHERE a.name IN ("
+#define SQL_FILTER_QUERY_END_CMD					\
+	")) GROUP BY dataobject_rowid HAVING ratio>0"			\
+	" ORDER BY ratio, dataobject_rowid;"
+enum {
+	sql_filter_query_cmd_dataobject_rowid = 0,
+	sql_filter_query_cmd_ratio
+};
 
 static inline 
 char *SQL_FILTER_MATCH_NODE_CMD(const sqlite_int64 filter_rowid)
@@ -1346,22 +1474,264 @@ char *SQL_FILTER_MATCH_NODE_CMD(const sqlite_int64 filter_rowid)
 	return sqlcmd;
 }
 
-static inline char *SQL_DEL_FILTER_CMD(const sqlite_int64 filter_rowid)
-{
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, 
-		 "DELETE FROM %s WHERE rowid=" 
-		 SQLITE_INT64_FMT ";", 
-		 TABLE_FILTERS, filter_rowid);
-
-	return sqlcmd;
-}
+// -- MATCHING
+/*
+	Matching of a single dataobject or node. These statements compute
+	the same result as the matching views, with the link table limited
+	to the dataobject or node in question through a bound rowid. This
+	avoids replacing the dynamic views (DDL) for every match. The result
+	columns are the same as those of the corresponding ratio view.
+*/
 
-#define SQL_BEGIN_TRANSACTION_CMD "BEGIN TRANSACTION;"
-#define SQL_END_TRANSACTION_CMD "END TRANSACTION;"
+/*
+	Node > Dataobjects, same columns as VIEW_MATCH_NODES_AND_DATAOBJECTS_AS_RATIO, 
+	followed by the id and node id of the data object. These are used to skip
+	data objects that the node already has without building them.
+*/
+#define SQL_MATCH_NODE_AND_DATAOBJECTS_CMD				\
+	"SELECT 100*m.weight/n.sum_weights as ratio, m.*,"		\
+	" d.id as dataobject_id, d.node_id as dataobject_node_id FROM"	\
+	" (SELECT da.dataobject_rowid as dataobject_rowid,"		\
+	" na.node_rowid as node_rowid, count(*) as mcount,"		\
+	" sum(na.weight) as weight, min(na.weight)="			\
+	STRINGIFY(ATTR_WEIGHT_NO_MATCH)					\
+	" as dataobject_not_match,"					\
+	" da.timestamp as dataobject_timestamp FROM "			\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" as na INNER JOIN "						\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da ON na.attr_rowid=da.attr_rowid WHERE na.node_rowid=?"	\
+	" GROUP by na.node_rowid, da.dataobject_rowid) as m LEFT JOIN "	\
+	TABLE_NODES							\
+	" as n ON m.node_rowid=n.rowid LEFT JOIN "			\
+	TABLE_DATAOBJECTS						\
+	" as d ON m.dataobject_rowid=d.rowid WHERE"			\
+	" dataobject_not_match=0 AND ratio >= ? AND mcount >= ?"	\
+	" ORDER BY ratio desc, mcount desc, d.timestamp desc;"
 
+enum {
+	sql_match_node_and_dataobjects_cmd_dataobject_id = view_match_nodes_and_dataobjects_rated_dataobject_timestamp + 1,
+	sql_match_node_and_dataobjects_cmd_dataobject_node_id
+};
 
+// Dataobject > Nodes, same columns as VIEW_MATCH_DATAOBJECTS_AND_NODES_AS_RATIO
+// A negative limit means no limit.
+#define SQL_MATCH_DATAOBJECT_AND_NODES_CMD				\
+	"SELECT 100*m.weight/n.sum_weights as ratio,"			\
+	" n.resolution_threshold as threshold, m.* FROM"		\
+	" (SELECT da.dataobject_rowid as dataobject_rowid,"		\
+	" na.node_rowid as node_rowid, count(*) as mcount,"		\
+	" sum(na.weight) as weight, min(na.weight)="			\
+	STRINGIFY(ATTR_WEIGHT_NO_MATCH)					\
+	" as dataobject_not_match,"					\
+	" da.timestamp as dataobject_timestamp FROM "			\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da INNER JOIN "						\
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID				\
+	" as na ON na.attr_rowid=da.attr_rowid WHERE da.dataobject_rowid=?" \
+	" GROUP by da.dataobject_rowid, na.node_rowid) as m LEFT JOIN "	\
+	TABLE_NODES							\
+	" as n ON m.node_rowid=n.rowid WHERE ratio >= threshold"	\
+	" AND mcount >= ? AND dataobject_not_match=0"			\
+	" ORDER BY ratio desc, mcount desc LIMIT ?;"
 
-/* ========================================================= */
+// Dataobject > Filters, same columns as VIEW_MATCH_FILTERS_AND_DATAOBJECTS_AS_RATIO
+#define SQL_MATCH_DATAOBJECT_AND_FILTERS_CMD				\
+	"SELECT filter_rowid, filter_event,"				\
+	" 100*fmcount/filter_num_attributes as ratio,"			\
+	" dataobject_rowid FROM"					\
+	" (SELECT f.rowid as filter_rowid,"				\
+	" f.event as filter_event, count(*) as fmcount,"		\
+	" f.num_attributes as filter_num_attributes,"			\
+	" da.dataobject_rowid as dataobject_rowid FROM "		\
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as da INNER JOIN "						\
+	VIEW_SIMILAR_ATTRIBUTES						\
+	" as a ON da.attr_rowid=a.b_rowid LEFT JOIN "			\
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID			\
+	" as fa ON fa.attr_rowid=a.a_rowid LEFT JOIN "			\
+	TABLE_FILTERS							\
+	" as f ON fa.filter_rowid=f.rowid WHERE da.dataobject_rowid=?"	\
+	" GROUP by f.rowid, da.dataobject_rowid)"			\
+	" WHERE ratio>0 ORDER BY ratio desc, filter_num_attributes desc;"
+
+/*
+	The cached statements. The order must match the StatementType_t 
+	enum in SQLDataStore.h.
+*/
+static const char *stmt_cmds[] = {
+	SQL_INSERT_DATAOBJECT_CMD,
+	SQL_FIND_DATAOBJECT_CMD,
+	SQL_DATAOBJECT_FROM_ROWID_CMD,
+	SQL_DELETE_DATAOBJECT_CMD,
+	SQL_AGE_DATAOBJECT_CMD,
+	SQL_INSERT_DATAOBJECT_ATTR_CMD,
+	SQL_ATTRS_FROM_DATAOBJECT_ROWID_CMD,
+	SQL_INSERT_ATTR_CMD,
+	SQL_FIND_ATTR_CMD,
+	SQL_ATTR_FROM_ROWID_CMD,
+	SQL_ATTRS_FROM_NODE_ROWID_CMD,
+	SQL_INSERT_IFACE_CMD,
+	SQL_FIND_IFACE_CMD,
+	SQL_IFACES_FROM_NODE_ROWID_CMD,
+	SQL_NODE_ROWID_FROM_IFACE_CMD,
+	SQL_INSERT_NODE_CMD,
+	SQL_DELETE_NODE_CMD,
+	SQL_INSERT_NODE_ATTR_CMD,
+	SQL_NODE_FROM_ID_CMD,
+	SQL_NODE_FROM_ROWID_CMD,
+	SQL_NODE_BY_TYPE_CMD,
+	SQL_INSERT_FILTER_CMD,
+	SQL_DELETE_FILTER_CMD,
+	SQL_INSERT_FILTER_ATTR_CMD,
+	SQL_CLEAR_FILTER_MATCHES_CMD,
+	SQL_FILL_FILTER_MATCHES_CMD,
+	SQL_FILTER_MATCH_PAGE_CMD,
+	SQL_MATCH_NODE_AND_DATAOBJECTS_CMD,
+	SQL_MATCH_DATAOBJECT_AND_NODES_CMD,
+	SQL_MATCH_DATAOBJECT_AND_FILTERS_CMD,
+	SQL_DATAOBJECT_USAGE_CMD,
+	SQL_EVICTION_CANDIDATES_CMD,
+	SQL_NODE_DESCRIPTIONS_FROM_NODE_ID_CMD,
+	SQL_DELETE_NODE_DESCRIPTIONS_CMD,
+	NULL
+};
+
+#define SQL_BEGIN_TRANSACTION_CMD "BEGIN TRANSACTION;"
+#define SQL_END_TRANSACTION_CMD "END TRANSACTION;"
+#define SQL_ROLLBACK_TRANSACTION_CMD "ROLLBACK TRANSACTION;"
+
+
+
+/* ========================================================= */
+/* Cache of materialized data objects                        */
+/* ========================================================= */
+
+DataObjectCache::DataObjectCache(size_t _maxBytes) : 
+	head(NULL), tail(NULL), maxBytes(_maxBytes), bytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+DataObjectCache::~DataObjectCache()
+{
+	clear();
+}
+
+// Puts the entry first in the list, as the most recently used
+void DataObjectCache::link(Entry *e)
+{
+	e->prev = NULL;
+	e->next = head;
+
+	if (head)
+		head->prev = e;
+	else
+		tail = e;
+
+	head = e;
+}
+
+void DataObjectCache::unlink(Entry *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		head = e->next;
+
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		tail = e->prev;
+
+	e->prev = e->next = NULL;
+}
+
+DataObjectRef DataObjectCache::lookup(sqlite_int64 rowid)
+{
+	RowIdMap::iterator it = rowids.find(rowid);
+
+	if (it == rowids.end()) {
+		misses++;
+		return NULL;
+	}
+	Entry *e = (*it).second;
+
+	hits++;
+	unlink(e);
+	link(e);
+
+	return e->dObj->copy();
+}
+
+void DataObjectCache::insert(sqlite_int64 rowid, const DataObjectRef& dObj, size_t size)
+{
+	if (!dObj || size > maxBytes)
+		return;
+
+	remove(rowid);
+	
+	while (tail && bytes + size > maxBytes)
+		evictLeastRecentlyUsed();
+	
+	Entry *e = new Entry(rowid, dObj->copy(), size);
+
+	rowids.insert(make_pair(rowid, e));
+	ids.insert(make_pair(string(dObj->getIdStr()), rowid));
+	link(e);
+	bytes += size;
+}
+
+void DataObjectCache::remove(RowIdMap::iterator it)
+{
+	Entry *e = (*it).second;
+	
+	ids.erase(string(e->dObj->getIdStr()));
+	bytes -= e->size;
+	unlink(e);
+	rowids.erase(it);
+	delete e;
+}
+
+void DataObjectCache::remove(sqlite_int64 rowid)
+{
+	RowIdMap::iterator it = rowids.find(rowid);
+
+	if (it != rowids.end())
+		remove(it);
+}
+
+void DataObjectCache::remove(const string& idStr)
+{
+	IdMap::iterator it = ids.find(idStr);
+
+	if (it != ids.end())
+		remove((*it).second);
+}
+
+void DataObjectCache::evictLeastRecentlyUsed()
+{
+	if (!tail)
+		return;
+
+	remove(rowids.find(tail->rowid));
+	evictions++;
+}
+
+void DataObjectCache::clear()
+{
+	while (!rowids.empty())
+		remove(rowids.begin());
+}
+
+void DataObjectCache::setMaxBytes(size_t _maxBytes)
+{
+	maxBytes = _maxBytes;
+	
+	while (tail && bytes > maxBytes)
+		evictLeastRecentlyUsed();
+}
+
+/* ========================================================= */
 /* Commands to create objects from datastore                 */
 /* ========================================================= */
 
@@ -1387,15 +1757,35 @@ DataObject *SQLDataStore::createDataObject(sqlite3_stmt * stmt)
 		receive_time = Timeval((long)(receivetime_millisecs / 1000), (long)((receivetime_millisecs - (receivetime_millisecs / 1000)*1000) * 1000));
 
 	/*
-	   FIXME: most of these fields that we use to initialize the data object will probably be overwritten when the metadata
-	   is parsed during construction. We should either decide that the fields are always set when parsing the metadata
-	   and then the create function should be much simpler, or, we should allow data objects to be created solely based on the information 
-	   in the data base. This last option would probably speed up data object construction since we would not have to parse
-	   the information all over again every time the data object is retrieved from the data store.
+	   When rebuilding from the table fields, the metadata is not parsed
+	   until it is needed. We fall back to parsing the metadata in case 
+	   the attributes cannot be read, e.g., when they were stored without
+	   weights by an older version of the data store.
 
-	   FIXME: add signature to data object table and set here.
 	   FIXME: add source interface.
 	*/
+	if (rebuildDataObjects) {
+		Attributes attrs;
+
+		if (getDataObjectAttributes(sqlite3_column_int64(stmt, table_dataobjects_rowid), attrs)) {
+			DataObject *dObj = DataObject::create_from_fields((const unsigned char *)sqlite3_column_blob(stmt, table_dataobjects_id),
+							 attrs, sqlite3_column_text(stmt, table_dataobjects_xmlhdr), 
+							 sqlite3_column_bytes(stmt, table_dataobjects_xmlhdr), true,
+							 (const char *) sqlite3_column_text(stmt, table_dataobjects_filepath),
+							 (const char *) sqlite3_column_text(stmt, table_dataobjects_filename),
+							 (DataObject::SignatureStatus_t)sqlite3_column_int64(stmt, table_dataobjects_signature_status),
+							 (const char *) sqlite3_column_text(stmt, table_dataobjects_signee),
+							 (unsigned char *)sqlite3_column_blob(stmt, table_dataobjects_signature),
+							 (unsigned long)sqlite3_column_int64(stmt, table_dataobjects_signature_len),
+							 create_time, receive_time,
+							 (unsigned long)sqlite3_column_int64(stmt, table_dataobjects_rxtime), datalen,
+							 (DataObject::DataState_t)sqlite3_column_int64(stmt, table_dataobjects_datastate),
+							 (unsigned char *)sqlite3_column_blob(stmt, table_dataobjects_datahash));
+			if (dObj)
+				return dObj;
+		}
+	}
+
 	return DataObject::create(sqlite3_column_text(stmt, table_dataobjects_xmlhdr), 
 					sqlite3_column_bytes(stmt, table_dataobjects_xmlhdr), NULL, NULL, true,
 					(const char *) sqlite3_column_text(stmt, table_dataobjects_filepath),
@@ -1410,12 +1800,41 @@ DataObject *SQLDataStore::createDataObject(sqlite3_stmt * stmt)
 					(unsigned char *)sqlite3_column_blob(stmt, table_dataobjects_datahash));
 }
 
+bool SQLDataStore::getDataObjectAttributes(const sqlite_int64 dataobject_rowid, Attributes& attrs)
+{
+	int ret;
+	bool success = true;
+	sqlite3_stmt *stmt = getStatement(STMT_ATTRS_FROM_DATAOBJECT_ROWID);
+
+	if (!stmt)
+		return false;
+
+	sqlite3_bind_int64(stmt, 1, dataobject_rowid);
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (sqlite3_column_type(stmt, sql_attrs_from_dataobject_rowid_cmd_weight) == SQLITE_NULL) {
+			success = false;
+			break;
+		}
+		attrs.add(Attribute((const char *)sqlite3_column_text(stmt, sql_attrs_from_dataobject_rowid_cmd_name),
+				    (const char *)sqlite3_column_text(stmt, sql_attrs_from_dataobject_rowid_cmd_value),
+				    (unsigned long)sqlite3_column_int64(stmt, sql_attrs_from_dataobject_rowid_cmd_weight)));
+	}
+
+	if (ret == SQLITE_ERROR) {
+		HAGGLE_ERR("Could not get data object attributes: %s\n", sqlite3_errmsg(db));
+		success = false;
+	}
+
+	sqlite3_reset(stmt);
+
+	return success;
+}
+
 NodeRef SQLDataStore::createNode(sqlite3_stmt * in_stmt)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 node_rowid;
 	NodeRef node = NULL;
 	Node::Id_t node_id;
@@ -1455,15 +1874,12 @@ NodeRef SQLDataStore::createNode(sqlite3_stmt * in_stmt)
 
 	node_rowid = sqlite3_column_int64(in_stmt, table_nodes_rowid);
 
-	sql_cmd = SQL_ATTRS_FROM_NODE_ROWID_CMD(node_rowid);
-
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_ATTRS_FROM_NODE_ROWID);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return node;
-	}
 
+	sqlite3_bind_int64(stmt, 1, node_rowid);
 
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
@@ -1487,15 +1903,14 @@ NodeRef SQLDataStore::createNode(sqlite3_stmt * in_stmt)
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
-	ret = sqlite3_prepare_v2(db, SQL_IFACES_FROM_NODE_ROWID_CMD(node_rowid), (int)
-				 strlen(SQL_IFACES_FROM_NODE_ROWID_CMD(node_rowid)), &stmt, &tail);
+	stmt = getStatement(STMT_IFACES_FROM_NODE_ROWID);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", SQL_IFACES_FROM_NODE_ROWID_CMD);
+	if (!stmt)
 		return node;
-	}
+
+	sqlite3_bind_int64(stmt, 1, node_rowid);
 
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
@@ -1526,7 +1941,7 @@ NodeRef SQLDataStore::createNode(sqlite3_stmt * in_stmt)
 	}
 
       out:
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	return node;
 }
@@ -1535,19 +1950,16 @@ Attribute *SQLDataStore::getAttrFromRowId(const sqlite_int64 attr_rowid, const s
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd;
 	Attribute *attr = NULL;
 	int num_match = 0;
 
-	sql_cmd = SQL_ATTR_FROM_ROWID_CMD(attr_rowid, node_rowid);
+	stmt = getStatement(STMT_ATTR_FROM_ROWID);
 
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return NULL;
-	}
+
+	sqlite3_bind_int64(stmt, 1, attr_rowid);
+	sqlite3_bind_int64(stmt, 2, node_rowid);
 
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
@@ -1571,35 +1983,62 @@ Attribute *SQLDataStore::getAttrFromRowId(const sqlite_int64 attr_rowid, const s
 		}
 	}
       out:
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	return attr;
 }
 
-DataObject *SQLDataStore::getDataObjectFromRowId(const sqlite_int64 dataObjectRowId)
+/*
+	The size of a cached data object is estimated as the object itself 
+	plus twice its XML header: once for the raw metadata and once for the 
+	parsed metadata and attributes.
+*/
+DataObjectRef SQLDataStore::createCachedDataObject(sqlite3_stmt *stmt)
+{
+	DataObjectRef dObj = createDataObject(stmt);
+
+	if (dObj) {
+		dataObjectCache.insert(sqlite3_column_int64(stmt, table_dataobjects_rowid), dObj, 
+				       sizeof(DataObject) + 
+				       2 * sqlite3_column_bytes(stmt, table_dataobjects_xmlhdr));
+	}
+	
+	return dObj;
+}
+
+DataObjectRef SQLDataStore::getDataObject(sqlite3_stmt *stmt)
+{
+	DataObjectRef dObj = dataObjectCache.lookup(sqlite3_column_int64(stmt, table_dataobjects_rowid));
+
+	if (dObj)
+		return dObj;
+
+	return createCachedDataObject(stmt);
+}
+
+DataObjectRef SQLDataStore::getDataObjectFromRowId(const sqlite_int64 dataObjectRowId)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd;
 	int num_match = 0;
-	DataObject *dObj = NULL;
+	DataObjectRef dObj = dataObjectCache.lookup(dataObjectRowId);
 
-	sql_cmd = SQL_DATAOBJECT_FROM_ROWID_CMD(dataObjectRowId);
+	if (dObj)
+		return dObj;
 
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_DATAOBJECT_FROM_ROWID);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return NULL;
-	}
+
+	sqlite3_bind_int64(stmt, 1, dataObjectRowId);
 
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
 			num_match++;
 
 			if (num_match == 1) {
-				dObj = createDataObject(stmt);
+				dObj = createCachedDataObject(stmt);
 			} else {
 				HAGGLE_DBG("More than on DataObject with rowid=" SQLITE_INT64_FMT "\n", dataObjectRowId);
 				goto out;
@@ -1610,7 +2049,7 @@ DataObject *SQLDataStore::getDataObjectFromRowId(const sqlite_int64 dataObjectRo
 		}
 	}
       out:
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	return dObj;
 }
@@ -1619,19 +2058,15 @@ NodeRef SQLDataStore::getNodeFromRowId(const sqlite_int64 nodeRowId)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd;
 	NodeRef node = NULL;
 	int num_match = 0;
 
-	sql_cmd = SQL_NODE_FROM_ROWID_CMD(nodeRowId);
-
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_NODE_FROM_ROWID);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return NULL;
-	}
+
+	sqlite3_bind_int64(stmt, 1, nodeRowId);
 
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
@@ -1651,7 +2086,7 @@ NodeRef SQLDataStore::getNodeFromRowId(const sqlite_int64 nodeRowId)
 	}
 
       out_err:
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	return node;
 }
@@ -1754,88 +2189,35 @@ int SQLDataStore::findAndAddDataObjectTargets(DataObjectRef& dObj, const sqlite_
 }
 
 /* ========================================================= */
-/* limit/reset views on dataobject and node attributes       */
+/* reset views on dataobject and node attributes             */
 /*                                                           */
-/* the views are limited to speed up matching queries        */
+/* older versions of the data store replaced these views     */
+/* with limited ones during matching, so a data base file    */
+/* may have been left with a limited view.                   */
 /* ========================================================= */
 
-int SQLDataStore::setViewLimitedDataobjectAttributes(sqlite_int64 dataobject_rowid) {
+int SQLDataStore::resetDynamicViews()
+{
 	int ret;
-	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd = sqlcmd;
-	
-	// -- drop existing view
-	sql_cmd = (char *) SQL_DROP_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD;
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
-		// view probably missing, so we do not quit
-	} else {
-		ret = sqlite3_step(stmt);
-	}
-	sqlite3_finalize(stmt);
+
+	// The views may be missing, so we do not check the result of the drop
+	sqlQuery(SQL_DROP_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD);
 	
-	// -- replace with a) limted to specific dataobject, or b) all (default)
-	sql_cmd = sqlcmd;
-	if (dataobject_rowid) {
-		snprintf(sql_cmd, SQL_MAX_CMD_SIZE, SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD " as da WHERE da.dataobject_rowid=" SQLITE_INT64_FMT ";", dataobject_rowid);
-		// remove ';' from SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD
-		sql_cmd[strlen(SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD)-1] = ' ';
-	} else {
-		sql_cmd = (char *) SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD;
-	}
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
+	ret = sqlQuery(SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD);
+
+	if (ret != SQLITE_DONE) {
+		HAGGLE_DBG("Could not reset dataobject attributes view: %s\n", sqlite3_errmsg(db));
 		return -1;
 	}
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	
-	return 1;
-}
 
+	sqlQuery(SQL_DROP_VIEW_LIMITED_NODE_ATTRIBUTES_CMD);
 
-int SQLDataStore::setViewLimitedNodeAttributes(sqlite_int64 node_rowid) {
-	int ret;
-	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd = sqlcmd;
-	// This is unused:
-	//char *tmp = NULL;
-	
-	// -- drop existing view
-	sql_cmd = (char *) SQL_DROP_VIEW_LIMITED_NODE_ATTRIBUTES_CMD;
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
-	} else {
-		ret = sqlite3_step(stmt);
-	}
-	sqlite3_finalize(stmt);
-	
-	// -- replace with a) limted to specific node, or b) all (default)
-	sql_cmd = sqlcmd;
-	if (node_rowid) {
-		snprintf(sql_cmd, SQL_MAX_CMD_SIZE, SQL_CREATE_VIEW_LIMITED_NODE_ATTRIBUTES_CMD " as na WHERE na.node_rowid=" SQLITE_INT64_FMT ";", node_rowid);
-		// remove ';' from SQL_CREATE_VIEW_LIMITED_NODE_ATTRIBUTES_CMD
-		sql_cmd[strlen(SQL_CREATE_VIEW_LIMITED_NODE_ATTRIBUTES_CMD)-1] = ' ';
-	} else {
-		sql_cmd = (char *) SQL_CREATE_VIEW_LIMITED_NODE_ATTRIBUTES_CMD;
-	}
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
+	ret = sqlQuery(SQL_CREATE_VIEW_LIMITED_NODE_ATTRIBUTES_CMD);
+
+	if (ret != SQLITE_DONE) {
+		HAGGLE_DBG("Could not reset node attributes view: %s\n", sqlite3_errmsg(db));
 		return -1;
 	}
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	
 	return 1;
 }
 
@@ -1845,13 +2227,30 @@ int SQLDataStore::setViewLimitedNodeAttributes(sqlite_int64 node_rowid) {
 /* ========================================================= */
 
 SQLDataStore::SQLDataStore(const bool _recreate, const string _filepath, const string name) : 
-	DataStore(name), db(NULL), isInMemory(false), recreate(_recreate), filepath(_filepath)
+	DataStore(name), db(NULL), isInMemory(false), recreate(_recreate), filepath(_filepath),
+	stmtCacheHits(0), stmtCacheMisses(0), rebuildDataObjects(false), hasReaders(false)
+#if defined(HAVE_SQLITE_BACKUP_SUPPORT)
+	, checkpointFile(NULL), checkpointBackup(NULL), checkpointPages(SQL_CHECKPOINT_PAGES), 
+	checkpointSlices(0), checkpointChanges(-1)
+#endif
 {
+	memset(stmts, 0, sizeof(stmts));
 }
 
 SQLDataStore::~SQLDataStore()
 {
+	HAGGLE_DBG("Statement cache: %lu hits, %lu misses\n", stmtCacheHits, stmtCacheMisses);
+	HAGGLE_DBG("Data object cache: %lu hits, %lu misses, %lu evictions, %lu objects (%lu bytes)\n", 
+		   dataObjectCache.getHits(), dataObjectCache.getMisses(), 
+		   dataObjectCache.getEvictions(), (unsigned long)dataObjectCache.size(), 
+		   (unsigned long)dataObjectCache.getBytes());
+	
+	finalizeStatements();
+
 #if defined(HAVE_SQLITE_BACKUP_SUPPORT)
+	// The full backup below supersedes a checkpoint in progress
+	finishCheckpoint();
+
 	// backup in-memory database
 	if (isInMemory) {
 		string file = getFilepath();
@@ -1938,6 +2337,9 @@ bool SQLDataStore::init()
 	if (num_tables > 0) {
 		HAGGLE_DBG("Database and tables already exist...\n");
 		sqlite3_finalize(stmt);
+		upgradeTables();
+		resetDynamicViews();
+		prepareStatements();
 		cleanupDataStore();
 		return true;
 	}
@@ -1949,12 +2351,84 @@ bool SQLDataStore::init()
 		return false;
 	}
 	
+	prepareStatements();
+
 #if defined(INMEMORY_DATASTORE)
 	_onConfig();
 #endif
 	return true;
 }
 
+bool SQLDataStore::initReader()
+{
+	string file = getFilepath();
+
+	if (file.empty())
+		return false;
+
+	int ret = sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READONLY, NULL);
+
+	if (ret != SQLITE_OK) {
+		HAGGLE_ERR("Can't open database file %s: %s\n", file.c_str(), sqlite3_errmsg(db));
+		sqlite3_close(db);
+		db = NULL;
+		return false;
+	}
+
+	// The writer may briefly hold locks, e.g., during a checkpoint
+	sqlite3_busy_timeout(db, SQL_READER_BUSY_TIMEOUT);
+
+	// Statements that write will fail, but are not used by a reader
+	prepareStatements();
+
+	return true;
+}
+
+/*
+	A reader has its own connection, statement cache and data object 
+	cache, so that it shares no state with this instance. Readers only 
+	run concurrently with the writer in WAL mode, where each reader sees 
+	a consistent snapshot of the database without blocking the writer.
+	The data object cache of a reader is not invalidated by the writer, 
+	and gets a smaller budget (see DataObjectCache).
+*/
+DataStore *SQLDataStore::_createReader()
+{
+	if (isInMemory) {
+		HAGGLE_ERR("Reader threads are not supported with an in-memory database\n");
+		return NULL;
+	}
+
+	string mode = setPragma("journal_mode", "WAL");
+
+	// SQLite reports the mode in use in lower case
+	if (mode != "wal") {
+		HAGGLE_ERR("Reader threads require journal_mode WAL (in use: %s)\n", mode.c_str());
+		return NULL;
+	}
+
+	SQLDataStore *reader = new SQLDataStore(false, filepath, "SQLDataStoreReader");
+
+	if (!reader)
+		return NULL;
+
+	reader->kernel = kernel;
+	reader->rebuildDataObjects = rebuildDataObjects;
+	if (dataObjectCache.getMaxBytes() < DATAOBJECT_READER_CACHE_MAX_BYTES)
+		reader->dataObjectCache.setMaxBytes(dataObjectCache.getMaxBytes());
+	else
+		reader->dataObjectCache.setMaxBytes(DATAOBJECT_READER_CACHE_MAX_BYTES);
+
+	if (!reader->initReader()) {
+		delete reader;
+		return NULL;
+	}
+
+	hasReaders = true;
+
+	return reader;
+}
+
 int SQLDataStore::createTables()
 {
 	int ret;
@@ -1975,6 +2449,109 @@ int SQLDataStore::createTables()
 	return 1;
 }
 
+/*
+	Runs the commands of a migration in one transaction, so that a
+	failed migration leaves no half-filled table behind that would make
+	the next start believe the upgrade was done.
+*/
+int SQLDataStore::migrateTables(const char **cmds)
+{
+	if (_beginTransaction() < 0)
+		return -1;
+
+	for (int i = 0; cmds[i]; i++) {
+		if (sqlQuery(cmds[i]) != SQLITE_DONE) {
+			HAGGLE_ERR("Migration failed: %s\n", sqlite3_errmsg(db));
+			fprintf(stderr, "SQL command: %s\n", cmds[i]);
+			sqlQuery(SQL_ROLLBACK_TRANSACTION_CMD);
+			return -1;
+		}
+	}
+	return _endTransaction();
+}
+
+int SQLDataStore::upgradeTables()
+{
+	sqlite3_stmt *stmt;
+	const char *tail;
+	int ret;
+
+	int upgraded = 0;
+	const char *index_cmds[] = { SQL_INDEX_DATAOBJECTS_NODE_ID_CMD, SQL_INDEX_FILTER_ATTRS_CMD, NULL };
+	const char *attribute_names_cmds[] = {
+		SQL_CREATE_DATAOBJECT_TABLE_ATTRIBUTE_NAMES_CMD,
+		SQL_FILL_DATAOBJECT_ATTRIBUTE_NAMES_CMD,
+		SQL_INDEX_DATAOBJECT_ATTR_NAMES_CMD,
+		SQL_DROP_TRIGGER_INSERT_DATAOBJECT_ATTRIBUTES_CMD,
+		SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_ATTRIBUTES_CMD,
+		SQL_DROP_TRIGGER_DEL_DATAOBJECT_ATTRIBUTES_CMD,
+		SQL_CREATE_TRIGGER_DEL_DATAOBJECT_ATTRIBUTES_CMD,
+		NULL
+	};
+	const char *usage_cmds[] = {
+		SQL_CREATE_TABLE_DATAOBJECT_USAGE_CMD,
+		SQL_FILL_DATAOBJECT_USAGE_CMD,
+		SQL_CREATE_TRIGGER_INSERT_DATAOBJECT_USAGE_CMD,
+		SQL_CREATE_TRIGGER_DEL_DATAOBJECT_USAGE_CMD,
+		NULL
+	};
+
+	// Data stores created by earlier versions lack some indexes
+	for (int i = 0; index_cmds[i]; i++) {
+		ret = sqlQuery(index_cmds[i]);
+
+		if (ret == SQLITE_ERROR) {
+			HAGGLE_ERR("Could not create index: %s\n", sqlite3_errmsg(db));
+		}
+	}
+
+	ret = sqlite3_prepare_v2(db, SQL_CHECK_DATAOBJECT_ATTRIBUTES_WEIGHT_CMD, -1, &stmt, &tail);
+
+	if (ret == SQLITE_OK) {
+		sqlite3_finalize(stmt);
+	} else {
+		HAGGLE_DBG("Adding attribute weights to data object attribute table\n");
+
+		ret = sqlQuery(SQL_ADD_DATAOBJECT_ATTRIBUTES_WEIGHT_CMD);
+
+		if (ret == SQLITE_ERROR) {
+			HAGGLE_ERR("Could not add attribute weights: %s\n", sqlite3_errmsg(db));
+			return -1;
+		}
+		upgraded = 1;
+	}
+
+	ret = sqlite3_prepare_v2(db, SQL_CHECK_DATAOBJECT_ATTRIBUTE_NAMES_CMD, -1, &stmt, &tail);
+
+	if (ret == SQLITE_OK) {
+		sqlite3_finalize(stmt);
+	} else {
+		HAGGLE_DBG("Adding attribute name table for data objects\n");
+
+		if (migrateTables(attribute_names_cmds) < 0) {
+			HAGGLE_ERR("Could not add attribute name table\n");
+			return -1;
+		}
+		upgraded = 1;
+	}
+
+	ret = sqlite3_prepare_v2(db, SQL_CHECK_DATAOBJECT_USAGE_CMD, -1, &stmt, &tail);
+
+	if (ret == SQLITE_OK) {
+		sqlite3_finalize(stmt);
+	} else {
+		HAGGLE_DBG("Adding data object usage table\n");
+
+		if (migrateTables(usage_cmds) < 0) {
+			HAGGLE_ERR("Could not add data object usage table\n");
+			return -1;
+		}
+		upgraded = 1;
+	}
+
+	return upgraded;
+}
+
 int SQLDataStore::cleanupDataStore()
 {
 	int ret;
@@ -2015,30 +2592,110 @@ int SQLDataStore::sqlQuery(const char *sql_cmd)
 	return ret;
 }
 
+int SQLDataStore::sqlQuery(StatementType_t type)
+{
+	int ret;
+	sqlite3_stmt *stmt = stmts[type];
+
+	// The caller has retrieved the statement through getStatement() 
+	// and bound its parameters
+	if (!stmt)
+		return SQLITE_ERROR;
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+	};
+	
+	if (ret == SQLITE_ERROR) {
+		HAGGLE_ERR("error: %s\n", sqlite3_errmsg(db));
+	}
+
+	sqlite3_reset(stmt);
+
+	return ret;
+}
+
+int SQLDataStore::prepareStatements()
+{
+	int ret, failed = 0;
+	const char *tail;
+
+	// Temporary tables belong to the connection, so they are created 
+	// along with its statements
+	if (sqlQuery(SQL_CREATE_TEMP_TABLE_FILTER_MATCHES_CMD) != SQLITE_DONE ||
+	    sqlQuery(SQL_INDEX_TEMP_FILTER_MATCHES_CMD) != SQLITE_DONE) {
+		HAGGLE_ERR("Could not create filter match table: %s\n", sqlite3_errmsg(db));
+	}
+
+	for (int i = 0; i < _STMT_MAX && stmt_cmds[i]; i++) {
+		if (stmts[i])
+			continue;
+		
+		ret = sqlite3_prepare_v2(db, stmt_cmds[i], -1, &stmts[i], &tail);
+
+		if (ret != SQLITE_OK) {
+			HAGGLE_ERR("SQLite command compilation failed! %s : %s\n", 
+				   stmt_cmds[i], sqlite3_errmsg(db));
+			stmts[i] = NULL;
+			failed++;
+		}
+	}
+	return failed;
+}
+
+void SQLDataStore::finalizeStatements()
+{
+	for (int i = 0; i < _STMT_MAX; i++) {
+		if (stmts[i]) {
+			sqlite3_finalize(stmts[i]);
+			stmts[i] = NULL;
+		}
+	}
+}
+
+sqlite3_stmt *SQLDataStore::getStatement(StatementType_t type)
+{
+	int ret;
+	const char *tail;
+
+	if (stmts[type]) {
+		stmtCacheHits++;
+		sqlite3_reset(stmts[type]);
+		sqlite3_clear_bindings(stmts[type]);
+		return stmts[type];
+	}
+
+	// Not compiled yet (or compilation failed earlier), try again
+	stmtCacheMisses++;
+
+	ret = sqlite3_prepare_v2(db, stmt_cmds[type], -1, &stmts[type], &tail);
+
+	if (ret != SQLITE_OK) {
+		HAGGLE_DBG("SQLite command compilation failed! %s\n", stmt_cmds[type]);
+		stmts[type] = NULL;
+		return NULL;
+	}
+	return stmts[type];
+}
+
 
 sqlite_int64 SQLDataStore::getDataObjectRowId(const DataObjectId_t& id)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 rowid = -1;
 
 	if (id == NULL)
 		return -1;
 
-	ret = sqlite3_prepare_v2(db, SQL_FIND_DATAOBJECT_CMD, (int) strlen(SQL_FIND_DATAOBJECT_CMD), &stmt, &tail);
-
+	stmt = getStatement(STMT_FIND_DATAOBJECT);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", SQL_FIND_DATAOBJECT_CMD);
+	if (!stmt)
 		return -1;
-	}
 
 	ret = sqlite3_bind_blob(stmt, 1, id, DATAOBJECT_ID_LEN, SQLITE_TRANSIENT);
 
 	if (ret != SQLITE_OK) {
 		HAGGLE_DBG("SQLite could not bind blob!\n");
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 
@@ -2048,14 +2705,13 @@ sqlite_int64 SQLDataStore::getDataObjectRowId(const DataObjectId_t& id)
 		rowid = sqlite3_column_int64(stmt, table_dataobjects_rowid);
 	}
 
+	sqlite3_reset(stmt);
+
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not insert DO Error: %s\n", sqlite3_errmsg(db));
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 
-	sqlite3_finalize(stmt);
-
 	return rowid;
 }
 
@@ -2063,20 +2719,18 @@ sqlite_int64 SQLDataStore::getAttributeRowId(const Attribute *attr)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd;
 	sqlite_int64 rowid = -1;
 
 	if (!attr)
 		return -1;
 
-	sql_cmd = SQL_FIND_ATTR_CMD(attr);
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_FIND_ATTR);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return -1;
-	}
+
+	sqlite3_bind_text(stmt, 1, attr->getName().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, 2, attr->getValue().c_str(), -1, SQLITE_TRANSIENT);
 
 	ret = sqlite3_step(stmt);
 
@@ -2084,14 +2738,13 @@ sqlite_int64 SQLDataStore::getAttributeRowId(const Attribute *attr)
 		rowid = sqlite3_column_int64(stmt, table_attributes_rowid);
 	}
 
+	sqlite3_reset(stmt);
+
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not find Attribute: %s\n", sqlite3_errmsg(db));
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 
-	sqlite3_finalize(stmt);
-
 	return rowid;
 }
 
@@ -2100,24 +2753,20 @@ sqlite_int64 SQLDataStore::getInterfaceRowId(const InterfaceRef& iface)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 ifaceRowId = -1;
 
 	if (!iface)
 		return -1;
 
-	ret = sqlite3_prepare_v2(db, SQL_FIND_IFACE_CMD, (int) strlen(SQL_FIND_IFACE_CMD), &stmt, &tail);
+	stmt = getStatement(STMT_FIND_IFACE);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", SQL_FIND_IFACE_CMD);
+	if (!stmt)
 		return -1;
-	}
 
 	ret = sqlite3_bind_blob(stmt, 1, iface->getIdentifier(), iface->getIdentifierLen(), SQLITE_TRANSIENT);
 
 	if (ret != SQLITE_OK) {
 		HAGGLE_DBG("SQLite could not bind blob!\n");
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 
@@ -2127,14 +2776,13 @@ sqlite_int64 SQLDataStore::getInterfaceRowId(const InterfaceRef& iface)
 		ifaceRowId = sqlite3_column_int64(stmt, table_interfaces_rowid);
 	}
 
+	sqlite3_reset(stmt);
+
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not insert DO Error: %s\n", sqlite3_errmsg(db));
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 
-	sqlite3_finalize(stmt);
-
 	return ifaceRowId;
 }
 
@@ -2143,20 +2791,16 @@ sqlite_int64 SQLDataStore::getNodeRowId(const InterfaceRef& iface)
 {
 	sqlite_int64 nodeRowId = -1;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	int ret;
 	
 	// lookup by common interfaces
-	
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT node_rowid FROM %s WHERE (type = %d AND mac_str='%s');", 
-		 TABLE_INTERFACES, iface->getType(), iface->getIdentifierStr());
-		
-	ret = sqlite3_prepare_v2(db, sqlcmd, (int) strlen(sqlcmd), &stmt, &tail);
-	
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sqlcmd);
+	stmt = getStatement(STMT_NODE_ROWID_FROM_IFACE);
+
+	if (!stmt)
 		return -1;
-	}
+	
+	sqlite3_bind_int(stmt, 1, iface->getType());
+	sqlite3_bind_text(stmt, 2, iface->getIdentifierStr(), -1, SQLITE_TRANSIENT);
 	
 	ret = sqlite3_step(stmt);
 	
@@ -2165,13 +2809,13 @@ sqlite_int64 SQLDataStore::getNodeRowId(const InterfaceRef& iface)
 		nodeRowId = sqlite3_column_int64(stmt, 0);
 	}
 	
+	sqlite3_reset(stmt);
+	
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not retrieve node from database: %s\n", sqlite3_errmsg(db));
 		return -1;
 	}
 	
-	sqlite3_finalize(stmt);	
-	
 	return nodeRowId;
 }
 
@@ -2179,23 +2823,19 @@ sqlite_int64 SQLDataStore::getNodeRowId(const NodeRef& node)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 nodeRowId = -1;
 
 	if (node->getType() != Node::TYPE_UNDEFINED) {
 		// lookup by id
-		ret = sqlite3_prepare_v2(db, SQL_NODE_FROM_ID_CMD, (int) strlen(SQL_NODE_FROM_ID_CMD), &stmt, &tail);
+		stmt = getStatement(STMT_NODE_FROM_ID);
 
-		if (ret != SQLITE_OK) {
-			HAGGLE_DBG("SQLite command compilation failed! %s\n", SQL_NODE_FROM_ID_CMD);
+		if (!stmt)
 			return -1;
-		}
 
 		ret = sqlite3_bind_blob(stmt, 1, node->getId(), NODE_ID_LEN, SQLITE_TRANSIENT);
 
 		if (ret != SQLITE_OK) {
 			HAGGLE_DBG("SQLite could not bind blob!\n");
-			sqlite3_finalize(stmt);
 			return -1;
 		}
 
@@ -2205,54 +2845,21 @@ sqlite_int64 SQLDataStore::getNodeRowId(const NodeRef& node)
 			nodeRowId = sqlite3_column_int64(stmt, table_nodes_rowid);
 		}
 
+		sqlite3_reset(stmt);
+
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("Could not insert DO Error: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
 			return -1;
 		}
-
-		sqlite3_finalize(stmt);
 	} else {
-		// lookup by common interfaces
-		
-		snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT node_rowid FROM %s", TABLE_INTERFACES);
-
+		// lookup by common interfaces, the first interface that 
+		// maps to a node decides
 		const InterfaceRefList *ifaces = node->getInterfaces();
 		
-		int cnt = 0;
 		for (InterfaceRefList::const_iterator it = ifaces->begin(); 
-		     it != ifaces->end(); it++) {
-			InterfaceRef ifaceRef = (*it);
-			cnt++;
-			
-			if (cnt == 1) 
-				sprintf(&(sqlcmd[strlen(sqlcmd)]), " WHERE (type = %d AND mac_str='%s')", ifaceRef->getType(), ifaceRef->getIdentifierStr());
-			else
-				sprintf(&(sqlcmd[strlen(sqlcmd)]), " OR (type = %d AND mac_str='%s')", ifaceRef->getType(), ifaceRef->getIdentifierStr());
-		}
-		
-		strcat(sqlcmd, ";");
-
-		ret = sqlite3_prepare_v2(db, sqlcmd, (int) strlen(sqlcmd), &stmt, &tail);
-			
-		if (ret != SQLITE_OK) {
-			HAGGLE_DBG("SQLite command compilation failed! %s\n", sqlcmd);
-			return -1;
-		}
-			
-		ret = sqlite3_step(stmt);
-		
-		if (ret == SQLITE_ROW) {
-			// No name for this column: See select statement in this function:
-			nodeRowId = sqlite3_column_int64(stmt, 0);
-		}
-			
-		if (ret == SQLITE_ERROR) {
-			HAGGLE_DBG("Could not retrieve node from database: %s\n", sqlite3_errmsg(db));
-			return -1;
+		     it != ifaces->end() && nodeRowId == -1; it++) {
+			nodeRowId = getNodeRowId(*it);
 		}
-
-		sqlite3_finalize(stmt);
 	}
 
 	return nodeRowId;
@@ -2269,8 +2876,6 @@ int SQLDataStore::evaluateFilters(const DataObjectRef& dObj, sqlite_int64 dataob
 {
 	int ret, n = 0;
 	sqlite3_stmt *stmt;
-	char *sql_cmd = sqlcmd;
-	const char *tail;
 	sqlite_int64 filter_rowid = -1;
 	int eventType = -1;
 	DataObjectRefList dObjs;
@@ -2287,17 +2892,13 @@ int SQLDataStore::evaluateFilters(const DataObjectRef& dObj, sqlite_int64 dataob
 	if (dataobject_rowid < 0)
 		return -1;
 	
-	/* limit VIEW_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC to dataobject in question */
-	setViewLimitedDataobjectAttributes(dataobject_rowid);
-
-	/* matching filters */
-	sql_cmd = (char *) SQL_FILTER_MATCH_DATAOBJECT_ALL_CMD;
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	/* matching filters, limited to the dataobject in question */
+	stmt = getStatement(STMT_MATCH_DATAOBJECT_AND_FILTERS);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", SQL_FILTER_MATCH_DATAOBJECT_ALL_CMD);
+	if (!stmt)
 		return -1;
-	}
+
+	sqlite3_bind_int64(stmt, 1, dataobject_rowid);
 	
 	// Add the data object to the result list
 	dObjs.add(dObj);
@@ -2312,15 +2913,15 @@ int SQLDataStore::evaluateFilters(const DataObjectRef& dObj, sqlite_int64 dataob
 			HAGGLE_DBG("Filter " SQLITE_INT64_FMT " with event type %d matches!\n", filter_rowid, eventType);
 			n++;
 
-                        kernel->addEvent(new Event(eventType, dObjs));
+                        postEvent(new Event(eventType, dObjs));
 		} else if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("Could not evaluate filter result, Error: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+			sqlite3_reset(stmt);
 			return -1;
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	return n;
 }
@@ -2328,36 +2929,73 @@ int SQLDataStore::evaluateFilters(const DataObjectRef& dObj, sqlite_int64 dataob
 
 // ----- Filter > Dataobjects
 
-int SQLDataStore::evaluateDataObjects(long eventType)
+int SQLDataStore::_evaluateFilterPage(DataStoreFilterCursor *c, unsigned long max)
 {
-	int ret;
+	int ret, n = 0;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 do_rowid = -1;
-	char *sql_cmd = sqlcmd;
 	DataObjectRefList dObjs;
 
-	HAGGLE_DBG("Evaluating filter\n");
+	HAGGLE_DBG("Evaluating filter, page %lu\n", c->numPages + 1);
 
-	/* reset dynamic link table */
-	setViewLimitedDataobjectAttributes();	
+	// The matches are ranked once, when the first page is evaluated
+	if (!c->started) {
+		stmt = getStatement(STMT_CLEAR_FILTER_MATCHES);
 
-	sql_cmd = SQL_FILTER_MATCH_ALL_CMD(eventType);
-	
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+		if (!stmt) {
+			HAGGLE_DBG("Clear filter matches command compilation failed\n");
+			return -1;
+		}
+		sqlite3_bind_int64(stmt, 1, c->filterId);
+		ret = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("Match filter command compilation failed\n");
+		if (ret != SQLITE_DONE) {
+			HAGGLE_DBG("Could not clear filter matches Error: %s\n", sqlite3_errmsg(db));
+			return -1;
+		}
+
+		stmt = getStatement(STMT_FILL_FILTER_MATCHES);
+
+		if (!stmt) {
+			HAGGLE_DBG("Match filter command compilation failed\n");
+			return -1;
+		}
+		sqlite3_bind_int64(stmt, 1, c->filterId);
+		ret = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+
+		if (ret != SQLITE_DONE) {
+			HAGGLE_DBG("Could not match filter Error: %s\n", sqlite3_errmsg(db));
+			return -1;
+		}
+	}
+
+	stmt = getStatement(STMT_FILTER_MATCH_PAGE);
+
+	if (!stmt) {
+		HAGGLE_DBG("Match filter page command compilation failed\n");
 		return -1;
 	}
 
+	sqlite3_bind_int64(stmt, 1, c->filterId);
+	sqlite3_bind_int64(stmt, 2, c->started ? (sqlite_int64)c->lastRatio : SQL_FILTER_MATCH_TOP_RATIO);
+	sqlite3_bind_int64(stmt, 3, c->lastWeight);
+	sqlite3_bind_int64(stmt, 4, c->lastNum);
+	sqlite3_bind_int64(stmt, 5, max > 0 ? (sqlite_int64)max : -1);
+
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
 			
-			do_rowid = sqlite3_column_int64(stmt, view_match_filters_and_dataobjects_as_ratio_dataobject_rowid);
+			do_rowid = sqlite3_column_int64(stmt, sql_filter_match_page_cmd_dataobject_rowid);
 
 			HAGGLE_DBG("Data object with rowid " SQLITE_INT64_FMT " matches!\n", do_rowid);
 			
+			c->advance((long)sqlite3_column_int64(stmt, sql_filter_match_page_cmd_ratio),
+				   (long)sqlite3_column_int64(stmt, sql_filter_match_page_cmd_match_weight),
+				   do_rowid);
+			n++;
+
 			DataObjectRef dObj = getDataObjectFromRowId(do_rowid);
 			
 			if (dObj) {
@@ -2365,29 +3003,32 @@ int SQLDataStore::evaluateDataObjects(long eventType)
                         } else {
 				HAGGLE_ERR("Could not create data object from row id " SQLITE_INT64_FMT "\n", do_rowid);
 			}
-			// FIXME: Set a limit on how many data objects to match when registering
-			// a filter. If there are many data objects, the matching will take too long time
-			// and Haggle will become unresponsive.
-			// Therefore, we set a limit to 10 data objects here. In the future we should
-			// make sure the limit is a user configurable variable and that the data
-			// objects returned are the highest ranking ones in descending order.
-			
-			if (dObjs.size() == 10)
-				break;
-
 		} else if (ret == SQLITE_ERROR) {
-			HAGGLE_DBG("Could not insert DO Error: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+			HAGGLE_DBG("Could not match filter Error: %s\n", sqlite3_errmsg(db));
+			sqlite3_reset(stmt);
 			return -1;
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	
+	// The last page has been read, so the ranked matches are not needed
+	if (max == 0 || (unsigned long)n < max) {
+		stmt = getStatement(STMT_CLEAR_FILTER_MATCHES);
+
+		if (stmt) {
+			sqlite3_bind_int64(stmt, 1, c->filterId);
+			sqlite3_step(stmt);
+			sqlite3_reset(stmt);
+		}
+	}
+
 	if (dObjs.size())
-		kernel->addEvent(new Event(eventType, dObjs));
+		postEvent(new Event(c->eventType, dObjs));
 
-	return dObjs.size();
+	// Returns the number of matches, so that the page is full even if 
+	// some data object could not be created
+	return n;
 }
 
 
@@ -2406,10 +3047,8 @@ int SQLDataStore::deleteDataObjectNodeDescriptions(DataObjectRef dObj,
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd = sqlcmd;
-	DataObjectRefList dObjs;
-	int result = 1;
+	sqlite_int64 createtime = dObj->getCreateTime().getTimeAsMilliSeconds();
+	unsigned int cntStoredNodeDescriptions = 0;
 	
 	// get node_id
 	NodeRef node = Node::create(dObj);
@@ -2419,76 +3058,84 @@ int SQLDataStore::deleteDataObjectNodeDescriptions(DataObjectRef dObj,
 
 	node_id = node->getIdStr();
 
-	// retrieve all dataobjects with same node_id
-	sprintf(sql_cmd, "SELECT * FROM %s WHERE node_id='%s' ORDER BY createtime desc", 
-		TABLE_DATAOBJECTS, node_id.c_str());
-	
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	/*
+		The stored node descriptions are compared by their create
+		time only, so no data objects are built. They are all older
+		than the new one if the newest is.
+	*/
+	stmt = getStatement(STMT_NODE_DESCRIPTIONS_FROM_NODE_ID);
 	
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("retrieve node descriptions command compilation failed\n");
 		return -1;
 	}
 	
-	unsigned int cntStoredNodeDescriptions = 0;
-	DataObjectRef newest_dObj = dObj;
-	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
-		if (ret == SQLITE_ROW) {
-			cntStoredNodeDescriptions++;
-			sqlite_int64 dObjRowId = sqlite3_column_int64(stmt, table_dataobjects_rowid);
-			
-			// create dObj and push it into list
-			DataObjectRef dObj_tmp = getDataObjectFromRowId(dObjRowId);
-			
-			if (dObj_tmp) {
-				if (dObj_tmp->getCreateTime() < newest_dObj->getCreateTime()) {
-					dObjs.push_back(dObj_tmp);
-				} else {
-					if (newest_dObj != dObj) {
-						dObjs.push_back(newest_dObj);
-					} else {
-						result = 0;
-					}
-					newest_dObj = dObj_tmp;
-				}
-			}
+	sqlite3_bind_text(stmt, 1, node_id.c_str(), -1, SQLITE_TRANSIENT);
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (cntStoredNodeDescriptions++ == 0 &&
+		    sqlite3_column_int64(stmt, sql_node_descriptions_from_node_id_cmd_createtime) >= createtime) {
+			sqlite3_reset(stmt);
+			return 0;
 		}
+		// The rowid may be reused by a later insert
+		dataObjectCache.remove(sqlite3_column_int64(stmt, sql_node_descriptions_from_node_id_cmd_rowid));
 	}
 	
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
+
+	if (ret == SQLITE_ERROR) {
+		HAGGLE_DBG("Could not retrieve node descriptions : %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
 
 	HAGGLE_DBG("%u node descriptions from same node [%s] already in datastore\n", 
 		   cntStoredNodeDescriptions, node_id.c_str());
-	
-	// loop through dObjs list and delete if older createtime
-	for (DataObjectRefList::iterator it = dObjs.begin(); 
-	     it != dObjs.end(); it++) {
-		// delete and report as event
-		_deleteDataObject(*it, true); 
+
+	if (cntStoredNodeDescriptions == 0)
+		return 1;
+
+	stmt = getStatement(STMT_DELETE_NODE_DESCRIPTIONS);
+
+	if (!stmt) {
+		HAGGLE_DBG("Delete node descriptions command compilation failed\n");
+		return -1;
 	}
-		
-	return result;
+
+	sqlite3_bind_text(stmt, 1, node_id.c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 2, createtime);
+
+	ret = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+
+	if (ret == SQLITE_ERROR) {
+		HAGGLE_DBG("Could not delete node descriptions : %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+	
+	HAGGLE_DBG("Deleted %d old node descriptions of node [%s]\n", 
+		   sqlite3_changes(db), node_id.c_str());
+
+	return 1;
 }
 
 
 int SQLDataStore::_deleteFilter(long eventtype)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 
-	sql_cmd = SQL_DELETE_FILTER_CMD(eventtype);
+	stmt = getStatement(STMT_DELETE_FILTER);
 
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("Delete filter command compilation failed\n");
 		return -1;
 	}
 
+	sqlite3_bind_int64(stmt, 1, eventtype);
+
 	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not delete filter : %s\n", sqlite3_errmsg(db));
@@ -2501,9 +3148,7 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 				const EventCallback<EventHandler> *callback)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 filter_rowid;
 	sqlite_int64 attr_rowid;
 	const Attributes *attrs;
@@ -2513,18 +3158,14 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 
 	HAGGLE_DBG("Insert filter: %s\n", f->getFilterDescription().c_str());
 
-	sql_cmd = SQL_INSERT_FILTER_CMD(f->getEventType());
-
-	ret = sqlite3_prepare_v2(db, sql_cmd, 
-				 (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_INSERT_FILTER);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return -1;
-	}
 
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_bind_int64(stmt, 1, f->getEventType());
+
+	ret = sqlQuery(STMT_INSERT_FILTER);
 
 	if (ret == SQLITE_CONSTRAINT) {
 		HAGGLE_DBG("Filter exists, updating...\n");
@@ -2554,7 +3195,15 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 	     it != attrs->end(); it++) {
 		const Attribute& a = (*it).second;
 
-		ret = sqlQuery(SQL_INSERT_ATTR_CMD(&a));
+		stmt = getStatement(STMT_INSERT_ATTR);
+
+		if (!stmt)
+			return -1;
+
+		sqlite3_bind_text(stmt, 1, a.getName().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 2, a.getValue().c_str(), -1, SQLITE_TRANSIENT);
+
+		ret = sqlQuery(STMT_INSERT_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("SQLite insert of attribute failed!\n");
@@ -2567,9 +3216,16 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 			attr_rowid = sqlite3_last_insert_rowid(db);
 		}
 
-		ret = sqlQuery(SQL_INSERT_FILTER_ATTR_CMD(filter_rowid, 
-							  attr_rowid, 
-							  a.getWeight()));
+		stmt = getStatement(STMT_INSERT_FILTER_ATTR);
+
+		if (!stmt)
+			return -1;
+
+		sqlite3_bind_int64(stmt, 1, filter_rowid);
+		sqlite3_bind_int64(stmt, 2, attr_rowid);
+		sqlite3_bind_int64(stmt, 3, a.getWeight());
+
+		ret = sqlQuery(STMT_INSERT_FILTER_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("insert of filter-attribute link failed!\n");
@@ -2578,11 +3234,11 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 	}
 
 	if (callback)
-		kernel->addEvent(new Event(callback, f));
+		postEvent(new Event(callback, f));
 	
 	// Find all data objects that match this filter, and report them back:
 	if (matchFilter)
-		evaluateDataObjects(f->getEventType());
+		evaluateFilterPage(new DataStoreFilterCursor(f->getEventType(), filter_rowid));
 	
 	return (int) filter_rowid;
 }
@@ -2591,16 +3247,11 @@ int SQLDataStore::_insertFilter(Filter *f, bool matchFilter,
 int SQLDataStore::_deleteNode(NodeRef& node)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	
-	sql_cmd = SQL_DELETE_NODE_CMD();
+	stmt = getStatement(STMT_DELETE_NODE);
 	
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), 
-				 &stmt, &tail);
-	
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("Delete node command compilation failed : %s\n", 
 			   sqlite3_errmsg(db));
 		return -1;
@@ -2611,12 +3262,10 @@ int SQLDataStore::_deleteNode(NodeRef& node)
    
 	if (ret != SQLITE_OK) {
 	   HAGGLE_DBG("SQLite could not bind blob!\n");
-	   sqlite3_finalize(stmt);
 	   return -1;
 	}
 				   
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	ret = sqlQuery(STMT_DELETE_NODE);
 	
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not delete node : %s\n", 
@@ -2632,9 +3281,7 @@ int SQLDataStore::_insertNode(NodeRef& node,
 			      bool mergeBloomfilter)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 node_rowid;
 	//sqlite_int64 dataobject_rowid;
 	sqlite_int64 attr_rowid;
@@ -2658,41 +3305,41 @@ int SQLDataStore::_insertNode(NodeRef& node,
 		node->getName().c_str(), node->getAttributes()->size(), 
 		   node->getInterfaces()->size());
 
-//	sqlQuery(SQL_BEGIN_TRANSACTION_CMD);
-
-	sql_cmd = SQL_INSERT_NODE_CMD(node);
-
-	HAGGLE_DBG("SQLcmd: %s\n", sql_cmd);
+	stmt = getStatement(STMT_INSERT_NODE);
 
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), 
-				 &stmt, &tail);
-
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("Error: %s\n", sqlite3_errmsg(db));
 		goto out_insertNode_err;
 	}
 
-	ret = sqlite3_bind_blob(stmt, 1, node->getId(), NODE_ID_LEN, 
+	sqlite3_bind_int(stmt, sql_insert_node_cmd_type, node->getType());
+	sqlite3_bind_text(stmt, sql_insert_node_cmd_id_str, node->getIdStr(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, sql_insert_node_cmd_name, node->getName().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, sql_insert_node_cmd_nodedescription_createtime, 
+			   node->getNodeDescriptionCreateTime().getTimeAsMilliSeconds());
+	sqlite3_bind_int64(stmt, sql_insert_node_cmd_resolution_max_matching_dataobjects, 
+			   node->getMaxDataObjectsInMatch());
+	sqlite3_bind_int64(stmt, sql_insert_node_cmd_resolution_threshold, 
+			   node->getMatchingThreshold());
+
+	ret = sqlite3_bind_blob(stmt, sql_insert_node_cmd_id, node->getId(), NODE_ID_LEN, 
 				SQLITE_TRANSIENT);
 
 	if (ret != SQLITE_OK) {
 		HAGGLE_DBG("SQLite could not bind blob!\n");
-		sqlite3_finalize(stmt);
 		goto out_insertNode_err;
 	}
 
-	ret = sqlite3_bind_blob(stmt, 2, node->getBloomfilter()->getRaw(), 
+	ret = sqlite3_bind_blob(stmt, sql_insert_node_cmd_bloomfilter, node->getBloomfilter()->getRaw(), 
 				node->getBloomfilter()->getRawLen() , 
 				SQLITE_TRANSIENT);
 
 	if (ret != SQLITE_OK) {
 		HAGGLE_DBG("SQLite could not bind blob!\n");
-		sqlite3_finalize(stmt);
 		goto out_insertNode_err;
 	}
 
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	ret = sqlQuery(STMT_INSERT_NODE);
 
 	if (ret == SQLITE_CONSTRAINT) {
 		NodeRef existing_node = node;
@@ -2722,7 +3369,6 @@ int SQLDataStore::_insertNode(NodeRef& node,
 		}
 
 		// Call this function again
-		// sqlQuery(SQL_END_TRANSACTION_CMD);
 		int ret = _insertNode(node, callback);
 		node.unlock();
 		return ret;
@@ -2747,9 +3393,15 @@ int SQLDataStore::_insertNode(NodeRef& node,
 		HAGGLE_DBG("Inserting attribute %s=%s\n", 
 			   a.getName().c_str(), a.getValue().c_str());
 
-		sql_cmd = SQL_INSERT_ATTR_CMD(&a);
+		stmt = getStatement(STMT_INSERT_ATTR);
+
+		if (!stmt)
+			goto out_insertNode_err;
+
+		sqlite3_bind_text(stmt, 1, a.getName().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 2, a.getValue().c_str(), -1, SQLITE_TRANSIENT);
 
-		ret = sqlQuery(sql_cmd);
+		ret = sqlQuery(STMT_INSERT_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("SQLite insert of attribute failed !\n");
@@ -2762,10 +3414,16 @@ int SQLDataStore::_insertNode(NodeRef& node,
 			attr_rowid = sqlite3_last_insert_rowid(db);
 		}
 
-		sql_cmd = SQL_INSERT_NODE_ATTR_CMD(node_rowid, 
-						   attr_rowid, a.getWeight());
+		stmt = getStatement(STMT_INSERT_NODE_ATTR);
+
+		if (!stmt)
+			goto out_insertNode_err;
+
+		sqlite3_bind_int64(stmt, 1, node_rowid);
+		sqlite3_bind_int64(stmt, 2, attr_rowid);
+		sqlite3_bind_int64(stmt, 3, a.getWeight());
 
-		ret = sqlQuery(sql_cmd);
+		ret = sqlQuery(STMT_INSERT_NODE_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("node-attribute link insert failed!\n");
@@ -2782,36 +3440,30 @@ int SQLDataStore::_insertNode(NodeRef& node,
 
 		iface.lock();
 		
-		sql_cmd = SQL_INSERT_IFACE_CMD((sqlite_int64) iface->getType(), 
-					       iface->getIdentifierStr(), 
-					       node_rowid);
-		
-		HAGGLE_DBG("Insert interface SQLcmd: %s\n", sql_cmd);
+		HAGGLE_DBG("Insert interface %s\n", iface->getIdentifierStr());
 
-		ret = sqlite3_prepare_v2(db, sql_cmd, 
-					 (int)strlen(sql_cmd), 
-					 &stmt, &tail);
+		stmt = getStatement(STMT_INSERT_IFACE);
 
-		if (ret != SQLITE_OK) {
-			HAGGLE_DBG("SQLite command compilation failed! %s\n", 
-				   sql_cmd);
+		if (!stmt) {
 			iface.unlock();
 			goto out_insertNode_err;
 		}
 
-		ret = sqlite3_bind_blob(stmt, 1, iface->getIdentifier(), 
+		sqlite3_bind_int(stmt, 1, iface->getType());
+		sqlite3_bind_text(stmt, 3, iface->getIdentifierStr(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int64(stmt, 4, node_rowid);
+
+		ret = sqlite3_bind_blob(stmt, 2, iface->getIdentifier(), 
 					iface->getIdentifierLen(), 
 					SQLITE_TRANSIENT);
 
 		if (ret != SQLITE_OK) {
 			HAGGLE_DBG("could not bind interface identifier blob\n");
-			sqlite3_finalize(stmt);
 			iface.unlock();
 			goto out_insertNode_err;
 		}
 
-		ret = sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
+		ret = sqlQuery(STMT_INSERT_IFACE);
 
 		if (ret == SQLITE_CONSTRAINT) {
 			HAGGLE_DBG("Interface %s already in datastore\n", 
@@ -2826,12 +3478,11 @@ int SQLDataStore::_insertNode(NodeRef& node,
 		iface.unlock();
 	}
 
-//	sqlQuery(SQL_END_TRANSACTION_CMD);	
 	node.unlock();
 	
 	if (callback) {
 		HAGGLE_DBG("Scheduling callback for inserted node\n");
-		kernel->addEvent(new Event(callback, node));
+		postEvent(new Event(callback, node));
 	}
 	HAGGLE_DBG("Node %s inserted successfully\n", 
 		   node->getName().c_str());
@@ -2839,7 +3490,6 @@ int SQLDataStore::_insertNode(NodeRef& node,
 	return 1;
 	
 out_insertNode_err:
-//	sqlQuery(SQL_END_TRANSACTION_CMD);
 	node.unlock();
 	return -1;	
 }
@@ -2849,9 +3499,7 @@ int SQLDataStore::_deleteDataObject(const DataObjectId_t &id,
 				    bool keepInBloomfilter)
 {
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	char idStr[MAX_DATAOBJECT_ID_STR_LEN];
 	int len = 0;
 
@@ -2867,7 +3515,7 @@ int SQLDataStore::_deleteDataObject(const DataObjectId_t &id,
 		// with the data object.
 		if (dObj) {
 			dObj->setStored(false);
-			kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, 
+			postEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, 
 						   dObj, keepInBloomfilter));
 		} else {
 			HAGGLE_ERR("Tried to report removal of a data object that "
@@ -2877,11 +3525,9 @@ int SQLDataStore::_deleteDataObject(const DataObjectId_t &id,
 		}
 	}
 	
-	sql_cmd = SQL_DELETE_DATAOBJECT_CMD();
-	
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_DELETE_DATAOBJECT);
 	
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("Delete dataobject command compilation failed : %s\n", 
 			   sqlite3_errmsg(db));
 		return -1;
@@ -2891,18 +3537,20 @@ int SQLDataStore::_deleteDataObject(const DataObjectId_t &id,
 	
 	if (ret != SQLITE_OK) {
 		HAGGLE_DBG("SQLite could not bind blob!\n");
-		sqlite3_finalize(stmt);
 		return -1;
 	}
 	
 	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	
 	if (ret == SQLITE_ERROR) {
 		HAGGLE_DBG("Could not delete dataobject : %s\n", 
 			   sqlite3_errmsg(db));
 		return -1;
 	} else {
+		// The rowid may be reused by a later insert
+		dataObjectCache.remove(string(idStr));
+
 		if (ret == SQLITE_ROW) {
 			HAGGLE_DBG("SQLITE_ROW Deleted data object %s\n", 
 				   idStr);
@@ -2925,7 +3573,7 @@ int SQLDataStore::_deleteDataObject(DataObjectRef& dObj,
 	// (If it has one.) So that the file is removed from disk along with the
 	// data object.
 	if (_deleteDataObject(dObj->getId(), false, keepInBloomfilter) == 0 && shouldReportRemoval)
-		kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObj, keepInBloomfilter));
+		postEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObj, keepInBloomfilter));
 	
 	return 0;
 }
@@ -2934,79 +3582,163 @@ int SQLDataStore::_ageDataObjects(const Timeval& minimumAge,
 				  const EventCallback<EventHandler> *callback, 
 				  bool keepInBloomfilter)
 {
-	int ret;
-	char *sql_cmd;
+	int ret = 0;
+	int step;
 	sqlite3_stmt *stmt;
-	const char *tail;
+	char age_modifier[32];
 	DataObjectRefList dObjs;
 	
-	// -- drop dataobject view
-	sql_cmd = (char *) SQL_DROP_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD;
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
-		// view probably missing, so we do not quit
-	} else {
-		ret = sqlite3_step(stmt);
-	}
-	sqlite3_finalize(stmt);
-	
-	// -- reset dataobject view
-	sql_cmd = (char *) SQL_CREATE_VIEW_LIMITED_DATAOBJECT_ATTRIBUTES_CMD;
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		HAGGLE_DBG("%s\n", sqlite3_errmsg(db));
-		// view probably missing, so we do not quit
-	} else {
-		ret = sqlite3_step(stmt);
-	}
-	sqlite3_finalize(stmt);
-	
 	// -- delete dataobjects not related to any filter (no interest) and being created more than minimumAge seconds ago. 
-	sql_cmd = SQL_AGE_DATAOBJECT_CMD(minimumAge);
-	
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_AGE_DATAOBJECTS);
 
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_DBG("Dataobject aging command compilation failed : %s\n", sqlite3_errmsg(db));
 		ret = -1;
 		goto out;
 	}
 	
-	while (dObjs.size() < DATASTORE_MAX_DATAOBJECTS_AGED_AT_ONCE && (ret = sqlite3_step(stmt)) != SQLITE_DONE) {
-		if (ret == SQLITE_ROW) {
-			DataObjectRef dObj = createDataObject(stmt);
-			if (dObj) {
-				dObj->setStored(false);
-				dObjs.push_back(dObj);
-			}
-		} else if (ret == SQLITE_ERROR) {
+	snprintf(age_modifier, sizeof(age_modifier), "-%ld seconds", minimumAge.getSeconds());
+	sqlite3_bind_text(stmt, 1, age_modifier, -1, SQLITE_TRANSIENT);
+	
+	while (dObjs.size() < DATASTORE_MAX_DATAOBJECTS_AGED_AT_ONCE && (step = sqlite3_step(stmt)) != SQLITE_DONE) {
+		if (step != SQLITE_ROW) {
 			HAGGLE_DBG("Could not age data object - Error: %s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+			sqlite3_reset(stmt);
 			ret = -1;
 			goto out;
 		}
+
+		DataObjectRef dObj = getDataObject(stmt);
+
+		if (dObj) {
+			dObj->setStored(false);
+			dObjs.push_back(dObj);
+		}
 	}
 	
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	
 	for (DataObjectRefList::iterator it = dObjs.begin(); it != dObjs.end(); it++) {
 		_deleteDataObject(*it, false);	// delete and report as event
 	}
 
-	kernel->addEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObjs, keepInBloomfilter));
-	
-	if (ret == SQLITE_ERROR) {
-		HAGGLE_DBG("Could not age data objects : %s\n", sqlite3_errmsg(db));
-		ret = -1;
-	}
+	postEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObjs, keepInBloomfilter));
 		
 out:
 	if (callback)
-		kernel->addEvent(new Event(callback, dObjs));
+		postEvent(new Event(callback, dObjs));
+
+	return ret;
+}
+
+int SQLDataStore::_evictDataObjects(DataStoreEvictionQuery *q)
+{
+	int ret;
+	sqlite3_stmt *stmt;
+	unsigned long num_dataobjects = 0;
+	unsigned long long bytes = 0;
+	DataObjectRefList dObjs;
+	const DataStoreEvictionPolicy& policy = q->getPolicy();
+
+	stmt = getStatement(STMT_DATAOBJECT_USAGE);
+
+	if (!stmt) {
+		HAGGLE_DBG("Data object usage command compilation failed : %s\n", sqlite3_errmsg(db));
+		ret = -1;
+		goto out;
+	}
+
+	ret = sqlite3_step(stmt);
+
+	if (ret == SQLITE_ROW) {
+		num_dataobjects = (unsigned long)sqlite3_column_int64(stmt, 0);
+		bytes = (unsigned long long)sqlite3_column_int64(stmt, 1);
+	}
+
+	sqlite3_reset(stmt);
+
+	if (ret != SQLITE_ROW) {
+		HAGGLE_DBG("Could not get data object usage - Error: %s\n", sqlite3_errmsg(db));
+		ret = -1;
+		goto out;
+	}
+
+	HAGGLE_DBG("Data store usage: %lu data objects, %llu bytes\n", num_dataobjects, bytes);
+
+	if (!q->isContinuing()) {
+		clearEvictionPlan();
+
+		if (!policy.isOverBudget(num_dataobjects, bytes, false)) {
+			ret = 0;
+			goto out;
+		}
+
+		stmt = getStatement(STMT_EVICTION_CANDIDATES);
+
+		if (!stmt) {
+			HAGGLE_DBG("Eviction command compilation failed : %s\n", sqlite3_errmsg(db));
+			ret = -1;
+			goto out;
+		}
+
+		while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
+			if (ret == SQLITE_ROW) {
+				const char *id = (const char *)sqlite3_column_text(stmt, sql_eviction_candidates_cmd_id);
+
+				q->addCandidate(sqlite3_column_int64(stmt, sql_eviction_candidates_cmd_rowid), 
+						id ? id : "", 
+						(unsigned long)sqlite3_column_int64(stmt, sql_eviction_candidates_cmd_interest), 
+						sqlite3_column_double(stmt, sql_eviction_candidates_cmd_age), 
+						(unsigned long long)sqlite3_column_int64(stmt, sql_eviction_candidates_cmd_size));
+			} else if (ret == SQLITE_ERROR) {
+				HAGGLE_DBG("Could not score data objects - Error: %s\n", sqlite3_errmsg(db));
+				sqlite3_reset(stmt);
+				ret = -1;
+				goto out;
+			}
+		}
+
+		sqlite3_reset(stmt);
+
+		q->getCandidates(evictionPlan, num_dataobjects, bytes);
+	}
+
+	// Evict the next batch of the plan, until the usage is within budget
+	while (!evictionPlan.empty() && dObjs.size() < policy.batchSize && 
+	       policy.isOverBudget(num_dataobjects, bytes, true)) {
+		DataStoreEvictionCandidate *c = evictionPlan.front();
+
+		evictionPlan.pop_front();
+
+		// The data object may have been deleted since the plan was made
+		DataObjectRef dObj = getDataObjectFromRowId(c->num);
+
+		if (dObj) {
+			HAGGLE_DBG("Evicting data object [%s] with utility %.2lf\n", 
+				   dObj->getIdStr(), c->utility);
+			dObj->setStored(false);
+			_deleteDataObject(dObj, false);
+			dObjs.push_back(dObj);
+			num_dataobjects--;
+			bytes -= c->size < bytes ? c->size : bytes;
+		}
+		delete c;
+	}
+
+	if (!policy.isOverBudget(num_dataobjects, bytes, true))
+		clearEvictionPlan();
+
+	if (dObjs.size()) {
+		LOG_ADD("%s: Evicted %lu data objects, data store usage %lu data objects, %llu bytes\n", 
+			Timeval::now().getAsString().c_str(), (unsigned long)dObjs.size(), 
+			num_dataobjects, bytes);
+		postEvent(new Event(EVENT_TYPE_DATAOBJECT_DELETED, dObjs, q->getKeepInBloomfilter()));
+	}
+
+	ret = dObjs.size();
+out:
+	if (q->getCallback())
+		postEvent(new Event(q->getCallback(), dObjs));
 
 	return ret;
 }
@@ -3017,9 +3749,7 @@ int SQLDataStore::_insertDataObject(DataObjectRef& dObj,
 	int ret;
 	size_t metadatalen;
 	char *metadata;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	sqlite_int64 dataobject_rowid;
 	sqlite_int64 attr_rowid;
 	sqlite_int64 ifaceRowId = -1;
@@ -3067,56 +3797,63 @@ int SQLDataStore::_insertDataObject(DataObjectRef& dObj,
 	if (dObj->getRemoteInterface())
 		ifaceRowId = getInterfaceRowId(dObj->getRemoteInterface());
 	
-	sql_cmd = sql_insert_dataobject_cmd_alloc(metadata, ifaceRowId, 
-						      dObj, node_id);
+	stmt = getStatement(STMT_INSERT_DATAOBJECT);
 
-	if (!sql_cmd) {
+	if (!stmt) {
 		goto out_insertDataObject_err;
 	}
 
-	ret = sqlite3_prepare_v2(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
-
-	free(sql_cmd);
-	
-	if (ret != SQLITE_OK) {
-		HAGGLE_ERR("SQLite command compilation failed! %s\n", sql_cmd);
-		goto out_insertDataObject_err;
-	}
-
-	ret = sqlite3_bind_blob(stmt, 1, dObj->getId(), 
+	/*
+		The metadata is bound as a parameter rather than inserted 
+		verbatim into the SQL command, which avoids the risk of SQL
+		injection (see the haggle trac page, ticket #139).
+	*/
+	sqlite3_bind_text(stmt, sql_insert_dataobject_cmd_xmlhdr, metadata, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, sql_insert_dataobject_cmd_filepath, dObj->getFilePath().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(stmt, sql_insert_dataobject_cmd_filename, dObj->getFileName().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_datalen, dObj->getDataLen());
+	sqlite3_bind_int(stmt, sql_insert_dataobject_cmd_datastate, dObj->getDataState());
+	sqlite3_bind_int(stmt, sql_insert_dataobject_cmd_signaturestatus, dObj->getSignatureStatus());
+	sqlite3_bind_text(stmt, sql_insert_dataobject_cmd_signee, dObj->getSignee().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_siglen, dObj->getSignatureLength());
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_createtime, 
+			   dObj->getCreateTime().getTimeAsMilliSeconds());
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_receivetime, 
+			   dObj->getReceiveTime().getTimeAsMilliSeconds());
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_rxtime, dObj->getRxTime());
+	sqlite3_bind_int64(stmt, sql_insert_dataobject_cmd_source_iface_rowid, ifaceRowId);
+	sqlite3_bind_text(stmt, sql_insert_dataobject_cmd_node_id, node_id.c_str(), -1, SQLITE_TRANSIENT);
+
+	ret = sqlite3_bind_blob(stmt, sql_insert_dataobject_cmd_id, dObj->getId(), 
 				DATAOBJECT_ID_LEN, SQLITE_TRANSIENT);
 
 	if (ret != SQLITE_OK) {
 		HAGGLE_ERR("could not bind data object identifier blob!\n");
-		sqlite3_finalize(stmt);
 		goto out_insertDataObject_err;
 	}
 
 	if (dObj->getDataState() > DataObject::DATA_STATE_NO_DATA) {
-		ret = sqlite3_bind_blob(stmt, 2, dObj->getDataHash(), 
+		ret = sqlite3_bind_blob(stmt, sql_insert_dataobject_cmd_datahash, dObj->getDataHash(), 
 					sizeof(DataHash_t), SQLITE_TRANSIENT);
 
 		if (ret != SQLITE_OK) {
 			HAGGLE_ERR("could not bind data object signature blob!\n");
-			sqlite3_finalize(stmt);
 			goto out_insertDataObject_err;
 		}
 	}
 
 	if (dObj->getSignatureLength() && 
 	    dObj->getSignatureStatus() != DataObject::SIGNATURE_MISSING) {
-		ret = sqlite3_bind_blob(stmt, 3, dObj->getSignature(), 
+		ret = sqlite3_bind_blob(stmt, sql_insert_dataobject_cmd_signature, dObj->getSignature(), 
 					dObj->getSignatureLength(), SQLITE_TRANSIENT);
 
 		if (ret != SQLITE_OK) {
 			HAGGLE_ERR("could not bind data object signature blob!\n");
-			sqlite3_finalize(stmt);
 			goto out_insertDataObject_err;
 		}
 	}
 
-	ret = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	ret = sqlQuery(STMT_INSERT_DATAOBJECT);
 
 	if (ret == SQLITE_CONSTRAINT) {
 		if (!dObj->isPersistent()) {
@@ -3159,9 +3896,15 @@ int SQLDataStore::_insertDataObject(DataObjectRef& dObj,
 	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++) {
 		const Attribute& a = (*it).second;
 
-		sql_cmd = SQL_INSERT_ATTR_CMD(&a);
+		stmt = getStatement(STMT_INSERT_ATTR);
+
+		if (!stmt)
+			goto out_insertDataObject_err;
+
+		sqlite3_bind_text(stmt, 1, a.getName().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 2, a.getValue().c_str(), -1, SQLITE_TRANSIENT);
 
-		ret = sqlQuery(sql_cmd);
+		ret = sqlQuery(STMT_INSERT_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_ERR("SQLite insert of attribute failed!\n");
@@ -3175,9 +3918,16 @@ int SQLDataStore::_insertDataObject(DataObjectRef& dObj,
 			attr_rowid = sqlite3_last_insert_rowid(db);
 		}
 
-		sql_cmd = SQL_INSERT_DATAOBJECT_ATTR_CMD(dataobject_rowid, attr_rowid);
+		stmt = getStatement(STMT_INSERT_DATAOBJECT_ATTR);
+
+		if (!stmt)
+			goto out_insertDataObject_err;
+
+		sqlite3_bind_int64(stmt, 1, dataobject_rowid);
+		sqlite3_bind_int64(stmt, 2, attr_rowid);
+		sqlite3_bind_int64(stmt, 3, a.getWeight());
 
-		ret = sqlQuery(sql_cmd);
+		ret = sqlQuery(STMT_INSERT_DATAOBJECT_ATTR);
 
 		if (ret == SQLITE_ERROR) {
 			HAGGLE_ERR("SQLite insert of dataobject-attribute link failed!\n");
@@ -3202,7 +3952,7 @@ int SQLDataStore::_insertDataObject(DataObjectRef& dObj,
 	}
 		
 	if (callback)
-		kernel->addEvent(new Event(callback, dObj));
+		postEvent(new Event(callback, dObj));
 		
 	return 0;
 
@@ -3212,7 +3962,7 @@ out_insertDataObject_duplicate:
 
         // Notify the data manager of this duplicate data object
         if (callback)
-		kernel->addEvent(new Event(callback, dObj));
+		postEvent(new Event(callback, dObj));
         
         return 0;
 out_insertDataObject_err:
@@ -3248,7 +3998,7 @@ int SQLDataStore::_retrieveNode(NodeRef& refNode, const EventCallback<EventHandl
 		HAGGLE_DBG("No node %s in data store\n", refNode->getName().c_str());
 		if (forceCallback) {
 			HAGGLE_DBG("Forcing callback\n");
-			kernel->addEvent(new Event(callback, refNode));
+			postEvent(new Event(callback, refNode));
 			return 0;
 		} else {
 			return -1;
@@ -3276,7 +4026,7 @@ int SQLDataStore::_retrieveNode(NodeRef& refNode, const EventCallback<EventHandl
 	
 	HAGGLE_DBG("Node %s retrieved successfully\n", refNode->getName().c_str());
 
-	kernel->addEvent(new Event(callback, node));
+	postEvent(new Event(callback, node));
 
 	return 1;
 }
@@ -3285,23 +4035,21 @@ int SQLDataStore::_retrieveNode(Node::Type_t type, const EventCallback<EventHand
 {
 	NodeRefList *nodes = NULL;
 	int ret;
-	char *sql_cmd;
 	sqlite3_stmt *stmt;
-	const char *tail;
 	
 	if (!callback) {
 		HAGGLE_ERR("No callback specified\n");
 		return -1;
 	}
 	
-	sql_cmd = SQL_NODE_BY_TYPE_CMD(type);
-	
-	ret = sqlite3_prepare(db, sql_cmd, (int)strlen(sql_cmd), &stmt, &tail);
+	stmt = getStatement(STMT_NODE_BY_TYPE);
 	
-	if (ret != SQLITE_OK) {
+	if (!stmt) {
 		HAGGLE_ERR("Node by type command compilation failed : %s\n", sqlite3_errmsg(db));
 		return -1;
 	}
+
+	sqlite3_bind_int(stmt, 1, type);
 	
 	do {
 		ret = sqlite3_step(stmt);
@@ -3315,11 +4063,11 @@ int SQLDataStore::_retrieveNode(Node::Type_t type, const EventCallback<EventHand
 				nodes->push_front(node);
 			}
 		}
-	} while (ret != SQLITE_DONE);
+	} while (ret != SQLITE_DONE && ret != SQLITE_ERROR);
 	
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	
-	kernel->addEvent(new Event(callback, nodes));
+	postEvent(new Event(callback, nodes));
 
 	return 1;
 }
@@ -3345,7 +4093,7 @@ int SQLDataStore::_retrieveNode(const InterfaceRef& iface, const EventCallback<E
 		HAGGLE_DBG("No node with interface [%s] in data store\n", iface->getIdentifierStr());
 		if (forceCallback) {
 			HAGGLE_DBG("Forcing callback\n");
-			kernel->addEvent(new Event(callback, iface));
+			postEvent(new Event(callback, iface));
 			return 0;
 		} else {
 			return -1;
@@ -3358,7 +4106,7 @@ int SQLDataStore::_retrieveNode(const InterfaceRef& iface, const EventCallback<E
 	
 	HAGGLE_DBG("Node %s retrieved successfully based on interface [%s]\n", node->getName().c_str(), iface->getIdentifierStr());
 	
-	kernel->addEvent(new Event(callback, node));
+	postEvent(new Event(callback, node));
 	
 	return 1;
 }
@@ -3376,10 +4124,11 @@ int SQLDataStore::_doFilterQuery(DataStoreFilterQuery *q)
 	unsigned int num_match = 0;
 	sqlite3_stmt *stmt;
 	const char *tail;
-	char *sql_cmd = sqlcmd;
 	int ret;
-	sqlite_int64 filter_rowid = 0;
-	sqlite_int64 dataobject_rowid = 0;
+	unsigned int i;
+	char term[128];
+	string sql_cmd = SQL_FILTER_QUERY_BEGIN_CMD;
+	string names;
 	
 	HAGGLE_DBG("Filter Query\n");
 	
@@ -3387,33 +4136,47 @@ int SQLDataStore::_doFilterQuery(DataStoreFilterQuery *q)
 		return -1;
 	}	
 	
+	const Attributes *attrs = q->getFilter()->getAttributes();
+
+	if (attrs->empty())
+		return 0;
+
+	// Put together the statement, with one term per filter attribute
+	for (i = 0; i < attrs->size(); i++) {
+		snprintf(term, sizeof(term), SQL_FILTER_QUERY_TERM_CMD, 2 + 2*i, 3 + 2*i, 3 + 2*i);
+		sql_cmd += term;
+		snprintf(term, sizeof(term), "%s?%u", i ? "," : "", 2 + 2*i);
+		names += term;
+	}
+
+	sql_cmd += SQL_FILTER_QUERY_FROM_CMD;
+	sql_cmd += names;
+	sql_cmd += SQL_FILTER_QUERY_END_CMD;
+
+	ret = sqlite3_prepare_v2(db, sql_cmd.c_str(), (int)sql_cmd.length(), &stmt, &tail);
+
+	if (ret != SQLITE_OK) {
+		HAGGLE_ERR("SQLite command compilation failed! %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_int64(stmt, 1, attrs->size());
+
+	i = 0;
+
+	for (Attributes::const_iterator it = attrs->begin(); it != attrs->end(); it++, i++) {
+		sqlite3_bind_text(stmt, 2 + 2*i, (*it).second.getName().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(stmt, 3 + 2*i, (*it).second.getValue().c_str(), -1, SQLITE_TRANSIENT);
+	}
+
 	qr = new DataStoreQueryResult();
 
 	if (!qr) {
 		HAGGLE_DBG("Could not allocate query result object\n");
+		sqlite3_finalize(stmt);
 		return -1;
 	}
 	
-	// insert filter into database (remove after query)
-	filter_rowid = _insertFilter((Filter*)q->getFilter());
-	
-	if (filter_rowid < 0)
-		return -1;
-	
-	/* reset view dataobject>attribute */
-	setViewLimitedDataobjectAttributes();
-
-	/* query */
-	sql_cmd = SQL_FILTER_MATCH_DATAOBJECT_CMD(filter_rowid);
-	
-	ret = sqlite3_prepare(db, sql_cmd, (int)strlen(sql_cmd), &stmt, &tail);
-	
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
-		ret = -1;
-		goto filterQuery_cleanup;
-	}
-	
 	/* loop through results and create dataobjects */
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (num_match == 0) {
@@ -3423,9 +4186,9 @@ int SQLDataStore::_doFilterQuery(DataStoreFilterQuery *q)
 		if (ret == SQLITE_ROW) {
 			num_match++;
 			
-			dataobject_rowid = sqlite3_column_int(stmt, view_match_filters_and_dataobjects_as_ratio_dataobject_rowid);
+			sqlite_int64 dataobject_rowid = sqlite3_column_int64(stmt, sql_filter_query_cmd_dataobject_rowid);
 			
-			HAGGLE_DBG("Dataobject with rowid %d matches!\n", dataobject_rowid);
+			HAGGLE_DBG("Dataobject with rowid " SQLITE_INT64_FMT " matches!\n", dataobject_rowid);
 			
 			DataObjectRef dObj = getDataObjectFromRowId(dataobject_rowid);
 			
@@ -3434,8 +4197,8 @@ int SQLDataStore::_doFilterQuery(DataStoreFilterQuery *q)
 			} else {
 				HAGGLE_DBG("Could not get data object from rowid\n");
 			}
-		} else if (ret == SQLITE_ERROR) {
-			HAGGLE_DBG("Could not insert DO Error: %s\n", sqlite3_errmsg(db));
+		} else {
+			HAGGLE_DBG("Filter query error: %s\n", sqlite3_errmsg(db));
 			break;
 		}
 	}
@@ -3443,21 +4206,12 @@ int SQLDataStore::_doFilterQuery(DataStoreFilterQuery *q)
 	sqlite3_finalize(stmt);
 
 	if (num_match) {
-		kernel->addEvent(new Event(q->getCallback(), qr));
+		postEvent(new Event(q->getCallback(), qr));
 	} else {
 		delete qr;
-	}
-
-	ret = num_match;
-	
-filterQuery_cleanup:	
-	// remove filter from database
-	sprintf(sql_cmd, "DELETE FROM %s WHERE rowid = " SQLITE_INT64_FMT "", TABLE_FILTERS, filter_rowid);
-	sqlite3_prepare(db, sql_cmd, (int)strlen(sql_cmd), &stmt, &tail);
-	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	
-	return ret;
+	}
+
+	return num_match;
 }
 
 
@@ -3472,9 +4226,8 @@ int SQLDataStore::_doDataObjectQueryStep2(NodeRef &node,
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd = sqlcmd;
 	int num_match = 0;
+	int num_skipped = 0;
 	
 	sqlite_int64 node_rowid = getNodeRowId(node);
 
@@ -3483,38 +4236,62 @@ int SQLDataStore::_doDataObjectQueryStep2(NodeRef &node,
 		return 0;
 	}
 
-	/* limit VIEW_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID_DYNAMIC to node in question */
-	setViewLimitedNodeAttributes(node_rowid);
-	 
-	/* matching */
-	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM " VIEW_MATCH_NODES_AND_DATAOBJECTS_AS_RATIO " WHERE ratio >= %u AND mcount >= %u;", threshold, attrMatch);
-
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	/* matching, limited to the node in question */
+	stmt = getStatement(STMT_MATCH_NODE_AND_DATAOBJECTS);
 
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		return 0;
-	}
 
-	/* looping through the results and allocating dataobjects */
+	sqlite3_bind_int64(stmt, 1, node_rowid);
+	sqlite3_bind_int64(stmt, 2, threshold);
+	sqlite3_bind_int64(stmt, 3, attrMatch);
+
+	/* 
+	   looping through the results and allocating dataobjects. The 
+	   bloomfilters and node ids are checked on the stored values first,
+	   so that only the data objects that are returned are built.
+	*/
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
 		if (ret == SQLITE_ROW) {
 			sqlite_int64 dObjRowId = sqlite3_column_int64(stmt, view_match_nodes_and_dataobjects_rated_dataobject_rowid);
+			const unsigned char *id = (const unsigned char *)sqlite3_column_blob(stmt, sql_match_node_and_dataobjects_cmd_dataobject_id);
+			const char *desc_node_id = (const char *)sqlite3_column_text(stmt, sql_match_node_and_dataobjects_cmd_dataobject_node_id);
+
+			if (!id || sqlite3_column_bytes(stmt, sql_match_node_and_dataobjects_cmd_dataobject_id) != DATAOBJECT_ID_LEN) {
+				HAGGLE_DBG("Bad data object id for rowid=" SQLITE_INT64_FMT "\n", dObjRowId);
+				continue;
+			}
+
+			// Ignore this data object if the target or the potential delegate 
+			// already has it
+			if (node->getBloomfilter()->has(id, DATAOBJECT_ID_LEN) || 
+			    (delegate_node && delegate_node->getBloomfilter()->has(id, DATAOBJECT_ID_LEN))) {
+				num_skipped++;
+				continue;
+			}
+
+			// Data objects that are not node descriptions have node id '-'
+			bool is_node_description = desc_node_id && strcmp(desc_node_id, "-") != 0;
+
+			// Ignore this data object if it is the node description of the target
+			// or a potential delegate
+			if (is_node_description && 
+			    (strcmp(desc_node_id, node->getIdStr()) == 0 || 
+			     (delegate_node && strcmp(desc_node_id, delegate_node->getIdStr()) == 0))) {
+				num_skipped++;
+				continue;
+			}
 
 			DataObjectRef dObj = getDataObjectFromRowId(dObjRowId);
 
 			if (dObj) {
-				bool delegate_has_dataobject = delegate_node ? delegate_node->getBloomfilter()->has(dObj) : false;
-				// Ignore this data object if the target or the potential delegate 
-				// already has it
-				if (node->getBloomfilter()->has(dObj) || delegate_has_dataobject)
-					continue;
-					
-				//HAGGLE_DBG("Data object rowid=" SQLITE_INT64_FMT "\n", dObjRowId);
-				if (dObj->isNodeDescription()) {
+				// Nodes without a node description are only known by their 
+				// interfaces, which requires the node in the description
+				if (is_node_description && 
+				    (node->getType() == Node::TYPE_UNDEFINED || 
+				     (delegate_node && delegate_node->getType() == Node::TYPE_UNDEFINED))) {
 					NodeRef desc_node = Node::create(Node::TYPE_PEER, dObj);
-					// Ignore this data object if it is the node description of the target
-					// or a potential delegate
+
 					if (desc_node == node || (delegate_node && delegate_node == desc_node)) {
 						continue;
 					}
@@ -3530,12 +4307,15 @@ int SQLDataStore::_doDataObjectQueryStep2(NodeRef &node,
 			}
 		} else if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("data object query Error:%s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+			sqlite3_reset(stmt);
 			return num_match;
 		}
 	}
 
-	sqlite3_finalize(stmt);
+	HAGGLE_DBG("%d data objects matched node %s, skipped %d that the node or delegate already has\n", 
+		   num_match, node->getName().c_str(), num_skipped);
+
+	sqlite3_reset(stmt);
 	
 	return num_match;
 }
@@ -3570,10 +4350,10 @@ int SQLDataStore::_doDataObjectQuery(DataStoreDataObjectQuery *q)
 	qr->setQueryResultTime();
 
 #if defined(BENCHMARK)
-	kernel->addEvent(new Event(q->getCallback(), qr));
+	postEvent(new Event(q->getCallback(), qr));
 #else
 	if (num_match) {
-		kernel->addEvent(new Event(q->getCallback(), qr));
+		postEvent(new Event(q->getCallback(), qr));
 	} else {
 		delete qr;
 	}
@@ -3640,10 +4420,10 @@ int SQLDataStore::_doDataObjectForNodesQuery(DataStoreDataObjectForNodesQuery *q
 	qr->setQueryResultTime();
 
 #if defined(BENCHMARK)
-	kernel->addEvent(new Event(q->getCallback(), qr));
+	postEvent(new Event(q->getCallback(), qr));
 #else
 	if (num_match) {
-		kernel->addEvent(new Event(q->getCallback(), qr));
+		postEvent(new Event(q->getCallback(), qr));
 	} else {
 		delete qr;
 	}
@@ -3660,8 +4440,6 @@ int SQLDataStore::_doNodeQuery(DataStoreNodeQuery *q)
 {
 	int ret;
 	sqlite3_stmt *stmt;
-	const char *tail;
-	char *sql_cmd = sqlcmd;
 	unsigned int num_match = 0;
 	DataStoreQueryResult *qr;
 	DataObjectRef dObj = q->getDataObject();
@@ -3686,22 +4464,16 @@ int SQLDataStore::_doNodeQuery(DataStoreNodeQuery *q)
 	
 	sqlite_int64 dataobject_rowid = getDataObjectRowId(dObj->getId());
 	
-	/* limit the dataobject attribute links */
-	setViewLimitedDataobjectAttributes(dataobject_rowid);
-	
-	/* the actual query */
-	if (q->getMaxResp() > 0) {
-		snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM %s WHERE ratio >= threshold AND mcount >= %u AND dataobject_not_match=0 limit %u;", VIEW_MATCH_DATAOBJECTS_AND_NODES_AS_RATIO, q->getAttrMatch(), q->getMaxResp());
-	} else {
-		snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "SELECT * FROM %s WHERE ratio >= threshold AND mcount >= %u AND dataobject_not_match=0;", VIEW_MATCH_DATAOBJECTS_AND_NODES_AS_RATIO, q->getAttrMatch());
-	}
-	
-	ret = sqlite3_prepare(db, sql_cmd, (int) strlen(sql_cmd), &stmt, &tail);
+	/* the actual query, limited to the dataobject in question */
+	stmt = getStatement(STMT_MATCH_DATAOBJECT_AND_NODES);
 	
-	if (ret != SQLITE_OK) {
-		HAGGLE_DBG("SQLite command compilation failed! %s\n", sql_cmd);
+	if (!stmt)
 		goto out_err;
-	}
+
+	sqlite3_bind_int64(stmt, 1, dataobject_rowid);
+	sqlite3_bind_int64(stmt, 2, q->getAttrMatch());
+	// A negative limit means no limit
+	sqlite3_bind_int64(stmt, 3, q->getMaxResp() > 0 ? (sqlite_int64)q->getMaxResp() : -1);
 
 	/* looping through the results and allocating nodes */
 	while ((ret = sqlite3_step(stmt)) != SQLITE_DONE) {
@@ -3727,12 +4499,12 @@ int SQLDataStore::_doNodeQuery(DataStoreNodeQuery *q)
 			}
 		} else if (ret == SQLITE_ERROR) {
 			HAGGLE_DBG("node query Error:%s\n", sqlite3_errmsg(db));
-			sqlite3_finalize(stmt);
+			sqlite3_reset(stmt);
 			goto out_err;
 		}
 	}
 	
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	
 	if (num_match == 0) {
 		qr->setQuerySqlEndTime();
@@ -3741,12 +4513,12 @@ int SQLDataStore::_doNodeQuery(DataStoreNodeQuery *q)
 	
 #if !defined(BENCHMARK)
 	if (num_match) {
-		kernel->addEvent(new Event(q->getCallback(), qr));
+		postEvent(new Event(q->getCallback(), qr));
 	} else {
 		delete qr;
 	}
 #else
-	kernel->addEvent(new Event(q->getCallback(), qr));
+	postEvent(new Event(q->getCallback(), qr));
 #endif
 	
 	HAGGLE_DBG("%u nodes matched data object [%s]\n", num_match, dObj->getIdStr());
@@ -3960,7 +4732,7 @@ int SQLDataStore::_readRepository(DataStoreRepositoryQuery *q, const EventCallba
 	}
 	sqlite3_finalize(stmt);
 		
-	kernel->addEvent(new Event(q->getCallback(), qr));
+	postEvent(new Event(q->getCallback(), qr));
 	
 	return 1;
 }
@@ -4135,6 +4907,18 @@ xml_alloc_fail:
 	return -1;
 }
 
+// The tables included in a dump, in order
+static const char *dumpTables[] = {
+	TABLE_ATTRIBUTES,
+	TABLE_DATAOBJECTS,
+	TABLE_NODES,
+	TABLE_FILTERS,
+	TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID,
+	TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID,
+	TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID,
+	NULL
+};
+
 xmlDocPtr SQLDataStore::dumpToXML()
 {
 	xmlDocPtr doc = NULL;
@@ -4158,39 +4942,11 @@ xmlDocPtr SQLDataStore::dumpToXML()
 	
 	xmlDocSetRootElement(doc, root_node);
 	
-	if (dumpTable(root_node, db, TABLE_ATTRIBUTES) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_ATTRIBUTES);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_DATAOBJECTS) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_DATAOBJECTS);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_NODES) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_NODES);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_FILTERS) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_FILTERS);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_MAP_DATAOBJECTS_TO_ATTRIBUTES_VIA_ROWID);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_MAP_NODES_TO_ATTRIBUTES_VIA_ROWID);
-		goto xml_alloc_fail;
-	}
-	
-	if (dumpTable(root_node, db, TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID) < 0) {
-		HAGGLE_ERR("Could not dump %s\n", TABLE_MAP_FILTERS_TO_ATTRIBUTES_VIA_ROWID);
-		goto xml_alloc_fail;
+	for (int i = 0; dumpTables[i]; i++) {
+		if (dumpTable(root_node, db, dumpTables[i]) < 0) {
+			HAGGLE_ERR("Could not dump %s\n", dumpTables[i]);
+			goto xml_alloc_fail;
+		}
 	}
 	
 //	setViewLimitedDataobjectAttributes();
@@ -4207,34 +4963,141 @@ xml_alloc_fail:
 	return NULL;
 }
 
-int SQLDataStore::_dump(const EventCallback<EventHandler> *callback)
+/*
+	Dumps at most max rows of a table, starting after the given rowid, 
+	into the buffer. Returns the number of dumped rows and sets the rowid 
+	of the last one, or returns -1 on failure.
+*/
+static int dumpTableRows(xmlBufferPtr buf, sqlite3 *db, const char *name, 
+			 sqlite_int64 *lastRowId, unsigned long max)
 {
-        xmlDocPtr doc;
-        char *dump;
-        int xmlLen;
-        
-        if (!callback) {
-                HAGGLE_ERR("Invalid callback\n");
+	sqlite3_stmt *stmt;
+	const char *tail;
+	char sql_cmd[256];
+	int ret, num = 0;
+
+	snprintf(sql_cmd, sizeof(sql_cmd), "SELECT * FROM %s WHERE ROWID>%lld ORDER BY ROWID LIMIT %lu;", 
+		 name, (long long)*lastRowId, max);
+
+	ret = sqlite3_prepare_v2(db, sql_cmd, (int)strlen(sql_cmd), &stmt, &tail);
+	
+	if (ret != SQLITE_OK) {
+		HAGGLE_ERR("SQLite command compilation failed! %s\n", sql_cmd);
+		HAGGLE_ERR("%s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+	
+	// The rows are collected under a table node only to be serialized
+	xmlNodePtr node = xmlNewNode(NULL, BAD_CAST name);
+
+	if (!node) {
+		sqlite3_finalize(stmt);
+		HAGGLE_ERR("Could not allocate new XML child node\n");
+		return -1;
+	}
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (dumpColumn(node, stmt) < 0) {
+			ret = SQLITE_ERROR;
+			break;
+		}
+		*lastRowId = sqlite3_column_int64(stmt, 0);
+		num++;
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (ret != SQLITE_DONE) {
+		HAGGLE_ERR("SQLite statement evaluation failed! %s\n", sql_cmd);
+		xmlFreeNode(node);
                 return -1;
-        }
-        doc = dumpToXML();
-        
-        if (!doc) {
-                HAGGLE_ERR("ERROR: Dump to XML failed\n");
-                return -2;
-        }
-	xmlDocDumpFormatMemory(doc, (xmlChar **)&dump, &xmlLen, 1);
+	}
 
-        xmlFreeDoc(doc);
+	for (xmlNodePtr row = node->children; row; row = row->next) {
+		if (xmlNodeDump(buf, NULL, row, 2, 1) < 0) {
+			HAGGLE_ERR("Could not serialize row of %s\n", name);
+			xmlFreeNode(node);
+			return -1;
+		}
+		xmlBufferCCat(buf, "\n");
+	}
 
-	if (xmlLen < 0) {
-                HAGGLE_ERR("ERROR: xmlLen is less than zero...\n");
-                return -3;
-        }
+	xmlFreeNode(node);
 
-        kernel->addEvent(new Event(callback, new DataStoreDump(dump, xmlLen)));
-	
-	return xmlLen;
+	return num;
+}
+
+/*
+	The tables are dumped one after the other, and the cursor position is 
+	the table and the rowid of the last dumped row in it. Rows inserted 
+	behind the cursor while the dump is in progress are thus included, 
+	while rows deleted ahead of it are not.
+*/
+int SQLDataStore::_dump(DataStoreDumpCursor *c, unsigned long max, char **data, size_t *len)
+{
+	xmlBufferPtr buf = xmlBufferCreate();
+	unsigned long num = 0;
+	int ret = 0;
+
+	if (!buf) {
+		HAGGLE_ERR("Could not allocate XML buffer\n");
+		return -1;
+	}
+
+	if (!c->started)
+		xmlBufferCCat(buf, "<HaggleDump>\n");
+
+	while (dumpTables[c->part] && num < max) {
+		const char *name = dumpTables[c->part];
+		sqlite_int64 lastRowId = c->lastRow;
+
+		// Open the table with its first chunk
+		if (lastRowId == 0) {
+			xmlBufferCCat(buf, "  <");
+			xmlBufferCCat(buf, name);
+			xmlBufferCCat(buf, ">\n");
+		}
+
+		int n = dumpTableRows(buf, db, name, &lastRowId, max - num);
+
+		if (n < 0) {
+			xmlBufferFree(buf);
+			return -1;
+		}
+
+		c->lastRow = lastRowId;
+		c->numRows += n;
+		num += n;
+
+		// A partial chunk means that the table is done
+		if (num < max) {
+			xmlBufferCCat(buf, "  </");
+			xmlBufferCCat(buf, name);
+			xmlBufferCCat(buf, ">\n");
+			c->part++;
+			c->lastRow = 0;
+		}
+	}
+
+	if (dumpTables[c->part]) {
+		ret = 1;
+	} else {
+		xmlBufferCCat(buf, "</HaggleDump>\n");
+	}
+
+	*len = xmlBufferLength(buf);
+	*data = (char *)malloc(*len);
+
+	if (!*data) {
+		HAGGLE_ERR("Could not allocate dump chunk\n");
+		xmlBufferFree(buf);
+		return -1;
+	}
+
+	memcpy(*data, xmlBufferContent(buf), *len);
+	xmlBufferFree(buf);
+
+	return ret;
 }
 
 int SQLDataStore::_dumpToFile(const char *filename)
@@ -4298,6 +5161,96 @@ int SQLDataStore::backupDatabase(sqlite3 *pInMemory, const char *zFilename, int
 
 	return rc;
 }
+
+/*
+	Checkpoints an in-memory database to the database file. The backup 
+	keeps the destination locked until it is complete, so that a crash 
+	in the middle of a checkpoint leaves the previous checkpoint intact. 
+	Changes made through this connection between two slices are applied 
+	to the destination by SQLite as they are made, and need not restart 
+	the checkpoint.
+*/
+int SQLDataStore::_checkpoint()
+{
+	// A database file is always up to date
+	if (!isInMemory)
+		return 0;
+
+	if (!checkpointBackup) {
+		// Nothing to do if the database is unchanged since the last checkpoint
+		if (sqlite3_total_changes(db) == checkpointChanges)
+			return 0;
+
+		string file = getFilepath();
+
+		if (file.empty())
+			return -1;
+
+		if (sqlite3_open(file.c_str(), &checkpointFile) != SQLITE_OK) {
+			HAGGLE_ERR("Could not open checkpoint file %s: %s\n", 
+				   file.c_str(), sqlite3_errmsg(checkpointFile));
+			finishCheckpoint();
+			return -1;
+		}
+
+		checkpointBackup = sqlite3_backup_init(checkpointFile, "main", db, "main");
+
+		if (!checkpointBackup) {
+			HAGGLE_ERR("Could not start checkpoint: %s\n", sqlite3_errmsg(checkpointFile));
+			finishCheckpoint();
+			return -1;
+		}
+
+		checkpointSlices = 0;
+		checkpointStart = Timeval::now();
+		checkpointChanges = sqlite3_total_changes(db);
+	}
+
+	int ret = sqlite3_backup_step(checkpointBackup, checkpointPages);
+
+	checkpointSlices++;
+
+	switch (ret) {
+	case SQLITE_OK:
+	case SQLITE_BUSY:
+	case SQLITE_LOCKED:
+		return 1;
+	case SQLITE_DONE:
+		break;
+	default:
+		HAGGLE_ERR("Checkpoint failed: %s\n", sqlite3_errmsg(checkpointFile));
+		finishCheckpoint();
+		return -1;
+	}
+
+	int pages = sqlite3_backup_pagecount(checkpointBackup);
+
+	finishCheckpoint();
+
+	HAGGLE_DBG("Checkpoint of %d pages in %lu slices took %.3lf s\n", 
+		   pages, checkpointSlices, (Timeval::now() - checkpointStart).getTimeAsSecondsDouble());
+	LOG_ADD("%s: %s checkpoint of %d pages in %lu slices\n", 
+		Timeval::now().getAsString().c_str(), getName(), pages, checkpointSlices);
+
+	return 0;
+}
+
+void SQLDataStore::finishCheckpoint()
+{
+	if (checkpointBackup) {
+		sqlite3_backup_finish(checkpointBackup);
+		checkpointBackup = NULL;
+	}
+	if (checkpointFile) {
+		sqlite3_close(checkpointFile);
+		checkpointFile = NULL;
+	}
+}
+#else
+int SQLDataStore::_checkpoint()
+{
+	return 0;
+}
 #endif // HAVE_SQLITE_BACKUP_SUPPORT
 
 #ifdef DEBUG_SQLDATASTORE
@@ -4622,6 +5575,175 @@ void SQLDataStore::_print()
 #endif /* DEBUG_SQLDATASTORE */
 
 
+int SQLDataStore::_beginTransaction()
+{
+	if (sqlQuery(SQL_BEGIN_TRANSACTION_CMD) != SQLITE_DONE) {
+		HAGGLE_ERR("Could not begin transaction: %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+	return 0;
+}
+
+int SQLDataStore::_endTransaction()
+{
+	// If a statement failed in a way that made SQLite roll back 
+	// the transaction, we are already back in autocommit mode
+	if (sqlite3_get_autocommit(db)) {
+		HAGGLE_ERR("Transaction was rolled back before commit\n");
+		dataObjectCache.clear();
+		return -1;
+	}
+
+	if (sqlQuery(SQL_END_TRANSACTION_CMD) != SQLITE_DONE) {
+		HAGGLE_ERR("Could not commit transaction: %s\n", sqlite3_errmsg(db));
+		sqlQuery(SQL_ROLLBACK_TRANSACTION_CMD);
+		// Objects cached during the transaction may no longer exist
+		dataObjectCache.clear();
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	Sets a pragma and returns the value reported back by SQLite, or an
+	empty string on failure. Some pragmas, e.g., journal_mode, report the
+	mode actually in use, which may differ from the requested one.
+*/
+string SQLDataStore::setPragma(const char *pragma, const char *value)
+{
+	string result;
+	sqlite3_stmt *stmt;
+	const char *tail;
+	int ret;
+
+	snprintf(sqlcmd, SQL_MAX_CMD_SIZE, "PRAGMA %s=%s;", pragma, value);
+
+	ret = sqlite3_prepare_v2(db, sqlcmd, (int) strlen(sqlcmd), &stmt, &tail);
+
+	if (ret != SQLITE_OK) {
+		HAGGLE_ERR("SQLite command compilation failed! %s\n", sqlcmd);
+		return result;
+	}
+
+	ret = sqlite3_step(stmt);
+
+	if (ret == SQLITE_ROW) {
+		const char *str = (const char *)sqlite3_column_text(stmt, 0);
+		result = str ? str : value;
+	} else if (ret == SQLITE_DONE) {
+		result = value;
+	} else {
+		HAGGLE_ERR("Could not set %s: %s\n", sqlcmd, sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(stmt);
+
+	return result;
+}
+
+int SQLDataStore::_configure(const Metadata& m)
+{
+	static const char *journal_modes[] = { 
+		"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF", NULL 
+	};
+	static const char *synchronous_modes[] = { 
+		"OFF", "NORMAL", "FULL", NULL 
+	};
+
+	const char *param = m.getParameter("in_memory");
+
+	// Switch before the reader threads are configured, since they 
+	// cannot be used with an in-memory database
+	if (param && strcmp(param, "true") == 0 && !isInMemory) {
+		if (hasReaders) {
+			HAGGLE_ERR("Cannot switch to an in-memory database with reader threads running\n");
+		} else if (_onConfig() > 0) {
+			HAGGLE_DBG("config in_memory=true\n");
+			LOG_ADD("# %s: in_memory=true\n", getName());
+		}
+	}
+
+	DataStore::_configure(m);
+
+	param = m.getParameter("journal_mode");
+
+	if (param) {
+		int i = 0;
+
+		while (journal_modes[i] && strcmp(param, journal_modes[i]) != 0)
+			i++;
+
+		if (journal_modes[i]) {
+			// An in-memory database always reports 'memory'
+			string mode = setPragma("journal_mode", journal_modes[i]);
+			HAGGLE_DBG("config journal_mode=%s (in use: %s)\n", 
+				   journal_modes[i], mode.c_str());
+			LOG_ADD("# %s: journal_mode=%s\n", getName(), mode.c_str());
+		} else {
+			HAGGLE_ERR("Bad journal_mode '%s'\n", param);
+		}
+	}
+
+#if defined(HAVE_SQLITE_BACKUP_SUPPORT)
+	param = m.getParameter("checkpoint_pages");
+
+	if (param) {
+		char *endptr = NULL;
+		long pages = strtol(param, &endptr, 10);
+		
+		if (endptr && endptr != param && pages > 0) {
+			checkpointPages = (int)pages;
+			HAGGLE_DBG("config checkpointPages=%d\n", checkpointPages);
+			LOG_ADD("# %s: checkpointPages=%d\n", getName(), checkpointPages);
+		}
+	}
+#endif
+
+	param = m.getParameter("dataobject_cache_size");
+
+	if (param) {
+		char *endptr = NULL;
+		unsigned long size = strtoul(param, &endptr, 10);
+		
+		if (endptr && endptr != param) {
+			dataObjectCache.setMaxBytes(size);
+			HAGGLE_DBG("config dataobject_cache_size=%lu\n", size);
+			LOG_ADD("# %s: dataobject_cache_size=%lu\n", getName(), size);
+		}
+	}
+
+	param = m.getParameter("rebuild_dataobjects");
+
+	if (param) {
+		if (strcmp(param, "true") == 0 || strcmp(param, "yes") == 0)
+			rebuildDataObjects = true;
+		else if (strcmp(param, "false") == 0 || strcmp(param, "no") == 0)
+			rebuildDataObjects = false;
+		
+		HAGGLE_DBG("config rebuild_dataobjects=%s\n", rebuildDataObjects ? "true" : "false");
+		LOG_ADD("# %s: rebuild_dataobjects=%s\n", getName(), rebuildDataObjects ? "true" : "false");
+	}
+
+	param = m.getParameter("synchronous");
+
+	if (param) {
+		int i = 0;
+
+		while (synchronous_modes[i] && strcmp(param, synchronous_modes[i]) != 0)
+			i++;
+
+		if (synchronous_modes[i]) {
+			setPragma("synchronous", synchronous_modes[i]);
+			HAGGLE_DBG("config synchronous=%s\n", synchronous_modes[i]);
+			LOG_ADD("# %s: synchronous=%s\n", getName(), synchronous_modes[i]);
+		} else {
+			HAGGLE_ERR("Bad synchronous mode '%s'\n", param);
+		}
+	}
+
+	return 0;
+}
+
 int SQLDataStore::_onConfig()
 {
 	// for now assume that this function is called to switch from file to in-memory
@@ -4642,10 +5764,13 @@ int SQLDataStore::_onConfig()
 		HAGGLE_DBG("Cannot switch to in-memory database since there is no backup support in SQLite\n");
 #endif
 		if (ret == SQLITE_OK) {
+			// The cached statements belong to the old connection
+			finalizeStatements();
 			if (db)
 				sqlite3_close(db);
 			db = db_memory;
 			isInMemory = true;
+			prepareStatements();
 		} else {
 			HAGGLE_ERR("did not switch to in-memory database\n");
 			return -1;
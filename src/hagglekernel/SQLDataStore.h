@@ -20,9 +20,11 @@
 	avoid circular dependencies. If/when a data type is added to this file,
 	remember to add it here.
 */
+class DataObjectCache;
 class SQLDataStore;
 
 #include <libcpphaggle/Platform.h>
+#include <libcpphaggle/Map.h>
 #include "DataStore.h"
 #include "Node.h"
 
@@ -30,8 +32,8 @@ class SQLDataStore;
 #define INMEMORY_DATASTORE_FILENAME ":memory:"
 #define DEFAULT_DATASTORE_FILEPATH DEFAULT_DATASTORE_PATH
 
-// FIXME: Make in-memory datastore a compile time option or support
-// runtime option through_onConfig() 
+// The in-memory datastore is a compile time option, or a runtime 
+// option through the in_memory configuration parameter
 // #define INMEMORY_DATASTORE 1
 
 #include <libxml/parser.h>
@@ -48,22 +50,195 @@ class SQLDataStore;
 #define DEBUG_SQLDATASTORE
 #endif
 
+// Default memory budget of the data object cache, in bytes
+#define DATAOBJECT_CACHE_MAX_BYTES (2*1024*1024)
+
+// Memory budget of the data object cache of each reader, in bytes. It 
+// is never larger than the budget of the writer's cache
+#define DATAOBJECT_READER_CACHE_MAX_BYTES (256*1024)
+
+// The number of database pages copied per slice of a checkpoint of an 
+// in-memory database
+#define SQL_CHECKPOINT_PAGES 100
+
+/**
+	A bounded cache of data objects that have been materialized from 
+	the data store, indexed by data object rowid and by id. Objects 
+	returned by queries are otherwise recreated from their XML header on 
+	every retrieval, which means parsing the metadata all over again.
+
+	The size of an entry is an estimate of the memory held by the object. 
+	When the total exceeds the memory budget, the least recently used 
+	entries are evicted. The entries are kept in a list ordered by use, 
+	so that a hit and an eviction take constant time. Entries must be 
+	removed when the corresponding row is deleted, or the cache would 
+	keep handing out data objects that are no longer stored. A rowid 
+	is never reused, as the data object table is declared with 
+	AUTOINCREMENT, so an entry cannot be mistaken for a newer row.
+
+	The cache keeps a private instance of each data object, and hands 
+	out copies of it. Data objects are changed by their users, e.g., 
+	aging marks them as no longer stored, so an instance shared between 
+	users would carry such changes to everyone retrieving the object. 
+	Copying is still cheaper than recreating the object, as neither 
+	the attributes nor the metadata are read from the database again.
+
+	The cache is not thread-safe, it should only be used by the data 
+	store thread.
+
+	Reader threads have caches of their own, which are not invalidated 
+	when the writer deletes or evicts data objects. A reader only looks 
+	up rowids returned by its own queries, so it hands out a deleted 
+	data object only to a query that still saw the row. The entries of 
+	deleted rows stay in the cache until they are evicted, which is 
+	why the caches of readers are kept small.
+*/
+class DataObjectCache
+{
+	class Entry {
+	public:
+		const sqlite_int64 rowid;
+		DataObjectRef dObj;
+		size_t size;
+		// The neighbours in the list ordered by use
+		Entry *prev, *next;
+		Entry(sqlite_int64 _rowid, const DataObjectRef& _dObj, size_t _size) : 
+			rowid(_rowid), dObj(_dObj), size(_size), prev(NULL), next(NULL) {}
+	};
+	typedef Map<sqlite_int64, Entry *> RowIdMap;
+	typedef Map<string, sqlite_int64> IdMap;
+	RowIdMap rowids;
+	IdMap ids;
+	// The most and the least recently used entries
+	Entry *head, *tail;
+	size_t maxBytes;
+	size_t bytes;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	void link(Entry *e);
+	void unlink(Entry *e);
+	void remove(RowIdMap::iterator it);
+	void evictLeastRecentlyUsed();
+public:
+	DataObjectCache(size_t _maxBytes = DATAOBJECT_CACHE_MAX_BYTES);
+	~DataObjectCache();
+	/**
+		Returns a copy of the cached data object with the given rowid, 
+		or a NULL reference if it is not in the cache.
+	*/
+	DataObjectRef lookup(sqlite_int64 rowid);
+	/**
+		Add a copy of a data object to the cache. The size is the 
+		estimated memory held by the object.
+	*/
+	void insert(sqlite_int64 rowid, const DataObjectRef& dObj, size_t size);
+	void remove(sqlite_int64 rowid);
+	void remove(const string& idStr);
+	void clear();
+	/**
+		Set the memory budget in bytes. A budget of zero disables the cache.
+	*/
+	void setMaxBytes(size_t _maxBytes);
+	size_t getMaxBytes() const { return maxBytes; }
+	size_t getBytes() const { return bytes; }
+	size_t size() const { return rowids.size(); }
+	unsigned long getHits() const { return hits; }
+	unsigned long getMisses() const { return misses; }
+	unsigned long getEvictions() const { return evictions; }
+};
+
 /** */
 class SQLDataStore : public DataStore
 {
 private:
+	/*
+		Statements that are executed frequently are compiled once and
+		kept in a cache. They are reset and rebound on each use instead
+		of being recompiled. The order must match the stmt_cmds[] array 
+		in SQLDataStore.cpp.
+	*/
+	typedef enum {
+		STMT_INSERT_DATAOBJECT = 0,
+		STMT_FIND_DATAOBJECT,
+		STMT_DATAOBJECT_FROM_ROWID,
+		STMT_DELETE_DATAOBJECT,
+		STMT_AGE_DATAOBJECTS,
+		STMT_INSERT_DATAOBJECT_ATTR,
+		STMT_ATTRS_FROM_DATAOBJECT_ROWID,
+		STMT_INSERT_ATTR,
+		STMT_FIND_ATTR,
+		STMT_ATTR_FROM_ROWID,
+		STMT_ATTRS_FROM_NODE_ROWID,
+		STMT_INSERT_IFACE,
+		STMT_FIND_IFACE,
+		STMT_IFACES_FROM_NODE_ROWID,
+		STMT_NODE_ROWID_FROM_IFACE,
+		STMT_INSERT_NODE,
+		STMT_DELETE_NODE,
+		STMT_INSERT_NODE_ATTR,
+		STMT_NODE_FROM_ID,
+		STMT_NODE_FROM_ROWID,
+		STMT_NODE_BY_TYPE,
+		STMT_INSERT_FILTER,
+		STMT_DELETE_FILTER,
+		STMT_INSERT_FILTER_ATTR,
+		STMT_CLEAR_FILTER_MATCHES,
+		STMT_FILL_FILTER_MATCHES,
+		STMT_FILTER_MATCH_PAGE,
+		STMT_MATCH_NODE_AND_DATAOBJECTS,
+		STMT_MATCH_DATAOBJECT_AND_NODES,
+		STMT_MATCH_DATAOBJECT_AND_FILTERS,
+		STMT_DATAOBJECT_USAGE,
+		STMT_EVICTION_CANDIDATES,
+		STMT_NODE_DESCRIPTIONS_FROM_NODE_ID,
+		STMT_DELETE_NODE_DESCRIPTIONS,
+		_STMT_MAX
+	} StatementType_t;
+
 	sqlite3 *db; 
 	bool isInMemory;
 	bool recreate;
 	string filepath;
+	sqlite3_stmt *stmts[_STMT_MAX];
+	unsigned long stmtCacheHits;
+	unsigned long stmtCacheMisses;
+	DataObjectCache dataObjectCache;
+	bool rebuildDataObjects; // Create data objects from the table fields rather than parsing the metadata
+	bool hasReaders; // Reader instances have been created
+#if defined(HAVE_SQLITE_BACKUP_SUPPORT)
+	// The checkpoint in progress of an in-memory database
+	sqlite3 *checkpointFile;
+	sqlite3_backup *checkpointBackup;
+	int checkpointPages;
+	unsigned long checkpointSlices;
+	int checkpointChanges; // Changes to the database at the last checkpoint
+	Timeval checkpointStart;
+	void finishCheckpoint();
+#endif
 
 	int cleanupDataStore();
 	int createTables();
+	int upgradeTables();
+	int migrateTables(const char **cmds);
 	int sqlQuery(const char *sql_cmd);
+	int sqlQuery(StatementType_t type);
+
+	/**
+		Compile all cached statements. Returns the number of statements 
+		that failed to compile, i.e., 0 on success.
+	*/
+	int prepareStatements();
+	void finalizeStatements();
+	/**
+		Returns a cached statement that has been reset and had its 
+		bindings cleared, or NULL if the statement could not be compiled.
+		Statements are not reentrant, so a caller must reset the statement
+		before calling a function that may use the same statement.
+	*/
+	sqlite3_stmt *getStatement(StatementType_t type);
 
-	int setViewLimitedDataobjectAttributes(sqlite_int64 dataobject_rowid = 0);
-	int setViewLimitedNodeAttributes(sqlite_int64 dataobject_rowid = 0);
-	int evaluateDataObjects(long eventType);
+	int resetDynamicViews();
 	int evaluateFilters(const DataObjectRef& dObj, sqlite_int64 dataobject_rowid = 0);
 
 	sqlite_int64 getDataObjectRowId(const DataObjectId_t& id);
@@ -73,10 +248,22 @@ private:
 	sqlite_int64 getInterfaceRowId(const InterfaceRef& iface);
 
 	DataObject *createDataObject(sqlite3_stmt *stmt);
+	/**
+		Reads the attributes of a data object from the attribute tables. 
+		Returns false if the attributes could not be read, or if some
+		attribute was stored without a weight.
+	*/
+	bool getDataObjectAttributes(const sqlite_int64 dataobject_rowid, Attributes& attrs);
 	NodeRef createNode(sqlite3_stmt *in_stmt);
 
 	Attribute *getAttrFromRowId(const sqlite_int64 attr_rowid, const sqlite_int64 node_rowid);
-	DataObject *getDataObjectFromRowId(const sqlite_int64 dataObjectRowId);
+	/**
+		Returns the data object in the current result row of the
+		statement, from the data object cache if possible.
+	*/
+	DataObjectRef getDataObject(sqlite3_stmt *stmt);
+	DataObjectRef createCachedDataObject(sqlite3_stmt *stmt);
+	DataObjectRef getDataObjectFromRowId(const sqlite_int64 dataObjectRowId);
 	NodeRef getNodeFromRowId(const sqlite_int64 nodeRowId);
 	Interface *getInterfaceFromRowId(const sqlite_int64 ifaceRowId);
 	
@@ -86,6 +273,12 @@ private:
 	int backupDatabase(sqlite3 *pInMemory, const char *zFilename, int toFile = 1);
 #endif
 	string getFilepath();
+	string setPragma(const char *pragma, const char *value);
+	/**
+		Opens a read-only connection to the database of a data store
+		that has already been initialized. Used by reader instances.
+	*/
+	bool initReader();
 		
 	
 #ifdef DEBUG_SQLDATASTORE
@@ -107,6 +300,7 @@ protected:
 	int _deleteDataObject(const DataObjectId_t &id, bool shouldReportRemoval = true, bool keepInBloomfilter = false);
 	int _deleteDataObject(DataObjectRef& dObj, bool shouldReportRemoval = true, bool keepInBloomfilter = false);
 	int _ageDataObjects(const Timeval& minimumAge, const EventCallback<EventHandler> *callback = NULL, bool keepInBloomfilter = false);
+	int _evictDataObjects(DataStoreEvictionQuery *q);
 	int _insertFilter(Filter *f, bool matchFilter = false, const EventCallback<EventHandler> *callback = NULL);
 	int _deleteFilter(long eventtype);
 	// matching Filters
@@ -124,8 +318,14 @@ protected:
 	int _readRepository(DataStoreRepositoryQuery *q, const EventCallback<EventHandler> *callback = NULL);
 	int _deleteRepository(DataStoreRepositoryQuery *q);
 	
-	int _dump(const EventCallback<EventHandler> *callback = NULL);
+	int _dump(DataStoreDumpCursor *c, unsigned long max, char **data, size_t *len);
 	int _dumpToFile(const char *filename);
+	int _evaluateFilterPage(DataStoreFilterCursor *c, unsigned long max);
+	int _beginTransaction();
+	int _endTransaction();
+	int _configure(const Metadata& m);
+	DataStore *_createReader();
+	int _checkpoint();
 	int _onConfig();
 
 public:
@@ -133,6 +333,8 @@ public:
 	~SQLDataStore();
 
 	bool init();
+	unsigned long getStatementCacheHits() const { return stmtCacheHits; }
+	unsigned long getStatementCacheMisses() const { return stmtCacheMisses; }
 };
 
 #endif /* _SQLDATASTORE_H */
@@ -163,20 +163,13 @@ SecurityTask::SecurityTask(const SecurityTaskType_t _type,
 SecurityHelper::SecurityHelper(SecurityManager *m, 
 			       const EventType _etype) : 
 	ManagerModule<SecurityManager>(m, "SecurityHelper"), 
-	taskQ("SecurityHelper"), etype(_etype)
+	stopped(false), etype(_etype)
 {
 }
 
 SecurityHelper::~SecurityHelper()
 {
-	if (isRunning())
-		stop();
-	
-	while (!taskQ.empty()) {
-		SecurityTask *task = NULL;
-		taskQ.retrieve(&task);
-		delete task;
-	}
+	stopTasks();
 }
 
 bool SecurityHelper::signDataObject(DataObjectRef& dObj, RSA *key)
@@ -327,39 +320,75 @@ void SecurityHelper::doTask(SecurityTask *task)
 	return;
 }
 
-bool SecurityHelper::run()
-{	
-	HAGGLE_DBG("SecurityHelper running...\n");
-	
-	while (!shouldExit()) {
-		QueueEvent_t qe;
-		SecurityTask *task = NULL;
-		
-		qe = taskQ.retrieve(&task);
-		
-		switch (qe) {
-		case QUEUE_ELEMENT:
-			doTask(task);
+/*
+	Runs the queued security tasks on the kernel's executor.
+*/
+class SecurityHelperTask : public Task {
+	SecurityHelper *helper;
+	void run() { helper->doTasks(); }
+public:
+	SecurityHelperTask(SecurityHelper *_helper) : helper(_helper) {}
+};
+
+void SecurityHelper::doTasks()
+{
+	mutex.lock();
+
+	while (!taskQ.empty() && !stopped) {
+		SecurityTask *task = taskQ.front();
+		taskQ.pop_front();
+		mutex.unlock();
+		doTask(task);
+		mutex.lock();
+	}
+	runner = NULL;
+	mutex.unlock();
+}
 
-			// Delete task here or return it with result in private event?
-			//delete task;
-			break;
-		case QUEUE_WATCH_ABANDONED:
-			HAGGLE_DBG("SecurityHelper instructed to exit...\n");
+bool SecurityHelper::addTask(SecurityTask *task)
+{
+	Mutex::AutoLocker l(mutex);
+
+	if (stopped) {
+		delete task;
+		return false;
+	}
+
+	taskQ.push_back(task);
+
+	// Start running the queue, unless a task is already doing it
+	if (!runner) {
+		runner = new SecurityHelperTask(this);
+
+		if (!submitTask(runner)) {
+			HAGGLE_ERR("Could not run security task\n");
+			runner = NULL;
+			taskQ.pop_back();
+			delete task;
 			return false;
-		default:
-			HAGGLE_ERR("Unknown security task queue return value\n");
 		}
 	}
-	return false;
+	return true;
 }
 
-void SecurityHelper::cleanup()
+void SecurityHelper::stopTasks()
 {
+	TaskRef task;
+
+	mutex.lock();
+	stopped = true;
+	task = runner;
+	mutex.unlock();
+
+	// The running task returns after the security task it is doing
+	if (task && !task->cancel())
+		task.unlocked()->wait();
+
+	Mutex::AutoLocker l(mutex);
+
 	while (!taskQ.empty()) {
-		SecurityTask *task = NULL;
-		taskQ.retrieve(&task);
-		delete task;
+		delete taskQ.front();
+		taskQ.pop_front();
 	}
 }
 
@@ -471,8 +500,8 @@ bool SecurityManager::init_derived()
 	
 	helper = new SecurityHelper(this, etype);
 
-	if (!helper || !helper->start()) {
-		HAGGLE_ERR("Could not create or start security helper\n");
+	if (!helper) {
+		HAGGLE_ERR("Could not create security helper\n");
 		return false;
 	}
 
@@ -510,7 +539,7 @@ void SecurityManager::onShutdown()
 {
 	if (helper) {
 		HAGGLE_DBG("Stopping security helper...\n");
-		helper->stop();
+		helper->stopTasks();
 	}
 	unregisterWithKernel();
 }
@@ -634,7 +663,7 @@ void SecurityManager::printCertificates()
 #endif
 	
 /*
- This function is called after the SecurityHelper thread finished a task.
+ This function is called after the SecurityHelper finished a task.
  The Security manager may act on any of the results if it wishes.
  
  */
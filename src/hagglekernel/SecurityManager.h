@@ -25,7 +25,7 @@
 #include <libcpphaggle/List.h>
 #include <libcpphaggle/HashMap.h>
 #include <libcpphaggle/Mutex.h>
-#include <libcpphaggle/GenericQueue.h>
+#include <libcpphaggle/Executor.h>
 
 using namespace haggle;
 
@@ -67,20 +67,33 @@ public:
         ~SecurityTask();
 };
 
+/*
+	The security helper runs its tasks on the kernel's executor. The
+	tasks run one at a time, in the order they were added, since the
+	verification of a data object may need a certificate stored by an
+	earlier task.
+*/
 class SecurityHelper : public ManagerModule<SecurityManager> {
 	friend class SecurityManager;
-	GenericQueue<SecurityTask *> taskQ;
+	friend class SecurityHelperTask;
+	List<SecurityTask *> taskQ;
+	TaskRef runner; // The executor task that runs the queued tasks, if any
+	bool stopped;
 	const EventType etype;
 	bool signDataObject(DataObjectRef& dObj, RSA *key);
 	bool verifyDataObject(DataObjectRef& dObj, CertificateRef& cert) const;
 	void doTask(SecurityTask *task);
-	bool run();
-        void cleanup();
+	void doTasks();
 public:
 	SecurityHelper(SecurityManager *m, const EventType _etype);
 	~SecurityHelper();
 
-	bool addTask(SecurityTask *task) { return taskQ.insert(task); }
+	bool addTask(SecurityTask *task);
+	/**
+		Waits for the task being run, and deletes the tasks that
+		have not yet run. Tasks added later are deleted directly.
+	*/
+	void stopTasks();
 };
 
 class SecurityManager : public Manager {
@@ -23,6 +23,7 @@
 #include "DebugManager.h"
 #include "HaggleKernel.h"
 #include "SQLDataStore.h"
+#include "MemoryDataStore.h"
 #include "DataManager.h"
 #include "NodeManager.h"
 #include "ProtocolManager.h"
@@ -63,6 +64,7 @@ HaggleKernel *kernel;
 static bool shouldCleanupPidFile = true;
 static bool setCreateTimeOnBloomfilterUpdate = false;
 static bool recreateDataStore = false;
+static bool useMemoryDataStore = false;
 static bool runAsInteractive = true;
 static SecurityLevel_t securityLevel = SECURITY_LEVEL_MEDIUM;
 /* Command line options variables. */
@@ -74,6 +76,7 @@ static unsigned int Benchmark_Nodes_Attr = 100;
 static unsigned int Benchmark_Attr_Num = 1000;
 static unsigned int Benchmark_DataObjects_Num = 10000;
 static unsigned int Benchmark_Test_Num = 100;
+static unsigned int Benchmark_Wildcard_Num = 0;
 #endif /* BENCHMARK */
 
 #if defined(OS_UNIX) && !defined(OS_ANDROID)
@@ -461,7 +464,14 @@ int run_haggle()
         /* Seed the random number generator */
 	prng_init();
 
-        kernel = new HaggleKernel(new SQLDataStore(recreateDataStore));
+	DataStore *ds;
+
+	if (useMemoryDataStore)
+		ds = new MemoryDataStore(recreateDataStore);
+	else
+		ds = new SQLDataStore(recreateDataStore);
+
+	kernel = new HaggleKernel(ds);
 
 	if (!kernel || !kernel->init()) {
 		fprintf(stderr, "Kernel initialization error!\n");
@@ -553,7 +563,7 @@ int run_haggle()
 
 #ifdef BENCHMARK
 	} else {
-		bm = new BenchmarkManager(kernel, Benchmark_DataObjects_Attr, Benchmark_Nodes_Attr, Benchmark_Attr_Num, Benchmark_DataObjects_Num, Benchmark_Test_Num);
+		bm = new BenchmarkManager(kernel, Benchmark_DataObjects_Attr, Benchmark_Nodes_Attr, Benchmark_Attr_Num, Benchmark_DataObjects_Num, Benchmark_Test_Num, Benchmark_Wildcard_Num);
 
 		if (!bm || !bm->init()) {
 			HAGGLE_ERR("Could not initialize benchmark manager\n");
@@ -635,14 +645,15 @@ static struct {
 	{ "-d", "--daemonize", "run in the background as a daemon." },
 	{ "-f", "--filelog", "write debug output to a file (haggle.log)." },
 	{ "-c", "--create-time-bloomfilter", "set create time in node description on bloomfilter update." },
-	{ "-s", "--security-level", "set security level 0-2 (low, medium, high)" }
+	{ "-s", "--security-level", "set security level 0-2 (low, medium, high)" },
+	{ "-m", "--memory-datastore", "keep the data store in memory (snapshot to disk at shutdown)." }
 };
 
 static void print_help()
 {	
 	unsigned int i;
 	
-	printf("Usage: ./haggle -[hbdfIcs{dd}]\n");
+	printf("Usage: ./haggle -[hbdfIcsm{dd}]\n");
 	
 	for (i = 0; i < sizeof(cmd) / (3*sizeof(char *)); i++) {
 		printf("\t%-4s %-20s %s\n", cmd[i].cmd_short, cmd[i].cmd_long, cmd[i].cmd_desc);
@@ -723,7 +734,7 @@ int main(void)
 			if (!(argv[1] && argv[2] && argv[3] && argv[4]
 			      && argv[5])) {
 				fprintf(stderr, "Bad number of arguments for benchmark option...\n");
-				fprintf(stderr, "usage: -b doAttr nodeAttr numAttr numDataObject numNode\n");
+				fprintf(stderr, "usage: -b doAttr nodeAttr numAttr numDataObject numNode [numWildcard]\n");
 				return -1;
 			}
 			printf("Haggle benchmarking...\n");
@@ -733,6 +744,11 @@ int main(void)
 			Benchmark_Attr_Num = atoi(argv[3]);
 			Benchmark_DataObjects_Num = atoi(argv[4]);
 			Benchmark_Test_Num = atoi(argv[5]);
+			
+			// The wildcard count is optional, and only read if it is a number
+			if (argc > 6 && argv[6][0] != '\0' &&
+			    strspn(argv[6], "0123456789") == strlen(argv[6]))
+				Benchmark_Wildcard_Num = atoi(argv[6]);
 #else
 			fprintf(stderr, "-b: Unsupported: no benchmarking compiled in!\n");
 			return EXIT_FAILURE;
@@ -755,6 +771,8 @@ int main(void)
                         securityLevel = static_cast<SecurityLevel_t>(atoi(argv[1]));
 			argv++;
 			argc--;
+		} else if (check_cmd(argv[0], 8)) {
+			useMemoryDataStore = true;
 		} else {
 			fprintf(stderr, "Unknown command line option: %s\n", argv[0]);
 			print_help();
@@ -7,6 +7,8 @@ ifneq ($(TARGET_SIMULATOR),true)
 LOCAL_SRC_FILES := \
 	String.cpp \
 	Heap.cpp \
+	TimerWheel.cpp \
+	Executor.cpp \
 	Thread.cpp \
 	Timeval.cpp \
 	Watch.cpp \
@@ -0,0 +1,489 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+
+#include <libcpphaggle/Executor.h>
+#include <libcpphaggle/Atomic.h>
+
+#include <haggleutils.h>
+
+namespace haggle {
+
+Task::Task() : state(TASK_STATE_PENDING), submitted(false)
+{
+}
+
+Task::~Task()
+{
+}
+
+bool Task::begin()
+{
+	Mutex::AutoLocker l(mutex);
+
+	if (state != TASK_STATE_PENDING)
+		return false;
+
+	state = TASK_STATE_RUNNING;
+
+	return true;
+}
+
+void Task::finish(int _state)
+{
+	Mutex::AutoLocker l(mutex);
+
+	state = _state;
+	cond.broadcast();
+}
+
+bool Task::cancel()
+{
+	Mutex::AutoLocker l(mutex);
+
+	if (state != TASK_STATE_PENDING)
+		return false;
+
+	state = TASK_STATE_CANCELLED;
+	cond.broadcast();
+
+	return true;
+}
+
+bool Task::isDone() const
+{
+	Mutex::AutoLocker l(mutex);
+
+	return state == TASK_STATE_DONE || state == TASK_STATE_CANCELLED;
+}
+
+bool Task::isCancelled() const
+{
+	Mutex::AutoLocker l(mutex);
+
+	return state == TASK_STATE_CANCELLED;
+}
+
+bool Task::wait(long msecs) const
+{
+	Mutex::AutoLocker l(mutex);
+	Timeval deadline = Timeval::now() + Timeval(msecs / 1000, (msecs % 1000) * 1000);
+
+	while (state == TASK_STATE_PENDING || state == TASK_STATE_RUNNING) {
+		if (msecs < 0) {
+			cond.wait(&mutex);
+		} else {
+			Timeval now = Timeval::now();
+
+			if (now >= deadline)
+				return false;
+
+			cond.timedWait(&mutex, (deadline - now).getTimevalStruct());
+		}
+	}
+	return true;
+}
+
+/*
+	A worker has two queues. Tasks that its own tasks submit are run
+	the most recent first, as they often work on the same data as the
+	task that submitted them, while tasks submitted from other threads
+	are run in the order they came. A worker first runs its own
+	tasks, then the submitted ones, and steals the oldest task of
+	another worker when it has none. The queues and the statistics
+	are protected by the runnable's mutex, while the sleeping state
+	is protected by the executor's mutex.
+*/
+class ExecutorWorker : public Runnable
+{
+	friend class Executor;
+	Executor *ex;
+	const unsigned int index;
+	ThreadId id;
+	List<TaskRef> local;
+	List<TaskRef> submitted;
+	bool sleeping;
+	unsigned long tasksRun;
+	unsigned long tasksStolen;
+	Timeval busyTime;
+	Timeval idleTime;
+	Timeval startTime;
+	Timeval stopTime;
+	TaskRef pop();
+	void sleep();
+	void runTask(TaskRef& task, bool stolen);
+	bool run();
+	void cleanup();
+	void hookCancel();
+public:
+	ExecutorWorker(Executor *_ex, unsigned int _index, const string _name) :
+		Runnable(_name), ex(_ex), index(_index), sleeping(false),
+		tasksRun(0), tasksStolen(0) {}
+	~ExecutorWorker() {}
+	void push(const TaskRef& task, bool fromSelf);
+	TaskRef steal();
+	void getStats(Executor::WorkerStats& stats);
+};
+
+void ExecutorWorker::push(const TaskRef& task, bool fromSelf)
+{
+	Mutex::AutoLocker l(mutex);
+
+	if (fromSelf)
+		local.push_back(task);
+	else
+		submitted.push_back(task);
+}
+
+TaskRef ExecutorWorker::pop()
+{
+	Mutex::AutoLocker l(mutex);
+	TaskRef task;
+
+	if (!local.empty()) {
+		task = local.back();
+		local.pop_back();
+	} else if (!submitted.empty()) {
+		task = submitted.front();
+		submitted.pop_front();
+	} else {
+		return task;
+	}
+	atomic_dec(&ex->numPending);
+
+	return task;
+}
+
+TaskRef ExecutorWorker::steal()
+{
+	Mutex::AutoLocker l(mutex);
+	TaskRef task;
+
+	if (!submitted.empty()) {
+		task = submitted.front();
+		submitted.pop_front();
+	} else if (!local.empty()) {
+		task = local.front();
+		local.pop_front();
+	} else {
+		return task;
+	}
+	atomic_dec(&ex->numPending);
+
+	return task;
+}
+
+void ExecutorWorker::runTask(TaskRef& task, bool stolen)
+{
+	Task *t = task.getObj();
+	Timeval start = Timeval::now();
+
+	/*
+	  The task is not locked while it runs, as the submitter may be
+	  waiting on it.
+	 */
+	if (!t->begin())
+		return;
+
+	t->run();
+
+	// Count the task before anyone waiting for it may read the statistics
+	mutex.lock();
+	tasksRun++;
+
+	if (stolen)
+		tasksStolen++;
+
+	busyTime += Timeval::now() - start;
+	mutex.unlock();
+
+	t->finish(TASK_STATE_DONE);
+}
+
+void ExecutorWorker::sleep()
+{
+	Timeval start;
+	bool slept = false;
+
+	ex->mutex.lock();
+
+	sleeping = true;
+	atomic_inc(&ex->numSleeping);
+
+	/*
+	  A submitter queues its task before it checks for sleeping
+	  workers, so either it finds this worker sleeping, or the task
+	  is counted here.
+	 */
+	if (ex->numPending == 0 && !shouldExit()) {
+		start = Timeval::now();
+		slept = true;
+
+		while (sleeping)
+			cond.wait(&ex->mutex);
+	}
+	if (sleeping) {
+		sleeping = false;
+		atomic_dec(&ex->numSleeping);
+	}
+	ex->mutex.unlock();
+
+	if (slept) {
+		Mutex::AutoLocker l(mutex);
+
+		idleTime += Timeval::now() - start;
+	}
+}
+
+bool ExecutorWorker::run()
+{
+	TaskRef task;
+	bool stolen = false;
+
+	// Lets tasks submitted from this thread go to its own queue
+	if (!(id == Thread::selfGetId()))
+		id.setToCurrentThread();
+
+	task = pop();
+
+	if (!task) {
+		task = ex->steal(this);
+		stolen = task;
+	}
+
+	if (task)
+		runTask(task, stolen);
+	else
+		sleep();
+
+	return !shouldExit();
+}
+
+void ExecutorWorker::cleanup()
+{
+	Mutex::AutoLocker l(mutex);
+
+	stopTime = Timeval::now();
+}
+
+void ExecutorWorker::hookCancel()
+{
+	Mutex::AutoLocker l(ex->mutex);
+
+	if (sleeping) {
+		sleeping = false;
+		atomic_dec(&ex->numSleeping);
+		cond.signal();
+	}
+}
+
+void ExecutorWorker::getStats(Executor::WorkerStats& stats)
+{
+	Mutex::AutoLocker l(mutex);
+	Timeval end = stopTime > startTime ? stopTime : Timeval::now();
+
+	stats.tasksRun = tasksRun;
+	stats.tasksStolen = tasksStolen;
+	stats.busyTime = busyTime;
+	stats.idleTime = idleTime;
+	stats.lifetime = startTime > Timeval() ? end - startTime : Timeval();
+	stats.utilization = 0;
+
+	if (stats.lifetime.getTimeAsMilliSeconds() > 0)
+		stats.utilization = busyTime.getTimeAsSecondsDouble() / stats.lifetime.getTimeAsSecondsDouble();
+}
+
+Executor::Executor(const string _name, unsigned int _numWorkers) :
+	name(_name), workers(NULL), numWorkers(_numWorkers), running(false),
+	numPending(0), numSleeping(0), nextWorker(0)
+{
+	char workerName[100];
+
+	if (numWorkers == 0)
+		numWorkers = 1;
+	else if (numWorkers > EXECUTOR_MAX_WORKERS)
+		numWorkers = EXECUTOR_MAX_WORKERS;
+
+	workers = new ExecutorWorker *[numWorkers];
+
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		snprintf(workerName, sizeof(workerName), "%s:%u", name.c_str(), i);
+		workers[i] = new ExecutorWorker(this, i, workerName);
+	}
+}
+
+Executor::~Executor()
+{
+	stop();
+
+	for (unsigned int i = 0; i < numWorkers; i++)
+		delete workers[i];
+
+	delete [] workers;
+}
+
+bool Executor::start()
+{
+	mutex.lock();
+
+	if (running) {
+		mutex.unlock();
+		return false;
+	}
+	running = true;
+	mutex.unlock();
+
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		ExecutorWorker *w = workers[i];
+
+		w->startTime = Timeval::now();
+
+		if (!w->start()) {
+			TRACE_ERR("Could not start worker %s\n", w->getName());
+			stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Executor::stop()
+{
+	mutex.lock();
+
+	if (!running) {
+		mutex.unlock();
+		return;
+	}
+	running = false;
+	mutex.unlock();
+
+	// Running tasks finish before the workers exit
+	for (unsigned int i = 0; i < numWorkers; i++)
+		workers[i]->stop();
+
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		TaskRef task;
+
+		while ((task = workers[i]->steal()))
+			task.getObj()->cancel();
+	}
+}
+
+ExecutorWorker *Executor::selfGetWorker() const
+{
+	ThreadId self = Thread::selfGetId();
+
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		if (workers[i]->id == self)
+			return workers[i];
+	}
+	return NULL;
+}
+
+void Executor::wakeWorker(ExecutorWorker *preferred)
+{
+	Mutex::AutoLocker l(mutex);
+	ExecutorWorker *w = NULL;
+
+	if (preferred->sleeping) {
+		w = preferred;
+	} else {
+		for (unsigned int i = 0; i < numWorkers; i++) {
+			if (workers[i]->sleeping) {
+				w = workers[i];
+				break;
+			}
+		}
+	}
+
+	if (w) {
+		w->sleeping = false;
+		atomic_dec(&numSleeping);
+		w->cond.signal();
+	}
+}
+
+TaskRef Executor::steal(ExecutorWorker *thief)
+{
+	TaskRef task;
+
+	for (unsigned int i = 1; i < numWorkers && !task; i++)
+		task = workers[(thief->index + i) % numWorkers]->steal();
+
+	return task;
+}
+
+bool Executor::submit(const TaskRef& task)
+{
+	ExecutorWorker *w;
+
+	if (!task)
+		return false;
+
+	Task *t = const_cast<Task *>(task.getObj());
+
+	/*
+	  The task is queued in the same critical section as the check
+	  that the executor is running. Otherwise stop() could cancel the
+	  queued tasks before this one is queued, and it would never run.
+	 */
+	mutex.lock();
+
+	if (!running) {
+		mutex.unlock();
+		return false;
+	}
+
+	t->mutex.lock();
+
+	if (t->submitted || t->state != TASK_STATE_PENDING) {
+		t->mutex.unlock();
+		mutex.unlock();
+		return false;
+	}
+	t->submitted = true;
+	t->mutex.unlock();
+
+	w = selfGetWorker();
+
+	if (w) {
+		w->push(task, true);
+	} else {
+		w = workers[(unsigned long)atomic_inc(&nextWorker) % numWorkers];
+		w->push(task, false);
+	}
+	atomic_inc(&numPending);
+
+	mutex.unlock();
+
+	if (numSleeping > 0)
+		wakeWorker(w);
+
+	return true;
+}
+
+bool Executor::getWorkerStats(unsigned int worker, WorkerStats& stats) const
+{
+	if (worker >= numWorkers)
+		return false;
+
+	workers[worker]->getStats(stats);
+
+	return true;
+}
+
+}; // namespace haggle
@@ -160,6 +160,36 @@ HeapItem *Heap::extractFirst(void)
 	return max;
 }
 
+bool Heap::remove(HeapItem *item)
+{
+	unsigned long i, parent;
+
+	if (!item || item->index >= _size || heap[item->index] != item)
+		return false;
+
+	i = item->index;
+	item->index = HeapItem::npos;
+	_size--;
+
+	if (i == _size)
+		return true;
+
+	/* move the last item into the hole, and then up or down */
+	item = heap[_size];
+	parent = (i - 1) / 2;
+
+	while ((i > 0) && (*heap[parent] > *item)) {
+		heap[i] = heap[parent];
+		heap[i]->index = i;
+		i = parent;
+		parent = (i - 1) / 2;
+	}
+	heap[i] = item;
+	item->index = i;
+	heapify(i);
+
+	return true;
+}
 	
 bool operator< (const HeapItem& i1, const HeapItem& i2)
 {
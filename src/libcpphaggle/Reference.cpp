@@ -18,36 +18,66 @@ namespace haggle {
 
 HashMap<void *, RefCounter *> RefCounter::objects;
 Mutex RefCounter::objectsMutex;
-unsigned long RefCounter::totNum = 0;
+volatile long RefCounter::totNum = 0;
 
 RefCounter::RefCounter(void *_obj) : 
-	countMutex(),
 	refcount(1),
+	intrusive(false),
 	objectMutex(),
 	obj(_obj), 
-	identifier(totNum++)
+	identifier(atomic_inc(&totNum) - 1)
 {
-	objects.insert(RefcountPair(obj, this));
+	objects.insert(RefcountPair(_obj, this));
 }
 
-RefCounter *RefCounter::create(void *_obj)
+RefCounter::RefCounter() : 
+	refcount(0),
+	intrusive(true),
+	objectMutex(),
+	obj(NULL), 
+	identifier(atomic_inc(&totNum) - 1)
+{
+}
+
+RefCounter *RefCounter::create(void *_key, void *_obj)
 {
-	Mutex::AutoLocker l(objectsMutex);
 	RefCounter *refCount;
 	// NULL is ok, but we don't need a RefCounter to it.
 	if (!_obj)
 		return NULL;
 	
-	RefcountMap::iterator it = objects.find(_obj);
+	Mutex::AutoLocker l(objectsMutex);
+	RefcountMap::iterator it = objects.find(_key);
 	
 	if (it != objects.end()) {
 		refCount = (RefCounter *) (*it).second;
-		if (refCount->inc_count() == 0)
+		if (refCount->inc_count_if_alive() == 0)
 			return NULL;
 		return refCount;
 	}
 	return new RefCounter(_obj);
 }
+
+RefCounter *RefCounter::create(RefCounted *_key, void *_obj)
+{
+	if (!_key)
+		return NULL;
+
+	RefCounter *refCount = &_key->refCounter;
+	
+	/*
+	  Set the object before taking the reference, so that every thread
+	  holding a reference finds it set. The object is only set once, 
+	  and threads racing to set it all set the same pointer.
+	 */
+	if (!refCount->obj)
+		atomic_cas_ptr(&refCount->obj, NULL, _obj);
+
+	if (refCount->inc_count_if_alive() == 0)
+		return NULL;
+
+	return refCount;
+}
 /**
     Destructor.
 */
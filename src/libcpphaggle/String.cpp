@@ -16,25 +16,125 @@
 #if !defined(ENABLE_STL)
 #include <string.h>
 #include <stdlib.h>
+#include <libcpphaggle/Mutex.h>
+#include <libcpphaggle/HashMap.h>
 
 namespace haggle {
 
 char String::nullchar = '\0';
 
+/*
+	The table of interned strings, which is an open addressing hash
+	table of the interned strings' storage. The storage is never
+	freed, so the strings can be read without holding the lock.
+*/
+static Mutex intern_mutex;
+static char **intern_table = NULL;
+static size_t intern_table_size = 0;
+static size_t intern_num = 0;
+static size_t intern_bytes = 0;
+
+/*
+	Returns the interned storage for a string, adding it to the
+	table if necessary, or NULL if the table is full.
+*/
+static char *intern_lookup(const char *str, size_t len)
+{
+	Mutex::AutoLocker l(intern_mutex);
+	size_t i;
+
+	if (intern_num * 2 >= intern_table_size) {
+		// Keep the table at most half full
+		size_t new_size = intern_table_size ? intern_table_size * 2 : 64;
+		char **new_table;
+
+		if (intern_num >= STRING_INTERN_MAX)
+			goto lookup;
+
+		new_table = (char **)calloc(new_size, sizeof(char *));
+
+		if (!new_table)
+			goto lookup;
+
+		for (i = 0; i < intern_table_size; i++) {
+			char *rec = intern_table[i];
+
+			if (rec) {
+				size_t j = hash_bytes(rec, strlen(rec)) & (new_size - 1);
+
+				while (new_table[j])
+					j = (j + 1) & (new_size - 1);
+
+				new_table[j] = rec;
+			}
+		}
+		free(intern_table);
+		intern_table = new_table;
+		intern_table_size = new_size;
+	}
+lookup:
+	if (!intern_table)
+		return NULL;
+
+	i = hash_bytes(str, len) & (intern_table_size - 1);
+
+	while (intern_table[i]) {
+		if (strcmp(intern_table[i], str) == 0)
+			return intern_table[i];
+
+		i = (i + 1) & (intern_table_size - 1);
+	}
+
+	if (intern_num >= STRING_INTERN_MAX || intern_bytes + len + 1 > STRING_INTERN_MAX_BYTES)
+		return NULL;
+
+	intern_table[i] = (char *)malloc(len + 1);
+
+	if (!intern_table[i])
+		return NULL;
+
+	memcpy(intern_table[i], str, len + 1);
+	intern_num++;
+	intern_bytes += len + 1;
+
+	return intern_table[i];
+}
+
+/*
+	Makes sure the string owns a buffer of at least len bytes, which
+	is zeroed after the end of the string. If the string shares its
+	storage, the contents are copied.
+*/
 char *String::alloc(size_t len)
 {
         char *tmp;
+	size_t cap = s == buf ? STRING_INLINE_SIZE : alloc_len;
 
-        if (len <= alloc_len || len == 0)
+        if (len <= cap || len == 0)
                 return s;
 
-        // If alloc_len is 0, then s points to the static nullchar.
-        // Therefore, we must reset the s pointer to NULL first,
-        // so that realloc does not try to free it.
-        if (alloc_len == 0)
-                s = NULL;
+	if (len <= STRING_INLINE_SIZE) {
+		// Only a string that shares its storage gets here,
+		// since the others have at least the inline buffer
+		memcpy(buf, s, slen);
+		memset(buf + slen, 0, STRING_INLINE_SIZE - slen);
+		s = buf;
+		return s;
+	}
+
+	// Grow at least twofold when the string gets longer, so that
+	// appending piece by piece does not copy all the time
+	if (slen && len < cap * 2)
+		len = cap * 2;
+
+	if (s != buf && alloc_len) {
+		tmp = (char *)realloc(s, len);
+	} else {
+		tmp = (char *)malloc(len);
 
-        tmp = (char *)realloc(s, len);
+		if (tmp)
+			memcpy(tmp, s, slen);
+	}
         
         if (tmp) {
                 s = tmp;
@@ -48,8 +148,20 @@ char *String::alloc(size_t len)
         return tmp;
 }
 
+/*
+	Frees any storage the string owns, and makes it empty.
+*/
+void String::release()
+{
+	if (s != buf && alloc_len)
+		free(s);
 
-String::String(const char *_s, size_t n) : s(&nullchar), alloc_len(0), slen(0)
+	s = &nullchar;
+	slen = 0;
+	alloc_len = 0;
+}
+
+String::String(const char *_s, size_t n) : s(&nullchar), slen(0), alloc_len(0)
 {
 	if (!_s)
 		return;
@@ -59,44 +171,79 @@ String::String(const char *_s, size_t n) : s(&nullchar), alloc_len(0), slen(0)
 	if (n > len)
 		n = len;
 
-	if (alloc(n + 1)) {
-                strncpy(s, _s, n);
+	if (n && alloc(n + 1)) {
+                memcpy(s, _s, n);
                 slen = n;
         }
 }
 
-String::String(const char *_s) : s(&nullchar), alloc_len(0), slen(0)
+String::String(const char *_s) : s(&nullchar), slen(0), alloc_len(0)
 {
-	if (_s && alloc(strlen(_s) + 1)) {
-                strcpy(s, _s);
-                slen = strlen(s);
+	if (!_s)
+		return;
+
+	size_t len = strlen(_s);
+
+	if (len && alloc(len + 1)) {
+                memcpy(s, _s, len + 1);
+                slen = len;
         }
 }
 
-String::String(const String& str) : s(&nullchar), alloc_len(0), slen(0)
+String::String(const String& str) : s(&nullchar), slen(0), alloc_len(0)
 {
-	if (alloc(str.slen + 1)) {
-		strcpy(s, str.s);
+	if (str.isInterned()) {
+		s = str.s;
+		slen = str.slen;
+	} else if (str.slen && alloc(str.slen + 1)) {
+		memcpy(s, str.s, str.slen + 1);
                 slen = str.slen;
         }
 }
 
-String::String(const char c) : s(&nullchar), alloc_len(0), slen(0)
+String::String(const char c) : s(&nullchar), slen(0), alloc_len(0)
 {
 	if (c != '\0' && alloc(2)) {
                 s[0] = c;
                 s[1] = '\0';
                 slen = 1;
-	} else if (alloc(1)) {
-		s[0] = '\0';
-		slen = 0;
 	}
 }
 
 String::~String() 
 {
-        if (alloc_len) 
-                free(s);
+	release();
+}
+
+String& String::intern()
+{
+	if (isInterned())
+		return *this;
+
+	if (slen == 0) {
+		// All empty strings share the null character
+		release();
+		return *this;
+	}
+
+	size_t len = slen;
+
+	if (len > STRING_INTERN_MAX_LEN)
+		return *this;
+
+	char *shared = intern_lookup(s, len);
+
+	if (shared) {
+		release();
+		s = shared;
+		slen = len;
+	}
+	return *this;
+}
+
+bool String::isInterned() const
+{
+	return s != buf && alloc_len == 0;
 }
 
 const char* String::c_str () const
@@ -116,7 +263,9 @@ size_t String::size() const
 
 void String::clear()
 {
-        if (slen) {
+	if (isInterned()) {
+		release();
+	} else if (slen) {
                 s[0] = '\0';
                 slen = 0;
         }
@@ -143,6 +292,10 @@ const char& String::at(size_t pos) const
 
 char& String::at(size_t pos)
 {
+	 // The caller may write to the character
+	 if (isInterned() && slen)
+		 alloc(slen + 1);
+
          if (s && slen <= pos)
                  return s[pos];
 
@@ -165,9 +318,13 @@ String String::substr(size_t pos, size_t n) const
 
 String& String::append(const String& str)
 {
-        if (str.slen && alloc(slen + str.slen + 1)) {
-                strcpy(s + slen, str.s);
-                slen += str.slen;
+        size_t len = str.slen;
+
+        if (len && alloc(slen + len + 1)) {
+                // The string may be appended to itself
+                memmove(s + slen, str.s, len);
+                slen += len;
+                s[slen] = '\0';
         }
 
         return *this;
@@ -179,8 +336,9 @@ String& String::append(const String& str, size_t pos, size_t n)
                 return *this;
 
         if (alloc(slen + n + 1)) {
-                strncpy(s + slen, str.s + pos, n);
+                memcpy(s + slen, str.s + pos, n);
                 slen += n;
+                s[slen] = '\0';
         }
 
         return *this;
@@ -191,9 +349,14 @@ String& String::append(const char* _s, size_t n)
         if (n == 0 || !_s || n > strlen(_s))
                 return *this;
 
+        // Growing the buffer may move a part of the string itself
+        if (_s >= s && _s <= s + slen)
+                return append(String(_s, n));
+
         if (alloc(slen + n + 1)) {
-                strncpy(s + slen, _s, n);
+                memcpy(s + slen, _s, n);
                 slen += n;
+                s[slen] = '\0';
         }
 
         return *this;
@@ -204,10 +367,7 @@ String& String::append(const char* _s)
         if (!_s || strlen(_s) == 0)
                 return *this;
 
-        if (alloc(slen + strlen(_s) + 1)) {
-                strcpy(s + slen, _s);
-                slen += strlen(_s);
-        }
+        return append(_s, strlen(_s));
 
         return *this;
 }
@@ -390,6 +550,9 @@ String& String::erase(size_t pos, size_t n)
 	if (pos >= slen)
 		return *this;
 
+	if (isInterned() && !alloc(slen + 1))
+		return *this;
+
 	if (n == npos || pos + n > slen) {
                 s[pos] = '\0';
                 slen -= (slen - pos);
@@ -399,7 +562,7 @@ String& String::erase(size_t pos, size_t n)
 	long cplen = slen - pos - n;
 
 	if (cplen > 0)
-		strncpy(s + pos, s + pos + n, cplen);
+		memmove(s + pos, s + pos + n, cplen);
 
 	slen -= n;
         s[slen] = '\0';
@@ -410,8 +573,20 @@ String& String::erase(size_t pos, size_t n)
 // operators
 String& String::operator=(const string& str)
 {
+	if (this == &str)
+		return *this;
+
+	if (str.isInterned()) {
+		release();
+		s = str.s;
+		slen = str.slen;
+		return *this;
+	}
+	if (isInterned())
+		release();
+
         if (alloc(str.slen + 1)) {
-                strcpy(s, str.s);
+                memcpy(s, str.s, str.slen + 1);
                 slen = str.slen;
         }
 
@@ -420,15 +595,32 @@ String& String::operator=(const string& str)
 
 String& String::operator=(const char* _s)
 {
-        if (_s && alloc(strlen(_s) + 1)) {
-                strcpy(s, _s);
-                slen = strlen(s);
+	if (!_s)
+		return *this;
+
+	size_t len = strlen(_s);
+
+	if (!isInterned() && _s >= s && _s <= s + slen) {
+		// Assigning a part of the string itself
+		memmove(s, _s, len + 1);
+		slen = len;
+		return *this;
+	}
+	if (isInterned())
+		release();
+
+        if (alloc(len + 1)) {
+                memcpy(s, _s, len + 1);
+                slen = len;
         }
         return *this;
 }
 
 String& String::operator=(char c)
 {
+	if (isInterned())
+		release();
+
         if (c != '\0' && alloc(2)) {
                 s[0] = c;
                 s[1] = '\0';
@@ -447,6 +639,10 @@ const char& String::operator[](size_t pos) const
 
 char& String::operator[](size_t pos)
 {
+	// The caller may write to the character
+	if (isInterned() && slen)
+		alloc(slen + 1);
+
         return s[pos];
 }
 
@@ -509,6 +705,10 @@ String operator+(const String& lhs, char rhs)
 
 bool operator==(const String& lhs, const String& rhs)
 {
+	// Interned strings with the same contents share storage
+	if (lhs.isInterned() && rhs.isInterned())
+		return lhs.c_str() == rhs.c_str();
+
         return lhs.compare(rhs) == 0;
 }
 
@@ -524,7 +724,7 @@ bool operator==(const String& lhs, const char* rhs)
 
 bool operator!=(const String& lhs, const String& rhs)
 {
-        return lhs.compare(rhs) != 0;
+	return !(lhs == rhs);
 }
 
 bool operator!=(const char* lhs, const String& rhs)
@@ -681,6 +881,15 @@ int main(int argc, char **argv)
 #include <stdarg.h>
 #include <libcpphaggle/PlatformDetect.h>
 
+string& stringintern(string &str)
+{
+#if defined(ENABLE_STL)
+	return str;
+#else
+	return str.intern();
+#endif
+}
+
 #if defined(OS_WINDOWS) || defined(OS_WINDOWS_MOBILE)
 /*
 	The reason this function is here is because windows doesn't have a 
@@ -0,0 +1,300 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include <libcpphaggle/TimerWheel.h>
+
+namespace haggle {
+
+// The number of bits of the tick below the slot index of a level
+#define LEVEL_SHIFT(level) (TIMERWHEEL_LEVEL0_BITS + ((level) - 1) * TIMERWHEEL_LEVELN_BITS)
+
+// The expired items are kept on a list that counts as a level of its own
+#define EXPIRED_LEVEL TIMERWHEEL_NUM_LEVELS
+
+TimerWheelItem::TimerWheelItem() : 
+	wheel(NULL), prev(NULL), next(NULL), slot(NULL), level(0), expires(0)
+{
+}
+
+TimerWheelItem::~TimerWheelItem()
+{
+	if (wheel)
+		wheel->remove(this);
+}
+
+TimerWheel::TimerWheel() : current(0), num(0), numExpired(0), expired(NULL)
+{
+	memset(levelSize, 0, sizeof(levelSize));
+	memset(level0, 0, sizeof(level0));
+	memset(levelN, 0, sizeof(levelN));
+}
+
+TimerWheel::~TimerWheel()
+{
+	// Leave the items to their owners
+	while (extract()) {}
+}
+
+int64_t TimerWheel::toTicks(const Timeval& t, bool roundUp)
+{
+	return (int64_t)t.getSeconds() * 1000 + (t.getMicroSeconds() + (roundUp ? 999 : 0)) / 1000;
+}
+
+void TimerWheel::link(TimerWheelItem *item, TimerWheelItem **slot, int level)
+{
+	item->prev = NULL;
+	item->next = *slot;
+	
+	if (*slot)
+		(*slot)->prev = item;
+	
+	*slot = item;
+	item->slot = slot;
+	item->level = level;
+	
+	if (level == EXPIRED_LEVEL)
+		numExpired++;
+	else
+		levelSize[level]++;
+	num++;
+}
+
+void TimerWheel::unlink(TimerWheelItem *item)
+{
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		*item->slot = item->next;
+	
+	if (item->next)
+		item->next->prev = item->prev;
+	
+	item->prev = item->next = NULL;
+	item->slot = NULL;
+	
+	if (item->level == EXPIRED_LEVEL)
+		numExpired--;
+	else
+		levelSize[item->level]--;
+	num--;
+}
+
+/*
+	Puts an item in the slot for its tick, relative to the current
+	tick. The slot index of a level is taken from the bits of the
+	absolute tick, so that a slot comes up again exactly when the
+	levels below it have wrapped around.
+*/
+void TimerWheel::place(TimerWheelItem *item)
+{
+	int64_t expires = item->expires;
+	int64_t delta = expires - current;
+	int level;
+
+	if (delta < 0) {
+		link(item, &expired, EXPIRED_LEVEL);
+		return;
+	}
+	if (delta < TIMERWHEEL_LEVEL0_SLOTS) {
+		link(item, &level0[expires & (TIMERWHEEL_LEVEL0_SLOTS - 1)], 0);
+		return;
+	}
+	if (delta > TIMERWHEEL_MAX_TICKS) {
+		// Park the item in the last level until it comes within range
+		expires = current + TIMERWHEEL_MAX_TICKS;
+		delta = TIMERWHEEL_MAX_TICKS;
+	}
+	for (level = 1; level < TIMERWHEEL_NUM_LEVELS - 1; level++) {
+		if (delta < ((int64_t)1 << LEVEL_SHIFT(level + 1)))
+			break;
+	}
+	link(item, &levelN[level - 1][(expires >> LEVEL_SHIFT(level)) & (TIMERWHEEL_LEVELN_SLOTS - 1)], level);
+}
+
+/*
+	Moves the items in a slot of a higher level down to the levels
+	below.
+*/
+void TimerWheel::cascade(int level, int index)
+{
+	TimerWheelItem **slot = &levelN[level - 1][index];
+
+	while (*slot) {
+		TimerWheelItem *item = *slot;
+		unlink(item);
+		place(item);
+	}
+}
+
+/*
+	Processes the ticks up to and including the given one, moving the
+	items that expire onto the expired list.
+*/
+void TimerWheel::run(int64_t now)
+{
+	while (current <= now) {
+		int index = (int)(current & (TIMERWHEEL_LEVEL0_SLOTS - 1));
+
+		if (num == numExpired) {
+			// Nothing left in the wheel, so skip ahead
+			current = now + 1;
+			break;
+		}
+		if (index == 0) {
+			/*
+			  The first level has wrapped around. Cascade the
+			  next slot of each level whose lower levels have
+			  all wrapped around.
+			 */
+			for (int level = 1; level < TIMERWHEEL_NUM_LEVELS; level++) {
+				int i = (int)((current >> LEVEL_SHIFT(level)) & (TIMERWHEEL_LEVELN_SLOTS - 1));
+
+				cascade(level, i);
+
+				if (i != 0)
+					break;
+			}
+		} else if (levelSize[0] == 0) {
+			// Nothing expires before the first level wraps around
+			int64_t next = current - index + TIMERWHEEL_LEVEL0_SLOTS;
+
+			if (next > now) {
+				current = now + 1;
+				break;
+			}
+			current = next;
+			continue;
+		}
+		while (level0[index]) {
+			TimerWheelItem *item = level0[index];
+			unlink(item);
+			link(item, &expired, EXPIRED_LEVEL);
+		}
+		current++;
+	}
+}
+
+bool TimerWheel::insert(TimerWheelItem *item, const Timeval& expiry)
+{
+	if (!item)
+		return false;
+
+	if (item->wheel)
+		item->wheel->remove(item);
+
+	// Do not process the ticks that passed while the wheel was empty
+	if (num == 0)
+		current = toTicks(Timeval::now(), false) + 1;
+
+	item->expires = toTicks(expiry, true);
+	item->wheel = this;
+	place(item);
+
+	return true;
+}
+
+bool TimerWheel::remove(TimerWheelItem *item)
+{
+	if (!item || item->wheel != this)
+		return false;
+
+	unlink(item);
+	item->wheel = NULL;
+
+	return true;
+}
+
+TimerWheelItem *TimerWheel::expire(const Timeval& now)
+{
+	TimerWheelItem *item;
+
+	if (!expired)
+		run(toTicks(now, false));
+
+	item = expired;
+
+	if (item)
+		remove(item);
+
+	return item;
+}
+
+TimerWheelItem *TimerWheel::extract()
+{
+	TimerWheelItem *item = expired;
+	int level, i;
+
+	for (i = 0; !item && levelSize[0] && i < TIMERWHEEL_LEVEL0_SLOTS; i++)
+		item = level0[i];
+
+	for (level = 1; !item && level < TIMERWHEEL_NUM_LEVELS; level++) {
+		for (i = 0; levelSize[level] && i < TIMERWHEEL_LEVELN_SLOTS; i++) {
+			if (levelN[level - 1][i]) {
+				item = levelN[level - 1][i];
+				break;
+			}
+		}
+	}
+	if (item)
+		remove(item);
+
+	return item;
+}
+
+bool TimerWheel::getNextExpiry(Timeval& tv) const
+{
+	int64_t next = -1;
+	int level, i;
+
+	if (num == 0)
+		return false;
+
+	if (numExpired) {
+		next = current - 1;
+	} else {
+		// The first level is exact, so the first non-empty slot is it
+		for (i = 0; levelSize[0] && i < TIMERWHEEL_LEVEL0_SLOTS; i++) {
+			if (level0[(current + i) & (TIMERWHEEL_LEVEL0_SLOTS - 1)]) {
+				next = current + i;
+				break;
+			}
+		}
+		/*
+		  A slot in a higher level comes up the first time the
+		  levels below it have wrapped around and the bits of the
+		  level equal the slot index.
+		 */
+		for (level = 1; level < TIMERWHEEL_NUM_LEVELS; level++) {
+			int shift = LEVEL_SHIFT(level);
+			int64_t start = (current + ((int64_t)1 << shift) - 1) >> shift;
+
+			for (i = 0; levelSize[level] && i < TIMERWHEEL_LEVELN_SLOTS; i++) {
+				if (levelN[level - 1][(start + i) & (TIMERWHEEL_LEVELN_SLOTS - 1)]) {
+					int64_t t = (start + i) << shift;
+
+					if (next < 0 || t < next)
+						next = t;
+					break;
+				}
+			}
+		}
+	}
+	tv.set((long)(next / 1000), (long)(next % 1000) * 1000);
+
+	return true;
+}
+
+}; // namespace haggle
@@ -235,16 +235,20 @@ HANDLE Watchable::getHandle() const
 }
 #endif
 
-Watch::Watch() : numObjects(0), timeoutValid(false), s(Thread::selfGetExitSignal())
+Watch::Watch() : numObjects(0), numRemoved(0), maxObjects(0), timeoutValid(false), s(Thread::selfGetExitSignal())
 {
-	int i;
-
-	for (i = 0; i < WATCH_MAX_NUM_OBJECTS; i++) {
-		objectIsSet[i] = 0;
-#if defined (OS_WINDOWS)
-		waitSockets[i].isValid = false;
+#if defined(OS_WINDOWS)
+	waitSockets = NULL;
+#elif defined(WATCH_USE_EPOLL)
+	epollfd = -1;
+	epollDisabled = false;
+	hasWaited = false;
+	epollEvents = NULL;
 #endif
-	}
+	objects = NULL;
+	objectStates = NULL;
+	objectIsSet = NULL;
+
 	// We retreive the cancel event, such that we can wait on it
 	// and cancel in case someone cancels the thread.
 	if (s) {
@@ -255,41 +259,293 @@ Watch::Watch() : numObjects(0), timeoutValid(false), s(Thread::selfGetExitSignal
 Watch::~Watch(void)
 {
 	clear();
+#if defined(OS_WINDOWS)
+	free(waitSockets);
+#elif defined(WATCH_USE_EPOLL)
+	free(epollEvents);
+#endif
+	free(objects);
+	free(objectStates);
+	free(objectIsSet);
+}
+
+/*
+	Double the number of slots. The arrays are reallocated one by one,
+	so that they are all still valid, although some may be larger than
+	needed, if one of the allocations fails.
+*/
+bool Watch::grow()
+{
+	int n = maxObjects ? maxObjects * 2 : WATCH_NUM_OBJECTS_INITIAL;
+	u_int8_t *states, *isSet;
+
+#if defined(OS_WINDOWS)
+	if (maxObjects >= WATCH_MAX_NUM_OBJECTS)
+		return false;
+
+	if (n > WATCH_MAX_NUM_OBJECTS)
+		n = WATCH_MAX_NUM_OBJECTS;
+
+	struct WatchSocket *ws = (struct WatchSocket *)realloc(waitSockets, n * sizeof(struct WatchSocket));
+
+	if (!ws)
+		return false;
+
+	waitSockets = ws;
+
+	for (int i = maxObjects; i < n; i++)
+		waitSockets[i].isValid = false;
+
+	HANDLE *objs = (HANDLE *)realloc(objects, n * sizeof(HANDLE));
+#else
+#if defined(WATCH_USE_EPOLL)
+	struct epoll_event *events = (struct epoll_event *)realloc(epollEvents, n * sizeof(struct epoll_event));
+
+	if (!events)
+		return false;
+
+	epollEvents = events;
+#endif
+	struct pollfd *objs = (struct pollfd *)realloc(objects, n * sizeof(struct pollfd));
+#endif
+	if (!objs)
+		return false;
+
+	objects = objs;
+
+	states = (u_int8_t *)realloc(objectStates, n * sizeof(u_int8_t));
+
+	if (!states)
+		return false;
+
+	objectStates = states;
+
+	isSet = (u_int8_t *)realloc(objectIsSet, n * sizeof(u_int8_t));
+
+	if (!isSet)
+		return false;
+
+	objectIsSet = isSet;
+	maxObjects = n;
+
+	return true;
+}
+
+/*
+	Returns the index of a free slot, reusing removed slots first.
+*/
+int Watch::allocIndex()
+{
+	int i;
+
+	if (numRemoved > 0) {
+		for (i = 0; i < numObjects; i++) {
+			if (objectStates[i] == WATCH_STATE_NONE) {
+				numRemoved--;
+				return i;
+			}
+		}
+	}
+
+	if (numObjects == maxObjects && !grow())
+		return -1;
+
+	return numObjects++;
+}
+
+void Watch::freeIndex(int index)
+{
+#if defined(OS_WINDOWS)
+	if (waitSockets[index].isValid) {
+		WSACloseEvent(objects[index]);
+		waitSockets[index].isValid = false;
+	}
+	objects[index] = NULL;
+#else
+#if defined(WATCH_USE_EPOLL)
+	if (epollfd != -1)
+		epollUnregister(index);
+#endif
+	objects[index].fd = -1;
+	objects[index].events = 0;
+	objects[index].revents = 0;
+#endif
+	objectStates[index] = WATCH_STATE_NONE;
+	objectIsSet[index] = 0;
+
+	if (index == numObjects - 1) {
+		numObjects--;
+
+		// Give back any removed slots at the end
+		while (numObjects > 0 && objectStates[numObjects - 1] == WATCH_STATE_NONE) {
+			numObjects--;
+			numRemoved--;
+		}
+	} else {
+		numRemoved++;
+	}
+}
+
+#if defined(WATCH_USE_EPOLL)
+static u_int32_t watch_state_to_epoll(u_int8_t state)
+{
+	u_int32_t events = 0;
+
+	if (state & WATCH_STATE_READ)
+		events |= EPOLLIN;
+	if (state & WATCH_STATE_WRITE)
+		events |= EPOLLOUT;
+	if (state & WATCH_STATE_EXCEPTION)
+		events |= EPOLLPRI;
+
+	return events;
 }
 
+static u_int8_t epoll_to_watch_state(u_int32_t events)
+{
+	u_int8_t state = WATCH_STATE_NONE;
+
+	// Like select(), report errors and hangups as readable and writeable
+	if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		state |= WATCH_STATE_READ;
+	if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+		state |= WATCH_STATE_WRITE;
+	if (events & EPOLLPRI)
+		state |= WATCH_STATE_EXCEPTION;
+
+	return state;
+}
+
+bool Watch::epollRegister(int index)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = watch_state_to_epoll(objectStates[index]);
+	ev.data.u32 = index;
+
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, objects[index].fd, &ev) == -1) {
+		// EEXIST means that the same descriptor was added twice,
+		// which epoll does not support
+		TRACE_DBG("Could not add descriptor %d to epoll set: %s\n", 
+			  objects[index].fd, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void Watch::epollUnregister(int index)
+{
+	int i;
+
+	/*
+	  If the descriptor was closed before it was removed, its number
+	  may since have been reused for an object in another slot. In that
+	  case the epoll registration belongs to the other slot.
+	*/
+	for (i = 0; i < numObjects; i++) {
+		if (i != index && objectStates[i] != WATCH_STATE_NONE && 
+		    objects[i].fd == objects[index].fd)
+			return;
+	}
+	// This fails harmlessly if the descriptor was already closed
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, objects[index].fd, NULL);
+}
+
+void Watch::epollStart()
+{
+	int i;
+
+	epollfd = epoll_create(maxObjects);
+
+	if (epollfd == -1) {
+		TRACE_ERR("Could not create epoll set: %s\n", strerror(errno));
+		epollDisabled = true;
+		return;
+	}
+
+	for (i = 0; i < numObjects; i++) {
+		if (objectStates[i] != WATCH_STATE_NONE && !epollRegister(i)) {
+			epollStop();
+			epollDisabled = true;
+			return;
+		}
+	}
+}
+
+void Watch::epollStop()
+{
+	if (epollfd != -1) {
+		close(epollfd);
+		epollfd = -1;
+	}
+}
+#endif
+
 int Watch::addsock(SOCKET sock, u_int8_t state)
 {
-	if (numObjects >= WATCH_MAX_NUM_OBJECTS || !(state & WATCH_STATE_ALL))
+	int i;
+
+	if (!(state & WATCH_STATE_ALL))
 		return -1;
 
-	objectStates[numObjects] = state;
+	i = allocIndex();
+
+	if (i < 0)
+		return -1;
+
+	objectStates[i] = state;
+	objectIsSet[i] = 0;
 #if defined(OS_WINDOWS)
-	objects[numObjects] = WSACreateEvent();
-	waitSockets[numObjects].isValid = true;
-	waitSockets[numObjects].sock = sock;
+	objects[i] = WSACreateEvent();
+	waitSockets[i].isValid = true;
+	waitSockets[i].sock = sock;
 #else
-	objects[numObjects] = sock;
+	objects[i].fd = sock;
+	objects[i].events = 0;
+	objects[i].revents = 0;
+
+	if (state & WATCH_STATE_READ)
+		objects[i].events |= POLLIN;
+	if (state & WATCH_STATE_WRITE)
+		objects[i].events |= POLLOUT;
+	if (state & WATCH_STATE_EXCEPTION)
+		objects[i].events |= POLLPRI;
+#if defined(WATCH_USE_EPOLL)
+	if (epollfd != -1 && !epollRegister(i)) {
+		// Fall back to poll()
+		epollStop();
+		epollDisabled = true;
+	}
 #endif
-	// return the index used and then increment the count
-	return numObjects++;
+#endif
+	return i;
 }
 
 #if defined(OS_WINDOWS)
 int Watch::addhandle(HANDLE h, u_int8_t state)
 {
-	if (numObjects >= WATCH_MAX_NUM_OBJECTS || !(state & WATCH_STATE_ALL))
+	int i;
+
+	if (!(state & WATCH_STATE_ALL))
 		return -1;
 
-	objects[numObjects] = h;
-	objectStates[numObjects] = state;
+	i = allocIndex();
 
-	return numObjects++;
+	if (i < 0)
+		return -1;
+
+	objects[i] = h;
+	objectStates[i] = state;
+	objectIsSet[i] = 0;
+
+	return i;
 }
 #endif
 
 int Watch::add(Watchable wbl, u_int8_t state)
 {
-	if (numObjects >= WATCH_MAX_NUM_OBJECTS || !(state & WATCH_STATE_ALL))
+	if (!(state & WATCH_STATE_ALL))
 		return -1;
 
 	switch (wbl.type) {
@@ -308,6 +564,18 @@ int Watch::add(Watchable wbl, u_int8_t state)
 	return -1;
 }
 
+bool Watch::remove(int objectIndex)
+{
+	// The exit signal cannot be removed
+	if (objectIndex < 0 || objectIndex >= numObjects || (s && objectIndex == 0) ||
+	    objectStates[objectIndex] == WATCH_STATE_NONE)
+		return false;
+
+	freeIndex(objectIndex);
+
+	return true;
+}
+
 /**
 	Watch::reset() will reset all watched objects in the watch to
 	unset state and also reset the remaining timeout time.
@@ -337,11 +605,16 @@ void Watch::clear()
 	int i = 0;
 
 	// Don't clear the exit signal
-	if (s)
+	if (s && numObjects > 0)
 		i++;
 
 	timeoutValid = false;
 
+#if defined(WATCH_USE_EPOLL)
+	// Closing the epoll set is cheaper than unregistering every
+	// object. It is recreated if the watch grows large again.
+	epollStop();
+#endif
 	for (;i < numObjects; i++) {
 		//printf("clearing wait index=%d\n", i);
 #if defined(OS_WINDOWS)
@@ -350,11 +623,13 @@ void Watch::clear()
 			waitSockets[i].isValid = false;
 		}
 #else
-		objects[i] = -1;
+		objects[i].fd = -1;
 #endif
+		objectStates[i] = WATCH_STATE_NONE;
 		objectIsSet[i] = false;
 	}
-	numObjects = i;
+	numObjects = (s && numObjects > 0) ? 1 : 0;
+	numRemoved = 0;
 }
 
 bool Watch::isSet(int objectIndex, u_int8_t state)
@@ -375,6 +650,10 @@ int Watch::wait(const Timeval *timeout)
 	if (numObjects == 0 && !s)
 		return Watch::FAILED;
 
+	// Do not leave the results of the last wait around, in case we
+	// return early
+	memset(objectIsSet, 0, numObjects);
+
 	absoluteTimeout.setNow();
 
 	if (timeout) {
@@ -387,6 +666,11 @@ int Watch::wait(const Timeval *timeout)
 
 #if defined(OS_WINDOWS)
 	DWORD millisec;
+	// Removed slots are left out of the handles passed to
+	// WaitForMultipleObjects(), which may not contain holes
+	HANDLE handles[WATCH_MAX_NUM_OBJECTS];
+	int handleIndex[WATCH_MAX_NUM_OBJECTS];
+	int numHandles = 0;
 	
 	if (timeout == NULL)
 		millisec = INFINITE;
@@ -400,6 +684,9 @@ int Watch::wait(const Timeval *timeout)
 		int flags = 0;
 		objectIsSet[i] = 0;
 
+		if (objectStates[i] == WATCH_STATE_NONE)
+			continue;
+
 		if (objectStates[i] & WATCH_STATE_READ)
 			flags |= (FD_READ | FD_ACCEPT | FD_CLOSE);
 		else if (objectStates[i] & WATCH_STATE_WRITE)
@@ -415,16 +702,20 @@ int Watch::wait(const Timeval *timeout)
 		} //else {
 			//TRACE_DBG("Thread %u : object %d is a handle\n", thr ? thr->getNum() : -1, i);
 		//}
+		handleIndex[numHandles] = i;
+		handles[numHandles++] = objects[i];
 	}
 
-	waitResult = WaitForMultipleObjects(numObjects, objects, FALSE, millisec);
+	waitResult = WaitForMultipleObjects(numHandles, handles, FALSE, millisec);
 
-	if (waitResult >= WAIT_ABANDONED_0 && waitResult < (int)(WAIT_ABANDONED_0 + numObjects)) {
-		TRACE_ERR("Wait was abandoned for object index %d\n", (waitResult - WAIT_ABANDONED_0));
-	} else if (waitResult >= WAIT_OBJECT_0 && waitResult < (int)(WAIT_OBJECT_0 + numObjects)) {
+	if (waitResult >= WAIT_ABANDONED_0 && waitResult < (int)(WAIT_ABANDONED_0 + numHandles)) {
+		TRACE_ERR("Wait was abandoned for object index %d\n", handleIndex[waitResult - WAIT_ABANDONED_0]);
+	} else if (waitResult >= WAIT_OBJECT_0 && waitResult < (int)(WAIT_OBJECT_0 + numHandles)) {
 		//TRACE_DBG("Object %d is set\n", (ret - WAIT_ABANDONED_0));
+		int first = handleIndex[waitResult - WAIT_OBJECT_0];
+
 		ret = Watch::SET;
-		i = waitResult - WAIT_OBJECT_0;
+		i = first;
 		// Check if it was the thread cancel event that was set
 		// Since we do not wait on all objects above, it should be safe to exit 
 		// after the first event is found
@@ -438,13 +729,15 @@ int Watch::wait(const Timeval *timeout)
 			WSANETWORKEVENTS netEvents;
 			DWORD res;
 
+			if (objectStates[i] == WATCH_STATE_NONE)
+				continue;
 			/* 
 			Check if an object other then a socket was set.
-			If it is the first index (==0), then we know for sure that the object's state
+			If it is the first index, then we know for sure that the object's state
 			is set. Otherwise we do not know, and have to check with WaitForSingleObject.
 			*/
 			if (!waitSockets[i].isValid) {
-				if (i == (waitResult - WAIT_OBJECT_0) ||  
+				if (i == first ||  
 					(WaitForSingleObject(objects[i], 0) == WAIT_OBJECT_0)) {
 
 					/*
@@ -561,68 +854,80 @@ out:
 		return Watch::TIMEOUT;
 	}
 #else
-	int maxfd = -1;
-	fd_set readset;
-	fd_set writeset;
-	fd_set errorset;
-	bool validread = false, validwrite = false, validerror = false;
+	int millisec = -1;
+	int numActive = numObjects - numRemoved;
 
-	FD_ZERO(&readset);
-	FD_ZERO(&writeset);
-	FD_ZERO(&errorset);
+	if (numActive == 0) {
+		TRACE_ERR("Nothing to wait on...\n");
+		return Watch::FAILED;
+	}
 
-      	for (i = 0; i < numObjects; i++) {
-		objectIsSet[i] = 0;
+	// Round up, so that we do not spin when less than a millisecond is left
+	if (timeout)
+		millisec = (int)(timeout->getSeconds() * 1000 + (timeout->getMicroSeconds() + 999) / 1000);
+
+#if defined(WATCH_USE_EPOLL)
+	if (epollfd == -1 && !epollDisabled && hasWaited && numActive >= WATCH_EPOLL_MIN_OBJECTS)
+		epollStart();
+
+	hasWaited = true;
 
-		if (objectStates[i] & WATCH_STATE_READ) {
-			FD_SET(objects[i], &readset);
-			validread = true;
+	if (epollfd != -1) {
+		waitResult = epoll_wait(epollfd, epollEvents, numActive, millisec);
+
+		if (waitResult < 0) {
+			TRACE_ERR("Wait on objects failed: %s\n", strerror(errno));
+			return Watch::FAILED;
+		} else if (waitResult == 0) {
+			timeoutValid = false;
+			return Watch::TIMEOUT;
 		}
-		if (objectStates[i] & WATCH_STATE_WRITE) {
-			FD_SET(objects[i], &writeset);
-			validwrite = true;
+
+		for (int k = 0; k < waitResult; k++) {
+			i = epollEvents[k].data.u32;
+			objectIsSet[i] = epoll_to_watch_state(epollEvents[k].events) & objectStates[i];
 		}
-		if (objectStates[i] & WATCH_STATE_EXCEPTION) {
-			FD_SET(objects[i], &errorset);
-			validerror = true;
+	} else
+#endif
+	{
+		waitResult = poll(objects, numObjects, millisec);
+		
+		if (waitResult < 0) {
+			TRACE_ERR("Wait on objects failed: %s\n", strerror(errno));
+			return Watch::FAILED;
+		} else if (waitResult == 0) {
+			timeoutValid = false;
+			return Watch::TIMEOUT;
 		}
 
-		if (objects[i] > maxfd)
-			maxfd = objects[i];
-	}
-	
-	if (!validread && !validwrite && !validerror) {
-		TRACE_ERR("Nothing to wait on...\n");
-		return Watch::FAILED;
-	}
+		for (i = 0; i < numObjects; i++) {
+			short revents = objects[i].revents;
 
-	waitResult = select(maxfd + 1, validread ? &readset : NULL, 
-			    validwrite ? &writeset : NULL, 
-			    validerror ? &errorset : NULL, 
-			    timeout ? const_cast<struct timeval *>(timeout->getTimevalStruct()) : NULL);
+			if (revents == 0)
+				continue;
 
-	if (waitResult < 0) {
-		TRACE_ERR("Wait on objects failed: %s\n", strerror(errno));
-		return Watch::FAILED;
-	} else if (waitResult == 0) {
-		timeoutValid = false;
-		return Watch::TIMEOUT;
+			if (revents & POLLNVAL) {
+				// select() fails on closed descriptors, and so do we
+				TRACE_ERR("Wait on objects failed: descriptor %d is not open\n", objects[i].fd);
+				memset(objectIsSet, 0, numObjects);
+				errno = EBADF;
+				return Watch::FAILED;
+			}
+			// Like select(), report errors and hangups as readable and writeable
+			if (revents & (POLLIN | POLLERR | POLLHUP))
+				objectIsSet[i] |= WATCH_STATE_READ;
+			if (revents & (POLLOUT | POLLERR | POLLHUP))
+				objectIsSet[i] |= WATCH_STATE_WRITE;
+			if (revents & POLLPRI)
+				objectIsSet[i] |= WATCH_STATE_EXCEPTION;
+
+			objectIsSet[i] &= objectStates[i];
+		}
 	}
 
 	ret = Watch::SET;
 
 	for (i = 0; i < numObjects; i++) {
-
-		if (FD_ISSET(objects[i], &readset)) {
-			objectIsSet[i] |= WATCH_STATE_READ;
-		} 
-		if (FD_ISSET(objects[i], &writeset)) {
-			objectIsSet[i] |= WATCH_STATE_WRITE;
-		}
-		if (FD_ISSET(objects[i], &errorset)) {
-			objectIsSet[i] |= WATCH_STATE_EXCEPTION;
-		} 
-
 		if (objectIsSet[i] & WATCH_STATE_ALL) {
 			numObjectsSet++;
 
@@ -635,7 +940,6 @@ out:
 	return ret;
 }
 
-
 int Watch::waitTimeout(unsigned long milliseconds)
 {
 	unsigned long secs = milliseconds / 1000;
@@ -0,0 +1,93 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _ATOMIC_H
+#define _ATOMIC_H
+
+#include "Platform.h"
+
+namespace haggle {
+
+/*
+	Atomic operations on counters and pointers. All of them are full
+	memory barriers.
+*/
+
+/**
+   Increments a counter and returns the new value.
+ */
+static inline long atomic_inc(volatile long *v)
+{
+#if defined(OS_WINDOWS)
+	return InterlockedIncrement(v);
+#else
+	return __sync_add_and_fetch(v, 1);
+#endif
+}
+
+/**
+   Decrements a counter and returns the new value.
+ */
+static inline long atomic_dec(volatile long *v)
+{
+#if defined(OS_WINDOWS)
+	return InterlockedDecrement(v);
+#else
+	return __sync_sub_and_fetch(v, 1);
+#endif
+}
+
+/**
+   Replaces the counter with newval if it is oldval. Returns true if
+   the counter was replaced.
+ */
+static inline bool atomic_cas(volatile long *v, long oldval, long newval)
+{
+#if defined(OS_WINDOWS)
+	return InterlockedCompareExchange(v, newval, oldval) == oldval;
+#else
+	return __sync_bool_compare_and_swap(v, oldval, newval);
+#endif
+}
+
+/**
+   Replaces the pointer with newval if it is oldval. Returns true if
+   the pointer was replaced.
+ */
+static inline bool atomic_cas_ptr(void * volatile *ptr, void *oldval, void *newval)
+{
+#if defined(OS_WINDOWS)
+	return InterlockedCompareExchangePointer(ptr, newval, oldval) == oldval;
+#else
+	return __sync_bool_compare_and_swap(ptr, oldval, newval);
+#endif
+}
+
+/**
+   Orders all memory accesses before the barrier before all accesses
+   after it, for code that writes one variable and then reads another
+   that a different thread writes.
+ */
+static inline void memory_barrier()
+{
+#if defined(OS_WINDOWS)
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+}; // namespace haggle
+
+#endif /* _ATOMIC_H */
@@ -0,0 +1,217 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _EXECUTOR_H
+#define _EXECUTOR_H
+
+#include "Thread.h"
+#include "Reference.h"
+#include "List.h"
+#include "Timeval.h"
+
+namespace haggle {
+
+class Executor;
+class ExecutorWorker;
+
+/*
+	Task states.
+*/
+#define TASK_STATE_PENDING   0
+#define TASK_STATE_RUNNING   1
+#define TASK_STATE_DONE      2
+#define TASK_STATE_CANCELLED 3
+
+/*
+	The number of worker threads of an executor, unless another
+	number is given when it is created.
+*/
+#define EXECUTOR_DEFAULT_WORKERS 2
+#define EXECUTOR_MAX_WORKERS 64
+
+/**
+	A Task is a short piece of work that runs on one of the worker
+	threads of an Executor. A derived class implements run(), and is
+	handed to the executor in a TaskRef, which also serves as the
+	future of the task: the submitter may wait for it, check whether
+	it is done, or cancel it before it starts.
+
+	A task should not block for long, as it occupies a worker that
+	other tasks could use. Work that waits on sockets or other
+	external events belongs in a Runnable with a thread of its own.
+
+	The state functions synchronize on the task's own mutex, so they
+	can be called through Reference::unlocked(), which avoids holding
+	the lock on the object while waiting.
+*/
+class Task : public RefCounted
+{
+	friend class ExecutorWorker;
+	friend class Executor;
+	mutable Mutex mutex;
+	mutable Condition cond;
+	int state;
+	bool submitted;
+	// Returns false if the task was cancelled before it started
+	bool begin();
+	void finish(int _state);
+protected:
+	/**
+		Does the work of the task. Called once, by a worker thread.
+	*/
+	virtual void run() = 0;
+public:
+	Task();
+	virtual ~Task();
+	/**
+		Cancels the task if it has not yet started.
+
+		Returns: true if the task was cancelled, or false if it is
+		already running or finished.
+	*/
+	bool cancel();
+	/**
+		Returns true if the task has run or was cancelled.
+	*/
+	bool isDone() const;
+	bool isCancelled() const;
+	/**
+		Waits for the task to finish or be cancelled. A negative
+		timeout waits forever.
+
+		Returns: true if the task is done, or false if the wait
+		timed out.
+	*/
+	bool wait(long msecs = -1) const;
+};
+
+typedef Reference<Task> TaskRef;
+
+/**
+	A Future is a task that computes a value. The value is available
+	through get() once the task is done.
+*/
+template<typename T>
+class Future : public Task
+{
+	T result;
+	void run() { result = compute(); }
+protected:
+	virtual T compute() = 0;
+public:
+	Future() : Task(), result() {}
+	virtual ~Future() {}
+	/**
+		Waits for the task and returns the computed value, or a
+		default constructed value if the task was cancelled.
+	*/
+	T get() const { wait(); return result; }
+};
+
+/**
+	The Executor runs tasks on a fixed set of worker threads, so that
+	short pieces of work do not need a thread each.
+
+	Every worker has queues of its own. Tasks submitted from other
+	threads are spread over the workers in turn, and run in the order
+	they were submitted. Tasks submitted by a task go to the queue of
+	the worker running it, and the worker runs the most recent of them
+	first. A worker with empty queues steals the oldest task of
+	another worker, and sleeps when there is nothing to steal.
+
+	The queues of a worker have a lock of their own, which is only
+	held while a task is added or removed, so the workers rarely
+	contend for it.
+*/
+class Executor
+{
+	friend class ExecutorWorker;
+	const string name;
+	ExecutorWorker **workers;
+	unsigned int numWorkers;
+	/*
+	  Protects the sleeping state of the workers and whether the
+	  executor accepts tasks.
+	 */
+	Mutex mutex;
+	bool running;
+	volatile long numPending; // Tasks in the queues
+	volatile long numSleeping;
+	volatile long nextWorker;
+	ExecutorWorker *selfGetWorker() const;
+	void wakeWorker(ExecutorWorker *preferred);
+	TaskRef steal(ExecutorWorker *thief);
+public:
+	/**
+		Statistics of one worker.
+	*/
+	class WorkerStats {
+	public:
+		unsigned long tasksRun;
+		unsigned long tasksStolen; // The tasks run that were taken from another worker
+		Timeval busyTime; // The time spent running tasks
+		Timeval idleTime; // The time spent sleeping
+		Timeval lifetime; // The time since the worker started
+		/**
+			The share of its lifetime that the worker has spent
+			running tasks, between 0 and 1.
+		*/
+		double utilization;
+		WorkerStats() : tasksRun(0), tasksStolen(0), utilization(0) {}
+	};
+	Executor(const string _name = "Executor", unsigned int _numWorkers = EXECUTOR_DEFAULT_WORKERS);
+	/**
+		Stops the executor if it is running.
+	*/
+	~Executor();
+	/**
+		Starts the worker threads. An executor can only be started
+		once.
+
+		Returns: true if all the workers were started.
+	*/
+	bool start();
+	/**
+		Stops the worker threads. Tasks that are running are allowed
+		to finish, while tasks that have not started are cancelled.
+		Tasks should no longer be submitted when stop() is called,
+		and it must not be called from a task.
+	*/
+	void stop();
+	bool isRunning() const { return running; }
+	/**
+		Queues a task to run on one of the workers.
+
+		Returns: true if the task was queued, or false if the
+		executor is not running or the task has already been
+		submitted.
+	*/
+	bool submit(const TaskRef& task);
+	unsigned int getNumWorkers() const { return numWorkers; }
+	/**
+		Returns the number of tasks waiting to run.
+	*/
+	unsigned long getNumPending() const { return numPending; }
+	/**
+		Gets the statistics of a worker.
+
+		Returns: false if there is no such worker.
+	*/
+	bool getWorkerStats(unsigned int worker, WorkerStats& stats) const;
+	const char *getName() const { return name.c_str(); }
+};
+
+}; // namespace haggle
+
+#endif /* _EXECUTOR_H */
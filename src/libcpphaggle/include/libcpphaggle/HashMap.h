@@ -31,10 +31,27 @@ namespace haggle {}
 #include <stdint.h>
 #endif
 
+#include <string.h>
+#include <new>
+
 #include "Pair.h"
-#include "List.h"
 #include "String.h"
 
+/*
+	The number of slots, and of items, that a hash map makes room for
+	on the first insert. Nothing is allocated before that, so that
+	empty maps, like the metadata registry of a leaf element, cost
+	nothing. Must be a power of two.
+*/
+#define HASHMAP_MIN_SIZE 8
+/*
+	The table doubles in size before it gets fuller than
+	HASHMAP_MAX_LOAD_NUM / HASHMAP_MAX_LOAD_DEN. It must never fill
+	up completely, since iteration starts and ends at an empty slot.
+*/
+#define HASHMAP_MAX_LOAD_NUM 7
+#define HASHMAP_MAX_LOAD_DEN 8
+
 namespace haggle {
 /**
    This is a simple implementation of a HashMap. It can be used to
@@ -45,71 +62,81 @@ namespace haggle {
    map and multimap.
   
    Note, that this hash map does not guarantee ordering of objects, and
-   it works by default as a multimap.
+   it works by default as a multimap. Items with the same key are
+   always next to each other when iterating, in the order they were
+   inserted.
 
-   The implementation is quite simple, and could probably be improved a
-   lot.
+   The hash table uses open addressing with linear probing ("Robin
+   Hood" hashing). Within a run of occupied slots, the slots are sorted
+   by the slot their key hashes to, so that a lookup can stop as soon
+   as it passes the place where the key would be. A slot only holds the
+   hash of the key and the index of the item, which is kept in a
+   separate, packed array. A lookup therefore scans a small array and
+   only compares keys when the hashes match, and the items are copied
+   only when the item array grows or an item is erased. Erasing moves
+   the following slots of the run back one step, so there are no
+   deleted markers.
+
+   Any insert may move the slots, and invalidates all iterators.
+   Erasing through an iterator moves that iterator to the next item,
+   while other iterators may become invalid.
   
    @author Erik Nordström
 */
-  
-/* FYI: This is the "One-at-a-Time" algorithm by Bob Jenkins */
-/* from requirements by Colin Plumb. */
-/* (http://burtleburtle.net/bob/hash/doobs.html) */
-/* adapted from Perl sources ( hv.h ) */
-static inline unsigned long hash_cstr(char* k) {
-	unsigned long hash = 0;
-		
-	while (*k != '\0') {
-		hash += *k++;
-		hash += (hash << 10);
-		hash ^= (hash >> 6);
-	}
-	hash += (hash << 3);
-	hash ^= (hash >> 11);
-		
-	return hash + (hash << 15);
+
+static inline unsigned int hash_rotl(unsigned int x, int r) {
+	return (x << r) | (x >> (32 - r));
 }
-	
-/*--- HashPJW ---------------------------------------------------
- *  An adaptation of Peter Weinberger's (PJW) generic hashing
- *  algorithm based on Allen Holub's version. Accepts a pointer
- *  to a datum to be hashed and returns an unsigned integer.
- *     Modified by sandro to include end
- *     Taken from http://www.ddj.com/articles/1996/9604/9604b/9604b.htm?topic=algorithms
- *-------------------------------------------------------------*/
-#define BITS_IN_int     ( sizeof(int) * CHAR_BIT )
-#define THREE_QUARTERS  ((int) ((BITS_IN_int * 3) / 4))
-#define ONE_EIGHTH      ((int) (BITS_IN_int / 8))
-#define HIGH_BITS       ( ~((unsigned int)(~0) >> ONE_EIGHTH ))	
-
-static inline unsigned int generic_hash(const char *start, const char *end) {
-	unsigned int hash_value, i;
-	if (end) {
-		for (hash_value = 0; start < end; ++start ) {
-			hash_value = ( hash_value << ONE_EIGHTH ) + *start;
-			if (( i = hash_value & HIGH_BITS ) != 0 )
-				hash_value =
-					( hash_value ^ ( i >> THREE_QUARTERS )) &
-					~HIGH_BITS;
-		}
-	} else {
-		for (hash_value = 0; *start; ++start )	{
-			hash_value = ( hash_value << ONE_EIGHTH ) + *start;
-			if (( i = hash_value & HIGH_BITS ) != 0 )
-				hash_value =
-					( hash_value ^ ( i >> THREE_QUARTERS )) &
-					~HIGH_BITS;
-		}
-		/* and the extra null value, so we match if working by length */
-		hash_value = ( hash_value << ONE_EIGHTH ) + *start;
-		if (( i = hash_value & HIGH_BITS ) != 0 ) {
-			hash_value =
-				( hash_value ^ ( i >> THREE_QUARTERS )) &
-				~HIGH_BITS;
-		}
+
+/*
+  MurmurHash3 (32-bit) by Austin Appleby, which is in the public
+  domain. It reads four bytes at a time, and every bit of the key
+  affects the low bits of the hash, which are the ones used to index
+  the table.
+*/
+static inline unsigned int hash_bytes(const void *key, size_t len) {
+	const unsigned char *data = (const unsigned char *)key;
+	const unsigned char *tail = data + (len & ~(size_t)3);
+	const unsigned int c1 = 0xcc9e2d51;
+	const unsigned int c2 = 0x1b873593;
+	unsigned int h = 0x9747b28c;
+	unsigned int k;
+
+	for (; data < tail; data += 4) {
+		memcpy(&k, data, 4);
+		k *= c1;
+		k = hash_rotl(k, 15);
+		k *= c2;
+		h ^= k;
+		h = hash_rotl(h, 13);
+		h = h * 5 + 0xe6546b64;
+	}
+
+	k = 0;
+
+	switch (len & 3) {
+	case 3:
+		k ^= tail[2] << 16;
+		// Fall through
+	case 2:
+		k ^= tail[1] << 8;
+		// Fall through
+	case 1:
+		k ^= tail[0];
+		k *= c1;
+		k = hash_rotl(k, 15);
+		k *= c2;
+		h ^= k;
 	}
-	return hash_value;
+
+	h ^= (unsigned int)len;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
 }
 	
 /*
@@ -118,33 +145,27 @@ static inline unsigned int generic_hash(const char *start, const char *end) {
 */
 template<typename T> 
 struct Hash {
-	static unsigned int hash(const T& k) { return generic_hash((const char *)&k, (const char *)&k + sizeof(T)); }
+	static unsigned int hash(const T& k) { return hash_bytes(&k, sizeof(T)); }
 };
+/*
+  Pointers are mixed in one go, using the finalizer of MurmurHash3's
+  64-bit version.
+*/
 template<typename T> 
 struct Hash<T*> {
 	static unsigned int hash(const T* k) { 
-		uintptr_t p = reinterpret_cast<uintptr_t>(k);
-		return generic_hash((const char *)&p, (const char *)&p + sizeof(uintptr_t)); 
+		unsigned long long p = reinterpret_cast<uintptr_t>(k);
+
+		p ^= p >> 33;
+		p *= 0xff51afd7ed558ccdULL;
+		p ^= p >> 33;
+		return (unsigned int)p; 
 	}
 };
 template<> 
 struct Hash<string> { 
-	static unsigned int hash(const string& k) { return generic_hash((const char *)k.c_str(), (const char *)k.c_str() + k.length()); }
+	static unsigned int hash(const string& k) { return hash_bytes(k.c_str(), k.length()); }
 };
-	
-
-/* from SGI STL */
-const unsigned long ms_primes[] =
-{
-	7ul,          13ul,         29ul,
-	53ul,         97ul,         193ul,       389ul,       769ul,
-	1543ul,       3079ul,       6151ul,      12289ul,     24593ul,
-	49157ul,      98317ul,      196613ul,    393241ul,    786433ul,
-	1572869ul,    3145739ul,    6291469ul,   12582917ul,  25165843ul,
-	50331653ul,   100663319ul,  201326611ul, 402653189ul, 805306457ul,
-	1610612741ul, 3221225473ul, 4294967291ul, 0
-};
- 
 
 /**
    HashMap: a class that implements a multimap container using a hash table.
@@ -156,204 +177,316 @@ public:
 	typedef unsigned long size_type;
 private:
 	typedef Pair<KeyType, ValueType > PairType;
-	typedef List<PairType > ListType;
+	/*
+	  Set in the hash of every occupied slot, so that an empty slot
+	  has a hash of zero.
+	*/
+	static const unsigned int SLOT_USED = 0x80000000;
+	/*
+	  A slot in the hash table. It refers to an entry, which holds
+	  the item.
+	*/
+	struct Slot {
+		unsigned int hash;
+		unsigned int entry;
+	};
+	/*
+	  The items are kept packed at the start of the entry array, in
+	  no particular order. Moving slots around in the table does not
+	  move the items.
+	*/
+	struct Entry {
+		unsigned int hash;
+		PairType pair;
+		Entry(const unsigned int _hash, const PairType& _pair) : hash(_hash), pair(_pair) {}
+	};
 	size_type _size;
-	unsigned long table_size;
-	ListType *table;
-	
+	// Number of slots, a power of two, or zero until the first insert
+	size_type table_size;
+	// An empty slot where iteration starts and ends
+	size_type start;
+	Slot *slots;
+	size_type entries_size;
+	Entry *entries;
+
+	static unsigned int getHash(const KeyType& k) {
+		return Hash<KeyType>::hash(k) | SLOT_USED;
+	}
+	size_type getIndex(const unsigned int h) const {
+		return h & (table_size - 1);
+	}
+	size_type nextSlot(const size_type i) const {
+		return (i + 1) & (table_size - 1);
+	}
+	size_type prevSlot(const size_type i) const {
+		return (i - 1) & (table_size - 1);
+	}
 	/**
-	   Get an index into the hash table given a key.
-	   @param k the key.
-	   @returns the index into the hash table
+	   How far the item in a slot is from the slot its key hashes to.
 	*/
-	size_type getIndex(const KeyType& k) const {
-		return Hash<KeyType>::hash(k) % table_size;
+	size_type getDistance(const size_type i) const {
+		return (i - getIndex(slots[i].hash)) & (table_size - 1);
+	}
+	bool isKey(const size_type i, const unsigned int h, const KeyType& k) const {
+		return slots[i].hash == h && k == entries[slots[i].entry].pair.first;
+	}
+	/**
+	   Find the first slot holding a key.
+	   @returns the slot, or table_size if the key is not in the map.
+	*/
+	size_type lookup(const KeyType& k) const {
+		if (_size == 0)
+			return table_size;
+
+		unsigned int h = getHash(k);
+		size_type i = getIndex(h);
+		size_type dist = 0;
+
+		while (slots[i].hash && getDistance(i) >= dist) {
+			if (isKey(i, h, k))
+				return i;
+			i = nextSlot(i);
+			dist++;
+		}
+		return table_size;
 	}
 	/**
-	   Get the next prime number that is larger than the
-	   given integer.
-	   @param n the integer to compare against.
-	   @returns the first prime that follows n
+	   Find the next occupied slot in iteration order.
+	   @returns the slot, or table_size if there are no more items.
 	*/
-	unsigned long getPrime(unsigned long n) const {
-		const unsigned long* ptr = &ms_primes[0];
-		for (; *ptr != 0; ++ptr) {
-			if (n < *ptr)
-				return *ptr;
+	size_type nextUsed(size_type i) const {
+		while ((i = nextSlot(i)) != start) {
+			if (slots[i].hash)
+				return i;
 		}
-		return 0;
+		return table_size;
 	}
 	/**
-	   Grow the hash table if necessary.
+	   Put a slot in the table at the given position, and move the
+	   rest of the run one slot ahead to make room.
 	*/
-	void grow() {
-		size_type new_size = getPrime(table_size + 1);
+	void placeSlot(const size_type i, const Slot& slot) {
+		size_type j = i;
 
-		if (!new_size || new_size <= table_size)
-			return;
-			
-		HashMap<KeyType, ValueType> largerHashMap(new_size);
+		while (slots[j].hash)
+			j = nextSlot(j);
 
-		for (iterator it = begin(); it != end(); ++it) {
-			largerHashMap.insert(*it);
+		if (j == start) {
+			// The table is never full, so there is another empty slot
+			do {
+				start = nextSlot(start);
+			} while (slots[start].hash);
 		}
-			
-		*this = largerHashMap;
+
+		for (; j != i; j = prevSlot(j)) {
+			slots[j] = slots[prevSlot(j)];
+		}
+		slots[i] = slot;
 	}
 	/**
-	   Create a new hash map with the given size. The actual size 
-	   of the hash table may be equal or greater than the size.
-	   @param tsize the minumum size of the hash table.
+	   Remove the item in a slot. The rest of the run moves back one
+	   slot, and the last entry moves into the removed one's place.
 	*/
-	HashMap(const size_type tsize) : _size(0), table_size(getPrime(tsize)), table(new ListType[table_size]) {}
+	void eraseSlot(size_type i) {
+		size_type e = slots[i].entry;
+		size_type last = _size - 1;
+		size_type j = nextSlot(i);
+
+		while (slots[j].hash && getDistance(j) > 0) {
+			slots[i] = slots[j];
+			i = j;
+			j = nextSlot(j);
+		}
+		slots[i].hash = 0;
+
+		entries[e].~Entry();
+
+		if (e != last) {
+			j = getIndex(entries[last].hash);
+
+			while (slots[j].entry != last || !slots[j].hash)
+				j = nextSlot(j);
+
+			new (&entries[e]) Entry(entries[last]);
+			entries[last].~Entry();
+			slots[j].entry = e;
+		}
+		_size--;
+	}
+	/**
+	   Double the number of slots. Only the slots move, not the items.
+	*/
+	void growTable() {
+		size_type old_size = table_size;
+		size_type old_start = start;
+		Slot *old_slots = slots;
+
+		table_size = table_size ? table_size * 2 : HASHMAP_MIN_SIZE;
+		start = 0;
+		slots = new Slot[table_size];
+		memset(slots, 0, table_size * sizeof(Slot));
+
+		if (!old_slots)
+			return;
+
+		// Going in iteration order keeps items with the same key
+		// in order
+		size_type i = old_start;
+
+		do {
+			i = (i + 1) & (old_size - 1);
+
+			if (old_slots[i].hash) {
+				size_type j = getIndex(old_slots[i].hash);
+				size_type dist = 0;
+
+				while (slots[j].hash && getDistance(j) >= dist) {
+					j = nextSlot(j);
+					dist++;
+				}
+				placeSlot(j, old_slots[i]);
+			}
+		} while (i != old_start);
+
+		delete [] old_slots;
+	}
+	/**
+	   Make room for more entries.
+	*/
+	void growEntries() {
+		size_type new_size = entries_size ? entries_size * 2 : HASHMAP_MIN_SIZE;
+		Entry *e = static_cast<Entry *>(::operator new(new_size * sizeof(Entry)));
+
+		for (size_type i = 0; i < _size; i++) {
+			new (&e[i]) Entry(entries[i]);
+			entries[i].~Entry();
+		}
+		::operator delete(entries);
+		entries = e;
+		entries_size = new_size;
+	}
+	void release() {
+		for (size_type i = 0; i < _size; i++) {
+			entries[i].~Entry();
+		}
+		delete [] slots;
+		::operator delete(entries);
+		slots = NULL;
+		entries = NULL;
+	}
+	void swap(HashMap<KeyType, ValueType>& m) {
+		size_type s = _size, ts = table_size, st = start, es = entries_size;
+		Slot *sl = slots;
+		Entry *e = entries;
+
+		_size = m._size;
+		table_size = m.table_size;
+		start = m.start;
+		slots = m.slots;
+		entries_size = m.entries_size;
+		entries = m.entries;
+		m._size = s;
+		m.table_size = ts;
+		m.start = st;
+		m.slots = sl;
+		m.entries_size = es;
+		m.entries = e;
+	}
 public:
 	class iterator {
 		friend class HashMap<KeyType, ValueType>;
 		friend class HashMap<KeyType, ValueType>::const_iterator;
 		HashMap<KeyType, ValueType> *m;
-		size_type table_index;
-		typename ListType::iterator it;
-		iterator(HashMap<KeyType, ValueType> *_m, const size_type _table_index, typename ListType::iterator _it) : m(_m), table_index(_table_index), it(_it) {}
-		inline void find_next_filled_bucket() {
-			if (table_index < m->table_size) {
-				// Advance iterator position
-				it++;
-				
-				// Check if the iterator points to a
-				// filled bucket, otherwise advance to
-				// the the next filled one
-				if (it == m->table[table_index].end()) {
-					while (++table_index < m->table_size) {
-						// Go to next bucket
-						it = m->table[table_index].begin();
-						// Check if the bucket has contents
-						if (it != m->table[table_index].end())
-							break;
-					}
-				}
-			} 
-		}
-		iterator& begin() { 
-			if (it == m->table[0].end()) 
-				find_next_filled_bucket();
-			return *this;
-		}
+		size_type index;
+		iterator(HashMap<KeyType, ValueType> *_m, const size_type _index) : m(_m), index(_index) {}
 	public:
-		iterator(const iterator& _it) : m(_it.m), table_index(_it.table_index), it(_it.it) {}
-		iterator() : m(0), table_index(0), it() {}
+		iterator(const iterator& _it) : m(_it.m), index(_it.index) {}
+		iterator() : m(0), index(0) {}
 		friend bool operator==(const iterator& it1, const iterator& it2) {
-			return (it1.it == it2.it);
+			return (it1.m == it2.m && it1.index == it2.index);
 		}
 		friend bool operator!=(const iterator& it1, const iterator& it2) {
 			return !(it1 == it2);
 		}
-		iterator& operator++() { find_next_filled_bucket(); return *this; }
-		iterator operator++(int) { iterator cit = *this; find_next_filled_bucket(); return cit; }
-		PairType& operator*() { return *it; }
+		iterator& operator++() { 
+			if (index < m->table_size) 
+				index = m->nextUsed(index); 
+			return *this; 
+		}
+		iterator operator++(int) { iterator cit = *this; ++(*this); return cit; }
+		PairType& operator*() { return m->entries[m->slots[index].entry].pair; }
 	};	
 	class const_iterator {
 		friend class HashMap<KeyType, ValueType>;
-		HashMap<KeyType, ValueType> *m;
-		size_type table_index;
-		typename ListType::const_iterator it;
-		const_iterator(const HashMap<KeyType, ValueType> *_m, const size_type _table_index, typename ListType::const_iterator _it) : m(const_cast<HashMap<KeyType, ValueType> *>(_m)), table_index(_table_index), it(_it) {}
-		
-		inline void find_next_filled_bucket() {
-			if (table_index < m->table_size) {
-				// Advance list iterator position
-				it++;
-				
-				// Check if the iterator points to a
-				// filled bucket, otherwise advance to
-				// the the next filled one
-				if (it == m->table[table_index].end()) {
-					while (++table_index < m->table_size) {
-						// Go to next bucket
-						it = m->table[table_index].begin();
-						// Check if the bucket has contents
-						if (it != m->table[table_index].end())
-							break;
-					}
-				}
-			} 
-		}
-		const_iterator& begin() { 
-			if (it == m->table[0].end()) 
-				find_next_filled_bucket();
-			return *this;
-		}
+		const HashMap<KeyType, ValueType> *m;
+		size_type index;
+		const_iterator(const HashMap<KeyType, ValueType> *_m, const size_type _index) : m(_m), index(_index) {}
 	public:
-		const_iterator(const const_iterator& _it) : m(_it.m), table_index(_it.table_index), it(_it.it) {}
-		const_iterator(const iterator& _it) : m(_it.m), table_index(_it.table_index), it(_it.it) {}
-		const_iterator() : m(0), table_index(0), it() {}
+		const_iterator(const const_iterator& _it) : m(_it.m), index(_it.index) {}
+		const_iterator(const iterator& _it) : m(_it.m), index(_it.index) {}
+		const_iterator() : m(0), index(0) {}
 		friend bool operator==(const const_iterator& it1, const const_iterator& it2) {
-			return (it1.it == it2.it);
+			return (it1.m == it2.m && it1.index == it2.index);
 		}
 		friend bool operator!=(const const_iterator& it1, const const_iterator& it2) {
 			return !(it1 == it2);
 		}
-		const_iterator& operator++() { find_next_filled_bucket(); return *this; }
-		const_iterator operator++(int) { const_iterator cit = *this; find_next_filled_bucket(); return cit; }
-		const PairType& operator*() const { return *it; }
+		const_iterator& operator++() { 
+			if (index < m->table_size) 
+				index = m->nextUsed(index); 
+			return *this; 
+		}
+		const_iterator operator++(int) { const_iterator cit = *this; ++(*this); return cit; }
+		const PairType& operator*() const { return m->entries[m->slots[index].entry].pair; }
 	};
-	iterator begin() { return iterator(this, 0, table[0].begin()).begin(); }
-	iterator end() {return iterator(this, table_size-1, table[table_size-1].end()); }
-	const_iterator begin() const { return const_iterator(this, 0, table[0].begin()).begin(); }
-	const_iterator end() const {return const_iterator(this, table_size-1, table[table_size-1].end()); }
+	iterator begin() { return iterator(this, _size ? nextUsed(start) : table_size); }
+	iterator end() { return iterator(this, table_size); }
+	const_iterator begin() const { return const_iterator(this, _size ? nextUsed(start) : table_size); }
+	const_iterator end() const { return const_iterator(this, table_size); }
 	size_type size() const { return _size; }
 	bool empty() const { return _size == 0; }
 	virtual iterator insert(const PairType& p) {
-		typename ListType::iterator it, it_insert;
 		const KeyType& k = p.first;
 
-		if (_size + 1 > table_size) {
-			grow();
+		if ((_size + 1) * HASHMAP_MAX_LOAD_DEN > table_size * HASHMAP_MAX_LOAD_NUM) {
+			growTable();
+		}
+		if (_size == entries_size) {
+			growEntries();
 		}
 
-		size_type index = getIndex(k);
+		Slot slot;
+		size_type i;
+		size_type dist = 0;
 
-                // Handle conflicts.
-                it = table[index].begin();
-                it_insert = it;
+		slot.hash = getHash(k);
+		slot.entry = _size;
+		i = getIndex(slot.hash);
 
-                while (it != table[index].end()) {
-                        // Find any occurence of the same key
-                        if (k == (*it).first) {
-                                // find the last occurence of this same key
-                                while (it != table[index].end() && k == (*it).first) {
-                                        it_insert = ++it;
-                                }
-                                break;
+		// Find the slot after any items with the same key, or
+		// before the first item that hashes to a later slot.
+		while (slots[i].hash && getDistance(i) >= dist) {
+			if (isKey(i, slot.hash, k)) {
+				do {
+					i = nextSlot(i);
+				} while (isKey(i, slot.hash, k));
+				break;
 			}
-                        it_insert = ++it;
-                }
+			i = nextSlot(i);
+			dist++;
+		}
+
+		new (&entries[_size]) Entry(slot.hash, p);
+		placeSlot(i, slot);
 		_size++;
 
-		return iterator(this, index, table[index].insert(it_insert, p));
+		return iterator(this, i);
 	}
 	iterator find(const KeyType& k) {		
-		typename ListType::iterator it;
-		size_type index = getIndex(k);
-
-		for (it = table[index].begin(); it != table[index].end(); ++it) {
-			if (k == (*it).first) {
-				return iterator(this, index, it);
-			}
-		}
-		return end();
+		return iterator(this, lookup(k));
 	}
 	const_iterator find(const KeyType& k) const {
-		typename ListType::const_iterator it;
-
-		size_type index = getIndex(k);
-			
-		for (it = table[index].begin(); it != table[index].end(); ++it) {
-			if (k == (*it).first) {
-				return const_iterator(this, index, it);
-				
-			}
-		}
-		return end();
+		return const_iterator(this, lookup(k));
 	}
 	iterator lower_bound(const KeyType& k) {
 		return find(k);
@@ -401,53 +534,63 @@ public:
 		}
 		return make_pair(it_low, it_high);
 	}
-		
+	/**
+	   Erase the item at an iterator. Afterwards, the iterator
+	   points to the next item, or end().
+	*/
 	void erase(iterator& pos) {
-		table[pos.table_index].erase(pos.it);
-		_size--;
+		eraseSlot(pos.index);
+
+		// The next item may have been moved into the slot
+		if (!slots[pos.index].hash)
+			pos.index = nextUsed(pos.index);
 	}
 
 	size_type erase(const KeyType& k) {
-                KeyType key = k; 
-                ListType *l = &table[getIndex(key)];
-                typename ListType::iterator it = l->begin();
-                size_type n = 0;
-                
-                while (it != l->end()) {
-                        if ((*it).first == key) {
-                                it = l->erase(it);
-                                _size--;
-                                n++;
-                        } else {
-                                it++;
-                        }
-                }
+		unsigned int h = getHash(k);
+		size_type i = lookup(k);
+		size_type n = 0;
+
+		// The following items with the same key move back into
+		// the slot as we erase
+		while (i < table_size && isKey(i, h, k)) {
+			eraseSlot(i);
+			n++;
+		}
 
 		return n;
 	}
 	void clear() {
-		for (size_type i = 0; i < table_size; i++) {
-			table[i].clear();
+		for (size_type i = 0; i < _size; i++) {
+			entries[i].~Entry();
 		}
+		if (slots)
+			memset(slots, 0, table_size * sizeof(Slot));
+		start = 0;
 		_size = 0;
 	}
-	HashMap(const HashMap<KeyType, ValueType>& m) : _size(m._size), table_size(m.table_size), table(new ListType[table_size]) {
-		for (size_type i = 0; i < table_size; i++) {
-			table[i] = m.table[i];
+	HashMap(const HashMap<KeyType, ValueType>& m) : _size(0), table_size(m.table_size), start(m.start), slots(NULL), entries_size(m._size), entries(NULL) {
+		if (m._size == 0) {
+			table_size = 0;
+			start = 0;
+			entries_size = 0;
+			return;
+		}
+		slots = new Slot[table_size];
+		memcpy(slots, m.slots, table_size * sizeof(Slot));
+		entries = static_cast<Entry *>(::operator new(entries_size * sizeof(Entry)));
+
+		for (; _size < m._size; _size++) {
+			new (&entries[_size]) Entry(m.entries[_size]);
 		}
 	}
-	HashMap() : _size(0), table_size(ms_primes[0]), table(new ListType[table_size]) {}
-	virtual ~HashMap() { delete [] table; }
+	HashMap() : _size(0), table_size(0), start(0), slots(NULL), entries_size(0), entries(NULL) {}
+	virtual ~HashMap() { release(); }
 
 	HashMap<KeyType, ValueType>& operator=(const HashMap<KeyType, ValueType>& m) {
-		delete [] table;
-		table = NULL;
-		_size = m._size;
-		table_size = m.table_size;
-		table = new ListType[table_size];
-
-		for (size_type i = 0; i < table_size; i++) {
-			table[i] = m.table[i];
+		if (this != &m) {
+			HashMap<KeyType, ValueType> copy(m);
+			swap(copy);
 		}
 		return *this;
 	}
@@ -61,6 +61,11 @@ public:
         bool full() const;
         bool insert(HeapItem *item);
         HeapItem *extractFirst();
+	/**
+	   Removes an item from anywhere in the heap. Returns false if
+	   the item is not in this heap.
+	 */
+	bool remove(HeapItem *item);
 	void pop_front();
         HeapItem *front();
 	unsigned long size() const;
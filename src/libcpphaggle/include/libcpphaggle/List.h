@@ -127,6 +127,10 @@ public:
 		container<T> *c = static_cast< container<T> *>(head.next);
 		return c->obj;
 	}
+	T& back() {
+		container<T> *c = static_cast< container<T> *>(head.prev);
+		return c->obj;
+	}
 	iterator begin() { return iterator(head.next); }
 	iterator end() {return iterator(&head); }
 	const_iterator begin() const { return const_iterator(head.next); }
@@ -394,18 +394,31 @@ public:
 			return end();
 	}
 	
+	/**
+	 Returns: An iterator to the first entry with a key that is not less
+	 than the given key, or end() if there is no such entry.
+	 */
 	iterator lower_bound(const Key& k) 
 	{
-		return find(k);
+		// The position where the key would be inserted
+		size_type pos = _find(k, true).first;
+
+		return pos < number_of_entries ? iterator(pos, this) : end();
 	}
 	const_iterator lower_bound(const Key& k) const
 	{
-		return find(k);
+		size_type pos = _find(k, true).first;
+
+		return pos < number_of_entries ? const_iterator(pos, this) : end();
 	}
 	
+	/**
+	 Returns: An iterator to the first entry with a key that is greater
+	 than the given key, or end() if there is no such entry.
+	 */
 	iterator upper_bound(const Key& k) 
 	{
-		iterator it = find(k);
+		iterator it = lower_bound(k);
 		
 		// iterate until we are past the last occurance
 		while (it != end() && k == (*it).first) {
@@ -415,7 +428,7 @@ public:
 	}
 	const_iterator upper_bound(const Key& k) const
 	{
-		const_iterator it = find(k);
+		const_iterator it = lower_bound(k);
 		
 		// iterate until we are past the last occurance
 		while (it != end() && k == (*it).first) {
@@ -423,6 +436,7 @@ public:
 		}
 		return it;
 	}
+	
 	Pair<iterator, iterator> equal_range (const Key& k) 
 	{
 		iterator it_low, it_high;
@@ -576,6 +590,10 @@ public:
 	const_iterator end() const { return _the_map.end(); }
 	iterator find(const key_type& k) { return _the_map.find(k); }
 	const_iterator find(const key_type& k) const { return _the_map.find(k); }
+	iterator lower_bound(const key_type& k) { return _the_map.lower_bound(k); }	
+	const_iterator lower_bound(const key_type& k) const { return _the_map.lower_bound(k); }
+	iterator upper_bound(const key_type& k) { return _the_map.upper_bound(k); }
+	const_iterator upper_bound(const key_type& k) const { return _the_map.upper_bound(k); }
 	iterator insert(iterator pos, const value_type& x) { return _the_map.insert_unique(pos, x); }
         Pair<iterator, bool> insert(const value_type& x) { return _the_map.insert_unique(x); }
 	void erase(iterator pos) { _the_map.erase(pos); }
@@ -19,6 +19,7 @@
 #include "Pair.h"
 #include "List.h"
 #include "Mutex.h"
+#include "Atomic.h"
 #include "HashMap.h"
 #include "String.h"
 
@@ -35,17 +36,32 @@
 
 namespace haggle {
 	
+class RefCounted;
+
+/*
+	The count of a counter in a RefCounted object whose last reference
+	has gone away. Such a counter starts at 0, so 0 cannot mean that
+	the object is being deleted.
+*/
+#define REFCOUNT_DEAD -1
+
 /**
  This class is for keeping a reference count to the object being 
  referenced. It is allocated on the heap, so that there is only one 
- reference count and one mutex to protect that reference count.
+ reference count and one mutex to protect the object. Objects that
+ inherit RefCounted carry their reference counter with them instead.
+
+ The reference count is changed with atomic operations, so copying and
+ destroying references does not take any lock.
  */
 class RefCounter {
+	friend class RefCounted;
 	typedef Pair<void *, RefCounter *> RefcountPair;
 	typedef HashMap<void *, RefCounter *> RefcountMap;
 	/**
 	 This is a store of objects that have already been refcounted. It is 
 	 used to ensure that objects have only one reference counter.
+	 Objects that inherit RefCounted are not in the store.
 	 */
 	static RefcountMap objects;
 	
@@ -58,21 +74,45 @@ class RefCounter {
 	 The total number of such object having been refcounted.
 	 Used for debugging purposes.
 	*/
-	static unsigned long totNum;
+	static volatile long totNum;
 	/**
-	 The mutex protecting the reference count
+	 The reference count. This will start at 1, and when it reaches 0, 
+	 the object will be deleted. A counter that is part of the object
+	 starts at 0, as no reference has been created yet, and is set to
+	 REFCOUNT_DEAD when the last reference goes away.
 	 */
-	Mutex countMutex;
+	volatile long refcount;
 	/**
-	 The reference count. This will start at 1, and when it reaches 0, 
-	 the object will be deleted.
+	 True if the counter is part of the object, in which case it goes
+	 away with the object.
 	 */
-	unsigned long refcount;
+	const bool intrusive;
 	
 	/**
 	 Constructor.
 	 */
 	RefCounter(void *_obj);
+	/**
+	 Constructor for a counter that is part of the object.
+	 */
+	RefCounter();
+	/**
+	 This function increases the reference count, unless the last
+	 reference has gone away and the object is being deleted.
+	 */
+	unsigned long inc_count_if_alive()
+	{
+		long count;
+
+		do {
+			count = refcount;
+
+			if (count == REFCOUNT_DEAD || (count == 0 && !intrusive))
+				return 0;
+		} while (!atomic_cas(&refcount, count, count + 1));
+
+		return count + 1;
+	}
 public:
 	
 	/**
@@ -81,9 +121,10 @@ public:
 	RecursiveMutex objectMutex;
 	
 	/**
-	 The object being refcounted.
+	 The object being refcounted. A counter that is part of the object
+	 gets it from the first reference, and it never changes after that.
 	 */
-	void *obj;
+	void * volatile obj;
 	
 	/**
 	 An identifying integer for the object being pointed to.
@@ -91,7 +132,12 @@ public:
 	 */
 	const unsigned long identifier;
 	
-	static RefCounter *create(void *_obj);
+	static RefCounter *create(void *_key, void *_obj);
+	/**
+	 Returns the counter in an object that inherits RefCounted,
+	 without looking up the object in the store.
+	 */
+	static RefCounter *create(RefCounted *_key, void *_obj);
 	/**
 	 Destructor.
 	 */
@@ -100,43 +146,43 @@ public:
 	template<typename T>
 	T *object() { return static_cast<T *>(obj); }
 	/**
-	 This function increases the reference count atomically.
+	 This function increases the reference count atomically. The
+	 caller must already hold a reference.
 	 */
 	unsigned long inc_count()
 	{
-		Mutex::AutoLocker l(countMutex);
-		if (refcount == 0)
-			return 0;
-		return ++refcount;
+		return atomic_inc(&refcount);
 	}
 	
 	/**
-	 This function decreases the reference count atomically.
+	 This function decreases the reference count atomically. When it
+	 drops the last reference, deleting the object is the last thing
+	 it does, so no member is touched once the counter may be gone.
 	 */
 	template<typename T>
 	unsigned long dec_count()
 	{
-		unsigned long ret;
-		countMutex.lock();
+		long count, next;
 
-		if (refcount == 0) {
-			countMutex.unlock();
-			return 0;
-		}
+		do {
+			count = refcount;
+			next = (count == 1 && intrusive) ? REFCOUNT_DEAD : count - 1;
+		} while (!atomic_cas(&refcount, count, next));
 
-		ret = --refcount;
+		if (count != 1)
+			return count - 1;
 
-		countMutex.unlock();
+		T *tmp_obj = static_cast<T *>(obj);
 
-		if (ret == 0) {	
+		if (!intrusive) {
 			objectsMutex.lock();
-			objects.erase(obj);
-			T * tmp_obj = static_cast<T *>(obj);
-			objectsMutex.unlock();			
+			objects.erase((void *)obj);
+			objectsMutex.unlock();
 			delete this;
-			delete tmp_obj;
-		} 
-		return ret;
+		}
+		delete tmp_obj;
+
+		return 0;
 	}
 	
 	/**
@@ -147,7 +193,26 @@ public:
 		return refcount;
 	}
 };
-	
+
+/**
+ Classes that are always refcounted can inherit this class, so that
+ the reference counter is kept in the object. Creating a reference from
+ a pointer to such an object then does not go through the global store
+ of reference counters and its mutex.
+
+ A copy of the object is a new object, with a reference counter of its
+ own.
+ */
+class RefCounted {
+	friend class RefCounter;
+	RefCounter refCounter;
+protected:
+	RefCounted() {}
+	RefCounted(const RefCounted&) {}
+	RefCounted& operator=(const RefCounted&) { return *this; }
+	~RefCounted() {}
+};
+
 /**
    The Reference class is used for refcounting any type of object. This is done
    without having to make any changes at all to the class being refcounted.
@@ -265,11 +330,13 @@ private:
 	/**
            Constructor
 	*/
-	Reference(const T *obj = NULL) : refCount(RefCounter::create(const_cast<T *>(obj)))
+	Reference(const T *obj = NULL) : refCount(RefCounter::create(const_cast<T *>(obj), const_cast<T *>(obj)))
 	{
-		if (!refCount) {
-			// ERROR!
-		}
+		/*
+		  The type must be complete, or the counter in a RefCounted
+		  object would not be found.
+		 */
+		(void)sizeof(T);
 	}
 	
 	/**
@@ -323,6 +390,14 @@ private:
 	   for example, by locking the reference while accessing the object.
 	*/
 	T *getObj() { return refCount ? refCount->object<T>() : NULL; }
+	/**
+	   Read access to the referenced object without locking it. Only
+	   const member functions can be called, and they should only read
+	   members that do not change once the object is shared, such as
+	   the identifiers of nodes and interfaces. Anything else must go
+	   through operator-> or lock(), like any change to the object.
+	*/
+	const T *unlocked() const { return refCount ? refCount->object<T>() : NULL; }
 	/**
            This function will return a heap-allocated copy of this reference.
 	*/
@@ -362,16 +437,19 @@ private:
 			// Do nothing:
 			return *this;
 		
+		RefCounter *old = refCount;
+
 		// First increase the reference count of the object we'll be pointing to
 		// when this is done. 
 		if (eo.refCount)
 			eo.refCount->inc_count();
-		// Then decrease the reference count of the object we were pointing at 
-		// before this operation.
-		if (refCount)
-			refCount->dec_count<T>();
 		// Do the actual assignment:
 		refCount = eo.refCount;
+		// Then decrease the reference count of the object we were pointing at 
+		// before this operation. This is done last, as the object deleted
+		// may hold the reference assigned from.
+		if (old)
+			old->dec_count<T>();
 		
 		return *this;
 	}
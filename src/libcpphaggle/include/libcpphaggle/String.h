@@ -28,15 +28,50 @@ namespace haggle {}
 
 #else
 
+/*
+	Strings shorter than this (counting the terminating null
+	character) are kept inside the string object, and are not
+	allocated on the heap.
+*/
+#define STRING_INLINE_SIZE 16
+/*
+	The maximum number of interned strings, the maximum length of an
+	interned string and the maximum number of bytes used by all of
+	them. Interned strings are never freed, so this bounds the memory
+	they use, also when the strings come from other nodes. Longer
+	strings, and strings beyond the limits, are left as they are by
+	String::intern().
+*/
+#define STRING_INTERN_MAX 8192
+#define STRING_INTERN_MAX_LEN 64
+#define STRING_INTERN_MAX_BYTES (256 * 1024)
+
 namespace haggle {
 
+/**
+   A string class that can replace STL's string in most simple cases.
+
+   Short strings are stored in the string object itself. A string may
+   also be interned, after which it shares read-only storage with all
+   other interned strings with the same contents. Copying an interned
+   string copies a pointer, and two interned strings are equal only if
+   they point to the same storage. A string that shares storage gets
+   its own copy before it is modified.
+*/
 class String {
 private:
 	char *s;
-	size_t alloc_len;  // the length of the malloc'd buffer
 	size_t slen;  // the length of the string (i.e., strlen(s))
+	union {
+		// The length of the malloc'd buffer, or zero if s
+		// points to shared storage
+		size_t alloc_len;
+		// The storage of short strings, when s == buf
+		char buf[STRING_INLINE_SIZE];
+	};
         static char nullchar;
         char *alloc(size_t len);
+	void release();
 	String(const char *_s, size_t n);
 public:
 	static const size_t npos = -1; // the largest possible position
@@ -50,6 +85,20 @@ public:
         void clear();
         bool empty () const;
 
+	/**
+	   Make the string share storage with all other interned
+	   strings with the same contents. Meant for strings that are
+	   repeated often, like attribute names. Strings longer than
+	   STRING_INTERN_MAX_LEN are not interned.
+	   Returns the string.
+	 */
+	String& intern();
+	/**
+	   Returns true if the string shares storage with other
+	   interned strings. The empty string always does.
+	 */
+	bool isInterned() const;
+
         const char& at(size_t pos ) const;
         char& at (size_t pos );
         
@@ -142,4 +191,11 @@ typedef haggle::String string;
 */
 int stringprintf(string &str, const char *format, ...);
 
+/**
+	Interns a string, see String::intern(). Does nothing when the
+	STL string is used.
+	Returns the string.
+*/
+string& stringintern(string &str);
+
 #endif /* _STRINGH_H_ */
@@ -0,0 +1,127 @@
+/* Copyright 2008-2009 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TIMERWHEEL_H
+#define _TIMERWHEEL_H
+
+#include <libcpphaggle/Timeval.h>
+
+namespace haggle {
+
+class TimerWheelItem;
+class TimerWheel;
+
+/*
+	The wheel has one level of TIMERWHEEL_LEVEL0_SLOTS slots of one
+	tick each, and TIMERWHEEL_NUM_LEVELS - 1 levels of
+	TIMERWHEEL_LEVELN_SLOTS slots, each slot spanning all the slots of
+	the level below. With one millisecond ticks, the levels cover 256
+	ms, 16 s, 17 min, 18 h and 49 days. Items further in the future are
+	kept in the last level until they come within its range.
+*/
+#define TIMERWHEEL_LEVEL0_BITS 8
+#define TIMERWHEEL_LEVELN_BITS 6
+#define TIMERWHEEL_LEVEL0_SLOTS (1 << TIMERWHEEL_LEVEL0_BITS)
+#define TIMERWHEEL_LEVELN_SLOTS (1 << TIMERWHEEL_LEVELN_BITS)
+#define TIMERWHEEL_NUM_LEVELS 5
+#define TIMERWHEEL_MAX_TICKS 0xffffffffLL
+
+/**
+ The TimerWheelItem class should be inherited by any data item that
+ should be placed in a timer wheel. An item that is deleted while in a
+ wheel removes itself from it.
+ */
+class TimerWheelItem
+{
+	friend class TimerWheel;
+	TimerWheel *wheel;
+	TimerWheelItem *prev, *next;
+	TimerWheelItem **slot;
+	int level;
+	int64_t expires; // In ticks
+public:
+	TimerWheelItem();
+	virtual ~TimerWheelItem();
+	/**
+	   Returns true if the item is in a timer wheel.
+	 */
+	bool isPending() const { return wheel != NULL; }
+};
+
+/**
+ The TimerWheel class implements a hierarchical timing wheel with a
+ resolution of one millisecond. Inserting and removing items takes
+ constant time. Items expire in the order of their ticks, but items
+ that expire in the same tick are returned in no particular order.
+ */
+class TimerWheel
+{
+	int64_t current; // The next tick to process
+	unsigned long num;
+	unsigned long numExpired;
+	unsigned long levelSize[TIMERWHEEL_NUM_LEVELS];
+	TimerWheelItem *level0[TIMERWHEEL_LEVEL0_SLOTS];
+	TimerWheelItem *levelN[TIMERWHEEL_NUM_LEVELS - 1][TIMERWHEEL_LEVELN_SLOTS];
+	TimerWheelItem *expired; // Expired items not yet returned
+
+	static int64_t toTicks(const Timeval& t, bool roundUp);
+	void link(TimerWheelItem *item, TimerWheelItem **slot, int level);
+	void unlink(TimerWheelItem *item);
+	void place(TimerWheelItem *item);
+	void cascade(int level, int index);
+	void run(int64_t now);
+public:
+	TimerWheel();
+	~TimerWheel();
+	bool empty() const { return num == 0; }
+	/**
+	   Returns the number of items in the wheel, including the
+	   expired ones that have not been returned yet.
+	 */
+	unsigned long size() const { return num; }
+	/**
+	   Inserts an item that expires at the given absolute time. An
+	   item that is already in a wheel is moved. An item that has
+	   already expired is returned by the next call to expire().
+	   Returns false if the item could not be inserted.
+	 */
+	bool insert(TimerWheelItem *item, const Timeval& expiry);
+	/**
+	   Removes an item from the wheel. Returns false if the item was
+	   not in this wheel.
+	 */
+	bool remove(TimerWheelItem *item);
+	/**
+	   Removes and returns one item that has expired at the given
+	   time, or NULL if there is none.
+	 */
+	TimerWheelItem *expire(const Timeval& now = Timeval::now());
+	/**
+	   Removes and returns any item in the wheel, or NULL if the
+	   wheel is empty. Used to empty the wheel.
+	 */
+	TimerWheelItem *extract();
+	/**
+	   Sets the time at which the next item may expire. The time is
+	   exact for items in the first level. For items in higher
+	   levels it is the time they are moved to a lower level, so
+	   expire() may return NULL at that time.
+	   Returns false if the wheel is empty.
+	 */
+	bool getNextExpiry(Timeval& tv) const;
+};
+
+}; // namespace haggle
+
+#endif /* _TIMERWHEEL_H */
@@ -82,12 +82,38 @@ public:
 	friend bool operator>(const Watchable& w1, const Watchable& w2);
 };
 
-// This number cannot be too low. The kernel can use quite a lot of sockets and
-// other watchable objects in its event loop
-#define WATCH_MAX_NUM_OBJECTS 20
+/*
+	The initial number of objects a watch has room for. The watch set
+	grows as needed, so this is not a limit.
+*/
+#define WATCH_NUM_OBJECTS_INITIAL 8
+
+#if defined(OS_WINDOWS)
+/*
+	WaitForMultipleObjects() cannot wait on more objects than this.
+*/
+#define WATCH_MAX_NUM_OBJECTS MAXIMUM_WAIT_OBJECTS
+#elif defined(OS_LINUX) && !defined(WATCH_USE_POLL)
+/*
+	On Linux, a watch that is waited on repeatedly switches from poll()
+	to epoll once it holds at least WATCH_EPOLL_MIN_OBJECTS objects. A
+	single poll() call is cheaper for the many short-lived watches on a
+	few objects, since epoll needs extra system calls to set up, while
+	epoll does not scan the whole set on every wait. Define
+	WATCH_USE_POLL to always use poll().
+*/
+#define WATCH_USE_EPOLL
+#define WATCH_EPOLL_MIN_OBJECTS 16
+#endif
+
+#if !defined(OS_WINDOWS)
+#include <poll.h>
+#endif
+#if defined(WATCH_USE_EPOLL)
+#include <sys/epoll.h>
+#endif
 
 #define WATCH_OBJECT_INDEX_MIN 0
-#define WATCH_OBJECT_INDEX_MAX (WATCH_MAX_NUM_OBJECTS-1)
 
 /*
   Watch flags that determine which events to watch for
@@ -105,22 +131,40 @@ class Watch
 {
 private:
 #if defined(OS_WINDOWS)
-	struct {
+	struct WatchSocket {
 		SOCKET sock;
 		bool isValid;
-	} waitSockets[WATCH_MAX_NUM_OBJECTS];
-	HANDLE objects[WATCH_MAX_NUM_OBJECTS]; // The object handles to watch#if defined(OS_WINDOWS)
+	} *waitSockets;
+	HANDLE *objects; // The object handles to watch
 	int addhandle(HANDLE h, u_int8_t state);
 #else
-	int objects[WATCH_MAX_NUM_OBJECTS]; // The object file descriptors to watch
+	struct pollfd *objects; // The object file descriptors to watch
+#if defined(WATCH_USE_EPOLL)
+	int epollfd; // The epoll set, or -1 when poll() is used
+	bool epollDisabled; // True if epoll failed for this watch
+	bool hasWaited; // True once the watch has been waited on
+	struct epoll_event *epollEvents;
+	bool epollRegister(int index);
+	void epollUnregister(int index);
+	void epollStart();
+	void epollStop();
 #endif
-	u_int8_t objectStates[WATCH_MAX_NUM_OBJECTS]; // The states to watch for
-	u_int8_t objectIsSet[WATCH_MAX_NUM_OBJECTS]; // The states currently set
-	int numObjects;
+#endif
+	u_int8_t *objectStates; // The states to watch for
+	u_int8_t *objectIsSet; // The states currently set
+	int numObjects; // The number of slots in use, including removed ones
+	int numRemoved; // The number of removed slots below numObjects
+	int maxObjects; // The number of allocated slots
 	Timeval absoluteTimeout; // Time when waiting was started
 	bool timeoutValid;  // True when absolute timeout is set
 	Signal *s;
+	bool grow();
+	int allocIndex();
+	void freeIndex(int index);
 	int addsock(SOCKET sock, u_int8_t state);
+	// The watch owns its arrays, so it cannot be copied
+	Watch(const Watch &); // Not defined
+	const Watch& operator=(const Watch &); // Not defined
 public:
 	enum {
 		FAILED = -1,
@@ -130,10 +174,19 @@ public:
 	};
 	/*
 		Add objects to watch set.
-		Returns -1 on error or an index between 0 and WATCH_OBJECT_INDEX_MAX.
+		Returns -1 on error or an index of at least WATCH_OBJECT_INDEX_MIN.
 		When a wait returns, the index can be used to see if the object was set.
+		The object stays in the set, and keeps its index, until it is
+		removed or the set is cleared.
 	*/
 	int add(Watchable wbl, u_int8_t state = WATCH_STATE_DEFAULT);
+	/*
+		Remove the object with the given index from the watch set. The
+		indexes of the other objects do not change, but the index may
+		be reused by a later add().
+		Returns true on success, or false if there is no such object.
+	*/
+	bool remove(int objectIndex);
 	/**
 		Wait on the objects added to the Watch. If timeToWait is NULL, then
 		the timeout will be infinate.
@@ -0,0 +1,183 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <stdio.h>
+#include <haggleutils.h>
+#include "HaggleKernel.h"
+#include "MemoryDataStore.h"
+#include "DataObject.h"
+#include "Filter.h"
+#include "Event.h"
+#include "Trace.h"
+
+using namespace haggle;
+
+/*
+	This program inserts data objects and a filter into the memory data
+	store, checks that the filter matches the right data objects, and
+	that deleted data objects are reported and no longer matched.
+
+	The data store tasks are run directly, without the data store
+	thread, and the events they post are read back from the kernel's
+	event queue.
+*/
+
+#define NUM_DATAOBJECTS 6
+
+class TestDataStore : public MemoryDataStore
+{
+public:
+	// An empty path disables the snapshot file
+	TestDataStore() : MemoryDataStore(true, "") {}
+	void setKernel(HaggleKernel *k) { kernel = k; }
+	int insertDataObject(DataObjectRef& dObj) { return _insertDataObject(dObj); }
+	int deleteDataObject(DataObjectRef& dObj) { return _deleteDataObject(dObj, true); }
+	int insertFilter(Filter *f, bool matchFilter) { return _insertFilter(f, matchFilter); }
+	int deleteFilter(long etype) { return _deleteFilter(etype); }
+};
+
+/*
+	Removes all events of the given type from the kernel's queue, and
+	returns the total number of data objects they carry, or -1 if the
+	data object 'dObj' is among them.
+*/
+static long drainEvents(HaggleKernel *k, EventType type, const DataObjectRef& dObj = NULL)
+{
+	long n = 0;
+	bool found = false;
+	Event *e;
+
+	while ((e = k->getNextEvent())) {
+		if (e->getType() == type) {
+			DataObjectRefList& dObjs = e->getDataObjectList();
+
+			for (DataObjectRefList::iterator it = dObjs.begin(); it != dObjs.end(); it++) {
+				if (dObj && *it == dObj)
+					found = true;
+				n++;
+			}
+		}
+		delete e;
+	}
+	return found ? -1 : n;
+}
+
+#if defined(OS_WINDOWS)
+int haggle_test_memorydatastore(void)
+#else
+int main(int argc, char *argv[])
+#endif
+{
+	bool success = true, tmp_succ;
+	DataObjectRef dObjs[NUM_DATAOBJECTS];
+	TestDataStore *ds;
+	HaggleKernel *k;
+	EventType etype;
+	Filter *f;
+	long n;
+	int i;
+
+	// Disable tracing
+	trace_disable(true);
+	Trace::disableStdout();
+
+	print_over_test_str_nl(0, "Memory data store test: ");
+
+	try {
+		ds = new TestDataStore();
+		// The kernel takes ownership of the data store
+		k = new HaggleKernel(ds);
+		ds->setKernel(k);
+
+		etype = Event::registerType("MemoryDataStoreTest", NULL);
+
+		print_over_test_str(1, "Init: ");
+		tmp_succ = ds->init() && EVENT_TYPE(etype);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		// Every other data object matches the filter
+		f = new Filter("Topic=news", etype);
+		ds->insertFilter(f, false);
+		delete f;
+
+		print_over_test_str(1, "Insert data objects: ");
+		tmp_succ = true;
+
+		for (i = 0; i < NUM_DATAOBJECTS; i++) {
+			char num[10];
+			snprintf(num, sizeof(num), "%d", i);
+			dObjs[i] = DataObject::create();
+			dObjs[i]->addAttribute("Topic", (i % 2) ? "sports" : "news");
+			dObjs[i]->addAttribute("Num", num);
+			tmp_succ &= (ds->insertDataObject(dObjs[i]) == 0);
+		}
+		// Each matching data object is reported as it is inserted
+		n = drainEvents(k, etype);
+		tmp_succ &= (n == NUM_DATAOBJECTS / 2);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Match filter: ");
+		f = new Filter("Topic=news", etype);
+		tmp_succ = (ds->insertFilter(f, true) > 0);
+		delete f;
+		n = drainEvents(k, etype, dObjs[1]);
+		tmp_succ &= (n == NUM_DATAOBJECTS / 2);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Delete data object: ");
+		tmp_succ = (ds->deleteDataObject(dObjs[0]) == 0);
+		n = drainEvents(k, EVENT_TYPE_DATAOBJECT_DELETED);
+		tmp_succ &= (n == 1);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Match after delete: ");
+		f = new Filter("Topic=news", etype);
+		tmp_succ = (ds->insertFilter(f, true) > 0);
+		delete f;
+		n = drainEvents(k, etype, dObjs[0]);
+		tmp_succ &= (n == NUM_DATAOBJECTS / 2 - 1);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Delete filter: ");
+		ds->deleteFilter(etype);
+		f = new Filter("Num=2", etype);
+		ds->insertFilter(f, false);
+		delete f;
+		DataObjectRef dObj = DataObject::create();
+		dObj->addAttribute("Topic", "news");
+		tmp_succ = (ds->insertDataObject(dObj) == 0);
+		n = drainEvents(k, etype);
+		tmp_succ &= (n == 0);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		for (i = 0; i < NUM_DATAOBJECTS; i++)
+			dObjs[i] = NULL;
+
+		delete k;
+	} catch (Exception &) {
+		return 1;
+	}
+
+	print_over_test_str(1, "Total: ");
+
+	return (success ? 0 : 1);
+}
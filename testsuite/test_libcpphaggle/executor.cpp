@@ -0,0 +1,327 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <libcpphaggle/Executor.h>
+#include <libcpphaggle/Atomic.h>
+#include <haggleutils.h>
+#include <stdio.h>
+
+using namespace haggle;
+/*
+  This program tests the executor: that tasks run, that futures return
+  their values, that tasks can be cancelled and waited for, and that
+  idle workers steal tasks queued by a busy worker. It also compares
+  running short tasks on the executor with starting a thread for each
+  of them.
+*/
+
+#define NUM_WORKERS 4
+#define NUM_TASKS 2000
+#define NUM_SUBTASKS 400
+// The number of short tasks to run on the executor, and with a thread each
+#define NUM_THREAD_TASKS 200
+// The most tasks each thread submits while the executor is stopped
+#define NUM_STOP_TASKS 10000
+// The number of times to stop an executor while tasks are submitted
+#define NUM_STOP_ROUNDS 20
+
+static volatile long num_run;
+
+// Does some work that cannot be optimized away
+static long work(long n)
+{
+	long sum = 0;
+
+	for (long i = 0; i < n * 1000; i++)
+		sum += i % 7;
+
+	return sum;
+}
+
+class CountTask : public Task {
+	void run() { atomic_inc(&num_run); }
+};
+
+class SumFuture : public Future<long> {
+	const long n;
+	long compute() { return n * (n + 1) / 2; }
+public:
+	SumFuture(long _n) : n(_n) {}
+};
+
+// A task that runs until the mutex is unlocked
+class BlockedTask : public Task {
+	Mutex *m;
+	void run() { started = true; m->lock(); m->unlock(); }
+public:
+	volatile bool started;
+	BlockedTask(Mutex *_m) : m(_m), started(false) {}
+};
+
+class WorkTask : public Task {
+	void run() { work(20); atomic_inc(&num_run); }
+};
+
+// Queues the subtasks on the worker that runs it
+class SpawnTask : public Task {
+	Executor *ex;
+	TaskRef *subtasks;
+	void run()
+	{
+		for (int i = 0; i < NUM_SUBTASKS; i++) {
+			subtasks[i] = new WorkTask();
+			ex->submit(subtasks[i]);
+		}
+	}
+public:
+	SpawnTask(Executor *_ex, TaskRef *_subtasks) : ex(_ex), subtasks(_subtasks) {}
+};
+
+// Submits tasks until the executor rejects one
+class SubmitRunnable : public Runnable {
+	Executor *ex;
+	bool run()
+	{
+		while (numSubmitted < NUM_STOP_TASKS) {
+			tasks[numSubmitted] = new CountTask();
+
+			if (!ex->submit(tasks[numSubmitted]))
+				break;
+
+			atomic_inc(&numSubmitted);
+		}
+		return false;
+	}
+	void cleanup() {}
+public:
+	TaskRef *tasks;
+	volatile long numSubmitted;
+	SubmitRunnable(Executor *_ex) : ex(_ex), tasks(new TaskRef[NUM_STOP_TASKS]), numSubmitted(0) {}
+	~SubmitRunnable() { delete [] tasks; }
+};
+
+class CountRunnable : public Runnable {
+	bool run() { atomic_inc(&num_run); return false; }
+	void cleanup() {}
+};
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Executor test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+		char str[100];
+		Executor ex("TestExecutor", NUM_WORKERS);
+		TaskRef *tasks = new TaskRef[NUM_TASKS];
+		Timeval start;
+		int i;
+
+		success &= ex.start();
+
+		print_over_test_str(1, "Run tasks: ");
+		num_run = 0;
+		tmp_succ = true;
+		for (i = 0; i < NUM_TASKS; i++) {
+			tasks[i] = new CountTask();
+			tmp_succ &= ex.submit(tasks[i]);
+		}
+		for (i = 0; i < NUM_TASKS; i++)
+			tmp_succ &= tasks[i].unlocked()->wait() && !tasks[i]->isCancelled();
+
+		tmp_succ &= num_run == NUM_TASKS;
+		// A task only runs once
+		tmp_succ &= !ex.submit(tasks[0]);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Future: ");
+		{
+			Reference<SumFuture> f = new SumFuture(1000);
+
+			tmp_succ = ex.submit(f.getObj());
+			tmp_succ &= f.unlocked()->get() == 500500;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Cancel and wait: ");
+		{
+			Executor single("Single", 1);
+			Mutex m;
+			BlockedTask *b = new BlockedTask(&m);
+			TaskRef blocked = b;
+			TaskRef queued = new CountTask();
+
+			num_run = 0;
+			m.lock();
+			tmp_succ = single.start();
+			tmp_succ &= single.submit(blocked);
+			tmp_succ &= single.submit(queued);
+
+			while (!b->started)
+				milli_sleep(1);
+
+			tmp_succ &= !blocked.unlocked()->wait(20);
+			// The running task cannot be cancelled, but the queued one can
+			tmp_succ &= !blocked->cancel() && single.getNumPending() == 1;
+			tmp_succ &= queued->cancel() && queued->isDone();
+			m.unlock();
+			tmp_succ &= blocked.unlocked()->wait() && !blocked->isCancelled();
+			single.stop();
+			tmp_succ &= queued->isCancelled() && num_run == 0;
+			tmp_succ &= !single.submit(new CountTask());
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Cancel on stop: ");
+		{
+			Executor single("Single", 1);
+			Mutex m;
+			TaskRef blocked = new BlockedTask(&m);
+			TaskRef queued = new CountTask();
+
+			m.lock();
+			tmp_succ = single.start();
+			tmp_succ &= single.submit(blocked);
+			tmp_succ &= single.submit(queued);
+			m.unlock();
+			single.stop();
+			tmp_succ &= blocked->isDone() && queued->isDone();
+			tmp_succ &= single.getNumPending() == 0;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Submit during stop: ");
+		tmp_succ = true;
+		for (int round = 0; round < NUM_STOP_ROUNDS; round++) {
+			Executor stopped("Stopped", NUM_WORKERS);
+			SubmitRunnable *submitters[NUM_WORKERS];
+
+			tmp_succ &= stopped.start();
+
+			for (i = 0; i < NUM_WORKERS; i++) {
+				submitters[i] = new SubmitRunnable(&stopped);
+				submitters[i]->start();
+			}
+			while (submitters[0]->numSubmitted < NUM_STOP_TASKS / 10)
+				;
+
+			stopped.stop();
+
+			for (i = 0; i < NUM_WORKERS; i++) {
+				submitters[i]->join();
+
+				// Every queued task has either run or been cancelled
+				for (long j = 0; j < submitters[i]->numSubmitted; j++)
+					tmp_succ &= submitters[i]->tasks[j]->isDone();
+
+				delete submitters[i];
+			}
+			tmp_succ &= stopped.getNumPending() == 0;
+			tmp_succ &= !stopped.submit(new CountTask());
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		{
+			TaskRef subtasks[NUM_SUBTASKS];
+			TaskRef spawn = new SpawnTask(&ex, subtasks);
+			Executor::WorkerStats stats;
+			unsigned long tasksRun = 0, tasksStolen = 0;
+
+			tmp_succ = true;
+			for (unsigned int w = 0; w < ex.getNumWorkers(); w++) {
+				tmp_succ &= ex.getWorkerStats(w, stats);
+				tasksStolen -= stats.tasksStolen;
+			}
+			num_run = 0;
+			tmp_succ &= ex.submit(spawn);
+			tmp_succ &= spawn.unlocked()->wait();
+
+			for (i = 0; i < NUM_SUBTASKS; i++)
+				tmp_succ &= subtasks[i].unlocked()->wait();
+
+			tmp_succ &= num_run == NUM_SUBTASKS;
+
+			for (unsigned int w = 0; w < ex.getNumWorkers(); w++) {
+				tmp_succ &= ex.getWorkerStats(w, stats);
+				tasksRun += stats.tasksRun;
+				tasksStolen += stats.tasksStolen;
+				tmp_succ &= stats.utilization >= 0 && stats.utilization <= 1;
+			}
+			tmp_succ &= !ex.getWorkerStats(ex.getNumWorkers(), stats);
+			// The subtasks are all queued on one worker
+			tmp_succ &= tasksStolen > 0;
+			tmp_succ &= tasksRun == NUM_TASKS + 1 + 1 + NUM_SUBTASKS;
+
+			snprintf(str, sizeof(str), "Work stealing (%lu of %d stolen): ",
+				 tasksStolen, NUM_SUBTASKS);
+			print_over_test_str(1, str);
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		num_run = 0;
+		start = Timeval::now();
+
+		for (i = 0; i < NUM_THREAD_TASKS; i++) {
+			tasks[i] = new CountTask();
+			ex.submit(tasks[i]);
+		}
+		for (i = 0; i < NUM_THREAD_TASKS; i++)
+			tasks[i].unlocked()->wait();
+
+		snprintf(str, sizeof(str), "%d tasks, executor (%.1f ms): ", NUM_THREAD_TASKS,
+			 (Timeval::now() - start).getTimeAsMilliSecondsDouble());
+		print_over_test_str(1, str);
+		tmp_succ = num_run == NUM_THREAD_TASKS;
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		num_run = 0;
+		start = Timeval::now();
+
+		for (i = 0; i < NUM_THREAD_TASKS; i++) {
+			CountRunnable r;
+
+			r.start();
+			r.join();
+		}
+		snprintf(str, sizeof(str), "%d tasks, thread each (%.1f ms): ", NUM_THREAD_TASKS,
+			 (Timeval::now() - start).getTimeAsMilliSecondsDouble());
+		print_over_test_str(1, str);
+		tmp_succ = num_run == NUM_THREAD_TASKS;
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		ex.stop();
+		delete [] tasks;
+
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(Exception &) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
@@ -0,0 +1,273 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <libcpphaggle/HashMap.h>
+#include <libcpphaggle/Timeval.h>
+#include <haggleutils.h>
+#include <libcpphaggle/Exception.h>
+#include <stdio.h>
+#include <string>
+#include <map>
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#endif
+
+using namespace haggle;
+/*
+  This program tests the hash map as a multimap, and compares how fast
+  it is with the standard library's containers on two workloads: many
+  small maps with string keys, like the attributes of data objects, and
+  one large map with pointer keys, like the store of reference counters.
+*/
+
+#define NUM_KEYS 5000
+// Every key is inserted this many times
+#define NUM_DUPLICATES 3
+
+#define NUM_SMALL_MAPS 20000
+#define SMALL_MAP_SIZE 12
+#define SMALL_MAP_LOOKUPS 10
+
+#define LARGE_MAP_SIZE 200000
+
+typedef HashMap<string, long> TestMap;
+
+static char names[SMALL_MAP_SIZE][32];
+static long objects[LARGE_MAP_SIZE];
+
+/*
+  Each benchmark runs the same operations on a container type, and
+  returns a checksum so that the work cannot be optimized away.
+*/
+template<typename Map, typename Key>
+static long bench_small_maps()
+{
+	Key *keys = new Key[SMALL_MAP_SIZE];
+	long sum = 0;
+
+	for (int i = 0; i < SMALL_MAP_SIZE; i++)
+		keys[i] = names[i];
+
+	for (int n = 0; n < NUM_SMALL_MAPS; n++) {
+		Map m;
+
+		for (int i = 0; i < SMALL_MAP_SIZE; i++)
+			m.insert(typename Map::value_type(keys[i], i));
+
+		for (int l = 0; l < SMALL_MAP_LOOKUPS; l++) {
+			for (int i = 0; i < SMALL_MAP_SIZE; i++) {
+				typename Map::iterator it = m.find(keys[i]);
+
+				if (it != m.end())
+					sum += (*it).second;
+			}
+		}
+		for (typename Map::iterator it = m.begin(); it != m.end(); it++)
+			sum += (*it).second;
+	}
+	delete [] keys;
+
+	return sum;
+}
+
+template<typename Map>
+static long bench_large_map()
+{
+	Map m;
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < LARGE_MAP_SIZE; i++)
+		m.insert(typename Map::value_type(&objects[i], i));
+
+	for (i = 0; i < LARGE_MAP_SIZE; i++) {
+		typename Map::iterator it = m.find(&objects[i]);
+
+		if (it != m.end())
+			sum += (*it).second;
+	}
+	for (i = 0; i < LARGE_MAP_SIZE; i++)
+		sum += m.erase(&objects[i]);
+
+	return sum;
+}
+
+/*
+  Give the haggle containers the same value_type name as the standard
+  ones, so that the benchmarks can be shared.
+*/
+template<typename KeyType, typename ValueType>
+class BenchHashMap : public HashMap<KeyType, ValueType> {
+public:
+	typedef Pair<KeyType, ValueType> value_type;
+};
+
+static bool bench(const char *name, long (*func)(), long expected)
+{
+	char str[100];
+	Timeval start = Timeval::now();
+	long sum = func();
+
+	snprintf(str, sizeof(str), "%s (%.0f ms): ", name,
+		 (Timeval::now() - start).getTimeAsMilliSecondsDouble());
+
+	print_over_test_str(1, str);
+	print_pass(sum == expected);
+
+	return sum == expected;
+}
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Hash map test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+		char key[32];
+		int i, j;
+		TestMap m;
+		TestMap::iterator it;
+		long expected;
+
+		print_over_test_str(1, "Insert duplicates: ");
+		tmp_succ = true;
+		for (j = 0; j < NUM_DUPLICATES; j++) {
+			for (i = 0; i < NUM_KEYS; i++) {
+				snprintf(key, sizeof(key), "key%d", i);
+				tmp_succ &= m.insert(make_pair(string(key), (long)(j * NUM_KEYS + i))) != m.end();
+			}
+		}
+		tmp_succ &= m.size() == NUM_KEYS * NUM_DUPLICATES;
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Equal range: ");
+		tmp_succ = true;
+		for (i = 0; i < NUM_KEYS; i++) {
+			snprintf(key, sizeof(key), "key%d", i);
+			Pair<TestMap::iterator, TestMap::iterator> p = m.equal_range(key);
+
+			// The values come out in the order they were inserted
+			for (j = 0; p.first != p.second; p.first++, j++) {
+				if ((*p.first).second != j * NUM_KEYS + i)
+					tmp_succ = false;
+			}
+			tmp_succ &= j == NUM_DUPLICATES;
+		}
+		tmp_succ &= m.find("nokey") == m.end();
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Iterate: ");
+		{
+			static int seen[NUM_KEYS * NUM_DUPLICATES];
+			unsigned long n = 0;
+
+			for (it = m.begin(); it != m.end(); it++) {
+				seen[(*it).second]++;
+				n++;
+			}
+			tmp_succ = n == m.size();
+
+			for (i = 0; i < NUM_KEYS * NUM_DUPLICATES; i++)
+				tmp_succ &= seen[i] == 1;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Copy: ");
+		{
+			TestMap copy(m);
+			TestMap assigned;
+
+			assigned.insert(make_pair(string("other"), 1L));
+			assigned = copy;
+			copy.clear();
+
+			tmp_succ = copy.empty() && copy.find("key1") == copy.end();
+			tmp_succ &= assigned.size() == m.size();
+			tmp_succ &= assigned.find("other") == assigned.end();
+			tmp_succ &= (*assigned.find("key1")).second == 1;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Erase while iterating: ");
+		// Erase every value from the first round of inserts
+		it = m.begin();
+		while (it != m.end()) {
+			if ((*it).second < NUM_KEYS)
+				m.erase(it);
+			else
+				it++;
+		}
+		tmp_succ = m.size() == NUM_KEYS * (NUM_DUPLICATES - 1);
+
+		for (it = m.begin(); it != m.end(); it++) {
+			if ((*it).second < NUM_KEYS)
+				tmp_succ = false;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Erase key: ");
+		tmp_succ = true;
+		for (i = 0; i < NUM_KEYS; i += 2) {
+			snprintf(key, sizeof(key), "key%d", i);
+			tmp_succ &= m.erase(key) == NUM_DUPLICATES - 1;
+			tmp_succ &= m.erase(key) == 0;
+		}
+		for (i = 1; i < NUM_KEYS; i += 2) {
+			snprintf(key, sizeof(key), "key%d", i);
+			tmp_succ &= m.upper_bound(key) != m.find(key);
+		}
+		tmp_succ &= m.size() == (NUM_KEYS / 2) * (NUM_DUPLICATES - 1);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		for (i = 0; i < SMALL_MAP_SIZE; i++) {
+			// Like the attribute names of a node description
+			snprintf(names[i], sizeof(names[i]), "Attribute%d", i % (SMALL_MAP_SIZE - 2));
+		}
+		expected = bench_small_maps<BenchHashMap<string, long>, string>();
+
+		success &= bench("Small maps, HashMap", bench_small_maps<BenchHashMap<string, long>, string>, expected);
+		success &= bench("Small maps, std::multimap", bench_small_maps<std::multimap<std::string, long>, std::string>, expected);
+#if __cplusplus >= 201103L
+		success &= bench("Small maps, std::unordered_multimap", bench_small_maps<std::unordered_multimap<std::string, long>, std::string>, expected);
+#endif
+		expected = 0;
+
+		for (i = 0; i < LARGE_MAP_SIZE; i++)
+			expected += i + 1;
+
+		success &= bench("Large map, HashMap", bench_large_map<BenchHashMap<long *, long> >, expected);
+		success &= bench("Large map, std::multimap", bench_large_map<std::multimap<long *, long> >, expected);
+#if __cplusplus >= 201103L
+		success &= bench("Large map, std::unordered_multimap", bench_large_map<std::unordered_multimap<long *, long> >, expected);
+#endif
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(Exception &) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
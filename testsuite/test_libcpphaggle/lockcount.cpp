@@ -0,0 +1,199 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <stdio.h>
+#include <libcpphaggle/Reference.h>
+#include <libcpphaggle/List.h>
+#include <libcpphaggle/Exception.h>
+#include <haggleutils.h>
+
+using namespace haggle;
+/*
+  This program counts the mutex locks taken when references are
+  created, copied and assigned, and when a list of references is
+  searched the way NodeStore looks up a node: by comparing the id of
+  every stored object, and checking whether the matching object is a
+  neighbor.
+
+  The id is compared both through operator->, which locks the object,
+  and through unlocked(), which does not.
+
+  Locks are only counted with the GNU C library, where the lock
+  function can be replaced by the program.
+*/
+
+#define NUM_ITEMS 200
+
+#if defined(__GLIBC__)
+#define COUNT_LOCKS
+#include <pthread.h>
+#include <dlfcn.h>
+
+typedef int (*mutex_lock_func_t)(pthread_mutex_t *);
+
+static mutex_lock_func_t real_mutex_lock = NULL;
+static unsigned long num_locks = 0;
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	if (!real_mutex_lock)
+		real_mutex_lock = (mutex_lock_func_t)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+
+	num_locks++;
+	return real_mutex_lock(mutex);
+}
+#endif
+
+class PlainItem {
+	const unsigned long id;
+	bool neighbor;
+public:
+	PlainItem(unsigned long _id) : id(_id), neighbor(_id % 2 == 0) {}
+	unsigned long getId() const { return id; }
+	bool isNeighbor() const { return neighbor; }
+};
+
+class CountedItem : public RefCounted {
+	const unsigned long id;
+	bool neighbor;
+public:
+	CountedItem(unsigned long _id) : id(_id), neighbor(_id % 2 == 0) {}
+	unsigned long getId() const { return id; }
+	bool isNeighbor() const { return neighbor; }
+};
+
+template<typename T>
+static Reference<T> lookupLocked(const List< Reference<T> >& items, unsigned long id)
+{
+	for (typename List< Reference<T> >::const_iterator it = items.begin(); it != items.end(); it++) {
+		if ((*it)->getId() == id && (*it)->isNeighbor())
+			return *it;
+	}
+	return NULL;
+}
+
+template<typename T>
+static Reference<T> lookupUnlocked(const List< Reference<T> >& items, unsigned long id)
+{
+	for (typename List< Reference<T> >::const_iterator it = items.begin(); it != items.end(); it++) {
+		if ((*it).unlocked()->getId() == id && (*it)->isNeighbor())
+			return *it;
+	}
+	return NULL;
+}
+
+#if defined(COUNT_LOCKS)
+template<typename T>
+static bool countLocks(const char *name, unsigned long pointerLocks)
+{
+	List< Reference<T> > items;
+	unsigned long locks, locked, unlocked, expected;
+	bool success = true, tmp_succ;
+	char str[80];
+	T *obj;
+
+	for (unsigned long i = 0; i < NUM_ITEMS; i++)
+		items.push_back(new T(i));
+
+	snprintf(str, sizeof(str), "%s, reference from pointer: ", name);
+	print_over_test_str(1, str);
+	obj = new T(NUM_ITEMS);
+	num_locks = 0;
+	{
+		Reference<T> ref(obj);
+	}
+	locks = num_locks;
+	// Both creating and dropping the last reference use the store
+	tmp_succ = (locks == 2 * pointerLocks);
+	success &= tmp_succ;
+	print_pass(tmp_succ);
+
+	snprintf(str, sizeof(str), "%s, copy and assign: ", name);
+	print_over_test_str(1, str);
+	num_locks = 0;
+	{
+		Reference<T> ref;
+
+		for (typename List< Reference<T> >::iterator it = items.begin(); it != items.end(); it++) {
+			Reference<T> copy = *it;
+			ref = copy;
+			ref = *it;
+		}
+	}
+	locks = num_locks;
+	// Neither do copies, nor references to NULL
+	tmp_succ = (locks == 0);
+	success &= tmp_succ;
+	print_pass(tmp_succ);
+
+	num_locks = 0;
+	for (unsigned long i = 0; i < NUM_ITEMS; i++)
+		lookupLocked(items, i);
+	locked = num_locks;
+
+	num_locks = 0;
+	for (unsigned long i = 0; i < NUM_ITEMS; i++)
+		lookupUnlocked(items, i);
+	unlocked = num_locks;
+
+	/*
+	  A locked lookup locks every item up to the one with the id, and
+	  that item once more for the neighbor check. Items with odd ids
+	  are not neighbors, so their lookups go through the whole list.
+	  An unlocked lookup only locks for the neighbor check.
+	 */
+	expected = 0;
+
+	for (unsigned long i = 0; i < NUM_ITEMS; i++)
+		expected += (i % 2 == 0) ? i + 2 : NUM_ITEMS + 1;
+
+	snprintf(str, sizeof(str), "%s, lookup by id: ", name);
+	print_over_test_str(1, str);
+	tmp_succ = (locked == expected && unlocked == NUM_ITEMS);
+	success &= tmp_succ;
+	print_pass(tmp_succ);
+
+	printf("        %u items, %.1f locks per lookup with operator->, %.1f with unlocked()\n",
+	       NUM_ITEMS, (double)locked / NUM_ITEMS, (double)unlocked / NUM_ITEMS);
+
+	return success;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Reference lock count test: ");
+
+	try {
+		bool success = true;
+
+#if defined(COUNT_LOCKS)
+		success &= countLocks<PlainItem>("Counter in store", 1);
+		success &= countLocks<CountedItem>("Counter in object", 0);
+#else
+		printf("        Locks are not counted on this platform\n");
+#endif
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(Exception &) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
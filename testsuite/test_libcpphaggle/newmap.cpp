@@ -150,6 +150,28 @@ try {
 			success &= tmp_succ;
 			print_pass(tmp_succ);
 
+			print_over_test_str(1, "Lower and upper bounds: ");
+			tmp_succ = true;
+
+			if (test3_map.lower_bound(42) == test3_map.end() || 
+			    (*test3_map.lower_bound(42)).first != 42)
+				tmp_succ = false;
+			if (test3_map.upper_bound(42) == test3_map.end() || 
+			    (*test3_map.upper_bound(42)).first != 1337)
+				tmp_succ = false;
+			if (test3_map.lower_bound(0) == test3_map.end() || 
+			    (*test3_map.lower_bound(0)).first != 12)
+				tmp_succ = false;
+			if (test3_map.upper_bound(26) == test3_map.end() || 
+			    (*test3_map.upper_bound(26)).first != 42)
+				tmp_succ = false;
+			if (test3_map.upper_bound(4711) != test3_map.end() || 
+			    test3_map.lower_bound(5000) != test3_map.end())
+				tmp_succ = false;
+
+			success &= tmp_succ;
+			print_pass(tmp_succ);
+
 			print_over_test_str(1, "Copying: ");
 			tmp_succ = true;
 
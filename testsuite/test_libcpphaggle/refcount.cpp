@@ -160,6 +160,17 @@ int haggle_test_refcount(void)
 
 			success &= tmp_succ;
  			print_pass(tmp_succ);
+
+			print_over_test_str(1, "Unlocked read access: ");
+			tmp_succ = (ifaceRef4.unlocked() == ifaceRef4.getObj() &&
+				    ifaceRef4.unlocked()->getType() == Interface::TYPE_ETHERNET &&
+				    ifaceRef6.unlocked() == NULL);
+
+			// Reading does not take a reference
+			tmp_succ &= ifaceRef4.refcount() == 2;
+
+			success &= tmp_succ;
+ 			print_pass(tmp_succ);
 			
 			print_over_test_str(1, "Total: ");
 					
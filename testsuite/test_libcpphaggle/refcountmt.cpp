@@ -0,0 +1,160 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <libcpphaggle/Thread.h>
+#include <libcpphaggle/Reference.h>
+#include <libcpphaggle/Atomic.h>
+#include <haggleutils.h>
+
+using namespace haggle;
+/*
+  This program stresses reference counting from many threads at once,
+  both with the counter kept in the global store and with the counter
+  kept in the object, and reports how long it takes. The objects must
+  survive while referenced, and be deleted exactly once.
+*/
+
+#define NUM_THREADS 4
+#define NUM_ITERATIONS 200000
+// How often a thread creates a reference from the plain pointer
+#define POINTER_INTERVAL 64
+
+static volatile long num_deleted;
+
+class PlainObject {
+public:
+	~PlainObject() { atomic_inc(&num_deleted); }
+};
+
+class CountedObject : public RefCounted {
+public:
+	~CountedObject() { atomic_inc(&num_deleted); }
+};
+
+template<typename T>
+class RefcountRunnable : public Runnable {
+	Reference<T> ref;
+	T *obj;
+public:
+	bool success;
+	RefcountRunnable(const Reference<T>& _ref) :
+		ref(_ref), obj(const_cast<T *>(_ref.getObj())), success(true) {}
+	~RefcountRunnable() {}
+
+	bool run()
+	{
+		for (long i = 0; i < NUM_ITERATIONS; i++) {
+			Reference<T> copy = ref;
+			Reference<T> copy2(copy);
+
+			copy = copy2;
+
+			if (i % POINTER_INTERVAL == 0) {
+				Reference<T> fromPointer(obj);
+
+				if (fromPointer.getObj() != obj || fromPointer.refcount() < 4)
+					success = false;
+			}
+			if (copy.refcount() < 3)
+				success = false;
+		}
+		ref = NULL;
+
+		return false;
+	}
+	void cleanup() {}
+};
+
+/*
+  Runs the threads on one shared object and checks the count and the
+  deletion afterwards.
+*/
+template<typename T>
+static bool stress(const char *name)
+{
+	RefcountRunnable<T> *thr[NUM_THREADS];
+	Reference<T> ref = new T();
+	bool success = true;
+	char str[100];
+	Timeval start;
+	int i;
+
+	num_deleted = 0;
+
+	for (i = 0; i < NUM_THREADS; i++)
+		thr[i] = new RefcountRunnable<T>(ref);
+
+	start = Timeval::now();
+
+	for (i = 0; i < NUM_THREADS; i++)
+		thr[i]->start();
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		thr[i]->join();
+		success &= thr[i]->success;
+		delete thr[i];
+	}
+	snprintf(str, sizeof(str), "%s, %d threads (%.0f ms): ", name, NUM_THREADS,
+		 (Timeval::now() - start).getTimeAsMilliSecondsDouble());
+
+	success &= ref.refcount() == 1 && num_deleted == 0;
+	ref = NULL;
+	success &= num_deleted == 1;
+
+	print_over_test_str(1, str);
+	print_pass(success);
+
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Multithreaded refcount test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+
+		print_over_test_str(1, "Counter in object: ");
+		{
+			CountedObject *obj = new CountedObject();
+			Reference<CountedObject> ref1(obj);
+			Reference<CountedObject> ref2(obj);
+
+			num_deleted = 0;
+			tmp_succ = ref1.refcount() == 2 && ref1.getId() == ref2.getId();
+			ref1 = NULL;
+			tmp_succ &= ref2.refcount() == 1 && num_deleted == 0;
+			ref2 = NULL;
+			tmp_succ &= num_deleted == 1;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		success &= stress<PlainObject>("Counter in store");
+		success &= stress<CountedObject>("Counter in object");
+
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(Exception &) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
@@ -143,6 +143,92 @@ int main(int argc, char *argv[])
 		success &= tmp_succ;
 		print_pass(tmp_succ);
 		
+		print_over_test_str_nl(1, "Storage tests: ");
+		
+		print_over_test_str(2, "Short and long strings: ");
+		
+		tmp_succ = false;
+		try {
+		string	str1 = "short";
+		string	str2 = "a string that does not fit in the object";
+		string	str3 = str1;
+		
+		str3 += str2;
+		str3 += str3;
+		tmp_succ = (str3.length() == 2 * (str1.length() + str2.length()));
+		tmp_succ &= (str3.substr(0, 5) == str1);
+		str3.erase(5);
+		tmp_succ &= (str3 == str1);
+		str3 = str3.c_str() + 1;
+		tmp_succ &= (str3 == "hort");
+		}catch(...)
+		{
+		tmp_succ = false;
+		}
+		
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+		
+		print_over_test_str(2, "Interning: ");
+		
+		tmp_succ = false;
+		try {
+		string	str1 = "Attribute name";
+		string	str2 = String("Attribute ") + "name";
+		string	str3 = "Other name";
+		string	empty = "";
+		
+		str1.intern();
+		str2.intern();
+		str3.intern();
+		empty.intern();
+		tmp_succ = (str1.isInterned() && str1.c_str() == str2.c_str());
+		tmp_succ &= (str1 == str2 && str1 != str3);
+		tmp_succ &= (empty == String() && empty != str1);
+		
+		// Copies share the storage
+		string	copy = str1;
+		tmp_succ &= (copy.c_str() == str1.c_str());
+
+		// Long strings are left as they are
+		string	longstr;
+		while (longstr.length() <= STRING_INTERN_MAX_LEN)
+			longstr += "x";
+		longstr.intern();
+		tmp_succ &= (!longstr.isInterned() && longstr.length() == STRING_INTERN_MAX_LEN + 1);
+		}catch(...)
+		{
+		tmp_succ = false;
+		}
+		
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+		
+		print_over_test_str(2, "Modify interned: ");
+		
+		tmp_succ = false;
+		try {
+		string	str1 = "Attribute name";
+		string	str2 = str1;
+		string	str3 = str1;
+		
+		str1.intern();
+		str2.intern();
+		str3.intern();
+		str2 += " changed";
+		str3[0] = 'a';
+		tmp_succ = (str1 == "Attribute name" && str2 == "Attribute name changed");
+		tmp_succ &= (str3 == "attribute name" && !str3.isInterned());
+		str2.erase(9);
+		tmp_succ &= (str1 == "Attribute name" && str2 == "Attribute");
+		}catch(...)
+		{
+		tmp_succ = false;
+		}
+		
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+		
 		print_over_test_str(1, "Total: ");
 		
 		return success ? 0 : 1;
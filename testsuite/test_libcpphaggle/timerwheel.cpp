@@ -0,0 +1,152 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <libcpphaggle/TimerWheel.h>
+#include <haggleutils.h>
+#include <libcpphaggle/Exception.h>
+
+using namespace haggle;
+/*
+  This program tests the timer wheel with many pending timers. The
+  timers are spread over all levels of the wheel, a third of them are
+  cancelled, and the rest must expire exactly once, in order, and
+  no earlier than their expiry time.
+*/
+
+#define NUM_TIMERS 100000
+// Timers are spread over an hour, and some are beyond the wheel's range
+#define MAX_DELAY_SECONDS 3600
+#define NUM_FAR_TIMERS 10
+#define FAR_DELAY_SECONDS (60 * 24 * 3600)
+
+class TestTimer : public TimerWheelItem {
+public:
+	Timeval expiry;
+	bool cancelled;
+	int fired;
+	TestTimer() : cancelled(false), fired(0) {}
+};
+
+static TestTimer timers[NUM_TIMERS];
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Timer wheel test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+		int i, num_cancelled = 0, num_fired = 0;
+		TimerWheel w;
+		TimerWheelItem *item;
+		Timeval start = Timeval::now(), now, last, tv;
+
+		prng_init();
+
+		print_over_test_str(1, "Insert: ");
+		tmp_succ = true;
+		for (i = 0; i < NUM_TIMERS; i++) {
+			double delay = (double)(prng_uint32() % (MAX_DELAY_SECONDS * 1000000UL)) / 1000000;
+
+			if (i < NUM_FAR_TIMERS)
+				delay = FAR_DELAY_SECONDS + i;
+
+			timers[i].expiry = start + Timeval(delay);
+			tmp_succ &= w.insert(&timers[i], timers[i].expiry);
+			tmp_succ &= timers[i].isPending();
+		}
+		tmp_succ &= w.size() == NUM_TIMERS;
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Cancel: ");
+		tmp_succ = true;
+		for (i = 0; i < NUM_TIMERS; i += 3) {
+			tmp_succ &= w.remove(&timers[i]);
+			tmp_succ &= !timers[i].isPending();
+			timers[i].cancelled = true;
+			num_cancelled++;
+		}
+		// An item is only removed once
+		tmp_succ &= !w.remove(&timers[0]);
+		tmp_succ &= w.size() == (unsigned long)(NUM_TIMERS - num_cancelled);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Reinsert: ");
+		// Moving a pending timer does not add it twice
+		tmp_succ = w.insert(&timers[1], timers[1].expiry);
+		tmp_succ &= w.size() == (unsigned long)(NUM_TIMERS - num_cancelled);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Expire: ");
+		tmp_succ = true;
+		last = start;
+
+		// Step through time from one expiry to the next
+		while (w.getNextExpiry(tv)) {
+			now = tv;
+
+			if (now < last) {
+				tmp_succ = false;
+				break;
+			}
+			while ((item = w.expire(now))) {
+				TestTimer *t = static_cast<TestTimer *>(item);
+
+				// Not early, and not later than one tick
+				if (t->cancelled || t->expiry > now ||
+				    t->expiry <= last - Timeval(0, 1000))
+					tmp_succ = false;
+
+				t->fired++;
+				num_fired++;
+			}
+			last = now;
+		}
+		for (i = 0; i < NUM_TIMERS; i++) {
+			if (timers[i].fired != (timers[i].cancelled ? 0 : 1))
+				tmp_succ = false;
+		}
+		tmp_succ &= num_fired == NUM_TIMERS - num_cancelled;
+		tmp_succ &= w.empty();
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Delete pending: ");
+		{
+			TestTimer *t = new TestTimer();
+
+			tmp_succ = w.insert(t, Timeval::now() + Timeval(10.0));
+			delete t;
+			tmp_succ &= w.empty();
+			tmp_succ &= w.expire(Timeval::now() + Timeval(20.0)) == NULL;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(...) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
@@ -0,0 +1,174 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); 
+ * you may not use this file except in compliance with the License. 
+ * You may obtain a copy of the License at 
+ *     
+ *     http://www.apache.org/licenses/LICENSE-2.0 
+ *
+ * Unless required by applicable law or agreed to in writing, software 
+ * distributed under the License is distributed on an "AS IS" BASIS, 
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ * See the License for the specific language governing permissions and 
+ * limitations under the License.
+ */ 
+
+#include "testhlp.h"
+#include <libcpphaggle/Watch.h>
+#include <haggleutils.h>
+#include <libcpphaggle/Exception.h>
+
+using namespace haggle;
+/*
+  This program tests the watch implementation on more objects than
+  the watch initially has room for.
+*/
+
+#define NUM_SOCKET_PAIRS 100
+
+static SOCKET sockets[NUM_SOCKET_PAIRS][2];
+static int indexes[NUM_SOCKET_PAIRS];
+
+/*
+  Waits on the watch and checks that exactly the sockets in the
+  "expected" array are set.
+*/
+static bool check_set(Watch& w, int *expected, int num_expected)
+{
+	int res = w.waitTimeout(100);
+	int i, j;
+
+	if (num_expected == 0)
+		return res == Watch::TIMEOUT;
+
+	if (res != Watch::SET)
+		return false;
+
+	for (i = 0; i < NUM_SOCKET_PAIRS; i++) {
+		bool shouldBeSet = false;
+
+		if (indexes[i] < 0)
+			continue;
+
+		for (j = 0; j < num_expected; j++)
+			if (expected[j] == i)
+				shouldBeSet = true;
+
+		if (w.isSet(indexes[i]) != shouldBeSet)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{	
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Watch test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+		char c = 'x';
+		int i, j, set[2];
+		Watch w;
+		
+		for (i = 0; i < NUM_SOCKET_PAIRS; i++) {
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[i]) < 0) {
+				printf("Could not create socket pair: %s ", strerror(errno));
+				return 1;
+			}
+		}
+
+		print_over_test_str(1, "Add: ");
+		tmp_succ = true;
+		for (i = 0; i < NUM_SOCKET_PAIRS; i++) {
+			indexes[i] = w.add(sockets[i][0]);
+
+			if (indexes[i] < WATCH_OBJECT_INDEX_MIN)
+				tmp_succ = false;
+
+			for (j = 0; j < i; j++)
+				if (indexes[j] == indexes[i])
+					tmp_succ = false;
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+		
+		print_over_test_str(1, "Timeout: ");
+		tmp_succ = check_set(w, NULL, 0);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Readable: ");
+		set[0] = 37;
+		send(sockets[37][1], &c, 1, 0);
+		tmp_succ = check_set(w, set, 1);
+
+		// The set stays registered between waits
+		set[1] = NUM_SOCKET_PAIRS - 1;
+		send(sockets[NUM_SOCKET_PAIRS - 1][1], &c, 1, 0);
+		tmp_succ &= check_set(w, set, 2);
+
+		recv(sockets[37][0], &c, 1, 0);
+		tmp_succ &= check_set(w, &set[1], 1);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Remove: ");
+		tmp_succ = w.remove(indexes[NUM_SOCKET_PAIRS - 1]);
+		indexes[NUM_SOCKET_PAIRS - 1] = -1;
+		tmp_succ &= check_set(w, NULL, 0);
+		tmp_succ &= !w.remove(indexes[NUM_SOCKET_PAIRS - 1]);
+
+		// Removing an object leaves the indexes of the others intact
+		tmp_succ &= w.remove(indexes[10]);
+		indexes[10] = -1;
+		set[0] = 11;
+		send(sockets[11][1], &c, 1, 0);
+		tmp_succ &= check_set(w, set, 1);
+		recv(sockets[11][0], &c, 1, 0);
+
+		// The removed object is readable, but no longer watched
+		recv(sockets[NUM_SOCKET_PAIRS - 1][0], &c, 1, 0);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Add after remove: ");
+		indexes[10] = w.add(sockets[10][0]);
+		tmp_succ = indexes[10] >= WATCH_OBJECT_INDEX_MIN;
+		set[0] = 10;
+		send(sockets[10][1], &c, 1, 0);
+		tmp_succ &= check_set(w, set, 1);
+		recv(sockets[10][0], &c, 1, 0);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Clear: ");
+		w.clear();
+		
+		for (i = 0; i < NUM_SOCKET_PAIRS; i++)
+			indexes[i] = -1;
+
+		indexes[5] = w.add(sockets[5][0]);
+		tmp_succ = check_set(w, NULL, 0);
+		set[0] = 5;
+		send(sockets[5][1], &c, 1, 0);
+		tmp_succ &= check_set(w, set, 1);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		for (i = 0; i < NUM_SOCKET_PAIRS; i++) {
+			CLOSE_SOCKET(sockets[i][0]);
+			CLOSE_SOCKET(sockets[i][1]);
+		}
+
+		print_over_test_str(1, "Total: ");
+		
+		return success ? 0 : 1;
+	} catch(...) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}
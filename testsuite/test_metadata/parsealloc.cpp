@@ -0,0 +1,205 @@
+/* Copyright 2008 Uppsala University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testhlp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <haggleutils.h>
+#include <libcpphaggle/Timeval.h>
+#include <libcpphaggle/Exception.h>
+#include "XMLMetadata.h"
+#include "Attribute.h"
+#include "DataObject.h"
+
+using namespace haggle;
+/*
+  This program parses the metadata of a data object over and over, the
+  same way as DataObject::parseMetadata() does, and reports how many
+  heap allocations and how much time each parse takes. Copies of the
+  metadata and the attributes are also made, since that is what
+  happens when data objects are passed around.
+
+  Allocations are only counted with the GNU C library, where the
+  allocation functions can be replaced by the program.
+*/
+
+#define NUM_PARSES 2000
+#define NUM_ATTRIBUTES 24
+
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static unsigned long num_allocs = 0;
+
+void *malloc(size_t size)
+{
+	num_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	num_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	num_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#endif
+
+// Attribute names come from a small set, while the values vary
+static const char *attr_names[] = {
+	"Picture", "Keyword", "Location", "ContentType", "Owner", "Album"
+};
+
+/*
+  Creates the metadata of a data object with a data file and a number
+  of attributes.
+*/
+static string create_raw_metadata()
+{
+	string raw = "<?xml version=\"1.0\"?>\n<Haggle create_time=\"1234567890.123456\" persistent=\"yes\">"
+		"<Data data_len=\"153600\"><FileName>IMG_2008_07_15_1342.jpg</FileName>"
+		"<FileHash>0nKa2D3y6y4E7Bmr0nKa2D3y6y4=</FileHash></Data>";
+	char buf[200];
+
+	for (int i = 0; i < NUM_ATTRIBUTES; i++) {
+		if (i % 4 == 3) {
+			snprintf(buf, sizeof(buf), "<Attr name=\"%s\" weight=\"%d\">A much longer attribute value, number %d</Attr>",
+				 attr_names[i % 6], i + 1, i);
+		} else {
+			snprintf(buf, sizeof(buf), "<Attr name=\"%s\" weight=\"%d\">value%d</Attr>",
+				 attr_names[i % 6], i + 1, i);
+		}
+		raw += buf;
+	}
+	raw += "</Haggle>";
+
+	return raw;
+}
+
+/*
+  Parses the metadata and its attributes.
+  Returns the number of attributes found, or -1 on error.
+*/
+static int parse(const string& raw, Attributes& attrs)
+{
+	XMLMetadata *m = new XMLMetadata();
+	int n = 0;
+
+	if (!m->initFromRaw((const unsigned char *)raw.c_str(), raw.length())) {
+		delete m;
+		return -1;
+	}
+
+	Metadata *mattr = m->getMetadata(DATAOBJECT_ATTRIBUTE_NAME);
+
+	while (mattr) {
+		const char *attrName = mattr->getParameter(DATAOBJECT_ATTRIBUTE_NAME_PARAM);
+		const char *weightStr = mattr->getParameter(DATAOBJECT_ATTRIBUTE_WEIGHT_PARAM);
+		unsigned long weight = weightStr ? strtoul(weightStr, NULL, 10) : 1;
+
+		Attribute a(attrName, mattr->getContent(), weight);
+
+		if (attrs.add(a))
+			n++;
+
+		mattr = m->getNextMetadata();
+	}
+
+	// Data objects copy their metadata and attributes
+	Metadata *copy = m->copy();
+	Attributes *attrsCopy = attrs.copy();
+
+	delete attrsCopy;
+	delete copy;
+	delete m;
+
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	// Disable tracing
+	trace_disable(true);
+
+	print_over_test_str_nl(0, "Metadata parse test: ");
+
+	try {
+		bool success = true;
+		bool tmp_succ;
+		char str[100];
+		string raw = create_raw_metadata();
+		Timeval start;
+		double ms;
+		int i;
+
+		print_over_test_str(1, "Parse: ");
+		{
+			Attributes attrs;
+
+			tmp_succ = parse(raw, attrs) == NUM_ATTRIBUTES;
+			tmp_succ &= attrs.find(Attribute("Picture", "value0")) != attrs.end();
+		}
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+#ifdef COUNT_ALLOCATIONS
+		unsigned long allocs = num_allocs;
+#endif
+		tmp_succ = true;
+		start = Timeval::now();
+
+		for (i = 0; i < NUM_PARSES; i++) {
+			Attributes attrs;
+
+			if (parse(raw, attrs) != NUM_ATTRIBUTES)
+				tmp_succ = false;
+		}
+		ms = (Timeval::now() - start).getTimeAsMilliSecondsDouble();
+
+#ifdef COUNT_ALLOCATIONS
+		snprintf(str, sizeof(str), "%d parses, %lu allocations each (%.0f ms): ",
+			 NUM_PARSES, (num_allocs - allocs) / NUM_PARSES, ms);
+#else
+		snprintf(str, sizeof(str), "%d parses (%.0f ms): ", NUM_PARSES, ms);
+#endif
+		print_over_test_str(1, str);
+		success &= tmp_succ;
+		print_pass(tmp_succ);
+
+		print_over_test_str(1, "Total: ");
+
+		return success ? 0 : 1;
+	} catch(Exception &) {
+		printf("**CRASH** ");
+		return 1;
+	}
+}